@@ -0,0 +1,187 @@
+// Merges synthetic audio tracks the way the exporter does and reports
+// throughput. Default: 6 stereo tracks of a 1 hour 44.1 kHz recording.
+//
+//   bench_audio_mix [--tracks N] [--minutes M] [--legacy]
+//
+// --legacy also times the previous per-sample deque mixer for comparison.
+
+#include "audio_mixer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+static const int kSampleRate = 44100;
+static const int kBlockFrames = 1024;   // AAC frame size
+
+using Clock = std::chrono::steady_clock;
+
+// Decoded frame sizes seen after resampling 48 kHz AAC to 44.1 kHz.
+static int ChunkFrames(int64_t index)
+{
+    return (index % 5 == 0) ? 941 : 940;
+}
+
+static std::vector<int16_t> MakeSource(int track)
+{
+    std::vector<int16_t> v(4096 * 2);
+    uint32_t seed = 0x9E3779B9u * (track + 1);
+    for (auto& s : v) {
+        seed = seed * 1664525u + 1013904223u;
+        s = (int16_t)(seed >> 16);
+    }
+    return v;
+}
+
+struct Result {
+    double seconds;
+    int64_t frames;
+    uint64_t checksum;
+};
+
+static Result RunBlockMixer(int tracks, int64_t totalFrames, bool planar)
+{
+    std::vector<std::vector<int16_t>> sources;
+    for (int t = 0; t < tracks; ++t)
+        sources.push_back(MakeSource(t));
+
+    BlockMixer mixer(tracks, kSampleRate, kBlockFrames, 10.0, totalFrames);
+    std::vector<int16_t> s16(kBlockFrames * 2);
+    std::vector<float> left(kBlockFrames), right(kBlockFrames);
+    std::vector<int64_t> pts(tracks, 0);
+    uint64_t checksum = 0;
+    int64_t mixed = 0;
+
+    auto drain = [&](bool flush) {
+        while (mixer.Ready(flush)) {
+            int n;
+            if (planar) {
+                n = mixer.MixPlanar(left.data(), right.data(), flush);
+                checksum += (uint64_t)(int64_t)(left[0] * 32768.0f) + (uint64_t)(int64_t)(right[n - 1] * 32768.0f);
+            } else {
+                n = mixer.MixS16(s16.data(), flush);
+                checksum += (uint64_t)(uint16_t)s16[0] + (uint64_t)(uint16_t)s16[n * 2 - 1];
+            }
+            mixed += n;
+        }
+    };
+
+    auto start = Clock::now();
+    int64_t chunk = 0;
+    bool more = true;
+    while (more) {
+        more = false;
+        // Tracks arrive interleaved, as packets do in the container.
+        for (int t = 0; t < tracks; ++t) {
+            if (pts[t] >= totalFrames)
+                continue;
+            int n = ChunkFrames(chunk + t);
+            const int16_t* src = sources[t].data() + ((chunk * 7 + t) % 2048) * 2;
+            mixer.Push(t, pts[t], src, n);
+            pts[t] += n;
+            more = true;
+        }
+        ++chunk;
+        drain(false);
+    }
+    mixer.FinishAll();
+    drain(true);
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    return { secs, mixed, checksum };
+}
+
+// The mixer the exporter used before: one deque per track, popped per sample.
+static Result RunLegacy(int tracks, int64_t totalFrames)
+{
+    std::vector<std::vector<int16_t>> sources;
+    for (int t = 0; t < tracks; ++t)
+        sources.push_back(MakeSource(t));
+
+    std::vector<std::deque<int16_t>> buffers(tracks);
+    std::vector<int16_t> mixBuffer(kBlockFrames * 2);
+    std::vector<int64_t> pts(tracks, 0);
+    uint64_t checksum = 0;
+    int64_t mixed = 0;
+
+    auto start = Clock::now();
+    int64_t chunk = 0;
+    bool more = true;
+    while (more) {
+        more = false;
+        for (int t = 0; t < tracks; ++t) {
+            if (pts[t] >= totalFrames)
+                continue;
+            int n = ChunkFrames(chunk + t);
+            const int16_t* src = sources[t].data() + ((chunk * 7 + t) % 2048) * 2;
+            std::vector<int16_t> tmp(src, src + n * 2);
+            buffers[t].insert(buffers[t].end(), tmp.begin(), tmp.end());
+            pts[t] += n;
+            more = true;
+        }
+        ++chunk;
+        while (true) {
+            bool ready = true;
+            for (auto& b : buffers)
+                if ((int)b.size() < kBlockFrames * 2) { ready = false; break; }
+            if (!ready)
+                break;
+            for (int i = 0; i < kBlockFrames * 2; ++i) {
+                int sum = 0;
+                for (auto& b : buffers) {
+                    sum += b.front();
+                    b.pop_front();
+                }
+                mixBuffer[i] = (int16_t)(sum / tracks);
+            }
+            checksum += (uint64_t)(uint16_t)mixBuffer[0] + (uint64_t)(uint16_t)mixBuffer[kBlockFrames * 2 - 1];
+            mixed += kBlockFrames;
+        }
+    }
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    return { secs, mixed, checksum };
+}
+
+static void Report(const char* name, const Result& r)
+{
+    double audioSecs = (double)r.frames / kSampleRate;
+    printf("%-14s %8.3f s  %9.1fx realtime  %12lld frames  checksum %016llx\n",
+           name, r.seconds, r.seconds > 0 ? audioSecs / r.seconds : 0.0,
+           (long long)r.frames, (unsigned long long)r.checksum);
+}
+
+int main(int argc, char** argv)
+{
+    int tracks = 6;
+    double minutes = 60.0;
+    bool legacy = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--tracks" && i + 1 < argc)
+            tracks = atoi(argv[++i]);
+        else if (arg == "--minutes" && i + 1 < argc)
+            minutes = atof(argv[++i]);
+        else if (arg == "--legacy")
+            legacy = true;
+        else {
+            fprintf(stderr, "usage: %s [--tracks N] [--minutes M] [--legacy]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (tracks < 1 || minutes <= 0) {
+        fprintf(stderr, "tracks and minutes must be positive\n");
+        return 1;
+    }
+
+    int64_t totalFrames = (int64_t)(minutes * 60.0 * kSampleRate);
+    printf("Merging %d tracks x %.1f min (%lld frames each)\n",
+           tracks, minutes, (long long)totalFrames);
+
+    Report("mix fltp", RunBlockMixer(tracks, totalFrames, true));
+    Report("mix s16", RunBlockMixer(tracks, totalFrames, false));
+    if (legacy)
+        Report("legacy deque", RunLegacy(tracks, totalFrames));
+    return 0;
+}
@@ -0,0 +1,521 @@
+// Generates deterministic test clips and times the engine on them: sequential
+// decode, random seeks, merged audio mixing, a copy-mode cut and an H.264
+// re-encode. Runs on the CPU only, so it works on any Linux box.
+//
+//   bench_media [--dir PATH] [--out results.json] [--label TEXT] [--seconds N]
+//               [--size WxH] [--fps N] [--seeks N] [--only NAME] [--skip-encode]
+//               [--read-ahead-mb N] [--write-behind-mb N] [--packet-cache-mb N]
+//
+// Clips are written once to --dir (default: the temp directory) and reused
+// by later runs, so results from different commits see the same input.
+// Compare two result files with tools/bench_compare.py.
+
+#include "media_source.h"
+#include "video_cutter.h"
+#include "debug_log.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static const int kAudioRate = 48000;
+static const double kPi = 3.14159265358979323846;
+
+struct ClipSpec {
+    std::string name;
+    AVCodecID codec = AV_CODEC_ID_H264;
+    int gop = 60;
+    int audioTracks = 2;
+};
+
+// Short GOPs seek fast, long ones stress the decode-to-target path.
+static const ClipSpec kClips[] = {
+    { "h264_gop12", AV_CODEC_ID_H264, 12, 2 },
+    { "h264_gop60", AV_CODEC_ID_H264, 60, 3 },
+    { "h264_gop250", AV_CODEC_ID_H264, 250, 3 },
+    { "hevc_gop60", AV_CODEC_ID_HEVC, 60, 3 },
+};
+
+struct BenchConfig {
+    fs::path dir;
+    int seconds = 20;
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    int seeks = 50;
+    bool encode = true;
+};
+
+struct ClipResult {
+    std::string name;
+    bool ok = false;
+    bool skipped = false;       // no encoder for the clip's codec
+    std::string error;
+    double decodeFps = 0.0;
+    int64_t decodedFrames = 0;
+    double seekP50Ms = 0.0;
+    double seekP99Ms = 0.0;
+    double seekMaxMs = 0.0;
+    double mixRealtime = 0.0;
+    double copyRealtime = 0.0;
+    double encodeFps = 0.0;
+};
+
+static double Since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Moving diagonal bands and a box that sweeps the frame, so the encoder sees
+// motion and detail in every frame.
+static void FillVideoFrame(AVFrame* f, int index)
+{
+    int w = f->width, h = f->height;
+    for (int y = 0; y < h; ++y) {
+        uint8_t* row = f->data[0] + (size_t)y * f->linesize[0];
+        for (int x = 0; x < w; ++x)
+            row[x] = (uint8_t)((x + 2 * y + 3 * index) & 0xFF);
+    }
+    int box = h / 4;
+    int bx = (index * 7) % std::max(1, w - box);
+    int by = (index * 3) % std::max(1, h - box);
+    for (int y = by; y < by + box; ++y)
+        memset(f->data[0] + (size_t)y * f->linesize[0] + bx, 235, box);
+    for (int y = 0; y < h / 2; ++y) {
+        uint8_t* u = f->data[1] + (size_t)y * f->linesize[1];
+        uint8_t* v = f->data[2] + (size_t)y * f->linesize[2];
+        for (int x = 0; x < w / 2; ++x) {
+            u[x] = (uint8_t)(128 + ((x + index) & 0x3F) - 32);
+            v[x] = (uint8_t)(128 + ((y - index) & 0x3F) - 32);
+        }
+    }
+}
+
+// Track t is a sine at 220 * (t + 1) Hz, a little quieter per track.
+static void FillAudioFrame(AVFrame* f, int track, int64_t firstSample)
+{
+    double freq = 220.0 * (track + 1);
+    float amp = 0.3f / (track + 1);
+    for (int c = 0; c < f->ch_layout.nb_channels; ++c) {
+        float* out = (float*)f->data[c];
+        for (int i = 0; i < f->nb_samples; ++i)
+            out[i] = amp * (float)sin(2.0 * kPi * freq * (double)(firstSample + i) / kAudioRate);
+    }
+}
+
+static bool Encode(AVFormatContext* oc, AVCodecContext* enc, AVStream* st, AVFrame* frame, AVPacket* pkt)
+{
+    if (avcodec_send_frame(enc, frame) < 0)
+        return false;
+    while (avcodec_receive_packet(enc, pkt) == 0) {
+        av_packet_rescale_ts(pkt, enc->time_base, st->time_base);
+        pkt->stream_index = st->index;
+        if (av_interleaved_write_frame(oc, pkt) < 0)
+            return false;
+    }
+    return true;
+}
+
+struct OutStream {
+    AVCodecContext* enc = nullptr;
+    AVStream* st = nullptr;
+    AVFrame* frame = nullptr;
+    int64_t next = 0;       // in enc->time_base
+};
+
+static void FreeOutStream(OutStream& s)
+{
+    avcodec_free_context(&s.enc);
+    av_frame_free(&s.frame);
+}
+
+static bool AddVideo(AVFormatContext* oc, const ClipSpec& spec, const BenchConfig& cfg, OutStream& s)
+{
+    const AVCodec* codec = avcodec_find_encoder(spec.codec);
+    if (!codec)
+        return false;
+    s.st = avformat_new_stream(oc, nullptr);
+    s.enc = avcodec_alloc_context3(codec);
+    if (!s.st || !s.enc)
+        return false;
+    s.enc->width = cfg.width;
+    s.enc->height = cfg.height;
+    s.enc->time_base = { 1, cfg.fps };
+    s.enc->framerate = { cfg.fps, 1 };
+    s.enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    s.enc->gop_size = spec.gop;
+    s.enc->max_b_frames = 2;
+    s.enc->bit_rate = 4000000;
+    s.enc->thread_count = 0;
+    // Fixed keyframe spacing, so the GOP length in the name is what seeks see.
+    av_opt_set(s.enc->priv_data, "preset", "veryfast", 0);
+    if (spec.codec == AV_CODEC_ID_H264)
+        av_opt_set(s.enc->priv_data, "x264-params", "scenecut=0", 0);
+    else
+        av_opt_set(s.enc->priv_data, "x265-params", "scenecut=0:log-level=error", 0);
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        s.enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(s.enc, codec, nullptr) < 0 ||
+        avcodec_parameters_from_context(s.st->codecpar, s.enc) < 0)
+        return false;
+    s.st->time_base = s.enc->time_base;
+    s.frame = av_frame_alloc();
+    if (!s.frame)
+        return false;
+    s.frame->format = s.enc->pix_fmt;
+    s.frame->width = cfg.width;
+    s.frame->height = cfg.height;
+    return av_frame_get_buffer(s.frame, 0) >= 0;
+}
+
+static bool AddAudio(AVFormatContext* oc, int track, OutStream& s)
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec)
+        return false;
+    s.st = avformat_new_stream(oc, nullptr);
+    s.enc = avcodec_alloc_context3(codec);
+    if (!s.st || !s.enc)
+        return false;
+    s.enc->sample_rate = kAudioRate;
+    s.enc->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    av_channel_layout_default(&s.enc->ch_layout, 2);
+    s.enc->bit_rate = 128000;
+    s.enc->time_base = { 1, kAudioRate };
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        s.enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(s.enc, codec, nullptr) < 0 ||
+        avcodec_parameters_from_context(s.st->codecpar, s.enc) < 0)
+        return false;
+    s.st->time_base = s.enc->time_base;
+    av_dict_set(&s.st->metadata, "title", ("Sine " + std::to_string(track + 1)).c_str(), 0);
+    s.frame = av_frame_alloc();
+    if (!s.frame)
+        return false;
+    s.frame->format = s.enc->sample_fmt;
+    s.frame->nb_samples = s.enc->frame_size;
+    s.frame->sample_rate = kAudioRate;
+    av_channel_layout_copy(&s.frame->ch_layout, &s.enc->ch_layout);
+    return av_frame_get_buffer(s.frame, 0) >= 0;
+}
+
+static bool GenerateClip(const ClipSpec& spec, const BenchConfig& cfg, const fs::path& path)
+{
+    std::string utf8 = path.u8string();
+    AVFormatContext* oc = nullptr;
+    if (avformat_alloc_output_context2(&oc, nullptr, nullptr, utf8.c_str()) < 0)
+        return false;
+    std::vector<OutStream> streams(1 + spec.audioTracks);
+    AVPacket* pkt = av_packet_alloc();
+    bool ok = pkt && AddVideo(oc, spec, cfg, streams[0]);
+    for (int t = 0; ok && t < spec.audioTracks; ++t)
+        ok = AddAudio(oc, t, streams[1 + t]);
+    ok = ok && avio_open(&oc->pb, utf8.c_str(), AVIO_FLAG_WRITE) >= 0;
+    bool opened = ok;
+    ok = ok && avformat_write_header(oc, nullptr) >= 0;
+
+    // Audio runs just ahead of video, so the muxer interleaves evenly.
+    int totalFrames = cfg.seconds * cfg.fps;
+    for (int i = 0; ok && i < totalFrames; ++i) {
+        OutStream& v = streams[0];
+        ok = av_frame_make_writable(v.frame) >= 0;
+        FillVideoFrame(v.frame, i);
+        v.frame->pts = v.next++;
+        ok = ok && Encode(oc, v.enc, v.st, v.frame, pkt);
+        double videoTime = (double)(i + 1) / cfg.fps;
+        for (int t = 0; ok && t < spec.audioTracks; ++t) {
+            OutStream& a = streams[1 + t];
+            while (ok && (double)a.next / kAudioRate < videoTime) {
+                ok = av_frame_make_writable(a.frame) >= 0;
+                FillAudioFrame(a.frame, t, a.next);
+                a.frame->pts = a.next;
+                a.next += a.frame->nb_samples;
+                ok = ok && Encode(oc, a.enc, a.st, a.frame, pkt);
+            }
+        }
+    }
+    for (auto& s : streams) {
+        if (ok && s.enc)
+            ok = Encode(oc, s.enc, s.st, nullptr, pkt);
+    }
+    if (ok)
+        ok = av_write_trailer(oc) >= 0;
+    if (opened)
+        avio_closep(&oc->pb);
+    for (auto& s : streams)
+        FreeOutStream(s);
+    av_packet_free(&pkt);
+    avformat_free_context(oc);
+    if (!ok) {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+    return ok;
+}
+
+static fs::path ClipPath(const ClipSpec& spec, const BenchConfig& cfg)
+{
+    std::ostringstream name;
+    name << spec.name << '_' << cfg.width << 'x' << cfg.height << '_' << cfg.fps << "fps_"
+         << cfg.seconds << "s_a" << spec.audioTracks << ".mp4";
+    return cfg.dir / name.str();
+}
+
+static double Percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t idx = (size_t)std::min<double>(v.size() - 1, std::ceil(p * v.size()) - 1);
+    return v[idx];
+}
+
+static void BenchDecode(MediaSource& src, ClipResult& r)
+{
+    src.Seek(0.0);
+    auto start = Clock::now();
+    int64_t frames = 0;
+    while (src.DecodeVideo())
+        ++frames;
+    double sec = Since(start);
+    r.decodedFrames = frames;
+    r.decodeFps = sec > 0 ? frames / sec : 0.0;
+}
+
+// Seek plus the first frame at the target, as the timeline does on a click.
+static void BenchSeek(MediaSource& src, int count, ClipResult& r)
+{
+    double span = std::max(0.0, src.Info().duration - 0.5);
+    uint32_t seed = 12345;
+    std::vector<double> ms;
+    for (int i = 0; i < count; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        double target = span * (seed >> 8) / (double)(1u << 24);
+        auto start = Clock::now();
+        if (src.Seek(target) && src.DecodeVideo())
+            ms.push_back(Since(start) * 1000.0);
+    }
+    r.seekP50Ms = Percentile(ms, 0.50);
+    r.seekP99Ms = Percentile(ms, 0.99);
+    r.seekMaxMs = ms.empty() ? 0.0 : *std::max_element(ms.begin(), ms.end());
+}
+
+static void BenchMix(MediaSource& src, ClipResult& r)
+{
+    src.Seek(0.0);
+    std::vector<int16_t> block(kMixBlockFrames * 2);
+    int64_t frames = 0;
+    auto start = Clock::now();
+    while (int n = src.MixAudio(block.data()))
+        frames += n;
+    double sec = Since(start);
+    r.mixRealtime = sec > 0 ? (frames / (double)kMixSampleRate) / sec : 0.0;
+}
+
+static bool BenchCut(const MediaInfo& info, const fs::path& out, bool encode, ClipResult& r)
+{
+    std::error_code ec;
+    fs::remove(out, ec);
+    ExportOptions options;
+    options.startTime = 0.0;
+    options.endTime = info.duration;
+    options.mergeAudio = encode;
+    options.convertH264 = encode;
+    options.maxBitrate = encode ? 4000 : 0;
+    ExportStats stats;
+    std::atomic<bool> cancel{ false };
+    VideoCutter cutter(info);
+    stats.Begin(info.duration);
+    auto start = Clock::now();
+    bool ok = cutter.CutVideo(out.wstring(), options, &stats, &cancel);
+    double sec = Since(start);
+    stats.Finish(ok);
+    fs::remove(out, ec);
+    if (!ok)
+        return false;
+    if (encode)
+        r.encodeFps = sec > 0 ? stats.Read().frames / sec : 0.0;
+    else
+        r.copyRealtime = sec > 0 ? info.duration / sec : 0.0;
+    return true;
+}
+
+static ClipResult RunClip(const ClipSpec& spec, const BenchConfig& cfg)
+{
+    ClipResult r;
+    r.name = spec.name;
+    fs::path path = ClipPath(spec, cfg);
+    std::error_code ec;
+    if (!avcodec_find_encoder(spec.codec)) {
+        r.skipped = true;
+        r.error = "no encoder for " + std::string(avcodec_get_name(spec.codec));
+        return r;
+    }
+    if (!fs::exists(path, ec)) {
+        fprintf(stderr, "generating %s\n", path.u8string().c_str());
+        if (!GenerateClip(spec, cfg, path)) {
+            r.error = "could not generate the clip";
+            return r;
+        }
+    }
+    MediaSource src;
+    if (!src.Open(path.wstring())) {
+        r.error = "could not open the clip";
+        return r;
+    }
+    BenchDecode(src, r);
+    BenchSeek(src, cfg.seeks, r);
+    BenchMix(src, r);
+    MediaInfo info = src.Info();
+    src.Close();
+
+    fs::path out = cfg.dir / ("bench_out_" + spec.name + ".mp4");
+    if (!BenchCut(info, out, false, r)) {
+        r.error = "copy cut failed";
+        return r;
+    }
+    if (cfg.encode && !BenchCut(info, out, true, r)) {
+        r.error = "re-encode failed";
+        return r;
+    }
+    r.ok = true;
+    return r;
+}
+
+static std::string Quoted(const std::string& s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+static std::string ResultsJson(const std::vector<ClipResult>& results, const BenchConfig& cfg,
+                               const std::string& label)
+{
+    std::ostringstream js;
+    js << "{\n  \"bench\": \"media\",\n  \"version\": 1,\n  \"label\": " << Quoted(label) << ",\n"
+       << "  \"time\": " << (long long)time(nullptr) << ",\n"
+       << "  \"threads\": " << std::thread::hardware_concurrency() << ",\n"
+       << "  \"config\": {\"width\": " << cfg.width << ", \"height\": " << cfg.height
+       << ", \"fps\": " << cfg.fps << ", \"seconds\": " << cfg.seconds
+       << ", \"seeks\": " << cfg.seeks << "},\n  \"clips\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ClipResult& r = results[i];
+        js << (i ? "," : "") << "\n    {\"name\": " << Quoted(r.name) << ", \"ok\": " << (r.ok ? "true" : "false")
+           << ", \"skipped\": " << (r.skipped ? "true" : "false");
+        if (!r.error.empty())
+            js << ", \"error\": " << Quoted(r.error);
+        js << ", \"decode_fps\": " << r.decodeFps << ", \"decoded_frames\": " << r.decodedFrames
+           << ", \"seek_p50_ms\": " << r.seekP50Ms << ", \"seek_p99_ms\": " << r.seekP99Ms
+           << ", \"seek_max_ms\": " << r.seekMaxMs << ", \"mix_realtime\": " << r.mixRealtime
+           << ", \"copy_realtime\": " << r.copyRealtime << ", \"encode_fps\": " << r.encodeFps << "}";
+    }
+    js << "\n  ]\n}\n";
+    return js.str();
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig cfg;
+    std::string outFile, label, only;
+    std::error_code ec;
+    cfg.dir = fs::temp_directory_path(ec) / "videoeditor_bench";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--dir" && hasValue) {
+            cfg.dir = fs::path(FromUtf8(argv[++i]));
+        } else if (arg == "--out" && hasValue) {
+            outFile = argv[++i];
+        } else if (arg == "--label" && hasValue) {
+            label = argv[++i];
+        } else if (arg == "--seconds" && hasValue) {
+            cfg.seconds = atoi(argv[++i]);
+        } else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &cfg.width, &cfg.height) != 2)
+                cfg.width = 0;
+        } else if (arg == "--fps" && hasValue) {
+            cfg.fps = atoi(argv[++i]);
+        } else if (arg == "--seeks" && hasValue) {
+            cfg.seeks = atoi(argv[++i]);
+        } else if (arg == "--only" && hasValue) {
+            only = argv[++i];
+        } else if (arg == "--skip-encode") {
+            cfg.encode = false;
+        } else if (arg == "--read-ahead-mb" && hasValue) {
+            g_readAheadMB = atoi(argv[++i]);
+        } else if (arg == "--write-behind-mb" && hasValue) {
+            g_writeBehindMB = atoi(argv[++i]);
+        } else if (arg == "--packet-cache-mb" && hasValue) {
+            g_packetCacheMB = atoi(argv[++i]);
+        } else if (arg == "--verbose") {
+            g_logToStderr = true;
+            g_logLevel = (int)LogLevel::Debug;
+        } else {
+            fprintf(stderr, "usage: %s [--dir PATH] [--out FILE] [--label TEXT] [--seconds N] [--size WxH]\n"
+                            "       [--fps N] [--seeks N] [--only NAME] [--skip-encode] [--read-ahead-mb N]\n"
+                            "       [--write-behind-mb N] [--packet-cache-mb N] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (cfg.seconds <= 0 || cfg.fps <= 0 || cfg.width < 16 || cfg.height < 16 || cfg.seeks < 0 ||
+        (cfg.width | cfg.height) & 1) {
+        fprintf(stderr, "seconds, fps and an even size must be positive\n");
+        return 2;
+    }
+    g_logToFile = false;
+    g_logPopups = false;
+    av_log_set_level(AV_LOG_ERROR);
+    fs::create_directories(cfg.dir, ec);
+
+    printf("%-12s %9s %9s %9s %9s %9s %9s\n", "clip", "dec fps", "seek p50", "seek p99",
+           "mix x", "copy x", "enc fps");
+    std::vector<ClipResult> results;
+    int failures = 0;
+    for (const ClipSpec& spec : kClips) {
+        if (!only.empty() && spec.name != only)
+            continue;
+        ClipResult r = RunClip(spec, cfg);
+        if (r.ok) {
+            printf("%-12s %9.1f %7.1fms %7.1fms %9.1f %9.1f %9.1f\n", r.name.c_str(), r.decodeFps,
+                   r.seekP50Ms, r.seekP99Ms, r.mixRealtime, r.copyRealtime, r.encodeFps);
+        } else if (r.skipped) {
+            printf("%-12s skipped: %s\n", r.name.c_str(), r.error.c_str());
+        } else {
+            printf("%-12s FAILED: %s\n", r.name.c_str(), r.error.c_str());
+            ++failures;
+        }
+        fflush(stdout);
+        results.push_back(r);
+    }
+
+    if (!outFile.empty()) {
+        FILE* fp = OpenFile(FromUtf8(outFile), "wb");
+        std::string json = ResultsJson(results, cfg, label);
+        if (!fp || fwrite(json.data(), 1, json.size(), fp) != json.size()) {
+            fprintf(stderr, "could not write %s\n", outFile.c_str());
+            ++failures;
+        }
+        if (fp)
+            fclose(fp);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+// Uploads generated files through the editor's B2 and Catbox uploaders to
+// tools/mock_upload_server.py and reports throughput, connection reuse and
+// retries. Start the server first (its flags inject latency, throttling and
+// failures), then:
+//
+//   bench_upload [--server URL] [--provider b2|catbox|both] [--sizes 10,100,1000,10000]
+//                [--part-mb N] [--threads N] [--limit-kbps N] [--dir PATH] [--verbose]
+//
+// Sizes are in MB; the default runs 10 MB to 10 GB. Test files are written
+// once to --dir (default: the temp directory) and deleted afterwards.
+
+#include "b2_upload.h"
+#include "catbox_upload.h"
+#include "upload_manager.h"
+#include "debug_log.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static size_t AppendCB(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    static_cast<std::string*>(userdata)->append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+// Mock server counters, see /stats in mock_upload_server.py.
+struct ServerStats {
+    long long connections = 0;
+    long long requests = 0;
+    long long authorizeCalls = 0;
+    long long uploadUrlCalls = 0;
+    long long injectedFailures = 0;
+    long long expiredTokens = 0;
+    long long sha1Mismatches = 0;
+};
+
+static long long JsonInt(const std::string& json, const char* key)
+{
+    size_t pos = json.find("\"" + std::string(key) + "\"");
+    if (pos == std::string::npos)
+        return 0;
+    pos = json.find(':', pos);
+    return pos == std::string::npos ? 0 : atoll(json.c_str() + pos + 1);
+}
+
+static bool ServerRequest(const std::string& url, bool post, std::string& response)
+{
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        return false;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    if (post)
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "");
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendCB);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    long status = 0;
+    bool ok = curl_easy_perform(curl) == CURLE_OK &&
+              curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status) == CURLE_OK &&
+              status == 200;
+    curl_easy_cleanup(curl);
+    return ok;
+}
+
+static bool FetchStats(const std::string& server, ServerStats& s)
+{
+    std::string json;
+    if (!ServerRequest(server + "/stats", false, json))
+        return false;
+    // Leave out this /stats request and the connection it came on.
+    s.connections = JsonInt(json, "connections") - 1;
+    s.requests = JsonInt(json, "requests") - 1;
+    s.authorizeCalls = JsonInt(json, "authorize_calls");
+    s.uploadUrlCalls = JsonInt(json, "upload_url_calls");
+    s.injectedFailures = JsonInt(json, "injected_failures");
+    s.expiredTokens = JsonInt(json, "expired_tokens");
+    s.sha1Mismatches = JsonInt(json, "sha1_mismatches");
+    return true;
+}
+
+// Incompressible filler so nothing on the way can shortcut the transfer.
+static bool WriteTestFile(const std::filesystem::path& path, int64_t bytes)
+{
+    FILE* fp = fopen(path.string().c_str(), "wb");
+    if (!fp)
+        return false;
+    std::vector<uint64_t> block(512 * 1024);
+    uint64_t x = 0x9E3779B97F4A7C15ull ^ (uint64_t)bytes;
+    for (int64_t left = bytes; left > 0;) {
+        for (auto& v : block) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            v = x;
+        }
+        size_t n = (size_t)std::min<int64_t>(left, (int64_t)(block.size() * sizeof(uint64_t)));
+        if (fwrite(block.data(), 1, n, fp) != n) {
+            fclose(fp);
+            return false;
+        }
+        left -= n;
+    }
+    return fclose(fp) == 0;
+}
+
+static std::vector<int> ParseSizes(const char* list)
+{
+    std::vector<int> sizes;
+    for (const char* p = list; *p;) {
+        int mb = atoi(p);
+        if (mb > 0)
+            sizes.push_back(mb);
+        const char* comma = strchr(p, ',');
+        if (!comma)
+            break;
+        p = comma + 1;
+    }
+    return sizes;
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: bench_upload [--server URL] [--provider b2|catbox|both]\n"
+            "                    [--sizes MB,MB,...] [--part-mb N] [--threads N]\n"
+            "                    [--limit-kbps N] [--dir PATH] [--verbose]\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::string server = "http://127.0.0.1:8765";
+    std::string provider = "both";
+    std::vector<int> sizes = { 10, 100, 1000, 10000 };
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    // The mock server accepts any credentials.
+    g_b2KeyId = L"bench-key";
+    g_b2AppKey = L"bench-secret";
+    g_b2BucketId = L"bench-bucket-id";
+    g_b2BucketName = L"bench";
+    g_logToFile = false;
+    g_logPopups = false;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--server") && hasValue)
+            server = argv[++i];
+        else if (!strcmp(argv[i], "--provider") && hasValue)
+            provider = argv[++i];
+        else if (!strcmp(argv[i], "--sizes") && hasValue)
+            sizes = ParseSizes(argv[++i]);
+        else if (!strcmp(argv[i], "--part-mb") && hasValue)
+            g_b2PartSizeMB = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && hasValue)
+            g_b2UploadThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--limit-kbps") && hasValue)
+            g_uploadLimitKBps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--dir") && hasValue)
+            dir = argv[++i];
+        else if (!strcmp(argv[i], "--verbose")) {
+            g_logToStderr = true;
+            g_logLevel = (int)LogLevel::Debug;
+        } else {
+            Usage();
+            return 2;
+        }
+    }
+    if (sizes.empty() || (provider != "b2" && provider != "catbox" && provider != "both")) {
+        Usage();
+        return 2;
+    }
+
+    SetEnvVar("VIDEOEDITOR_B2_API_URL", server.c_str());
+    SetEnvVar("VIDEOEDITOR_CATBOX_URL", (server + "/user/api.php").c_str());
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    ServerStats probe;
+    if (!FetchStats(server, probe)) {
+        fprintf(stderr, "no mock server at %s (run tools/mock_upload_server.py)\n", server.c_str());
+        curl_global_cleanup();
+        return 1;
+    }
+    UploadManager::Get().Start();
+
+    std::vector<UploadProvider> providers;
+    if (provider != "catbox")
+        providers.push_back(UploadProvider::B2);
+    if (provider != "b2")
+        providers.push_back(UploadProvider::Catbox);
+
+    printf("part %d MB, %d threads, limit %s\n", g_b2PartSizeMB, g_b2UploadThreads,
+           g_uploadLimitKBps > 0 ? (std::to_string(g_uploadLimitKBps) + " KB/s").c_str() : "none");
+    printf("%-7s %8s %9s %9s %6s %6s %5s %5s %6s %6s %s\n", "target", "MB", "seconds", "MB/s",
+           "conns", "reqs", "auth", "urls", "faults", "tries", "result");
+
+    int failures = 0;
+    for (int mb : sizes) {
+        std::filesystem::path file = dir / ("bench_upload_" + std::to_string(mb) + "MB.bin");
+        if (!WriteTestFile(file, (int64_t)mb * 1024 * 1024)) {
+            fprintf(stderr, "could not write %s\n", file.string().c_str());
+            ++failures;
+            continue;
+        }
+        for (UploadProvider p : providers) {
+            std::string ignored;
+            ServerRequest(server + "/stats/reset", true, ignored);
+
+            auto start = Clock::now();
+            auto job = UploadManager::Get().Enqueue(p, file.wstring());
+            std::string url;
+            bool ok = UploadManager::Get().Wait(job, url, nullptr);
+            double sec = std::chrono::duration<double>(Clock::now() - start).count();
+
+            ServerStats s;
+            FetchStats(server, s);
+            if (!ok || s.sha1Mismatches)
+                ++failures;
+            printf("%-7s %8d %9.2f %9.1f %6lld %6lld %5lld %5lld %6lld %6d %s\n",
+                   p == UploadProvider::B2 ? "b2" : "catbox", mb, sec, mb / sec,
+                   s.connections, s.requests, s.authorizeCalls, s.uploadUrlCalls,
+                   s.injectedFailures + s.expiredTokens, job->attempts.load(),
+                   ok ? (s.sha1Mismatches ? "SHA-1 MISMATCH" : "ok") : "FAILED");
+            fflush(stdout);
+        }
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+    }
+
+    UploadManager::Get().Stop();
+    curl_global_cleanup();
+    return failures ? 1 : 0;
+}
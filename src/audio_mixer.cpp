@@ -0,0 +1,293 @@
+#include "audio_mixer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VE_MIX_SSE2 1
+#include <emmintrin.h>
+#else
+#define VE_MIX_SSE2 0
+#endif
+
+SampleRing::SampleRing(size_t capacityFrames)
+{
+    Reset(capacityFrames);
+}
+
+void SampleRing::Reset(size_t capacityFrames)
+{
+    m_data.assign(capacityFrames * 2, 0);
+    m_capacity = capacityFrames;
+    m_head = 0;
+    m_size = 0;
+}
+
+void SampleRing::Clear()
+{
+    m_head = 0;
+    m_size = 0;
+}
+
+size_t SampleRing::Write(const int16_t* src, size_t frames)
+{
+    frames = std::min(frames, Free());
+    if (frames == 0)
+        return 0;
+    size_t tail = (m_head + m_size) % m_capacity;
+    size_t first = std::min(frames, m_capacity - tail);
+    memcpy(&m_data[tail * 2], src, first * 2 * sizeof(int16_t));
+    if (frames > first)
+        memcpy(&m_data[0], src + first * 2, (frames - first) * 2 * sizeof(int16_t));
+    m_size += frames;
+    return frames;
+}
+
+size_t SampleRing::WriteSilence(size_t frames)
+{
+    frames = std::min(frames, Free());
+    if (frames == 0)
+        return 0;
+    size_t tail = (m_head + m_size) % m_capacity;
+    size_t first = std::min(frames, m_capacity - tail);
+    memset(&m_data[tail * 2], 0, first * 2 * sizeof(int16_t));
+    if (frames > first)
+        memset(&m_data[0], 0, (frames - first) * 2 * sizeof(int16_t));
+    m_size += frames;
+    return frames;
+}
+
+void SampleRing::Discard(size_t frames)
+{
+    frames = std::min(frames, m_size);
+    m_size -= frames;
+    m_head = m_size ? (m_head + frames) % m_capacity : 0;
+}
+
+void SampleRing::Peek(size_t frames, const int16_t** first, size_t* firstFrames,
+                      const int16_t** second, size_t* secondFrames) const
+{
+    frames = std::min(frames, m_size);
+    size_t a = std::min(frames, m_capacity - m_head);
+    *first = m_data.data() + m_head * 2;
+    *firstFrames = a;
+    *second = m_data.data();
+    *secondFrames = frames - a;
+}
+
+static void AddSamples(int32_t* acc, const int16_t* src, size_t count)
+{
+    size_t i = 0;
+#if VE_MIX_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), hi));
+    }
+#endif
+    for (; i < count; ++i)
+        acc[i] += src[i];
+}
+
+BlockMixer::BlockMixer(int trackCount, int sampleRate, int blockFrames,
+                       double bufferSeconds, int64_t endFrame)
+    : m_tracks(std::max(trackCount, 1)),
+      m_acc(std::max(blockFrames, 1) * 2),
+      m_blockFrames(std::max(blockFrames, 1)),
+      m_endFrame(endFrame),
+      m_resyncFrames(sampleRate / 50)
+{
+    size_t capacity = std::max((size_t)(bufferSeconds * sampleRate), (size_t)m_blockFrames * 4);
+    for (auto& t : m_tracks)
+        t.ring.Reset(capacity);
+    m_pressureFrames = capacity / 4;
+}
+
+void BlockMixer::Push(int track, int64_t pts, const int16_t* samples, int frames)
+{
+    if (track < 0 || track >= TrackCount() || frames <= 0)
+        return;
+    Track& t = m_tracks[track];
+
+    // Small pts jitter (resampler rounding, codec priming) keeps the
+    // stream contiguous; anything larger is a real gap or overlap.
+    if (pts == kNoPts || (t.started && std::llabs(pts - t.writePts) <= m_resyncFrames))
+        pts = t.writePts;
+    t.started = true;
+
+    if (pts < t.writePts) {
+        int64_t skip = t.writePts - pts;
+        if (skip >= frames) {
+            m_stats.droppedFrames += frames;
+            return;
+        }
+        samples += skip * 2;
+        frames -= (int)skip;
+        pts = t.writePts;
+        m_stats.droppedFrames += skip;
+    }
+    if (m_endFrame > 0) {
+        if (pts >= m_endFrame) {
+            m_stats.droppedFrames += frames;
+            return;
+        }
+        if (pts + frames > m_endFrame) {
+            m_stats.droppedFrames += pts + frames - m_endFrame;
+            frames = (int)(m_endFrame - pts);
+        }
+    }
+    if (pts > t.writePts) {
+        if (t.ring.Size() == 0) {
+            // Leading silence is implicit; nothing needs to be stored.
+            t.headPts = t.writePts = pts;
+        } else {
+            size_t gap = (size_t)(pts - t.writePts);
+            size_t pad = t.ring.WriteSilence(gap);
+            m_stats.paddedFrames += pad;
+            t.writePts += pad;
+            if (pad < gap) {
+                m_stats.droppedFrames += frames;
+                return;
+            }
+        }
+    }
+
+    size_t written = t.ring.Write(samples, frames);
+    t.writePts += written;
+    m_stats.droppedFrames += frames - (int64_t)written;
+}
+
+void BlockMixer::Finish(int track)
+{
+    if (track >= 0 && track < TrackCount())
+        m_tracks[track].finished = true;
+}
+
+void BlockMixer::FinishAll()
+{
+    for (auto& t : m_tracks)
+        t.finished = true;
+}
+
+int BlockMixer::NextBlockFrames(bool flush) const
+{
+    int64_t n = m_blockFrames;
+    if (m_endFrame > 0)
+        n = std::min(n, m_endFrame - m_readPts);
+    if (n <= 0)
+        return 0;
+
+    bool allFinished = true;
+    bool ready = true;
+    bool pressure = false;
+    int64_t maxWrite = m_readPts;
+    for (const auto& t : m_tracks) {
+        allFinished = allFinished && t.finished;
+        if (!t.finished && t.writePts < m_readPts + n)
+            ready = false;
+        if (t.ring.Free() < m_pressureFrames)
+            pressure = true;
+        maxWrite = std::max(maxWrite, t.writePts);
+    }
+
+    if (allFinished || flush) {
+        int64_t remaining = maxWrite - m_readPts;
+        if (remaining >= n)
+            return (int)n;
+        return flush ? (int)std::max<int64_t>(remaining, 0) : 0;
+    }
+    return (ready || pressure) ? (int)n : 0;
+}
+
+bool BlockMixer::Ready(bool flush) const
+{
+    return NextBlockFrames(flush) > 0;
+}
+
+int BlockMixer::Accumulate(bool flush)
+{
+    int n = NextBlockFrames(flush);
+    if (n <= 0)
+        return 0;
+
+    memset(m_acc.data(), 0, (size_t)n * 2 * sizeof(int32_t));
+    bool forced = false;
+    for (auto& t : m_tracks) {
+        if (!t.finished && t.writePts < m_readPts + n)
+            forced = true;
+        if (t.ring.Size() == 0)
+            continue;
+        int64_t offset = t.headPts - m_readPts;
+        if (offset >= n)
+            continue;
+        size_t take = std::min(t.ring.Size(), (size_t)(n - offset));
+        const int16_t* a;
+        const int16_t* b;
+        size_t aFrames, bFrames;
+        t.ring.Peek(take, &a, &aFrames, &b, &bFrames);
+        AddSamples(m_acc.data() + offset * 2, a, aFrames * 2);
+        AddSamples(m_acc.data() + (offset + aFrames) * 2, b, bFrames * 2);
+        t.ring.Discard(take);
+        t.headPts += take;
+    }
+
+    m_readPts += n;
+    for (auto& t : m_tracks) {
+        if (t.ring.Size() == 0) {
+            // A lagging track gave up this block; anything it delivers for
+            // it later is dropped as overlap.
+            t.writePts = std::max(t.writePts, m_readPts);
+            t.headPts = t.writePts;
+        }
+    }
+    m_stats.blocks++;
+    if (forced)
+        m_stats.forcedBlocks++;
+    return n;
+}
+
+int BlockMixer::MixS16(int16_t* out, bool flush)
+{
+    int n = Accumulate(flush);
+    const float scale = 1.0f / TrackCount();
+    const size_t count = (size_t)n * 2;
+    size_t i = 0;
+#if VE_MIX_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128 f0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_acc[i]))), vscale);
+        __m128 f1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_acc[i + 4]))), vscale);
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(f0), _mm_cvttps_epi32(f1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+#endif
+    for (; i < count; ++i) {
+        int32_t v = (int32_t)((float)m_acc[i] * scale);
+        out[i] = (int16_t)std::min(std::max(v, -32768), 32767);
+    }
+    return n;
+}
+
+int BlockMixer::MixPlanar(float* left, float* right, bool flush)
+{
+    int n = Accumulate(flush);
+    const float scale = 1.0f / (32768.0f * TrackCount());
+    int f = 0;
+#if VE_MIX_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; f + 4 <= n; f += 4) {
+        __m128 f0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_acc[f * 2]))), vscale);
+        __m128 f1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_acc[f * 2 + 4]))), vscale);
+        _mm_storeu_ps(left + f, _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + f, _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#endif
+    for (; f < n; ++f) {
+        left[f] = (float)m_acc[f * 2] * scale;
+        right[f] = (float)m_acc[f * 2 + 1] * scale;
+    }
+    return n;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-capacity ring of interleaved stereo int16 frames. Storage is
+// allocated once; writes that do not fit are truncated, never grown.
+class SampleRing {
+public:
+    explicit SampleRing(size_t capacityFrames = 0);
+
+    void Reset(size_t capacityFrames);
+    void Clear();
+
+    size_t Capacity() const { return m_capacity; }
+    size_t Size() const { return m_size; }
+    size_t Free() const { return m_capacity - m_size; }
+
+    size_t Write(const int16_t* src, size_t frames);
+    size_t WriteSilence(size_t frames);
+    void Discard(size_t frames);
+
+    // Oldest `frames` frames as at most two contiguous spans.
+    void Peek(size_t frames, const int16_t** first, size_t* firstFrames,
+              const int16_t** second, size_t* secondFrames) const;
+
+private:
+    std::vector<int16_t> m_data;
+    size_t m_capacity = 0;
+    size_t m_head = 0;
+    size_t m_size = 0;
+};
+
+struct MixStats {
+    int64_t blocks = 0;
+    int64_t forcedBlocks = 0;   // emitted while a track was still short
+    int64_t paddedFrames = 0;   // silence inserted to fill pts gaps
+    int64_t droppedFrames = 0;  // overlap, out-of-range or overflow
+};
+
+// Mixes N stereo int16 tracks into fixed-size blocks. Every track is placed
+// on a shared timeline by pts (in output samples, 0 = start of the cut), so
+// gaps become silence and overlaps are dropped. Each track buffers at most
+// `bufferSeconds`; when one ring comes under pressure the mixer emits blocks
+// anyway and lagging tracks contribute silence for the part they miss.
+class BlockMixer {
+public:
+    static const int64_t kNoPts = INT64_MIN;
+
+    BlockMixer(int trackCount, int sampleRate, int blockFrames,
+               double bufferSeconds, int64_t endFrame = 0);
+
+    int TrackCount() const { return (int)m_tracks.size(); }
+    int BlockFrames() const { return m_blockFrames; }
+    int64_t Position() const { return m_readPts; }
+    const MixStats& Stats() const { return m_stats; }
+
+    // Queue `frames` interleaved stereo frames for a track. `pts` is the
+    // position of the first frame; kNoPts appends after the previous push.
+    void Push(int track, int64_t pts, const int16_t* samples, int frames);
+    void Finish(int track);
+    void FinishAll();
+
+    // True when MixS16/MixPlanar would produce a block. With `flush` set,
+    // partial trailing blocks are emitted once every track is finished.
+    bool Ready(bool flush) const;
+
+    // Average of all tracks. Both return the number of frames written,
+    // which is BlockFrames() except for the last block of a flush.
+    int MixS16(int16_t* out, bool flush);
+    int MixPlanar(float* left, float* right, bool flush);
+
+private:
+    struct Track {
+        SampleRing ring;
+        int64_t headPts = 0;   // pts of the oldest frame in the ring
+        int64_t writePts = 0;  // pts just past the newest frame
+        bool started = false;
+        bool finished = false;
+    };
+
+    int NextBlockFrames(bool flush) const;
+    int Accumulate(bool flush);
+
+    std::vector<Track> m_tracks;
+    std::vector<int32_t> m_acc;
+    int m_blockFrames;
+    int64_t m_readPts = 0;
+    int64_t m_endFrame;
+    int64_t m_resyncFrames;
+    size_t m_pressureFrames;
+    MixStats m_stats;
+};
@@ -1,5 +1,7 @@
 #include "audio_player.h"
 #include "video_player.h"
+#include "trace.h"
+#include "debug_log.h"
 #include <chrono>
 #include <limits>
 
@@ -9,9 +11,35 @@ AudioPlayer::~AudioPlayer() {
     Cleanup();
 }
 
+void AudioPlayer::StartDeviceInit() {
+    m_deviceThread = std::thread([this] {
+        TraceSetThreadName("Audio device");
+        TRACE_SCOPE("Audio device init", "startup");
+        auto start = std::chrono::steady_clock::now();
+        if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+            return;
+        bool ok = Initialize();
+        CoUninitialize();
+        LOG_INFO("Audio device " << (ok ? "ready" : "unavailable") << " after "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start).count() << " ms");
+    });
+}
+
+bool AudioPlayer::WaitForDevice() {
+    if (m_deviceThread.joinable())
+    {
+        TRACE_SCOPE("Wait for audio device", "startup");
+        m_deviceThread.join();
+    }
+    return m_player->audioInitialized;
+}
+
 bool AudioPlayer::Initialize() {
-    // Use multi-threaded COM so the audio client functions correctly from any thread
-    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    // The device objects outlive the thread that makes them: keep the
+    // process MTA up until Cleanup so the UI and audio threads, which join
+    // it implicitly, can keep using them.
+    HRESULT hr = CoIncrementMTAUsage(&m_mtaCookie);
     if (FAILED(hr))
         return false;
 
@@ -82,6 +110,7 @@ bool AudioPlayer::Initialize() {
 }
 
 void AudioPlayer::Cleanup() {
+    WaitForDevice();
     if (m_player->audioThreadRunning)
     {
         m_player->audioThreadRunning = false;
@@ -117,7 +146,11 @@ void AudioPlayer::Cleanup() {
     }
     
     m_player->audioInitialized = false;
-    CoUninitialize();
+    if (m_mtaCookie)
+    {
+        CoDecrementMTAUsage(m_mtaCookie);
+        m_mtaCookie = nullptr;
+    }
 }
 
 bool AudioPlayer::InitializeTracks() {
@@ -247,6 +280,7 @@ void AudioPlayer::StopThread() {
 void AudioPlayer::ProcessFrame(AVPacket* audioPacket) {
     if (!m_player->audioInitialized || m_player->audioTracks.empty())
         return;
+    TRACE_SCOPE("ProcessFrame", "audio");
 
     // Find the corresponding audio track
     AudioTrack *track = nullptr;
@@ -313,6 +347,7 @@ void AudioPlayer::SetMasterVolume(float volume) {
 }
 
 void AudioPlayer::AudioThreadFunction() {
+    TraceSetThreadName("Audio");
     // Each thread interacting with WASAPI must initialize COM separately
     if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
         return;
@@ -325,6 +360,7 @@ void AudioPlayer::AudioThreadFunction() {
     HRESULT hr;
     auto startTime = m_player->masterStartTime;
     double startPts = m_player->masterStartPts;
+    bool starved = false;
 
     while (m_player->audioThreadRunning)
     {
@@ -343,6 +379,18 @@ void AudioPlayer::AudioThreadFunction() {
         double masterPts = startPts + elapsed;
         UINT64 played = m_framesWritten > padding ? m_framesWritten - padding : 0;
         double playedPts = played / static_cast<double>(m_player->audioSampleRate);
+        m_player->playbackStats.SetAudioClock(m_player->masterStartPts + playedPts);
+        // Count each time the device buffer runs dry, not every pass while it is
+        if (padding == 0 && m_framesWritten > 0)
+        {
+            if (!starved)
+                m_player->playbackStats.OnAudioUnderrun();
+            starved = true;
+        }
+        else
+        {
+            starved = false;
+        }
 
         if (masterPts < playedPts)
         {
@@ -362,6 +410,9 @@ void AudioPlayer::AudioThreadFunction() {
             framesNeeded = available;
 
         int buffered = GetAvailableFrameCount();
+        m_player->playbackStats.SetAudioBuffers(
+            buffered / static_cast<double>(m_player->audioSampleRate),
+            m_player->bufferFrameCount ? padding / static_cast<double>(m_player->bufferFrameCount) : 0.0);
         if (framesNeeded > static_cast<UINT32>(buffered))
             framesNeeded = static_cast<UINT32>(buffered);
 
@@ -372,6 +423,7 @@ void AudioPlayer::AudioThreadFunction() {
             continue;
         }
 
+        TRACE_SCOPE("AudioWrite", "audio");
         BYTE* pData;
         hr = m_player->renderClient->GetBuffer(framesNeeded, &pData);
         if (FAILED(hr))
@@ -393,6 +445,7 @@ void AudioPlayer::AudioThreadFunction() {
 }
 
 void AudioPlayer::MixAudioTracks(uint8_t* outputBuffer, int frameCount, double startPts) {
+    TRACE_SCOPE("MixAudioTracks", "audio");
     memset(outputBuffer, 0, frameCount * m_player->audioChannels * sizeof(int16_t));
     int16_t *out = reinterpret_cast<int16_t*>(outputBuffer);
 
@@ -2,6 +2,7 @@
 
 #include "video_player.h"
 #include <chrono>
+#include <thread>
 
 class VideoPlayer;
 
@@ -10,6 +11,11 @@ public:
     AudioPlayer(VideoPlayer* player);
     ~AudioPlayer();
 
+    // Opens the default output device on a background thread, so a slow or
+    // Bluetooth device does not hold up the window.
+    void StartDeviceInit();
+    // Blocks until that thread is done; true when the device is usable.
+    bool WaitForDevice();
     bool Initialize();
     void Cleanup();
     bool InitializeTracks();
@@ -27,4 +33,6 @@ private:
 
     VideoPlayer* m_player;
     int64_t m_framesWritten;
+    std::thread m_deviceThread;
+    CO_MTA_USAGE_COOKIE m_mtaCookie = nullptr;
 };
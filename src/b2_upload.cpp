@@ -1,8 +1,34 @@
 #include "b2_upload.h"
-#include "options_window.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include "debug_log.h"
+#include "sha1.h"
+#include "upload_manager.h"
 #include <curl/curl.h>
 #include <string>
-#include <commctrl.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+
+// Large files go up in parts of g_b2PartSizeMB. B2 needs 5 MB at least for
+// every part but the last; each thread holds one part in memory.
+static const int kMinPartMB = 5;
+static const int kMaxPartMB = 1024;
+// B2 numbers parts 1 to 10000.
+static const int64_t kMaxParts = 10000;
+static const int kMaxUploadThreads = 16;
+static const int kPartAttempts = 4;
+// Disk reads for large files are hashed in chunks of this size.
+static const size_t kReadChunkBytes = 1024 * 1024;
+static const int64_t kSha1HexLength = 40;
+// Account tokens last 24 hours; refresh a little before B2 expires them.
+static const auto kAuthLifetime = std::chrono::hours(23);
 
 static size_t WriteCB(char* ptr, size_t size, size_t nmemb, void* userdata) {
     std::string* out = static_cast<std::string*>(userdata);
@@ -12,21 +38,12 @@ static size_t WriteCB(char* ptr, size_t size, size_t nmemb, void* userdata) {
 
 static int ProgressCB(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
                       curl_off_t ultotal, curl_off_t ulnow) {
-    HWND bar = reinterpret_cast<HWND>(clientp);
-    if (bar && ultotal > 0) {
-        int pct = static_cast<int>((double)ulnow / ultotal * 100.0);
-        SendMessage(bar, PBM_SETPOS, pct, 0);
-    }
+    std::atomic<int>* percent = static_cast<std::atomic<int>*>(clientp);
+    if (percent && ultotal > 0)
+        *percent = static_cast<int>((double)ulnow / ultotal * 100.0);
     return 0;
 }
 
-static std::string Narrow(const std::wstring& w) {
-    int sz = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    std::string s(sz - 1, 0);
-    WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, s.data(), sz, nullptr, nullptr);
-    return s;
-}
-
 static bool ExtractJson(const std::string& json, const std::string& key, std::string& value) {
     size_t pos = json.find("\"" + key + "\"");
     if (pos == std::string::npos) return false;
@@ -40,96 +57,715 @@ static bool ExtractJson(const std::string& json, const std::string& key, std::st
     return true;
 }
 
-bool UploadToB2(const std::wstring& filePath, std::string& outUrl, HWND progressBar) {
-    if (g_b2KeyId.empty() || g_b2AppKey.empty() || g_b2BucketId.empty() || g_b2BucketName.empty())
-        return false;
+static std::string JsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
 
-    CURL* curl = curl_easy_init();
-    if (!curl) return false;
+// VIDEOEDITOR_B2_API_URL points the uploader at a local stand-in server.
+static std::string ApiBase() {
+    const char* env = getenv("VIDEOEDITOR_B2_API_URL");
+    return env && *env ? env : "https://api.backblazeb2.com";
+}
+
+static bool B2Configured() {
+    return !g_b2KeyId.empty() && !g_b2AppKey.empty() && !g_b2BucketId.empty() &&
+           !g_b2BucketName.empty();
+}
+
+static std::string PublicUrl(const std::string& downloadUrl, const std::string& name) {
+    if (!g_b2CustomUrl.empty()) {
+        std::string base = ToUtf8(g_b2CustomUrl);
+        if (base.back() != '/' && base.back() != '\\') base += '/';
+        return base + name;
+    }
+    return downloadUrl + "/file/" + ToUtf8(g_b2BucketName) + "/" + name;
+}
+
+static bool PerformOk(CURL* curl) {
+    if (UploadManager::Get().Perform(curl) != CURLE_OK) return false;
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    return status == 200;
+}
+
+struct B2Account {
+    std::string authToken;
+    std::string apiUrl;
+    std::string downloadUrl;
+};
 
+static bool Authorize(CURL* curl, B2Account& account) {
     std::string response;
-    curl_easy_setopt(curl, CURLOPT_URL, "https://api.backblazeb2.com/b2api/v2/b2_authorize_account");
-    std::string creds = Narrow(g_b2KeyId) + ":" + Narrow(g_b2AppKey);
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, (ApiBase() + "/b2api/v2/b2_authorize_account").c_str());
+    std::string creds = ToUtf8(g_b2KeyId) + ":" + ToUtf8(g_b2AppKey);
     curl_easy_setopt(curl, CURLOPT_USERPWD, creds.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCB);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) { curl_easy_cleanup(curl); return false; }
+    if (!PerformOk(curl)) return false;
+    return ExtractJson(response, "authorizationToken", account.authToken) &&
+           ExtractJson(response, "apiUrl", account.apiUrl) &&
+           ExtractJson(response, "downloadUrl", account.downloadUrl);
+}
 
-    std::string authToken, apiUrl, downloadUrl;
-    if (!ExtractJson(response, "authorizationToken", authToken) ||
-        !ExtractJson(response, "apiUrl", apiUrl) ||
-        !ExtractJson(response, "downloadUrl", downloadUrl)) {
-        curl_easy_cleanup(curl);
-        return false;
+// One authorization is shared by every upload until it nears expiry or B2
+// rejects it, instead of a b2_authorize_account round trip per file.
+static std::mutex g_authMutex;
+static std::mutex g_authorizing;         // one b2_authorize_account at a time
+static B2Account g_authCache;
+static std::string g_authCreds;
+static std::chrono::steady_clock::time_point g_authTime;
+
+// Upload URLs from b2_get_upload_url can be reused until a request on one
+// fails, so finished single uploads hand theirs back here.
+struct B2UploadUrl {
+    std::string bucketId;
+    std::string url;
+    std::string auth;
+};
+static std::vector<B2UploadUrl> g_uploadUrls;
+
+static bool CachedAuthorize(CURL* curl, B2Account& account) {
+    std::string creds = ToUtf8(g_b2KeyId) + ":" + ToUtf8(g_b2AppKey);
+    // Uploads starting together wait for the first one's authorization.
+    std::lock_guard<std::mutex> authorizing(g_authorizing);
+    {
+        std::lock_guard<std::mutex> lock(g_authMutex);
+        if (!g_authCache.authToken.empty() && g_authCreds == creds &&
+            std::chrono::steady_clock::now() - g_authTime < kAuthLifetime) {
+            account = g_authCache;
+            return true;
+        }
     }
+    if (!Authorize(curl, account))
+        return false;
+    std::lock_guard<std::mutex> lock(g_authMutex);
+    if (g_authCreds != creds)
+        g_uploadUrls.clear();
+    g_authCache = account;
+    g_authCreds = creds;
+    g_authTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+// Called when B2 answers 401: the next upload authorizes again.
+static void DropAuthorization(const std::string& authToken) {
+    std::lock_guard<std::mutex> lock(g_authMutex);
+    if (g_authCache.authToken == authToken)
+        g_authCache = B2Account();
+}
 
+static bool PostJson(CURL* curl, const B2Account& account, const char* call,
+                     const std::string& body, std::string& response) {
     response.clear();
+    curl_easy_reset(curl);
     struct curl_slist* hdrs = nullptr;
-    std::string authHeader = "Authorization: " + authToken;
-    hdrs = curl_slist_append(hdrs, authHeader.c_str());
-    std::string postData = std::string("{\"bucketId\":\"") + Narrow(g_b2BucketId) + "\"}";
-    curl_easy_setopt(curl, CURLOPT_URL, (apiUrl + "/b2api/v2/b2_get_upload_url").c_str());
+    hdrs = curl_slist_append(hdrs, ("Authorization: " + account.authToken).c_str());
+    std::string url = account.apiUrl + "/b2api/v2/" + call;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postData.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, postData.size());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body.size());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCB);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    res = curl_easy_perform(curl);
+    bool ok = PerformOk(curl);
     curl_slist_free_all(hdrs);
-    if (res != CURLE_OK) { curl_easy_cleanup(curl); return false; }
+    if (!ok) {
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        if (status == 401)
+            DropAuthorization(account.authToken);
+        LOG_WARN("B2 " << call << " failed: " << response);
+    }
+    return ok;
+}
 
-    std::string uploadUrl, uploadAuth;
-    if (!ExtractJson(response, "uploadUrl", uploadUrl) ||
-        !ExtractJson(response, "authorizationToken", uploadAuth)) {
-        curl_easy_cleanup(curl);
+// A large file being assembled on B2. Shared by every thread sending parts.
+struct B2LargeFile {
+    B2Account account;
+    std::string name;
+    std::string fileId;
+    std::atomic<bool>* cancelFlag = nullptr;
+    std::mutex shaMutex;
+    std::vector<std::string> partSha1;      // index is part number - 1
+    std::atomic<int64_t> sentBytes{ 0 };    // includes parts still in flight
+
+    bool Cancelled() const { return cancelFlag && *cancelFlag; }
+};
+
+static bool StartLargeFile(CURL* curl, B2LargeFile& lf) {
+    std::string response;
+    std::string body = "{\"bucketId\":" + JsonString(ToUtf8(g_b2BucketId)) +
+                       ",\"fileName\":" + JsonString(lf.name) +
+                       ",\"contentType\":\"b2/x-auto\"}";
+    return PostJson(curl, lf.account, "b2_start_large_file", body, response) &&
+           ExtractJson(response, "fileId", lf.fileId);
+}
+
+static bool FinishLargeFile(CURL* curl, B2LargeFile& lf) {
+    std::string body = "{\"fileId\":" + JsonString(lf.fileId) + ",\"partSha1Array\":[";
+    for (size_t i = 0; i < lf.partSha1.size(); ++i) {
+        if (lf.partSha1[i].empty())
+            return false;
+        body += (i ? "," : "") + JsonString(lf.partSha1[i]);
+    }
+    body += "]}";
+    std::string response;
+    return PostJson(curl, lf.account, "b2_finish_large_file", body, response);
+}
+
+static void CancelLargeFile(CURL* curl, B2LargeFile& lf) {
+    std::string response;
+    PostJson(curl, lf.account, "b2_cancel_large_file",
+             "{\"fileId\":" + JsonString(lf.fileId) + "}", response);
+}
+
+// A part ready to send, hashed by whoever produced it.
+struct QueuedPart {
+    int number = 0;
+    std::vector<uint8_t> data;
+    std::string sha1;
+};
+
+// Bounded hand-off between the producer of parts (the export, or a file
+// reader) and the sending threads. Push blocks while full so the producer
+// stays at most `capacity` parts ahead of the network.
+class PartQueue {
+public:
+    explicit PartQueue(size_t capacity) : m_capacity(capacity) {}
+
+    bool Push(QueuedPart&& part) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_spaceFree.wait(lock, [this] { return m_parts.size() < m_capacity || m_failed; });
+        if (m_failed)
+            return false;
+        m_parts.push_back(std::move(part));
+        lock.unlock();
+        m_partReady.notify_one();
+        return true;
+    }
+
+    // False once the queue is closed and drained, or failed or aborted.
+    bool Pop(QueuedPart& part) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_partReady.wait(lock, [this] { return !m_parts.empty() || m_closed || m_failed; });
+        if (m_failed || m_aborted || m_parts.empty())
+            return false;
+        part = std::move(m_parts.front());
+        m_parts.pop_front();
+        lock.unlock();
+        m_spaceFree.notify_one();
+        return true;
+    }
+
+    // No more parts will be pushed. With `abort` queued parts are dropped.
+    void Close(bool abort) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_aborted = m_aborted || abort;
+        }
+        m_partReady.notify_all();
+    }
+
+    void Fail() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_failed = true;
+        }
+        m_partReady.notify_all();
+        m_spaceFree.notify_all();
+    }
+
+    bool Failed() const { return m_failed; }
+
+    // True if every pushed part was handed out and nothing went wrong.
+    bool Completed() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed && !m_aborted && !m_failed && m_parts.empty();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_partReady;
+    std::condition_variable m_spaceFree;
+    std::deque<QueuedPart> m_parts;
+    size_t m_capacity;
+    bool m_closed = false;
+    bool m_aborted = false;
+    std::atomic<bool> m_failed{ false };
+};
+
+// One sending thread: its own connection and upload URL, since B2 hands
+// out upload URLs per thread. A failed part is retried with backoff on a
+// fresh URL; bytes of a failed attempt are taken back off the progress.
+class PartSender {
+public:
+    explicit PartSender(B2LargeFile& lf) : m_file(lf), m_curl(curl_easy_init()) {}
+    ~PartSender() { if (m_curl) curl_easy_cleanup(m_curl); }
+
+    bool Send(const QueuedPart& part) {
+        if (!m_curl)
+            return false;
+        size_t size = part.data.size();
+        for (int attempt = 0; attempt < kPartAttempts; ++attempt) {
+            if (attempt > 0 && !Backoff(attempt))
+                return false;
+            if (m_file.Cancelled())
+                return false;
+            if (m_url.empty() && !GetUploadUrl())
+                continue;
+            m_counted = 0;
+            if (Upload(part)) {
+                m_file.sentBytes += (int64_t)size - m_counted;
+                std::lock_guard<std::mutex> lock(m_file.shaMutex);
+                if (m_file.partSha1.size() < (size_t)part.number)
+                    m_file.partSha1.resize(part.number);
+                m_file.partSha1[part.number - 1] = part.sha1;
+                return true;
+            }
+            m_file.sentBytes -= m_counted;
+            m_url.clear();
+        }
+        LOG_ERROR("B2 part " << part.number << " failed after retries");
         return false;
     }
 
-    FILE* fp = _wfopen(filePath.c_str(), L"rb");
-    if (!fp) { curl_easy_cleanup(curl); return false; }
-    fseek(fp, 0, SEEK_END);
-    long fsz = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+private:
+    static int OnProgress(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t ulnow) {
+        PartSender* self = static_cast<PartSender*>(clientp);
+        self->m_file.sentBytes += (int64_t)ulnow - self->m_counted;
+        self->m_counted = ulnow;
+        return self->m_file.Cancelled() ? 1 : 0;
+    }
+
+    // Sleeps 1 s, 2 s, 4 s... before a retry; false if cancelled meanwhile.
+    bool Backoff(int attempt) {
+        auto until = std::chrono::steady_clock::now() + std::chrono::seconds(1 << (attempt - 1));
+        while (std::chrono::steady_clock::now() < until) {
+            if (m_file.Cancelled())
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return true;
+    }
+
+    bool GetUploadUrl() {
+        std::string response;
+        std::string body = "{\"fileId\":" + JsonString(m_file.fileId) + "}";
+        return PostJson(m_curl, m_file.account, "b2_get_upload_part_url", body, response) &&
+               ExtractJson(response, "uploadUrl", m_url) &&
+               ExtractJson(response, "authorizationToken", m_auth);
+    }
+
+    bool Upload(const QueuedPart& part) {
+        std::string response;
+        curl_easy_reset(m_curl);
+        struct curl_slist* hdrs = nullptr;
+        hdrs = curl_slist_append(hdrs, ("Authorization: " + m_auth).c_str());
+        hdrs = curl_slist_append(hdrs, ("X-Bz-Part-Number: " + std::to_string(part.number)).c_str());
+        hdrs = curl_slist_append(hdrs, ("X-Bz-Content-Sha1: " + part.sha1).c_str());
+        curl_easy_setopt(m_curl, CURLOPT_URL, m_url.c_str());
+        curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, hdrs);
+        curl_easy_setopt(m_curl, CURLOPT_POSTFIELDS, reinterpret_cast<const char*>(part.data.data()));
+        curl_easy_setopt(m_curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)part.data.size());
+        curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, WriteCB);
+        curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(m_curl, CURLOPT_XFERINFOFUNCTION, OnProgress);
+        curl_easy_setopt(m_curl, CURLOPT_XFERINFODATA, this);
+        curl_easy_setopt(m_curl, CURLOPT_NOPROGRESS, 0L);
+        bool ok = PerformOk(m_curl);
+        curl_slist_free_all(hdrs);
+        if (!ok)
+            LOG_WARN("B2 part " << part.number << " attempt failed: " << response);
+        return ok;
+    }
+
+    B2LargeFile& m_file;
+    CURL* m_curl;
+    std::string m_url;
+    std::string m_auth;
+    int64_t m_counted = 0;      // bytes of the current attempt in sentBytes
+};
+
+static void SendQueuedParts(B2LargeFile* lf, PartQueue* queue) {
+    PartSender sender(*lf);
+    QueuedPart part;
+    while (queue->Pop(part)) {
+        if (!sender.Send(part)) {
+            queue->Fail();
+            return;
+        }
+        part.data = std::vector<uint8_t>();
+    }
+}
+
+// Parts of g_b2PartSizeMB, made larger when a file of `fileSize` bytes would
+// need more than kMaxParts of them. Streams, whose size is not known ahead,
+// keep the configured size.
+static int64_t PartBytes(int64_t fileSize = 0) {
+    int64_t configured = (int64_t)std::clamp(g_b2PartSizeMB, kMinPartMB, kMaxPartMB) * 1024 * 1024;
+    return std::max(configured, (fileSize + kMaxParts - 1) / kMaxParts);
+}
+
+static int UploadThreads() {
+    return std::clamp(g_b2UploadThreads, 1, kMaxUploadThreads);
+}
+
+// Reads the file front to back, hashing each chunk as it comes off the
+// disk, and queues whole parts. It runs up to one part per sender ahead of
+// the network, so hashing never holds up an upload.
+static void ReadFileParts(const std::wstring& filePath, int64_t size, PartQueue* queue) {
+    FILE* fp = OpenFile(filePath, "rb");
+    if (!fp) {
+        queue->Fail();
+        return;
+    }
+    const int64_t partBytes = PartBytes(size);
+    int number = 0;
+    for (int64_t offset = 0; offset < size && !queue->Failed(); offset += partBytes) {
+        QueuedPart part;
+        part.number = ++number;
+        part.data.resize((size_t)std::min(partBytes, size - offset));
+        Sha1 sha;
+        for (size_t done = 0; done < part.data.size();) {
+            size_t len = std::min(kReadChunkBytes, part.data.size() - done);
+            if (fread(part.data.data() + done, 1, len, fp) != len) {
+                fclose(fp);
+                queue->Fail();
+                return;
+            }
+            sha.Update(part.data.data() + done, len);
+            done += len;
+        }
+        part.sha1 = sha.FinalHex();
+        if (!queue->Push(std::move(part)))
+            break;
+    }
+    fclose(fp);
+    queue->Close(false);
+}
+
+// Sends an existing file with UploadThreads() parts in flight.
+static bool UploadLargeFile(CURL* curl, B2LargeFile& lf, const std::wstring& filePath,
+                            int64_t size, std::atomic<int>* percent) {
+    if (!StartLargeFile(curl, lf))
+        return false;
+
+    const int64_t partBytes = PartBytes(size);
+    const int parts = (int)((size + partBytes - 1) / partBytes);
+    const int threadCount = std::min(UploadThreads(), parts);
+    lf.partSha1.resize(parts);
+    PartQueue queue((size_t)threadCount);
+    std::atomic<int> running{ threadCount };
+
+    std::thread reader(ReadFileParts, filePath, size, &queue);
+    std::vector<std::thread> senders;
+    for (int i = 0; i < threadCount; ++i)
+        senders.emplace_back([&]() {
+            SendQueuedParts(&lf, &queue);
+            --running;
+        });
+    while (running > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (percent)
+            *percent = (int)(lf.sentBytes * 100 / size);
+    }
+    // A reader blocked on a full queue is released by Fail().
+    if (!queue.Completed())
+        queue.Fail();
+    reader.join();
+    for (auto& t : senders)
+        t.join();
+
+    if (!queue.Failed() && !lf.Cancelled() && FinishLargeFile(curl, lf))
+        return true;
+    CancelLargeFile(curl, lf);
+    return false;
+}
+
+// Feeds a single-request upload from the file and appends the hex SHA-1
+// after the last byte ("hex_digits_at_end"), so the upload is verified
+// without reading the file twice.
+struct HashingReader {
+    FILE* fp = nullptr;
+    Sha1 sha;
+    std::string trailer;
+    size_t trailerSent = 0;
+    bool atEnd = false;
+};
+
+static size_t ReadHashing(char* buf, size_t size, size_t nitems, void* userdata) {
+    HashingReader* r = static_cast<HashingReader*>(userdata);
+    size_t room = size * nitems;
+    if (!r->atEnd) {
+        size_t n = fread(buf, 1, room, r->fp);
+        if (n > 0) {
+            r->sha.Update(buf, n);
+            return n;
+        }
+        if (ferror(r->fp))
+            return CURL_READFUNC_ABORT;
+        r->atEnd = true;
+        r->trailer = r->sha.FinalHex();
+    }
+    size_t n = std::min(room, r->trailer.size() - r->trailerSent);
+    memcpy(buf, r->trailer.data() + r->trailerSent, n);
+    r->trailerSent += n;
+    return n;
+}
+
+static bool TakeUploadUrl(CURL* curl, const B2Account& account, B2UploadUrl& out) {
+    out.bucketId = ToUtf8(g_b2BucketId);
+    {
+        std::lock_guard<std::mutex> lock(g_authMutex);
+        for (size_t i = g_uploadUrls.size(); i-- > 0;) {
+            if (g_uploadUrls[i].bucketId == out.bucketId) {
+                out = g_uploadUrls[i];
+                g_uploadUrls.erase(g_uploadUrls.begin() + i);
+                return true;
+            }
+        }
+    }
+    std::string response;
+    std::string postData = "{\"bucketId\":" + JsonString(out.bucketId) + "}";
+    return PostJson(curl, account, "b2_get_upload_url", postData, response) &&
+           ExtractJson(response, "uploadUrl", out.url) &&
+           ExtractJson(response, "authorizationToken", out.auth);
+}
+
+static void ReturnUploadUrl(const B2UploadUrl& uploadUrl) {
+    std::lock_guard<std::mutex> lock(g_authMutex);
+    g_uploadUrls.push_back(uploadUrl);
+}
+
+bool UploadToB2(const std::wstring& filePath, std::string& outUrl, std::atomic<int>* percent) {
+    if (!B2Configured())
+        return false;
+
+    std::error_code ec;
+    int64_t fsz = (int64_t)std::filesystem::file_size(std::filesystem::path(filePath), ec);
+    if (ec) return false;
+
+    CURL* curl = curl_easy_init();
+    if (!curl) return false;
+
+    B2Account account;
+    if (!CachedAuthorize(curl, account)) {
+        curl_easy_cleanup(curl);
+        return false;
+    }
 
     std::wstring wname = filePath.substr(filePath.find_last_of(L"/\\") + 1);
-    std::string name = Narrow(wname);
+    std::string name = ToUtf8(wname);
+
+    if (fsz > PartBytes()) {
+        B2LargeFile lf;
+        lf.account = account;
+        lf.name = name;
+        bool ok = UploadLargeFile(curl, lf, filePath, fsz, percent);
+        if (ok)
+            outUrl = PublicUrl(account.downloadUrl, name);
+        curl_easy_cleanup(curl);
+        return ok;
+    }
+
+    B2UploadUrl uploadUrl;
+    if (!TakeUploadUrl(curl, account, uploadUrl)) {
+        curl_easy_cleanup(curl);
+        return false;
+    }
+
+    HashingReader reader;
+    reader.fp = OpenFile(filePath, "rb");
+    if (!reader.fp) { curl_easy_cleanup(curl); return false; }
+
     char* esc = curl_easy_escape(curl, name.c_str(), 0);
 
-    hdrs = nullptr;
-    hdrs = curl_slist_append(hdrs, ("Authorization: " + uploadAuth).c_str());
+    curl_easy_reset(curl);
+    struct curl_slist* hdrs = nullptr;
+    hdrs = curl_slist_append(hdrs, ("Authorization: " + uploadUrl.auth).c_str());
     hdrs = curl_slist_append(hdrs, (std::string("X-Bz-File-Name: ") + esc).c_str());
     hdrs = curl_slist_append(hdrs, "Content-Type: b2/x-auto");
-    hdrs = curl_slist_append(hdrs, "X-Bz-Content-Sha1: do_not_verify");
+    hdrs = curl_slist_append(hdrs, "X-Bz-Content-Sha1: hex_digits_at_end");
 
-    curl_easy_setopt(curl, CURLOPT_URL, uploadUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_URL, uploadUrl.url.c_str());
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
     curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
     curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-    curl_easy_setopt(curl, CURLOPT_READDATA, fp);
-    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)fsz);
-    if (progressBar) {
-        SendMessage(progressBar, PBM_SETPOS, 0, 0);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadHashing);
+    curl_easy_setopt(curl, CURLOPT_READDATA, &reader);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(fsz + kSha1HexLength));
+    if (percent) {
+        *percent = 0;
         curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCB);
-        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, progressBar);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, percent);
         curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
     }
-    response.clear();
+    std::string response;
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCB);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    res = curl_easy_perform(curl);
+    bool ok = PerformOk(curl);
     curl_slist_free_all(hdrs);
     curl_free(esc);
-    fclose(fp);
-    if (res != CURLE_OK) { curl_easy_cleanup(curl); return false; }
+    fclose(reader.fp);
+    if (!ok) {
+        // The URL may be what failed; it is dropped rather than returned.
+        LOG_ERROR("B2 upload failed: " << response);
+        curl_easy_cleanup(curl);
+        return false;
+    }
+    ReturnUploadUrl(uploadUrl);
 
-    if (!g_b2CustomUrl.empty()) {
-        std::string base = Narrow(g_b2CustomUrl);
-        if (base.back() != '/' && base.back() != '\\') base += '/';
-        outUrl = base + name;
+    outUrl = PublicUrl(account.downloadUrl, name);
+    curl_easy_cleanup(curl);
+    return true;
+}
+
+// Shared between the export thread and the upload threads.
+struct B2StreamState {
+    B2LargeFile file;
+    PartQueue queue;
+    std::atomic<int64_t> queuedBytes{ 0 };
+
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;                  // upload threads have exited
+    bool succeeded = false;
+
+    explicit B2StreamState(size_t capacity) : queue(capacity) {}
+};
+
+// Coordinating thread: opens the large file, runs UploadThreads() senders
+// until the queue is closed and drained, then finishes or cancels the file.
+static void RunStreamUpload(B2StreamState* st) {
+    CURL* curl = curl_easy_init();
+    bool ok = curl && B2Configured() && CachedAuthorize(curl, st->file.account) &&
+              StartLargeFile(curl, st->file);
+    if (ok) {
+        std::vector<std::thread> senders;
+        for (int i = 0; i < UploadThreads(); ++i)
+            senders.emplace_back(SendQueuedParts, &st->file, &st->queue);
+        for (auto& t : senders)
+            t.join();
     } else {
-        outUrl = downloadUrl + "/file/" + Narrow(g_b2BucketName) + "/" + name;
+        st->queue.Fail();
     }
-    curl_easy_cleanup(curl);
+
+    bool complete = st->queue.Completed() && !st->file.Cancelled();
+    if (complete)
+        complete = FinishLargeFile(curl, st->file);
+    else if (curl && !st->file.fileId.empty())
+        CancelLargeFile(curl, st->file);
+    if (!complete)
+        st->queue.Fail();
+    if (curl)
+        curl_easy_cleanup(curl);
+
+    {
+        std::lock_guard<std::mutex> lock(st->mutex);
+        st->succeeded = complete;
+        st->finished = true;
+    }
+    st->done.notify_all();
+}
+
+B2StreamUpload::B2StreamUpload(const std::wstring& filePath, std::atomic<bool>* cancelFlag)
+    // Keep every sender busy with one part in reserve.
+    : m_state(std::make_unique<B2StreamState>((size_t)UploadThreads() + 1)),
+      m_sha(std::make_unique<Sha1>()), m_partBytes((size_t)PartBytes())
+{
+    m_state->file.name = ToUtf8(filePath.substr(filePath.find_last_of(L"/\\") + 1));
+    m_state->file.cancelFlag = cancelFlag;
+}
+
+B2StreamUpload::~B2StreamUpload()
+{
+    if (!m_worker.joinable())
+        return;
+    m_state->queue.Close(true);
+    m_worker.join();
+}
+
+bool B2StreamUpload::Write(const uint8_t* data, size_t size)
+{
+    if (m_state->queue.Failed())
+        return false;
+    while (size > 0) {
+        // A full part is only queued once more data follows, so the last
+        // part is never empty and a started file always has two parts.
+        if (m_current.size() == m_partBytes && !QueuePart())
+            return false;
+        if (m_current.capacity() < m_partBytes)
+            m_current.reserve(m_partBytes);
+        size_t take = std::min(size, m_partBytes - m_current.size());
+        m_current.insert(m_current.end(), data, data + take);
+        // Hashed here while the bytes are still in cache.
+        m_sha->Update(data, take);
+        data += take;
+        size -= take;
+    }
+    return true;
+}
+
+bool B2StreamUpload::QueuePart()
+{
+    if (!m_worker.joinable())
+        m_worker = std::thread(RunStreamUpload, m_state.get());
+    QueuedPart part;
+    part.number = ++m_partCount;
+    part.sha1 = m_sha->FinalHex();
+    m_sha->Reset();
+    part.data = std::move(m_current);
+    m_current = std::vector<uint8_t>();
+    int64_t bytes = (int64_t)part.data.size();
+    if (!m_state->queue.Push(std::move(part)))
+        return false;
+    m_state->queuedBytes += bytes;
+    return true;
+}
+
+bool B2StreamUpload::Finish(bool exportOk, std::string& outUrl, const std::function<void(int)>& progress)
+{
+    if (!m_worker.joinable())
+        return false;
+    B2StreamState& st = *m_state;
+    if (exportOk && !st.queue.Failed())
+        QueuePart();
+    st.queue.Close(!exportOk);
+
+    // The bar now tracks whatever the export got ahead of the network by.
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(st.mutex);
+            if (st.done.wait_for(lock, std::chrono::milliseconds(200), [&st] { return st.finished; }))
+                break;
+        }
+        int64_t total = st.queuedBytes;
+        if (progress && total > 0) {
+            int pct = (int)(st.file.sentBytes * 100 / total);
+            progress(std::min(pct, 100));
+        }
+    }
+    m_worker.join();
+
+    if (!st.succeeded) {
+        LOG_ERROR("Streamed B2 upload did not complete");
+        return false;
+    }
+    outUrl = PublicUrl(st.file.account.downloadUrl, st.file.name);
     return true;
 }
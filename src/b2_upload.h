@@ -1,5 +1,44 @@
 #pragma once
 #include <string>
-#include <windows.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "output_sink.h"
 
-bool UploadToB2(const std::wstring& filePath, std::string& outUrl, HWND progressBar = nullptr);
+// Files larger than one part (g_b2PartSizeMB) are sent as a large file
+// with g_b2UploadThreads parts in flight; smaller ones in a single request.
+// `percent` receives the upload progress.
+bool UploadToB2(const std::wstring& filePath, std::string& outUrl, std::atomic<int>* percent = nullptr);
+
+struct B2StreamState;
+class Sha1;
+
+// Uploads an export to B2 while it is still being written. Full parts go
+// out through the large-file API on g_b2UploadThreads threads and Write
+// blocks while too many are waiting, so memory stays bounded. Nothing is
+// sent until the output outgrows one part, leaving short clips to UploadToB2.
+class B2StreamUpload : public OutputSink {
+public:
+    B2StreamUpload(const std::wstring& filePath, std::atomic<bool>* cancelFlag);
+    ~B2StreamUpload() override;
+
+    bool Write(const uint8_t* data, size_t size) override;
+
+    // Sends the last part and finishes the file, or cancels it when the
+    // export failed. Returns false if nothing was streamed or a part could
+    // not be sent; the finished file then has to be uploaded with UploadToB2.
+    // `progress` receives the percentage of the file sent so far.
+    bool Finish(bool exportOk, std::string& outUrl, const std::function<void(int)>& progress);
+
+private:
+    bool QueuePart();
+
+    std::unique_ptr<B2StreamState> m_state;
+    std::vector<uint8_t> m_current;     // part being filled by the export
+    std::unique_ptr<Sha1> m_sha;        // hash of m_current so far
+    size_t m_partBytes;
+    int m_partCount = 0;
+    std::thread m_worker;
+};
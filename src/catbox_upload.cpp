@@ -1,8 +1,10 @@
 #include "catbox_upload.h"
-#include "options_window.h"
+#include "engine_settings.h"
+#include "platform.h"
 #include "debug_log.h"
+#include "upload_manager.h"
 #include <curl/curl.h>
-#include <commctrl.h>
+#include <cstdlib>
 #include <string>
 #include <sstream>
 
@@ -14,11 +16,9 @@ static size_t WriteCB(char* ptr, size_t size, size_t nmemb, void* userdata) {
 
 static int ProgressCB(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
                       curl_off_t ultotal, curl_off_t ulnow) {
-    HWND bar = reinterpret_cast<HWND>(clientp);
-    if (bar && ultotal > 0) {
-        int pct = static_cast<int>((double)ulnow / ultotal * 100.0);
-        SendMessage(bar, PBM_SETPOS, pct, 0);
-    }
+    std::atomic<int>* percent = static_cast<std::atomic<int>*>(clientp);
+    if (percent && ultotal > 0)
+        *percent = static_cast<int>((double)ulnow / ultotal * 100.0);
     return 0;
 }
 
@@ -33,37 +33,28 @@ static std::wstring Trim(const std::wstring& in)
     return in.substr(start, end - start);
 }
 
-static std::string Narrow(const std::wstring& w) {
-    int sz = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, nullptr, 0, nullptr,
- nullptr);
-    std::string s(sz - 1, 0);
-    WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, s.data(), sz, nullptr, nullptr);
-    return s;
+// VIDEOEDITOR_CATBOX_URL points the uploader at a local stand-in server.
+static std::string ApiUrl() {
+    const char* env = getenv("VIDEOEDITOR_CATBOX_URL");
+    return env && *env ? env : "https://catbox.moe/user/api.php";
 }
 
-bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, HWND progressBar) {
-    std::string path = Narrow(filePath);
+bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, std::atomic<int>* percent) {
+    std::string path = ToUtf8(filePath);
     std::wstring trimmedHash = Trim(g_catboxUserHash);
 
-    {
-        std::ostringstream oss;
-        oss << "UploadToCatbox start path=" << path;
-        if (!trimmedHash.empty())
-            oss << " userhash=" << Narrow(trimmedHash);
-        else
-            oss << " anonymous";
-        DebugLog(oss.str());
-    }
+    LOG_INFO("UploadToCatbox start path=" << path
+             << (trimmedHash.empty() ? " anonymous" : " userhash=" + ToUtf8(trimmedHash)));
 
     CURL* curl = curl_easy_init();
     if (!curl) {
-        DebugLog("curl_easy_init failed", true);
+        LOG_ERROR("curl_easy_init failed");
         return false;
     }
 
     curl_mime* mime = curl_mime_init(curl);
     if (!mime) { 
-        DebugLog("curl_mime_init failed", true);
+        LOG_ERROR("curl_mime_init failed");
         curl_easy_cleanup(curl); 
         return false; 
     }
@@ -75,7 +66,7 @@ bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, HWND prog
     if (!trimmedHash.empty()) {
         part = curl_mime_addpart(mime);
         curl_mime_name(part, "userhash");
-        std::string hash = Narrow(trimmedHash);
+        std::string hash = ToUtf8(trimmedHash);
         curl_mime_data(part, hash.c_str(), CURL_ZERO_TERMINATED);
     }
     part = curl_mime_addpart(mime);
@@ -83,30 +74,29 @@ bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, HWND prog
     curl_mime_filedata(part, path.c_str());
 
     std::string response;
-    curl_easy_setopt(curl, CURLOPT_URL, "https://catbox.moe/user/api.php");
+    std::string apiUrl = ApiUrl();
+    curl_easy_setopt(curl, CURLOPT_URL, apiUrl.c_str());
     curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "VideoEditor/1.0");
     curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCB);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    if (progressBar) {
-        SendMessage(progressBar, PBM_SETPOS, 0, 0);
+    if (percent) {
+        *percent = 0;
         curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCB);
-        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, progressBar);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, percent);
         curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
     }
 
     long httpCode = 0;
-    CURLcode res = curl_easy_perform(curl);
+    CURLcode res = UploadManager::Get().Perform(curl);
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
-    {
-        std::ostringstream oss;
-        oss << "curl result=" << curl_easy_strerror(res) << " HTTP=" << httpCode;
-        DebugLog(oss.str());
-    }
+    LOG_INFO("curl result=" << curl_easy_strerror(res) << " HTTP=" << httpCode);
     curl_mime_free(mime);
     if (res != CURLE_OK || httpCode != 200) {
-        DebugLog("Catbox upload failed: " + response, true);
+        // No popups here: this runs on an upload manager thread, which
+        // retries before the caller reports the result.
+        LOG_ERROR("Catbox upload failed: " << response);
         curl_easy_cleanup(curl);
         return false;
     }
@@ -116,9 +106,12 @@ bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, HWND prog
            (response.back() == '\n' || response.back() == '\r' || response.back() == ' '))
         response.pop_back();
     outUrl = response;
-    DebugLog("Catbox response: " + outUrl);
+    LOG_INFO("Catbox response: " << outUrl);
     curl_easy_cleanup(curl);
     bool ok = !outUrl.empty() && outUrl.rfind("http", 0) == 0;
-    DebugLog(ok ? "Catbox upload succeeded" : "Catbox returned invalid URL", true);
+    if (ok)
+        LOG_INFO("Catbox upload succeeded");
+    else
+        LOG_ERROR("Catbox returned invalid URL");
     return ok;
 }
@@ -1,5 +1,6 @@
 #pragma once
+#include <atomic>
 #include <string>
-#include <windows.h>
 
-bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, HWND progressBar = nullptr);
+// `percent` receives the upload progress; see UploadManager for the bar.
+bool UploadToCatbox(const std::wstring& filePath, std::string& outUrl, std::atomic<int>* percent = nullptr);
@@ -0,0 +1,662 @@
+#include "cli_job.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+
+namespace fs = std::filesystem;
+
+// Just enough JSON for job files: objects, arrays, strings, numbers, bools.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    const JsonValue* Find(const char* key) const
+    {
+        auto it = object.find(key);
+        return type == Type::Object && it != object.end() ? &it->second : nullptr;
+    }
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : m_text(text) {}
+
+    bool Parse(JsonValue& out, std::string& error)
+    {
+        bool ok = Value(out, 0);
+        SkipSpace();
+        if (ok && m_pos != m_text.size())
+            ok = Fail("trailing characters");
+        if (!ok)
+            error = m_error + " at offset " + std::to_string(m_pos);
+        return ok;
+    }
+
+private:
+    bool Fail(const char* what)
+    {
+        if (m_error.empty())
+            m_error = what;
+        return false;
+    }
+
+    void SkipSpace()
+    {
+        while (m_pos < m_text.size() && strchr(" \t\r\n", m_text[m_pos]))
+            ++m_pos;
+    }
+
+    bool Literal(const char* word)
+    {
+        size_t len = strlen(word);
+        if (m_text.compare(m_pos, len, word) != 0)
+            return Fail("unexpected token");
+        m_pos += len;
+        return true;
+    }
+
+    bool Value(JsonValue& v, int depth)
+    {
+        if (depth > 64)
+            return Fail("nested too deeply");
+        SkipSpace();
+        if (m_pos >= m_text.size())
+            return Fail("unexpected end");
+        char c = m_text[m_pos];
+        if (c == '{')
+            return Object(v, depth);
+        if (c == '[')
+            return Array(v, depth);
+        if (c == '"') {
+            v.type = JsonValue::Type::String;
+            return String(v.string);
+        }
+        if (c == 't' || c == 'f') {
+            v.type = JsonValue::Type::Bool;
+            v.boolean = c == 't';
+            return Literal(v.boolean ? "true" : "false");
+        }
+        if (c == 'n') {
+            v.type = JsonValue::Type::Null;
+            return Literal("null");
+        }
+        const char* start = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        v.type = JsonValue::Type::Number;
+        v.number = strtod(start, &end);
+        if (end == start)
+            return Fail("unexpected token");
+        m_pos += end - start;
+        return true;
+    }
+
+    bool Object(JsonValue& v, int depth)
+    {
+        v.type = JsonValue::Type::Object;
+        ++m_pos;
+        SkipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == '}') {
+            ++m_pos;
+            return true;
+        }
+        for (;;) {
+            SkipSpace();
+            std::string key;
+            if (m_pos >= m_text.size() || m_text[m_pos] != '"' || !String(key))
+                return Fail("expected a key");
+            SkipSpace();
+            if (m_pos >= m_text.size() || m_text[m_pos] != ':')
+                return Fail("expected ':'");
+            ++m_pos;
+            if (!Value(v.object[key], depth + 1))
+                return false;
+            SkipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == ',') {
+                ++m_pos;
+                continue;
+            }
+            if (m_pos < m_text.size() && m_text[m_pos] == '}') {
+                ++m_pos;
+                return true;
+            }
+            return Fail("expected ',' or '}'");
+        }
+    }
+
+    bool Array(JsonValue& v, int depth)
+    {
+        v.type = JsonValue::Type::Array;
+        ++m_pos;
+        SkipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == ']') {
+            ++m_pos;
+            return true;
+        }
+        for (;;) {
+            v.array.emplace_back();
+            if (!Value(v.array.back(), depth + 1))
+                return false;
+            SkipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == ',') {
+                ++m_pos;
+                continue;
+            }
+            if (m_pos < m_text.size() && m_text[m_pos] == ']') {
+                ++m_pos;
+                return true;
+            }
+            return Fail("expected ',' or ']'");
+        }
+    }
+
+    static void AppendUtf8(std::string& s, uint32_t c)
+    {
+        if (c < 0x80) {
+            s += (char)c;
+        } else if (c < 0x800) {
+            s += (char)(0xC0 | (c >> 6));
+            s += (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            s += (char)(0xE0 | (c >> 12));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        } else {
+            s += (char)(0xF0 | (c >> 18));
+            s += (char)(0x80 | ((c >> 12) & 0x3F));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+    }
+
+    bool Hex4(uint32_t& c)
+    {
+        if (m_pos + 4 > m_text.size())
+            return Fail("bad \\u escape");
+        c = 0;
+        for (int i = 0; i < 4; ++i) {
+            char h = m_text[m_pos++];
+            c <<= 4;
+            if (h >= '0' && h <= '9') c |= h - '0';
+            else if (h >= 'a' && h <= 'f') c |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F') c |= h - 'A' + 10;
+            else return Fail("bad \\u escape");
+        }
+        return true;
+    }
+
+    bool String(std::string& s)
+    {
+        ++m_pos;
+        while (m_pos < m_text.size()) {
+            char c = m_text[m_pos++];
+            if (c == '"')
+                return true;
+            if (c != '\\') {
+                s += c;
+                continue;
+            }
+            if (m_pos >= m_text.size())
+                break;
+            char e = m_text[m_pos++];
+            switch (e) {
+            case 'n': s += '\n'; break;
+            case 't': s += '\t'; break;
+            case 'r': s += '\r'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'u': {
+                uint32_t c1;
+                if (!Hex4(c1))
+                    return false;
+                // Surrogate pair
+                if (c1 >= 0xD800 && c1 < 0xDC00 && m_text.compare(m_pos, 2, "\\u") == 0) {
+                    uint32_t c2;
+                    m_pos += 2;
+                    if (!Hex4(c2))
+                        return false;
+                    c1 = 0x10000 + ((c1 - 0xD800) << 10) + (c2 - 0xDC00);
+                }
+                AppendUtf8(s, c1);
+                break;
+            }
+            default: s += e; break;
+            }
+        }
+        return Fail("unterminated string");
+    }
+
+    const std::string& m_text;
+    size_t m_pos = 0;
+    std::string m_error;
+};
+
+bool ParseTimecode(const std::string& text, double& seconds)
+{
+    if (text.empty())
+        return false;
+    double total = 0.0;
+    size_t pos = 0;
+    int fields = 0;
+    for (;;) {
+        const char* start = text.c_str() + pos;
+        char* end = nullptr;
+        double v = strtod(start, &end);
+        if (end == start || v < 0.0)
+            return false;
+        total = total * 60.0 + v;
+        pos += end - start;
+        ++fields;
+        if (pos == text.size())
+            break;
+        if (text[pos] != ':' || fields == 3)
+            return false;
+        ++pos;
+    }
+    seconds = total;
+    return true;
+}
+
+// "start-end" with either side a timecode; an empty end runs to the end.
+static bool ParseRange(const std::string& text, CliRange& range)
+{
+    size_t dash = text.find('-');
+    if (dash == std::string::npos)
+        return false;
+    std::string end = text.substr(dash + 1);
+    if (!ParseTimecode(text.substr(0, dash), range.startTime))
+        return false;
+    range.endTime = -1.0;
+    if (!end.empty() && !ParseTimecode(end, range.endTime))
+        return false;
+    return range.endTime < 0.0 || range.endTime > range.startTime;
+}
+
+static bool ParseTrackList(const std::string& text, CliJob& job)
+{
+    job.tracks.clear();
+    job.allTracks = text == "all";
+    if (job.allTracks || text == "none")
+        return true;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        char* end = nullptr;
+        long idx = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end || idx < 0)
+            return false;
+        job.tracks.push_back((int)idx);
+        if (comma == std::string::npos)
+            break;
+        pos = comma + 1;
+    }
+    return true;
+}
+
+static bool ParseCount(const char* text, int minValue, int& out)
+{
+    char* end = nullptr;
+    long v = strtol(text, &end, 10);
+    if (!*text || *end || v < minValue || v > 1000000)
+        return false;
+    out = (int)v;
+    return true;
+}
+
+static void ReadEnv(const char* name, std::wstring& out)
+{
+    const char* v = getenv(name);
+    if (v && *v)
+        out = FromUtf8(v);
+}
+
+// Credentials can stay out of job files and shell history.
+static void ApplyEnvironment()
+{
+    ReadEnv("VIDEOEDITOR_B2_KEY_ID", g_b2KeyId);
+    ReadEnv("VIDEOEDITOR_B2_APP_KEY", g_b2AppKey);
+    ReadEnv("VIDEOEDITOR_B2_BUCKET_ID", g_b2BucketId);
+    ReadEnv("VIDEOEDITOR_B2_BUCKET_NAME", g_b2BucketName);
+    ReadEnv("VIDEOEDITOR_B2_URL", g_b2CustomUrl);
+    ReadEnv("VIDEOEDITOR_CATBOX_USERHASH", g_catboxUserHash);
+}
+
+static bool JsonTime(const JsonValue& v, double& seconds)
+{
+    if (v.type == JsonValue::Type::Number) {
+        seconds = v.number;
+        return seconds >= 0.0;
+    }
+    return v.type == JsonValue::Type::String && ParseTimecode(v.string, seconds);
+}
+
+static bool JsonRange(const JsonValue& v, CliRange& range)
+{
+    if (v.type == JsonValue::Type::String)
+        return ParseRange(v.string, range);
+    const JsonValue* start = nullptr;
+    const JsonValue* end = nullptr;
+    if (v.type == JsonValue::Type::Array && (v.array.size() == 1 || v.array.size() == 2)) {
+        start = &v.array[0];
+        end = v.array.size() == 2 ? &v.array[1] : nullptr;
+    } else if (v.type == JsonValue::Type::Object) {
+        start = v.Find("start");
+        end = v.Find("end");
+    }
+    range = CliRange();
+    if (start && !JsonTime(*start, range.startTime))
+        return false;
+    if (end && end->type != JsonValue::Type::Null && !JsonTime(*end, range.endTime))
+        return false;
+    return range.endTime < 0.0 || range.endTime > range.startTime;
+}
+
+// Relative paths in a job file are taken from the file's directory.
+static std::wstring JobPath(const fs::path& base, const std::string& value)
+{
+    fs::path p(FromUtf8(value));
+    return (p.is_absolute() ? p : base / p).wstring();
+}
+
+static bool ApplyJson(const JsonValue& root, const fs::path& base, CliJob& job, std::string& error)
+{
+    if (root.type != JsonValue::Type::Object) {
+        error = "job file must hold a JSON object";
+        return false;
+    }
+    for (const auto& item : root.object) {
+        const std::string& key = item.first;
+        const JsonValue& v = item.second;
+        bool isStr = v.type == JsonValue::Type::String;
+        bool isNum = v.type == JsonValue::Type::Number;
+        bool isBool = v.type == JsonValue::Type::Bool;
+        bool ok = true;
+        if (key == "input" && isStr) {
+            job.inputs.push_back(JobPath(base, v.string));
+        } else if (key == "inputs" && v.type == JsonValue::Type::Array) {
+            for (const auto& in : v.array) {
+                ok = ok && in.type == JsonValue::Type::String;
+                if (ok)
+                    job.inputs.push_back(JobPath(base, in.string));
+            }
+        } else if (key == "output" && isStr) {
+            job.output = JobPath(base, v.string);
+        } else if (key == "output_dir" && isStr) {
+            job.outputDir = JobPath(base, v.string);
+        } else if (key == "format" && isStr) {
+            job.format = v.string;
+        } else if (key == "ranges" && v.type == JsonValue::Type::Array) {
+            job.ranges.clear();
+            for (const auto& r : v.array) {
+                CliRange range;
+                ok = ok && JsonRange(r, range);
+                job.ranges.push_back(range);
+            }
+        } else if (key == "tracks" && isStr) {
+            ok = ParseTrackList(v.string, job);
+        } else if (key == "tracks" && v.type == JsonValue::Type::Array) {
+            job.tracks.clear();
+            job.allTracks = false;
+            for (const auto& t : v.array) {
+                ok = ok && t.type == JsonValue::Type::Number && t.number >= 0;
+                job.tracks.push_back((int)t.number);
+            }
+        } else if (key == "merge_audio" && isBool) {
+            job.options.mergeAudio = v.boolean;
+        } else if (key == "video" && isStr) {
+            ok = v.string == "copy" || v.string == "h264";
+            job.options.convertH264 = v.string == "h264";
+        } else if (key == "nvenc" && isBool) {
+            job.options.useNvenc = v.boolean;
+        } else if (key == "bitrate" && isNum) {
+            job.options.maxBitrate = (int)v.number;
+        } else if (key == "target_size_mb" && isNum) {
+            job.options.targetSizeMB = (int)v.number;
+        } else if (key == "fast_first_pass" && isBool) {
+            job.options.fastFirstPass = v.boolean;
+        } else if (key == "upload" && isStr) {
+            ok = v.string.empty() || v.string == "b2" || v.string == "catbox";
+            job.upload = v.string;
+        } else if (key == "upload_limit_kbps" && isNum) {
+            g_uploadLimitKBps = (int)v.number;
+        } else if (key == "b2" && v.type == JsonValue::Type::Object) {
+            const struct { const char* name; std::wstring* target; } fields[] = {
+                { "key_id", &g_b2KeyId }, { "app_key", &g_b2AppKey },
+                { "bucket_id", &g_b2BucketId }, { "bucket_name", &g_b2BucketName },
+                { "url", &g_b2CustomUrl },
+            };
+            for (const auto& f : fields) {
+                if (const JsonValue* s = v.Find(f.name))
+                    *f.target = FromUtf8(s->string);
+            }
+            if (const JsonValue* n = v.Find("part_size_mb"))
+                g_b2PartSizeMB = (int)n->number;
+            if (const JsonValue* n = v.Find("threads"))
+                g_b2UploadThreads = (int)n->number;
+        } else if (key == "catbox" && v.type == JsonValue::Type::Object) {
+            if (const JsonValue* s = v.Find("userhash"))
+                g_catboxUserHash = FromUtf8(s->string);
+        } else if (key == "parallel" && isNum) {
+            ok = v.number >= 1;
+            job.parallel = (int)v.number;
+        } else if (key == "recursive" && isBool) {
+            job.recursive = v.boolean;
+        } else if (key == "overwrite" && isBool) {
+            job.overwrite = v.boolean;
+        } else if (key == "cache_mb" && isNum) {
+            g_exportCacheMB = (int)v.number;
+        } else if (key == "verbose" && isBool) {
+            job.verbose = v.boolean;
+        } else if (key == "trace" && isStr) {
+            job.traceFile = JobPath(base, v.string);
+        } else {
+            error = "unknown or mistyped job file key \"" + key + "\"";
+            return false;
+        }
+        if (!ok) {
+            error = "bad value for job file key \"" + key + "\"";
+            return false;
+        }
+    }
+    if (job.options.targetSizeMB > 0)
+        job.options.convertH264 = true;
+    return true;
+}
+
+bool LoadCliJobFile(const std::wstring& path, CliJob& job, std::string& error)
+{
+    FILE* fp = OpenFile(path, "rb");
+    if (!fp) {
+        error = "could not open job file " + ToUtf8(path);
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        text.append(buf, n);
+    fclose(fp);
+
+    JsonValue root;
+    JsonReader reader(text);
+    if (!reader.Parse(root, error)) {
+        error = ToUtf8(path) + ": " + error;
+        return false;
+    }
+    return ApplyJson(root, fs::path(path).parent_path(), job, error);
+}
+
+static bool TakesValue(const std::string& arg)
+{
+    static const char* options[] = {
+        "--job", "-o", "--output", "--output-dir", "--format", "--range", "--start", "--end",
+        "--tracks", "--bitrate", "--target-size", "--upload", "--upload-limit", "-j",
+        "--parallel", "--cache-mb", "--trace",
+    };
+    for (const char* o : options) {
+        if (arg == o)
+            return true;
+    }
+    return false;
+}
+
+bool ParseCliArgs(int argc, char** argv, CliJob& job, std::string& error)
+{
+    ApplyEnvironment();
+    if (argc < 2) {
+        error.clear();
+        return false;
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool takesValue = true;
+        bool ok = true;
+        if (arg == "--merge-audio") {
+            job.options.mergeAudio = true;
+            takesValue = false;
+        } else if (arg == "--copy") {
+            job.options.convertH264 = false;
+            takesValue = false;
+        } else if (arg == "--h264") {
+            job.options.convertH264 = true;
+            takesValue = false;
+        } else if (arg == "--nvenc") {
+            job.options.useNvenc = true;
+            takesValue = false;
+        } else if (arg == "--fast-first-pass") {
+            job.options.fastFirstPass = true;
+            takesValue = false;
+        } else if (arg == "--recursive") {
+            job.recursive = true;
+            takesValue = false;
+        } else if (arg == "--overwrite") {
+            job.overwrite = true;
+            takesValue = false;
+        } else if (arg == "--verbose") {
+            job.verbose = true;
+            takesValue = false;
+        } else if (arg == "--help" || arg == "-h") {
+            error.clear();
+            return false;
+        } else if (TakesValue(arg) && !next) {
+            error = "missing value for " + arg;
+            return false;
+        } else if (arg == "--job") {
+            if (!LoadCliJobFile(FromUtf8(next), job, error))
+                return false;
+        } else if (arg == "-o" || arg == "--output") {
+            job.output = FromUtf8(next);
+        } else if (arg == "--output-dir") {
+            job.outputDir = FromUtf8(next);
+        } else if (arg == "--format") {
+            job.format = next;
+        } else if (arg == "--range") {
+            CliRange range;
+            ok = ParseRange(next, range);
+            job.ranges.push_back(range);
+        } else if (arg == "--start" || arg == "--end") {
+            // Shorthand for a single range; changes the last one if given.
+            if (job.ranges.empty())
+                job.ranges.push_back(CliRange());
+            CliRange& range = job.ranges.back();
+            ok = ParseTimecode(next, arg == "--start" ? range.startTime : range.endTime);
+        } else if (arg == "--tracks") {
+            ok = ParseTrackList(next, job);
+        } else if (arg == "--bitrate") {
+            ok = ParseCount(next, 0, job.options.maxBitrate);
+        } else if (arg == "--target-size") {
+            ok = ParseCount(next, 0, job.options.targetSizeMB);
+            job.options.convertH264 = job.options.convertH264 || job.options.targetSizeMB > 0;
+        } else if (arg == "--upload") {
+            job.upload = next;
+            ok = job.upload == "b2" || job.upload == "catbox" || job.upload == "none";
+            if (job.upload == "none")
+                job.upload.clear();
+        } else if (arg == "--upload-limit") {
+            ok = ParseCount(next, 0, g_uploadLimitKBps);
+        } else if (arg == "-j" || arg == "--parallel") {
+            ok = ParseCount(next, 1, job.parallel);
+        } else if (arg == "--cache-mb") {
+            ok = ParseCount(next, 0, g_exportCacheMB);
+        } else if (arg == "--trace") {
+            job.traceFile = FromUtf8(next);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            error = "unknown option " + arg;
+            return false;
+        } else {
+            job.inputs.push_back(FromUtf8(arg));
+            takesValue = false;
+        }
+        if (!ok) {
+            error = "bad value for " + arg + ": " + next;
+            return false;
+        }
+        if (takesValue)
+            ++i;
+    }
+
+    for (const auto& range : job.ranges) {
+        if (range.endTime >= 0.0 && range.endTime <= range.startTime) {
+            error = "range end must be after its start";
+            return false;
+        }
+    }
+    if (job.inputs.empty()) {
+        error = "no input files";
+        return false;
+    }
+    if (!job.output.empty() && (job.inputs.size() > 1 || job.ranges.size() > 1 ||
+                                fs::is_directory(fs::path(job.inputs[0])))) {
+        error = "--output needs a single input file and range; use --output-dir";
+        return false;
+    }
+    if (job.upload == "b2" && (g_b2KeyId.empty() || g_b2AppKey.empty() || g_b2BucketId.empty())) {
+        error = "B2 upload needs VIDEOEDITOR_B2_KEY_ID, VIDEOEDITOR_B2_APP_KEY and VIDEOEDITOR_B2_BUCKET_ID (or a \"b2\" job file section)";
+        return false;
+    }
+    return true;
+}
+
+void PrintCliUsage()
+{
+    fprintf(stderr,
+        "usage: videoeditor-cli [options] INPUT...\n"
+        "\n"
+        "Cuts and exports video files or every video in a directory with the\n"
+        "editor's export engine. Progress is written to stdout as JSON lines.\n"
+        "\n"
+        "  --job FILE            read options from a JSON job file\n"
+        "  -o, --output FILE     output file (one input and range)\n"
+        "  --output-dir DIR      where outputs go (default: next to each input)\n"
+        "  --format EXT          output container (default: mp4)\n"
+        "  --range START-END     range to export; repeat for several outputs,\n"
+        "                        END may be empty to run to the end\n"
+        "  --start T, --end T    a single range\n"
+        "  --tracks LIST         audio tracks to keep, e.g. 0,2 (default: all)\n"
+        "  --merge-audio         mix the kept tracks into one\n"
+        "  --copy | --h264       copy the video stream (default) or encode H.264\n"
+        "  --nvenc               encode with NVENC\n"
+        "  --bitrate KBPS        H.264 video bitrate\n"
+        "  --target-size MB      two-pass encode to a file size (implies --h264)\n"
+        "  --fast-first-pass     cheaper analysis pass for --target-size\n"
+        "  --upload b2|catbox    upload each output; credentials come from the\n"
+        "                        VIDEOEDITOR_B2_* / VIDEOEDITOR_CATBOX_USERHASH\n"
+        "                        environment or the job file\n"
+        "  --upload-limit KBPS   total upload bandwidth (default: unlimited)\n"
+        "  -j, --parallel N      exports run at once (default: 1)\n"
+        "  --recursive           include subdirectories of input directories\n"
+        "  --overwrite           replace existing outputs instead of skipping\n"
+        "  --cache-mb N          export cache size, 0 turns it off\n"
+        "  --verbose             copy the debug log to stderr\n"
+        "  --trace FILE          save a Chrome trace of the run (ui.perfetto.dev)\n");
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "export_options.h"
+
+// A range to cut, in seconds. endTime < 0 runs to the end of the file.
+struct CliRange {
+    double startTime = 0.0;
+    double endTime = -1.0;
+};
+
+// Everything videoeditor-cli was asked to do. Filled from the command line
+// and/or a JSON job file; later settings override earlier ones.
+struct CliJob {
+    std::vector<std::wstring> inputs;      // files or directories
+    std::wstring output;                   // explicit output file, single input and range only
+    std::wstring outputDir;                // empty: next to each input
+    std::string format = "mp4";            // output extension
+    std::vector<CliRange> ranges;          // empty: the whole file
+    std::vector<int> tracks;               // audio tracks to keep, by index
+    bool allTracks = true;                 // ignore `tracks`, keep every track
+    ExportOptions options;                 // start/end are filled per range
+    std::string upload;                    // "", "b2" or "catbox"
+    int parallel = 1;                      // inputs/ranges exported at once
+    bool recursive = false;                // descend into input directories
+    bool overwrite = false;
+    bool verbose = false;
+    std::wstring traceFile;                // Chrome trace of the run, saved at the end
+};
+
+// Parses argv[1..]; `--job FILE` is loaded where it appears. Sets the
+// engine settings (credentials, cache, logging) it carries as it goes.
+bool ParseCliArgs(int argc, char** argv, CliJob& job, std::string& error);
+bool LoadCliJobFile(const std::wstring& path, CliJob& job, std::string& error);
+
+// Seconds, or [[hh:]mm:]ss with an optional fraction.
+bool ParseTimecode(const std::string& text, double& seconds);
+
+void PrintCliUsage();
@@ -0,0 +1,427 @@
+// videoeditor-cli: the editor's cut/export/upload path without a window.
+// Inputs may be files or directories; each input and range becomes one
+// export, run --parallel at a time. Every event is one JSON object per line
+// on stdout, diagnostics go to stderr. See PrintCliUsage for the options.
+//
+//   videoeditor-cli --range 1:00-1:30 --h264 --target-size 8 clip.mkv
+//   videoeditor-cli --job batch.json -j 4 /srv/incoming
+
+#include "cli_job.h"
+#include "video_cutter.h"
+#include "media_source.h"
+#include "export_flow.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include "debug_log.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cwctype>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <shellapi.h>
+#endif
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static const wchar_t* kVideoExtensions[] = {
+    L".mp4", L".avi", L".mov", L".mkv", L".wmv", L".flv", L".webm", L".m4v", L".3gp",
+};
+
+static std::atomic<bool> s_cancel{ false };
+
+static void OnSignal(int)
+{
+    s_cancel.store(true);
+}
+
+// One input and range to export.
+struct CliTask {
+    std::wstring input;
+    std::wstring output;
+    CliRange range;
+};
+
+// An export in flight, sampled by the progress thread.
+struct ActiveExport {
+    const CliTask* task = nullptr;
+    ExportStats stats;
+};
+
+static std::mutex s_outMutex;
+static std::mutex s_activeMutex;
+static std::vector<ActiveExport*> s_active;
+
+static std::string JsonString(const std::string& s)
+{
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += (char)c;
+        }
+    }
+    return out + "\"";
+}
+
+static std::string JsonPath(const std::wstring& path)
+{
+    return JsonString(ToUtf8(path));
+}
+
+static void Emit(const std::string& line)
+{
+    std::lock_guard<std::mutex> lock(s_outMutex);
+    fputs(line.c_str(), stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+static void EmitError(const CliTask& task, const std::string& message)
+{
+    Emit("{\"event\":\"error\",\"input\":" + JsonPath(task.input) +
+         ",\"output\":" + JsonPath(task.output) + ",\"message\":" + JsonString(message) + "}");
+}
+
+static bool IsVideoFile(const fs::path& path)
+{
+    std::wstring ext = path.extension().wstring();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
+    for (const wchar_t* e : kVideoExtensions) {
+        if (ext == e)
+            return true;
+    }
+    return false;
+}
+
+// Our own outputs land next to the inputs by default; leave them out so a
+// second run over the same directory does not export the exports.
+static bool IsCliOutput(const fs::path& path)
+{
+    std::wstring stem = path.stem().wstring();
+    size_t pos = stem.rfind(L"_cut");
+    if (pos == std::wstring::npos)
+        return false;
+    for (size_t i = pos + 4; i < stem.size(); ++i) {
+        if (!iswdigit(stem[i]))
+            return false;
+    }
+    return true;
+}
+
+static void ExpandInputs(const CliJob& job, std::vector<std::wstring>& files)
+{
+    for (const auto& input : job.inputs) {
+        fs::path p(input);
+        std::error_code ec;
+        if (!fs::is_directory(p, ec)) {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<std::wstring> found;
+        auto add = [&](const fs::directory_entry& e) {
+            if (e.is_regular_file(ec) && IsVideoFile(e.path()) && !IsCliOutput(e.path()))
+                found.push_back(e.path().wstring());
+        };
+        if (job.recursive) {
+            for (const auto& e : fs::recursive_directory_iterator(p, ec))
+                add(e);
+        } else {
+            for (const auto& e : fs::directory_iterator(p, ec))
+                add(e);
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+}
+
+static std::vector<CliTask> BuildTasks(const CliJob& job)
+{
+    std::vector<std::wstring> files;
+    ExpandInputs(job, files);
+    std::vector<CliRange> ranges = job.ranges;
+    if (ranges.empty())
+        ranges.push_back(CliRange());
+
+    std::wstring ext = L"." + FromUtf8(job.format);
+    std::vector<CliTask> tasks;
+    for (const auto& file : files) {
+        fs::path in(file);
+        fs::path dir = job.outputDir.empty() ? in.parent_path() : fs::path(job.outputDir);
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            CliTask task;
+            task.input = file;
+            task.range = ranges[i];
+            if (!job.output.empty()) {
+                task.output = job.output;
+            } else {
+                std::wstring name = in.stem().wstring() + L"_cut";
+                if (ranges.size() > 1)
+                    name += std::to_wstring(i + 1);
+                task.output = (dir / (name + ext)).wstring();
+            }
+            tasks.push_back(task);
+        }
+    }
+    return tasks;
+}
+
+static void ProgressLoop(std::mutex& doneMutex, std::condition_variable& doneCv, bool& done)
+{
+    std::unique_lock<std::mutex> wait(doneMutex);
+    while (!doneCv.wait_for(wait, std::chrono::milliseconds(500), [&] { return done; })) {
+        std::lock_guard<std::mutex> lock(s_activeMutex);
+        for (ActiveExport* a : s_active) {
+            ExportSnapshot snap = a->stats.Read();
+            if (!snap.running)
+                continue;
+            std::ostringstream line;
+            line << "{\"event\":\"progress\",\"output\":" << JsonPath(a->task->output)
+                 << ",\"percent\":" << (int)(snap.progress * 100.0)
+                 << ",\"fps\":" << snap.fps << ",\"realtime\":" << snap.realtime
+                 << ",\"bytes\":" << snap.bytes << ",\"eta\":" << snap.eta << "}";
+            Emit(line.str());
+        }
+    }
+}
+
+// The same steps as the editor's export thread, through RunExportFlow.
+static bool RunTask(const CliJob& job, const CliTask& task)
+{
+    Clock::time_point begin = Clock::now();
+    std::error_code ec;
+    if (!job.overwrite && fs::exists(fs::path(task.output), ec)) {
+        Emit("{\"event\":\"skipped\",\"input\":" + JsonPath(task.input) +
+             ",\"output\":" + JsonPath(task.output) + ",\"reason\":\"output exists\"}");
+        return true;
+    }
+
+    MediaInfo info;
+    {
+        MediaSource source;
+        if (!source.Open(task.input)) {
+            EmitError(task, "could not open input");
+            return false;
+        }
+        info = source.Info();
+    }
+    std::vector<int> trackIndices;
+    for (size_t i = 0; i < info.audioTracks.size(); ++i) {
+        bool keep = job.allTracks ||
+                    std::find(job.tracks.begin(), job.tracks.end(), (int)i) != job.tracks.end();
+        info.audioTracks[i].isMuted = !keep;
+        if (keep)
+            trackIndices.push_back((int)i);
+    }
+    for (int t : job.tracks) {
+        if (!job.allTracks && t >= (int)info.audioTracks.size()) {
+            EmitError(task, "audio track " + std::to_string(t) + " does not exist");
+            return false;
+        }
+    }
+
+    ExportOptions options = job.options;
+    options.startTime = task.range.startTime;
+    options.endTime = task.range.endTime < 0.0 ? info.duration : std::min(task.range.endTime, info.duration);
+    if (options.endTime <= options.startTime) {
+        EmitError(task, "range is outside the file");
+        return false;
+    }
+    fs::create_directories(fs::path(task.output).parent_path(), ec);
+    Emit("{\"event\":\"start\",\"input\":" + JsonPath(task.input) +
+         ",\"output\":" + JsonPath(task.output) +
+         ",\"start\":" + std::to_string(options.startTime) +
+         ",\"end\":" + std::to_string(options.endTime) + "}");
+
+    ExportFlowRequest request;
+    request.sourcePath = task.input;
+    request.outputPath = task.output;
+    request.options = options;
+    request.audioTracks = trackIndices;
+    request.upload = !job.upload.empty();
+    request.provider = job.upload == "catbox" ? UploadProvider::Catbox : UploadProvider::B2;
+    request.cancelFlag = &s_cancel;
+
+    ActiveExport active;
+    active.task = &task;
+    TargetSizeReport report;
+    int lastPercent = -1;
+    ExportFlowCallbacks callbacks;
+    callbacks.encode = [&](const ExportOptions& opts) {
+        {
+            std::lock_guard<std::mutex> lock(s_activeMutex);
+            s_active.push_back(&active);
+        }
+        active.stats.Begin(opts.endTime - opts.startTime);
+        VideoCutter cutter(info);
+        bool ok = cutter.CutVideo(task.output, opts, &active.stats, &s_cancel);
+        active.stats.Finish(ok);
+        report = cutter.GetTargetSizeReport();
+        {
+            std::lock_guard<std::mutex> lock(s_activeMutex);
+            s_active.erase(std::find(s_active.begin(), s_active.end(), &active));
+        }
+        return ok;
+    };
+    callbacks.uploadProgress = [&](int percent) {
+        if (percent == lastPercent)
+            return;
+        lastPercent = percent;
+        Emit("{\"event\":\"upload\",\"output\":" + JsonPath(task.output) +
+             ",\"percent\":" + std::to_string(percent) + "}");
+    };
+
+    ExportFlowResult result = RunExportFlow(request, callbacks);
+    bool ok = result.ok;
+    bool cached = result.cached;
+    bool upload = request.upload;
+    bool up = result.uploaded;
+    const std::string& url = result.url;
+    bool success = ok && (!upload || up);
+    std::ostringstream line;
+    line << "{\"event\":\"done\",\"input\":" << JsonPath(task.input)
+         << ",\"output\":" << JsonPath(task.output)
+         << ",\"ok\":" << (success ? "true" : "false")
+         << ",\"exported\":" << (ok ? "true" : "false")
+         << ",\"cancelled\":" << (s_cancel ? "true" : "false")
+         << ",\"cached\":" << (cached ? "true" : "false")
+         << ",\"bytes\":" << (ok ? (int64_t)fs::file_size(fs::path(task.output), ec) : 0)
+         << ",\"seconds\":" << std::chrono::duration<double>(Clock::now() - begin).count();
+    if (upload)
+        line << ",\"uploaded\":" << (up ? "true" : "false") << ",\"url\":" << JsonString(url);
+    if (report.valid)
+        line << ",\"target\":{\"target_bytes\":" << report.targetBytes
+             << ",\"actual_bytes\":" << report.actualBytes
+             << ",\"error_percent\":" << report.ErrorPercent()
+             << ",\"video_kbps\":" << report.videoKbps
+             << ",\"attempts\":" << report.attempts << "}";
+    if (!cached)
+        line << ",\"stats\":" << ExportSnapshotJson(active.stats.Read());
+    line << "}";
+    Emit(line.str());
+    return success;
+}
+
+static int RunCli(int argc, char** argv)
+{
+    // Headless by default: warnings on stderr, no log file in the working
+    // directory and no message boxes. --verbose adds the full debug log.
+    g_logToFile = false;
+    g_logPopups = false;
+    CliJob job;
+    std::string error;
+    if (!ParseCliArgs(argc, argv, job, error)) {
+        if (error.empty()) {
+            PrintCliUsage();
+            return 0;
+        }
+        fprintf(stderr, "videoeditor-cli: %s (see --help)\n", error.c_str());
+        return 2;
+    }
+    g_logToStderr = job.verbose;
+    // Nothing else reads the log, so quiet runs skip formatting the records.
+    g_logLevel = (int)(job.verbose ? LogLevel::Debug : LogLevel::Error);
+    av_log_set_level(job.verbose ? AV_LOG_INFO : AV_LOG_ERROR);
+    if (!job.traceFile.empty())
+        TraceEnable(true);
+
+    std::vector<CliTask> tasks = BuildTasks(job);
+    if (tasks.empty()) {
+        fprintf(stderr, "videoeditor-cli: no video files found\n");
+        return 1;
+    }
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (!job.upload.empty())
+        UploadManager::Get().Start();
+
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    bool done = false;
+    std::thread progress(ProgressLoop, std::ref(doneMutex), std::ref(doneCv), std::ref(done));
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<int> failed{ 0 };
+    int workers = std::min<int>(job.parallel, (int)tasks.size());
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; ++w) {
+        threads.emplace_back([&] {
+            TraceSetThreadName("Export worker");
+            while (!s_cancel) {
+                size_t i = next++;
+                if (i >= tasks.size())
+                    break;
+                if (!RunTask(job, tasks[i]))
+                    ++failed;
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        done = true;
+    }
+    doneCv.notify_all();
+    progress.join();
+
+    if (!job.upload.empty())
+        UploadManager::Get().Stop();
+    curl_global_cleanup();
+
+    if (!job.traceFile.empty() && !TraceSave(job.traceFile))
+        fprintf(stderr, "videoeditor-cli: could not write trace %s\n", ToUtf8(job.traceFile).c_str());
+
+    size_t started = std::min(next.load(), tasks.size());
+    Emit("{\"event\":\"summary\",\"tasks\":" + std::to_string(tasks.size()) +
+         ",\"failed\":" + std::to_string(failed.load()) +
+         ",\"not_run\":" + std::to_string(tasks.size() - started) +
+         ",\"cancelled\":" + (s_cancel ? "true" : "false") + "}");
+    return failed || s_cancel ? 1 : 0;
+}
+
+#ifdef _WIN32
+// The narrow argv is in the ANSI code page; rebuild it as UTF-8.
+int main()
+{
+    int argc = 0;
+    wchar_t** wargv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    std::vector<std::string> args;
+    for (int i = 0; i < argc; ++i)
+        args.push_back(ToUtf8(wargv[i]));
+    LocalFree(wargv);
+    std::vector<char*> argv;
+    for (auto& a : args)
+        argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+    return RunCli(argc, argv.data());
+}
+#else
+int main(int argc, char** argv)
+{
+    return RunCli(argc, argv);
+}
+#endif
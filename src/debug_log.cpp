@@ -1,19 +1,326 @@
 #include "debug_log.h"
-#include "options_window.h"
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
-static std::ofstream g_debugFile;
+namespace fs = std::filesystem;
+
+static const size_t kLogRingSize = 4096;   // records; a power of two
+static const int kLogBackups = 3;          // debug.log.1 .. debug.log.3
+static const char* kLogFile = "debug.log";
+
+struct LogRecord {
+    LogLevel level = LogLevel::Info;
+    uint32_t thread = 0;
+    std::chrono::system_clock::time_point time;
+    std::string text;
+};
+
+// Bounded multi-producer, single-consumer ring. A producer claims a slot by
+// advancing m_head with a CAS, moves its record in and publishes it through
+// the slot's sequence number; the writer thread alone advances m_tail.
+class LogRing {
+public:
+    LogRing()
+    {
+        for (size_t i = 0; i < kLogRingSize; ++i)
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // The claimed position, or -1 when the ring is full.
+    int64_t Push(LogRecord& rec)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = m_slots[pos & (kLogRingSize - 1)];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.rec = std::move(rec);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return (int64_t)pos;
+                }
+            } else if (diff < 0) {
+                return -1;      // full: the writer has not freed this slot yet
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Pop(LogRecord& rec)
+    {
+        Slot& slot = m_slots[m_tail & (kLogRingSize - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != m_tail + 1)
+            return false;
+        rec = std::move(slot.rec);
+        slot.seq.store(m_tail + kLogRingSize, std::memory_order_release);
+        ++m_tail;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        LogRecord rec;
+    };
+    Slot m_slots[kLogRingSize];
+    std::atomic<size_t> m_head{0};
+    size_t m_tail = 0;
+};
+
+static std::atomic<bool> s_loggerGone{false};
+
+class Logger {
+public:
+    static Logger& Get()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    void Push(LogRecord& rec, bool urgent)
+    {
+        int64_t pos = m_ring.Push(rec);
+        if (pos < 0)
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        // Errors are written right away, and a burst wakes the writer every
+        // half ring. A wakeup lost to the race with the writer going to
+        // sleep only delays the records to its next poll.
+        if (urgent || (pos > 0 && pos % (kLogRingSize / 2) == 0)) {
+            m_urgent = true;
+            m_wake.notify_one();
+        }
+    }
+
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        uint64_t ticket = ++m_flushRequested;
+        m_wake.notify_one();
+        m_flushed.wait(lock, [&] { return m_flushDone >= ticket; });
+    }
+
+    ~Logger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        if (m_thread.joinable())
+            m_thread.join();
+        s_loggerGone = true;
+    }
+
+private:
+    Logger() : m_thread(&Logger::Run, this) {}
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return m_stop || m_urgent || m_flushRequested != m_flushDone;
+            });
+            bool stop = m_stop;
+            uint64_t ticket = m_flushRequested;
+            m_urgent = false;
+            lock.unlock();
+            while (Drain()) {
+            }
+            lock.lock();
+            m_flushDone = ticket;
+            m_flushed.notify_all();
+            if (stop)
+                break;
+        }
+        if (m_file)
+            fclose(m_file);
+        m_file = nullptr;
+    }
+
+    // Writes up to one ring's worth of records; false once nothing was left.
+    bool Drain()
+    {
+        std::string batch;
+        LogRecord rec;
+        size_t count = 0;
+        while (count < kLogRingSize && m_ring.Pop(rec)) {
+#ifdef _WIN32
+            size_t start = batch.size();
+            AppendLine(batch, rec);
+            OutputDebugStringA(batch.c_str() + start);
+#else
+            AppendLine(batch, rec);
+#endif
+            ++count;
+        }
+        uint64_t dropped = m_dropped.exchange(0);
+        if (dropped) {
+            LogRecord note;
+            note.level = LogLevel::Warning;
+            note.time = std::chrono::system_clock::now();
+            note.text = std::to_string(dropped) + " log records dropped, the queue was full";
+            AppendLine(batch, note);
+        }
+        if (batch.empty())
+            return false;
+
+        if (g_logToFile)
+            WriteFile(batch);
+        else if (m_file) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+        if (g_logToStderr) {
+            fwrite(batch.data(), 1, batch.size(), stderr);
+            fflush(stderr);
+        }
+        return count == kLogRingSize;
+    }
+
+    static void AppendLine(std::string& out, const LogRecord& rec)
+    {
+        time_t secs = std::chrono::system_clock::to_time_t(rec.time);
+        int ms = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           rec.time.time_since_epoch()).count() % 1000);
+        tm local = {};
+#ifdef _WIN32
+        localtime_s(&local, &secs);
+#else
+        localtime_r(&secs, &local);
+#endif
+        char prefix[64];
+        size_t n = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+        snprintf(prefix + n, sizeof(prefix) - n, ".%03d %-5s [%u] ", ms, LogLevelName(rec.level), rec.thread);
+        out += prefix;
+        out += rec.text;
+        out += '\n';
+    }
+
+    void WriteFile(const std::string& batch)
+    {
+        if (!m_file) {
+            m_file = fopen(kLogFile, "a");
+            if (!m_file)
+                return;
+            fseek(m_file, 0, SEEK_END);
+            m_fileSize = ftell(m_file);
+        }
+        int64_t limit = (int64_t)g_logRotateMB * 1024 * 1024;
+        if (limit > 0 && m_fileSize > 0 && m_fileSize + (int64_t)batch.size() > limit)
+            Rotate();
+        if (!m_file)
+            return;
+        fwrite(batch.data(), 1, batch.size(), m_file);
+        fflush(m_file);
+        m_fileSize += (int64_t)batch.size();
+    }
+
+    // debug.log -> debug.log.1 -> ... -> debug.log.<kLogBackups>, oldest dropped.
+    void Rotate()
+    {
+        fclose(m_file);
+        m_file = nullptr;
+        std::error_code ec;
+        std::string base = kLogFile;
+        fs::remove(base + "." + std::to_string(kLogBackups), ec);
+        for (int i = kLogBackups - 1; i >= 1; --i)
+            fs::rename(base + "." + std::to_string(i), base + "." + std::to_string(i + 1), ec);
+        fs::rename(base, base + ".1", ec);
+        m_file = fopen(kLogFile, "a");
+        m_fileSize = 0;
+    }
+
+    LogRing m_ring;
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_urgent{false};
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_flushed;
+    bool m_stop = false;
+    uint64_t m_flushRequested = 0;
+    uint64_t m_flushDone = 0;
+    FILE* m_file = nullptr;         // writer thread only
+    int64_t m_fileSize = 0;
+    std::thread m_thread;           // last, so it starts after the rest
+};
+
+static uint32_t LogThreadId()
+{
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t id = next++;
+    return id;
+}
+
+const char* LogLevelName(LogLevel level)
+{
+    switch (level) {
+    case LogLevel::Debug:   return "DEBUG";
+    case LogLevel::Info:    return "INFO";
+    case LogLevel::Warning: return "WARN";
+    case LogLevel::Error:   return "ERROR";
+    default:                return "?";
+    }
+}
+
+bool ParseLogLevel(const std::string& name, LogLevel& level)
+{
+    if (name == "debug")
+        level = LogLevel::Debug;
+    else if (name == "info")
+        level = LogLevel::Info;
+    else if (name == "warning" || name == "warn")
+        level = LogLevel::Warning;
+    else if (name == "error")
+        level = LogLevel::Error;
+    else
+        return false;
+    return true;
+}
+
+void LogMessage(LogLevel level, std::string msg)
+{
+    LogRecord rec;
+    rec.level = level;
+    rec.thread = LogThreadId();
+    rec.time = std::chrono::system_clock::now();
+    rec.text = std::move(msg);
+    if (s_loggerGone) {
+        // Static destructors after the writer stopped: stderr only.
+        if (g_logToStderr)
+            fprintf(stderr, "%s\n", rec.text.c_str());
+        return;
+    }
+    Logger::Get().Push(rec, level >= LogLevel::Error);
+}
+
+void LogFlush()
+{
+    if (!s_loggerGone)
+        Logger::Get().Flush();
+}
 
 void DebugLog(const std::string& msg, bool popup) {
-    if (g_logToFile) {
-        if (!g_debugFile.is_open())
-            g_debugFile.open("debug.log", std::ios::app);
-        if (g_debugFile.is_open())
-            g_debugFile << msg << std::endl;
-    }
-    OutputDebugStringA((msg + "\n").c_str());
-    if (popup) {
+    LogLevel level = popup ? LogLevel::Error : LogLevel::Info;
+    if (LogEnabled(level))
+        LogMessage(level, msg);
+#ifdef _WIN32
+    if (popup && g_logPopups) {
+        LogFlush();
         MessageBoxA(nullptr, msg.c_str(), "Video Editor Debug", MB_OK | MB_ICONINFORMATION);
     }
+#else
+    (void)popup;
+#endif
 }
@@ -1,3 +1,36 @@
 #pragma once
+#include <sstream>
 #include <string>
+#include "engine_settings.h"
+
+// Records are queued in a lock-free ring and written by a background thread
+// to debug.log (rotated by size), stderr and the debugger, so callers never
+// wait on I/O. A record that finds the ring full is dropped and counted.
+enum class LogLevel { Debug, Info, Warning, Error };
+
+inline bool LogEnabled(LogLevel level) { return (int)level >= g_logLevel; }
+void LogMessage(LogLevel level, std::string msg);
+// Waits until everything logged so far has been written.
+void LogFlush();
+const char* LogLevelName(LogLevel level);
+bool ParseLogLevel(const std::string& name, LogLevel& level);
+
+// `expr` is streamed into the message, and only evaluated when the level
+// is on: LOG_DEBUG("Segment " << index << " opened");
+#define LOG_AT(level, expr)                                  \
+    do {                                                     \
+        if (LogEnabled(level)) {                             \
+            std::ostringstream logStream_;                   \
+            logStream_ << expr;                              \
+            LogMessage(level, logStream_.str());             \
+        }                                                    \
+    } while (0)
+#define LOG_DEBUG(expr) LOG_AT(LogLevel::Debug, expr)
+#define LOG_INFO(expr) LOG_AT(LogLevel::Info, expr)
+#define LOG_WARN(expr) LOG_AT(LogLevel::Warning, expr)
+#define LOG_ERROR(expr) LOG_AT(LogLevel::Error, expr)
+
+// An Info record, or an Error one shown in a message box when `popup` is
+// set and g_logPopups is on; the box waits for the record to reach the log
+// first.
 void DebugLog(const std::string& msg, bool popup = false);
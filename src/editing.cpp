@@ -2,11 +2,16 @@
 #include "video_player.h"
 #include "ui_updates.h"
 #include "progress_window.h"
+#include "debug_log.h"
+#include "trace.h"
 #include <commdlg.h>
+#include <commctrl.h>
 #include <thread>
+#include <memory>
 #include <string>
-#include "b2_upload.h"
-#include "catbox_upload.h"
+#include <sstream>
+#include <vector>
+#include "export_flow.h"
 
 // Forward declarations
 void UpdateCutInfoLabel(HWND hwnd);
@@ -20,10 +25,174 @@ extern bool g_useNvenc;
 extern bool g_autoUpload;
 extern bool g_useCatbox;
 extern bool g_useB2;
+extern bool g_fastFirstPass;
+extern bool g_exportCopies;
+extern int g_exportCacheMB;
+extern std::wstring g_catboxUserHash;
+extern std::wstring g_b2BucketName;
+extern std::wstring g_b2CustomUrl;
 std::wstring g_uploadedUrl;
+std::wstring g_exportSummary;
 bool g_uploadSuccess = false;
 bool g_lastOperationWasExport = false;
 
+static std::wstring FormatTargetSizeReport(const TargetSizeReport& report)
+{
+    if (!report.valid)
+        return std::wstring();
+    wchar_t buf[160];
+    swprintf_s(buf, _countof(buf), L"Size: %.2f MiB of %.2f MiB target (%+.1f%%)%s",
+               report.actualBytes / 1048576.0, report.targetBytes / 1048576.0,
+               report.ErrorPercent(),
+               report.reusedFirstPass ? L", first pass reused" : L"");
+    return buf;
+}
+
+// Size and bitrate of the small H.264 copy made next to an export.
+static const int kCopyHeight = 720;
+static const int kCopyVideoKbps = 2000;
+
+// Main output plus a 720p H.264 copy and an audio-only copy next to it. All
+// three merge or keep the audio tracks as the main output does.
+static std::vector<ExportBranch> BuildExportBranches(const std::wstring& outFile,
+                                                     const ExportOptions& options)
+{
+    ExportBranch::Audio audio = options.mergeAudio ? ExportBranch::Audio::Merge : ExportBranch::Audio::Copy;
+    std::vector<ExportBranch> branches;
+    ExportBranch master;
+    master.outputFilename = outFile;
+    master.video = options.convertH264 ? ExportBranch::Video::H264 : ExportBranch::Video::Copy;
+    master.audio = audio;
+    branches.push_back(master);
+
+    std::wstring base = outFile;
+    size_t dot = base.find_last_of(L'.');
+    size_t slash = base.find_last_of(L"\\/");
+    if (dot != std::wstring::npos && (slash == std::wstring::npos || dot > slash))
+        base.erase(dot);
+
+    ExportBranch small;
+    small.outputFilename = base + L"_" + std::to_wstring(kCopyHeight) + L"p.mp4";
+    small.video = ExportBranch::Video::H264;
+    small.audio = audio;
+    small.height = kCopyHeight;
+    small.videoKbps = kCopyVideoKbps;
+    branches.push_back(small);
+
+    ExportBranch audioOnly;
+    audioOnly.outputFilename = base + L"_audio.m4a";
+    audioOnly.video = ExportBranch::Video::None;
+    audioOnly.audio = audio;
+    branches.push_back(audioOnly);
+    return branches;
+}
+
+// One machine-readable line per export so runs can be compared from the log.
+static void LogExportStats(const ExportOptions& options, bool copies, bool ok)
+{
+    if (!LogEnabled(LogLevel::Info))
+        return;
+    std::ostringstream oss;
+    oss << "EXPORT_STATS {\"ok\":" << (ok ? "true" : "false")
+        << ",\"cancelled\":" << (g_cancelExport ? "true" : "false")
+        << ",\"duration_s\":" << (options.endTime - options.startTime)
+        << ",\"h264\":" << (options.convertH264 ? "true" : "false")
+        << ",\"nvenc\":" << (options.useNvenc ? "true" : "false")
+        << ",\"merge_audio\":" << (options.mergeAudio ? "true" : "false")
+        << ",\"max_kbps\":" << options.maxBitrate
+        << ",\"target_mb\":" << options.targetSizeMB
+        << ",\"copies\":" << (copies ? "true" : "false")
+        << ",\"stats\":" << ExportSnapshotJson(g_exportStats.Read()) << "}";
+    LogMessage(LogLevel::Info, oss.str());
+}
+
+// Runs on the export thread. With copies enabled the source is decoded once
+// for all outputs instead of once per file.
+static bool RunExportJob(const std::wstring& outFile, const ExportOptions& options, bool copies)
+{
+    g_exportStats.Begin(options.endTime - options.startTime);
+    std::vector<ExportBranch> branches;
+    bool ok;
+    if (copies) {
+        branches = BuildExportBranches(outFile, options);
+        ok = g_videoPlayer->ExportBranches(branches, options, &g_exportStats, &g_cancelExport);
+    } else {
+        ok = g_videoPlayer->CutVideo(outFile, options, &g_exportStats, &g_cancelExport);
+    }
+    g_exportStats.Finish(ok);
+    LogExportStats(options, copies, ok);
+    if (!ok)
+        return false;
+
+    if (!copies) {
+        g_exportSummary = FormatTargetSizeReport(g_videoPlayer->GetTargetSizeReport());
+        return true;
+    }
+    g_exportSummary = L"Also saved:";
+    for (size_t i = 1; i < branches.size(); ++i) {
+        const std::wstring& name = branches[i].outputFilename;
+        size_t slash = name.find_last_of(L"\\/");
+        g_exportSummary += L"\n" + (slash == std::wstring::npos ? name : name.substr(slash + 1));
+    }
+    return true;
+}
+
+static void ShowUploadProgress(int percent)
+{
+    SendMessage(g_hProgressBar, PBM_SETPOS, percent, 0);
+}
+
+static std::vector<int> UnmutedAudioTracks()
+{
+    std::vector<int> tracks;
+    for (int i = 0; i < g_videoPlayer->GetAudioTrackCount(); ++i) {
+        if (!g_videoPlayer->IsAudioTrackMuted(i))
+            tracks.push_back(i);
+    }
+    return tracks;
+}
+
+// Export thread body shared by Cut and Export. The cache, streaming and
+// upload steps are RunExportFlow's, the same as in the CLI.
+static void RunExportThread(HWND hwnd, std::wstring outFile, ExportOptions options, bool copies)
+{
+    TraceSetThreadName("Export");
+    g_uploadSuccess = false;
+    g_uploadedUrl.clear();
+    g_exportSummary.clear();
+
+    ExportFlowRequest request;
+    request.sourcePath = g_videoPlayer->loadedFilename;
+    request.outputPath = outFile;
+    request.options = options;
+    request.audioTracks = UnmutedAudioTracks();
+    request.singleFile = !copies;
+    request.upload = g_autoUpload && (g_useCatbox || g_useB2);
+    request.provider = g_useCatbox ? UploadProvider::Catbox : UploadProvider::B2;
+    request.cancelFlag = &g_cancelExport;
+
+    ExportFlowCallbacks callbacks;
+    callbacks.encode = [&](const ExportOptions& opts) { return RunExportJob(outFile, opts, copies); };
+    callbacks.uploadStarting = [](bool streamed) {
+        std::wstring title = streamed ? L"Finishing upload to " : L"Uploading to ";
+        title += g_useCatbox ? L"catbox.moe" : L"Backblaze B2";
+        SetWindowTextW(g_hProgressWindow, title.c_str());
+    };
+    callbacks.uploadProgress = ShowUploadProgress;
+
+    ExportFlowResult result = RunExportFlow(request, callbacks);
+    if (result.cached)
+        g_exportSummary = L"Reused from the export cache.";
+    if (result.uploaded) {
+        const std::string& url = result.url;
+        int sz = MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, nullptr, 0);
+        g_uploadedUrl.assign(sz - 1, 0);
+        MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, g_uploadedUrl.data(), sz);
+        g_uploadSuccess = true;
+    }
+    PostMessage(hwnd, (WM_APP + 1), result.ok ? 1 : 0, 0); // WM_APP_CUT_DONE
+}
+
 void OnSetStartClicked(HWND hwnd)
 {
     if (!g_videoPlayer || !g_videoPlayer->IsLoaded()) return;
@@ -89,53 +258,22 @@ void OnCutClicked(HWND hwnd)
 
         bool useSize = SendMessage(GetDlgItem(hwnd, 1025), BM_GETCHECK, 0, 0) == BST_CHECKED; // ID_RADIO_USE_SIZE
 
-        double startTime = g_cutStartTime;
-        double endTime = g_cutEndTime;
-
+        ExportOptions options;
+        options.startTime = g_cutStartTime;
+        options.endTime = g_cutEndTime;
+        options.mergeAudio = mergeAudio;
+        options.convertH264 = convertH264;
+        options.useNvenc = g_useNvenc;
+        options.maxBitrate = bitrate;
         if (convertH264 && useSize && targetSize > 0) {
-            double duration = endTime - startTime;
-            int audioKbps = 0;
-            if (mergeAudio) {
-                audioKbps = 128; // single AAC track
-            } else {
-                for (const auto& track : g_videoPlayer->audioTracks) {
-                    if (track->isMuted) continue;
-                    AVCodecParameters* par = g_videoPlayer->formatContext->streams[track->streamIndex]->codecpar;
-                    int br = par->bit_rate > 0 ? par->bit_rate : 128000;
-                    audioKbps += br / 1000;
-                }
-            }
-            int totalKbps = static_cast<int>((targetSize * 8192) / duration);
-            bitrate = totalKbps > audioKbps ? (totalKbps - audioKbps) : totalKbps / 2;
+            options.targetSizeMB = targetSize;
+            options.fastFirstPass = g_fastFirstPass;
         }
 
         ShowProgressWindow(hwnd);
         std::wstring outFile = szFile;
-        std::thread([hwnd, outFile, mergeAudio, convertH264, bitrate, startTime, endTime]() {
-            g_uploadSuccess = false;
-            g_uploadedUrl.clear();
-            bool ok = g_videoPlayer->CutVideo(outFile, startTime, endTime,
-                                             mergeAudio, convertH264, g_useNvenc,
-                                             bitrate, g_hProgressBar, &g_cancelExport);
-            if (ok && g_autoUpload && (g_useCatbox || g_useB2)) {
-                std::wstring title = L"Uploading to ";
-                title += g_useCatbox ? L"catbox.moe" : L"Backblaze B2";
-                SetWindowTextW(g_hProgressWindow, title.c_str());
-                std::string url;
-                bool up = false;
-                if (g_useCatbox)
-                    up = UploadToCatbox(outFile, url, g_hProgressBar);
-                else if (g_useB2)
-                    up = UploadToB2(outFile, url, g_hProgressBar);
-                if (up) {
-                    int sz = MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, nullptr, 0);
-                    g_uploadedUrl.assign(sz - 1, 0);
-                    MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, g_uploadedUrl.data(), sz);
-                    g_uploadSuccess = true;
-                }
-            }
-            PostMessage(hwnd, (WM_APP + 1), ok ? 1 : 0, 0); // WM_APP_CUT_DONE
-        }).detach();
+        bool copies = g_exportCopies;
+        std::thread(RunExportThread, hwnd, outFile, options, copies).detach();
     }
 }
 
@@ -175,52 +313,21 @@ void OnExportClicked(HWND hwnd)
 
         bool useSize = SendMessage(GetDlgItem(hwnd, 1025), BM_GETCHECK, 0, 0) == BST_CHECKED;
 
-        double startTime = 0.0;
-        double endTime = g_videoPlayer->GetDuration();
-
+        ExportOptions options;
+        options.startTime = 0.0;
+        options.endTime = g_videoPlayer->GetDuration();
+        options.mergeAudio = mergeAudio;
+        options.convertH264 = convertH264;
+        options.useNvenc = g_useNvenc;
+        options.maxBitrate = bitrate;
         if (convertH264 && useSize && targetSize > 0) {
-            double duration = endTime - startTime;
-            int audioKbps = 0;
-            if (mergeAudio) {
-                audioKbps = 128;
-            } else {
-                for (const auto& track : g_videoPlayer->audioTracks) {
-                    if (track->isMuted) continue;
-                    AVCodecParameters* par = g_videoPlayer->formatContext->streams[track->streamIndex]->codecpar;
-                    int br = par->bit_rate > 0 ? par->bit_rate : 128000;
-                    audioKbps += br / 1000;
-                }
-            }
-            int totalKbps = static_cast<int>((targetSize * 8192) / duration);
-            bitrate = totalKbps > audioKbps ? (totalKbps - audioKbps) : totalKbps / 2;
+            options.targetSizeMB = targetSize;
+            options.fastFirstPass = g_fastFirstPass;
         }
 
         ShowProgressWindow(hwnd);
         std::wstring outFile = szFile;
-        std::thread([hwnd, outFile, mergeAudio, convertH264, bitrate, startTime, endTime]() {
-            g_uploadSuccess = false;
-            g_uploadedUrl.clear();
-            bool ok = g_videoPlayer->CutVideo(outFile, startTime, endTime,
-                                             mergeAudio, convertH264, g_useNvenc,
-                                             bitrate, g_hProgressBar, &g_cancelExport);
-            if (ok && g_autoUpload && (g_useCatbox || g_useB2)) {
-                std::wstring title = L"Uploading to ";
-                title += g_useCatbox ? L"catbox.moe" : L"Backblaze B2";
-                SetWindowTextW(g_hProgressWindow, title.c_str());
-                std::string url;
-                bool up = false;
-                if (g_useCatbox)
-                    up = UploadToCatbox(outFile, url, g_hProgressBar);
-                else if (g_useB2)
-                    up = UploadToB2(outFile, url, g_hProgressBar);
-                if (up) {
-                    int sz = MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, nullptr, 0);
-                    g_uploadedUrl.assign(sz - 1, 0);
-                    MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, g_uploadedUrl.data(), sz);
-                    g_uploadSuccess = true;
-                }
-            }
-            PostMessage(hwnd, (WM_APP + 1), ok ? 1 : 0, 0);
-        }).detach();
+        bool copies = g_exportCopies;
+        std::thread(RunExportThread, hwnd, outFile, options, copies).detach();
     }
 }
@@ -11,3 +11,4 @@ void OnExportClicked(HWND hwnd);
 extern bool g_lastOperationWasExport;
 extern bool g_uploadSuccess;
 extern std::wstring g_uploadedUrl;
+extern std::wstring g_exportSummary;
@@ -0,0 +1,22 @@
+#include "engine_settings.h"
+
+bool g_logToFile = true;
+bool g_logToStderr = false;
+bool g_logPopups = true;
+int g_logLevel = 1;
+int g_logRotateMB = 8;
+int g_exportCacheMB = 4096;
+int g_readAheadMB = 32;
+int g_writeBehindMB = 64;
+int g_packetCacheMB = 256;
+int g_proxyCacheMB = 8192;
+int g_proxyHeight = 540;
+std::wstring g_b2KeyId;
+std::wstring g_b2AppKey;
+std::wstring g_b2BucketId;
+std::wstring g_b2BucketName;
+std::wstring g_b2CustomUrl;
+int g_b2PartSizeMB = 32;
+int g_b2UploadThreads = 4;
+int g_uploadLimitKBps = 0;
+std::wstring g_catboxUserHash;
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+// Settings read by the engine library. The editor loads them from the
+// registry in options_window.cpp; headless tools set them directly.
+
+extern bool g_logToFile;
+extern bool g_logToStderr;        // echo DebugLog to stderr (headless tools)
+extern bool g_logPopups;          // DebugLog(msg, true) shows a message box; off in headless tools
+extern int g_logLevel;            // lowest LogLevel written, 0 = debug
+extern int g_logRotateMB;         // debug.log size that starts a new file
+extern int g_exportCacheMB;       // export cache size limit, 0 = off
+extern int g_readAheadMB;         // block cache per source on slow storage, 0 = FFmpeg's own reads
+extern int g_writeBehindMB;       // export writes queued for the I/O thread, 0 = avio_open
+extern int g_packetCacheMB;       // demuxed packets kept per open file, 0 = off
+extern int g_proxyCacheMB;        // proxy cache size limit, 0 = no proxies
+extern int g_proxyHeight;         // frame height of proxies
+
+extern std::wstring g_b2KeyId;
+extern std::wstring g_b2AppKey;
+extern std::wstring g_b2BucketId;
+extern std::wstring g_b2BucketName;
+extern std::wstring g_b2CustomUrl;
+extern int g_b2PartSizeMB;        // large-file part size
+extern int g_b2UploadThreads;     // parts uploaded in parallel
+extern int g_uploadLimitKBps;     // 0 = unlimited
+extern std::wstring g_catboxUserHash;
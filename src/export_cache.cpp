@@ -0,0 +1,209 @@
+#include "export_cache.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include "debug_log.h"
+#include "sha1.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+// Bump when the encoder setup changes so older outputs are not reused.
+static const int kCacheVersion = 2;
+// Bytes read from the start, middle and end of the source for its identity.
+static const size_t kSampleBytes = 1024 * 1024;
+
+ExportCache& ExportCache::Get()
+{
+    static ExportCache cache;
+    return cache;
+}
+
+bool HashSource(const std::wstring& path, Sha1& sha)
+{
+    std::error_code ec;
+    int64_t size = (int64_t)fs::file_size(fs::path(path), ec);
+    if (ec)
+        return false;
+    FILE* fp = OpenFile(path, "rb");
+    if (!fp)
+        return false;
+    std::string header = "size " + std::to_string(size);
+    sha.Update(header.data(), header.size());
+    std::vector<uint8_t> buf(kSampleBytes);
+    int64_t offsets[3] = { 0, size / 2, size - (int64_t)kSampleBytes };
+    bool ok = true;
+    for (int64_t offset : offsets) {
+        offset = std::max<int64_t>(offset, 0);
+        if (SeekFile(fp, offset, SEEK_SET) != 0) {
+            ok = false;
+            break;
+        }
+        size_t n = fread(buf.data(), 1, buf.size(), fp);
+        sha.Update(buf.data(), n);
+    }
+    fclose(fp);
+    return ok;
+}
+
+std::string ExportCache::MakeKey(const std::wstring& sourcePath, const ExportOptions& options,
+                                 const std::vector<int>& audioTracks, const std::wstring& outputPath,
+                                 bool streamed)
+{
+    Sha1 sha;
+    if (!HashSource(sourcePath, sha))
+        return std::string();
+
+    // Every ExportOptions field that reaches the encoder. A sink also
+    // changes the file: the muxer writes fragmented MP4 for it and the
+    // resumable path is skipped, so `streamed` is part of the key.
+    std::string ext = fs::path(outputPath).extension().u8string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+    std::ostringstream key;
+    key << "|v" << kCacheVersion
+        << '|' << std::fixed << std::setprecision(3) << options.startTime << '|' << options.endTime
+        << '|' << options.mergeAudio << '|' << options.convertH264 << '|' << options.useNvenc
+        << '|' << options.maxBitrate << '|' << options.targetSizeMB << '|' << options.fastFirstPass
+        << '|' << ext << '|' << streamed << "|tracks";
+    for (int idx : audioTracks)
+        key << ',' << idx;
+    std::string s = key.str();
+    sha.Update(s.data(), s.size());
+    return sha.FinalHex();
+}
+
+// The range and URLs go in the entry's extra lines.
+static void ReadFields(ExportCacheEntry& entry)
+{
+    for (const auto& field : entry.extra) {
+        std::istringstream ls(field.second);
+        if (field.first == "range") {
+            ls >> entry.startTime >> entry.endTime;
+        } else if (field.first == "url") {
+            std::string url, target;
+            ls >> url;
+            std::getline(ls >> std::ws, target);
+            if (!url.empty())
+                entry.urls[target] = url;
+        }
+    }
+}
+
+static void WriteFields(ExportCacheEntry& entry)
+{
+    std::ostringstream range;
+    range << std::fixed << std::setprecision(3) << entry.startTime << ' ' << entry.endTime;
+    entry.extra.clear();
+    entry.extra.emplace_back("range", range.str());
+    for (const auto& u : entry.urls)
+        entry.extra.emplace_back("url", u.second + ' ' + u.first);
+}
+
+// Hard link when possible so storing and fetching cost no copy; the write
+// time check in Fetch notices if either name is overwritten later.
+static bool LinkOrCopy(const fs::path& from, const fs::path& to)
+{
+    std::error_code ec;
+    fs::remove(to, ec);
+    fs::create_hard_link(from, to, ec);
+    if (!ec)
+        return true;
+    return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+}
+
+bool ExportCache::Fetch(const std::string& key, const std::wstring& outputPath, ExportCacheEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    entry = ExportCacheEntry();
+    if (!m_store.Find(key, entry))
+        return false;
+    ReadFields(entry);
+
+    fs::path cached = m_store.FilePath(key, entry.extension);
+    fs::path output(outputPath);
+    std::error_code ec;
+    if (!fs::equivalent(cached, output, ec) && !LinkOrCopy(cached, output)) {
+        LOG_WARN("Export cache could not place " << output.u8string());
+        return false;
+    }
+    m_store.Touch(entry);
+    LOG_INFO("Export cache hit " << key << " -> " << output.u8string());
+    return true;
+}
+
+void ExportCache::Store(const std::string& key, const std::wstring& outputPath,
+                        const std::wstring& sourcePath, const ExportOptions& options)
+{
+    if (key.empty() || g_exportCacheMB <= 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fs::path output(outputPath);
+    ExportCacheEntry entry;
+    entry.key = key;
+    entry.extension = output.extension().u8string();
+    if (entry.extension.empty())
+        entry.extension = ".bin";
+    entry.source = fs::path(sourcePath).filename().u8string();
+    entry.startTime = options.startTime;
+    entry.endTime = options.endTime;
+
+    m_store.Remove(key, entry.extension);
+    if (!LinkOrCopy(output, m_store.FilePath(key, entry.extension))) {
+        LOG_WARN("Export cache could not store " << output.u8string());
+        return;
+    }
+    WriteFields(entry);
+    if (!m_store.Add(entry))
+        return;
+    m_store.Trim((int64_t)g_exportCacheMB * 1024 * 1024, false);
+}
+
+void ExportCache::SetUrl(const std::string& key, const std::string& target, const std::string& url)
+{
+    if (key.empty() || url.empty())
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ExportCacheEntry entry;
+    if (m_store.Load(key, entry)) {
+        ReadFields(entry);
+        entry.urls[target] = url;
+        WriteFields(entry);
+        m_store.Save(entry);
+    }
+}
+
+std::vector<ExportCacheEntry> ExportCache::List()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<ExportCacheEntry> entries;
+    for (const auto& stored : m_store.Scan()) {
+        ExportCacheEntry entry;
+        static_cast<FileCacheEntry&>(entry) = stored;
+        ReadFields(entry);
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+void ExportCache::Remove(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ExportCacheEntry entry;
+    m_store.Load(key, entry);
+    m_store.Remove(key, entry.extension);
+}
+
+void ExportCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_store.Clear();
+}
+
+void ExportCache::Trim(int64_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_store.Trim(maxBytes, false);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "export_options.h"
+#include "file_cache_store.h"
+
+class Sha1;
+
+// Adds a source file's identity to `sha`: its size and samples from the
+// start, middle and end, so renames and copies still match while a
+// re-encoded or trimmed file does not. False if it cannot be read.
+bool HashSource(const std::wstring& path, Sha1& sha);
+
+// A finished single-file export kept for reuse. The range and URLs are
+// kept as extra lines of the entry file.
+struct ExportCacheEntry : FileCacheEntry {
+    double startTime = 0.0;
+    double endTime = 0.0;
+    std::map<std::string, std::string> urls;  // upload target -> URL
+};
+
+// Content-addressed store of finished exports in VideoEditor/ExportCache
+// under LocalDataDir(). The key covers the source content (size plus
+// sampled bytes, not its name or path) and every setting that changes the
+// output, so a repeated export is linked back instead of encoded again and
+// its upload URL can be reused. Least recently used entries are evicted
+// beyond g_exportCacheMB.
+class ExportCache {
+public:
+    static ExportCache& Get();
+
+    // `audioTracks` are the unmuted tracks the export mixes or copies.
+    // `streamed` exports go to an output sink as fragmented MP4 and are
+    // kept apart from plain ones.
+    static std::string MakeKey(const std::wstring& sourcePath, const ExportOptions& options,
+                               const std::vector<int>& audioTracks, const std::wstring& outputPath,
+                               bool streamed);
+
+    // Places the cached output at `outputPath`. False if there is no entry
+    // or the cached file was changed or removed since it was stored.
+    bool Fetch(const std::string& key, const std::wstring& outputPath, ExportCacheEntry& entry);
+    // Adds a finished export, then evicts down to the size limit.
+    void Store(const std::string& key, const std::wstring& outputPath, const std::wstring& sourcePath,
+               const ExportOptions& options);
+    void SetUrl(const std::string& key, const std::string& target, const std::string& url);
+
+    // Most recently used first.
+    std::vector<ExportCacheEntry> List();
+    void Remove(const std::string& key);
+    void Clear();
+    void Trim(int64_t maxBytes);
+
+private:
+    ExportCache() = default;
+
+    FileCacheStore m_store{ L"ExportCache", "Export cache" };
+    std::mutex m_mutex;
+};
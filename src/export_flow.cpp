@@ -0,0 +1,71 @@
+#include "export_flow.h"
+#include "export_cache.h"
+#include "b2_upload.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include "debug_log.h"
+#include <filesystem>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+std::string UploadTargetId(UploadProvider provider)
+{
+    std::wstring id = provider == UploadProvider::Catbox ? L"catbox:" + g_catboxUserHash
+                                                         : L"b2:" + g_b2BucketName + L"|" + g_b2CustomUrl;
+    return ToUtf8(id);
+}
+
+ExportFlowResult RunExportFlow(const ExportFlowRequest& request, const ExportFlowCallbacks& callbacks)
+{
+    ExportFlowResult result;
+    ExportOptions options = request.options;
+    std::string target = UploadTargetId(request.provider);
+    std::string cacheKey;
+    bool streamUpload = request.upload && request.provider == UploadProvider::B2 && request.singleFile;
+    if (request.singleFile && g_exportCacheMB > 0) {
+        cacheKey = ExportCache::MakeKey(request.sourcePath, options, request.audioTracks, request.outputPath,
+                                        streamUpload);
+        ExportCacheEntry entry;
+        result.cached = ExportCache::Get().Fetch(cacheKey, request.outputPath, entry);
+        if (result.cached) {
+            result.ok = true;
+            auto it = entry.urls.find(target);
+            if (request.upload && it != entry.urls.end()) {
+                result.url = it->second;
+                result.uploaded = true;
+            }
+        } else {
+            // The old file may be a link into the cache; writing through it
+            // would spoil that entry.
+            std::error_code ec;
+            fs::remove(fs::path(request.outputPath), ec);
+        }
+    }
+
+    std::unique_ptr<B2StreamUpload> stream;
+    if (!result.cached) {
+        if (streamUpload) {
+            stream = std::make_unique<B2StreamUpload>(request.outputPath, request.cancelFlag);
+            options.sink = stream.get();
+        }
+        result.ok = callbacks.encode(options);
+        if (result.ok && !cacheKey.empty())
+            ExportCache::Get().Store(cacheKey, request.outputPath, request.sourcePath, options);
+    }
+    if (stream) {
+        if (result.ok && callbacks.uploadStarting)
+            callbacks.uploadStarting(true);
+        result.uploaded = stream->Finish(result.ok, result.url, callbacks.uploadProgress);
+    }
+    bool cancelled = request.cancelFlag && *request.cancelFlag;
+    if (result.ok && request.upload && !result.uploaded && !cancelled) {
+        if (callbacks.uploadStarting)
+            callbacks.uploadStarting(false);
+        auto job = UploadManager::Get().Enqueue(request.provider, request.outputPath);
+        result.uploaded = UploadManager::Get().Wait(job, result.url, callbacks.uploadProgress);
+    }
+    if (result.uploaded && !cacheKey.empty())
+        ExportCache::Get().SetUrl(cacheKey, target, result.url);
+    return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include "export_options.h"
+#include "upload_manager.h"
+
+// Where an upload lands; a cached URL is only reused for the same target.
+std::string UploadTargetId(UploadProvider provider);
+
+// One export as the editor and the CLI run it.
+struct ExportFlowRequest {
+    std::wstring sourcePath;
+    std::wstring outputPath;
+    ExportOptions options;
+    std::vector<int> audioTracks;       // unmuted tracks, for the cache key
+    bool singleFile = true;             // false for fan-out exports: no cache, no streaming
+    bool upload = false;
+    UploadProvider provider = UploadProvider::B2;
+    std::atomic<bool>* cancelFlag = nullptr;
+};
+
+struct ExportFlowResult {
+    bool ok = false;                    // the output exists
+    bool cached = false;                // taken from the export cache
+    bool uploaded = false;
+    std::string url;
+};
+
+struct ExportFlowCallbacks {
+    // Writes the output with the given options (the sink may be set).
+    std::function<bool(const ExportOptions&)> encode;
+    // Called before waiting on an upload; `streamed` if it ran during the
+    // encode and only has to finish.
+    std::function<void(bool streamed)> uploadStarting;
+    std::function<void(int)> uploadProgress;
+};
+
+// Takes a repeat of an earlier single-file export from the export cache,
+// along with its upload URL. Otherwise encodes, streaming the output to B2
+// while it is written when that is the upload target, and stores it in the
+// cache. If the output was not streamed (fan-out export, short clip,
+// non-MP4 output, upload error) it is uploaded afterwards.
+ExportFlowResult RunExportFlow(const ExportFlowRequest& request, const ExportFlowCallbacks& callbacks);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class OutputSink;
+
+// Settings for a single cut/export job handed to VideoCutter.
+struct ExportOptions {
+    double startTime = 0.0;
+    double endTime = 0.0;
+    bool mergeAudio = false;
+    bool convertH264 = false;
+    bool useNvenc = false;
+    int maxBitrate = 0;          // video kbps, ignored when targetSizeMB > 0
+    int targetSizeMB = 0;        // two-pass target size mode when > 0 (MiB)
+    bool fastFirstPass = false;  // cheaper analysis pass (quarter-res on NVENC)
+    OutputSink* sink = nullptr;  // gets the MP4 bytes while they are written
+};
+
+// One output of a fan-out export. All branches are fed from a single decode
+// of the source; branches with the same size and bitrate share an encoder.
+struct ExportBranch {
+    enum class Video { None, Copy, H264 };
+    enum class Audio { None, Copy, Merge };
+
+    std::wstring outputFilename;   // container is picked from the extension
+    Video video = Video::H264;
+    Audio audio = Audio::Merge;
+    int height = 0;                // H.264 output height, 0 keeps the source
+    int videoKbps = 0;             // 0 uses the job's bitrate/target size
+};
+
+// Outcome of a target size export, filled in by VideoCutter.
+struct TargetSizeReport {
+    bool valid = false;
+    int64_t targetBytes = 0;
+    int64_t actualBytes = 0;
+    int videoKbps = 0;
+    int attempts = 0;
+    bool reusedFirstPass = false;
+
+    double ErrorPercent() const {
+        return targetBytes > 0 ? (actualBytes - targetBytes) * 100.0 / targetBytes : 0.0;
+    }
+};
@@ -0,0 +1,87 @@
+#include "export_segments.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static const char* kManifestName = "manifest.txt";
+static const char* kSegmentPrefix = "seg";
+
+std::string SegmentFileName(int index, const std::string& extension)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s%05d", kSegmentPrefix, index);
+    return name + extension;
+}
+
+bool SegmentManifest::Load(const fs::path& dir)
+{
+    key.clear();
+    segmentUs = 0;
+    segments.clear();
+
+    std::ifstream in(dir / kManifestName);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        ls >> tag;
+        if (tag == "key") {
+            ls >> key;
+        } else if (tag == "segment_us") {
+            ls >> segmentUs;
+        } else if (tag == "segment") {
+            ExportSegment seg;
+            ls >> seg.index >> seg.startUs >> seg.endUs >> seg.file;
+            if (!ls || seg.index != NextIndex() || seg.endUs <= seg.startUs)
+                break;
+            std::error_code ec;
+            if (!fs::is_regular_file(dir / fs::u8path(seg.file), ec))
+                break;
+            segments.push_back(seg);
+        }
+    }
+    return !key.empty() && segmentUs > 0;
+}
+
+bool SegmentManifest::Save(const fs::path& dir) const
+{
+    fs::path tmp = dir / (std::string(kManifestName) + ".tmp");
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out)
+            return false;
+        out << "key " << key << '\n'
+            << "segment_us " << segmentUs << '\n';
+        for (const auto& seg : segments)
+            out << "segment " << seg.index << ' ' << seg.startUs << ' ' << seg.endUs
+                << ' ' << seg.file << '\n';
+        out.flush();
+        if (!out)
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, dir / kManifestName, ec);
+    return !ec;
+}
+
+void RemoveStaleSegments(const fs::path& dir, const SegmentManifest& manifest)
+{
+    std::error_code ec;
+    std::vector<fs::path> stale;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().u8string();
+        if (name.rfind(kSegmentPrefix, 0) != 0)
+            continue;
+        bool listed = std::any_of(manifest.segments.begin(), manifest.segments.end(),
+                                  [&](const ExportSegment& s) { return s.file == name; });
+        if (!listed)
+            stale.push_back(entry.path());
+    }
+    for (const auto& p : stale)
+        fs::remove(p, ec);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// One finished segment of a resumable export. Times are microseconds from
+// the start of the cut; endUs is the first frame of the next segment.
+struct ExportSegment {
+    int index = 0;
+    std::string file;
+    int64_t startUs = 0;
+    int64_t endUs = 0;
+};
+
+// Checkpoint list kept as manifest.txt next to the segment files. Only
+// segments whose file was finalized are listed, so anything on disk past
+// the last entry after a crash or cancel is simply redone.
+class SegmentManifest {
+public:
+    std::string key;            // export settings; a mismatch discards the parts
+    int64_t segmentUs = 0;
+    std::vector<ExportSegment> segments;
+
+    // Returns false if the manifest is missing or unreadable. Entries after
+    // a gap or a missing file are dropped.
+    bool Load(const std::filesystem::path& dir);
+    // Writes a temporary file and renames it over the old manifest so an
+    // interrupted save never leaves a truncated list.
+    bool Save(const std::filesystem::path& dir) const;
+
+    int64_t ResumeUs() const { return segments.empty() ? 0 : segments.back().endUs; }
+    int NextIndex() const { return segments.empty() ? 0 : segments.back().index + 1; }
+};
+
+// Deletes segment files in `dir` that the manifest does not list.
+void RemoveStaleSegments(const std::filesystem::path& dir, const SegmentManifest& manifest);
+std::string SegmentFileName(int index, const std::string& extension);
@@ -0,0 +1,175 @@
+#include "export_stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <iomanip>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+static int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t ProcessCpuNs()
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (int64_t)(k.QuadPart + u.QuadPart) * 100;
+#else
+    return (int64_t)((double)std::clock() / CLOCKS_PER_SEC * 1e9);
+#endif
+}
+
+const char* ExportStageName(ExportStage stage)
+{
+    switch (stage) {
+    case ExportStage::Demux:  return "demux";
+    case ExportStage::Decode: return "decode";
+    case ExportStage::Scale:  return "scale";
+    case ExportStage::Encode: return "encode";
+    case ExportStage::Audio:  return "audio";
+    case ExportStage::Mux:    return "mux";
+    default:                  return "unknown";
+    }
+}
+
+void ExportStats::Begin(double durationSeconds)
+{
+    m_durationUs.store((int64_t)(durationSeconds * 1e6), std::memory_order_relaxed);
+    m_jobPpm.store(0, std::memory_order_relaxed);
+    m_passPpm.store(0, std::memory_order_relaxed);
+    m_passesDone.store(0, std::memory_order_relaxed);
+    m_frames.store(0, std::memory_order_relaxed);
+    m_bytes.store(0, std::memory_order_relaxed);
+    for (auto& s : m_stageNs)
+        s.store(0, std::memory_order_relaxed);
+    m_cpuStartNs.store(ProcessCpuNs(), std::memory_order_relaxed);
+    m_endNs.store(0, std::memory_order_relaxed);
+    m_startNs.store(NowNs(), std::memory_order_relaxed);
+    m_running.store(true, std::memory_order_release);
+}
+
+void ExportStats::Finish(bool completed)
+{
+    if (completed)
+        m_jobPpm.store(1000000, std::memory_order_relaxed);
+    m_endNs.store(NowNs(), std::memory_order_relaxed);
+    m_running.store(false, std::memory_order_release);
+}
+
+void ExportStats::SetProgress(double jobFraction, double passFraction)
+{
+    jobFraction = std::min(std::max(jobFraction, 0.0), 1.0);
+    passFraction = std::min(std::max(passFraction, 0.0), 1.0);
+    m_jobPpm.store((int64_t)(jobFraction * 1e6), std::memory_order_relaxed);
+    m_passPpm.store((int64_t)(passFraction * 1e6), std::memory_order_relaxed);
+}
+
+void ExportStats::EndPass()
+{
+    m_passesDone.fetch_add(1, std::memory_order_relaxed);
+    m_passPpm.store(0, std::memory_order_relaxed);
+}
+
+void ExportStats::AddStageTime(ExportStage stage, int64_t ns)
+{
+    int i = (int)stage;
+    if (i >= 0 && i < kExportStageCount)
+        m_stageNs[i].fetch_add(ns, std::memory_order_relaxed);
+}
+
+ExportSnapshot ExportStats::Read() const
+{
+    ExportSnapshot s;
+    s.running = m_running.load(std::memory_order_acquire);
+    int64_t start = m_startNs.load(std::memory_order_relaxed);
+    if (start == 0)
+        return s;
+    int64_t end = s.running ? NowNs() : m_endNs.load(std::memory_order_relaxed);
+    s.elapsed = std::max<int64_t>(end - start, 0) / 1e9;
+    s.cpuSeconds = std::max<int64_t>(ProcessCpuNs() - m_cpuStartNs.load(std::memory_order_relaxed), 0) / 1e9;
+
+    double duration = m_durationUs.load(std::memory_order_relaxed) / 1e6;
+    double pass = m_passPpm.load(std::memory_order_relaxed) / 1e6;
+    s.progress = m_jobPpm.load(std::memory_order_relaxed) / 1e6;
+    s.frames = m_frames.load(std::memory_order_relaxed);
+    s.bytes = m_bytes.load(std::memory_order_relaxed);
+    for (int i = 0; i < kExportStageCount; ++i)
+        s.stageSeconds[i] = m_stageNs[i].load(std::memory_order_relaxed) / 1e9;
+
+    double media = (m_passesDone.load(std::memory_order_relaxed) + pass) * duration;
+    if (s.elapsed > 0.0) {
+        s.fps = s.frames / s.elapsed;
+        s.realtime = media / s.elapsed;
+    }
+    // Bitrate and size only make sense while the output file is being
+    // written; after the last pass the final size is known.
+    double written = (pass > 0.0 ? pass : (s.running ? 0.0 : 1.0)) * duration;
+    if (written > 0.0 && s.bytes > 0) {
+        s.kbps = s.bytes * 8.0 / 1000.0 / written;
+        s.projectedBytes = s.bytes * duration / written;
+    }
+    if (!s.running)
+        s.eta = 0.0;
+    else if (s.progress > 0.001)
+        s.eta = s.elapsed * (1.0 - s.progress) / s.progress;
+    return s;
+}
+
+StageClock::StageClock(ExportStats* stats)
+    : m_stats(stats), m_last(std::chrono::steady_clock::now())
+{
+}
+
+void StageClock::Lap(ExportStage stage)
+{
+    bool tracing = TraceEnabled();
+    if (!m_stats && !tracing)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if (m_stats)
+        m_stats->AddStageTime(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count());
+    // Each lap is one span on the export thread's trace track.
+    if (tracing)
+        TraceRecord(ExportStageName(stage), "export", TraceTimeNs(m_last), TraceTimeNs(now));
+    m_last = now;
+}
+
+std::string ExportSnapshotJson(const ExportSnapshot& snap)
+{
+    std::ostringstream o;
+    o << std::fixed << std::setprecision(3)
+      << "{\"running\":" << (snap.running ? "true" : "false")
+      << ",\"elapsed_s\":" << snap.elapsed
+      << ",\"cpu_s\":" << snap.cpuSeconds
+      << ",\"progress\":" << snap.progress
+      << ",\"frames\":" << snap.frames
+      << ",\"fps\":" << snap.fps
+      << ",\"realtime\":" << snap.realtime
+      << ",\"bytes\":" << snap.bytes
+      << ",\"kbps\":" << snap.kbps
+      << ",\"projected_bytes\":" << std::setprecision(0) << snap.projectedBytes << std::setprecision(3)
+      << ",\"eta_s\":" << snap.eta
+      << ",\"stage_wall_s\":{";
+    for (int i = 0; i < kExportStageCount; ++i) {
+        if (i) o << ',';
+        o << '"' << ExportStageName((ExportStage)i) << "\":" << snap.stageSeconds[i];
+    }
+    o << "}}";
+    return o.str();
+}
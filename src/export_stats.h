@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class ExportStage { Demux, Decode, Scale, Encode, Audio, Mux, Count };
+
+const int kExportStageCount = (int)ExportStage::Count;
+const char* ExportStageName(ExportStage stage);
+
+// Point-in-time view of an export, derived from ExportStats.
+struct ExportSnapshot {
+    bool running = false;
+    double elapsed = 0.0;          // wall seconds since Begin
+    double progress = 0.0;         // whole job, 0..1
+    double fps = 0.0;              // video frames per wall second
+    double realtime = 0.0;         // media seconds processed per wall second
+    double kbps = 0.0;             // output bitrate so far
+    double projectedBytes = 0.0;   // output size if the bitrate holds
+    double eta = -1.0;             // seconds left, -1 while unknown
+    double cpuSeconds = 0.0;       // process CPU time, all threads
+    int64_t frames = 0;
+    int64_t bytes = 0;
+    double stageSeconds[kExportStageCount] = {};  // wall seconds, export thread
+};
+
+// Live numbers for one export job. The export thread updates them with
+// relaxed atomics and the UI samples them on a timer, so nothing blocks
+// per packet.
+class ExportStats {
+public:
+    void Begin(double durationSeconds);
+    // Stops the clock; a completed job reports 100% progress.
+    void Finish(bool completed);
+
+    // jobFraction covers all passes; passFraction is the share of the range
+    // the current pass has reached.
+    void SetProgress(double jobFraction, double passFraction);
+    // Counts a full pass over the range towards the realtime factor.
+    void EndPass();
+    void AddFrames(int64_t frames) { m_frames.fetch_add(frames, std::memory_order_relaxed); }
+    void SetOutputBytes(int64_t bytes) { m_bytes.store(bytes, std::memory_order_relaxed); }
+    void AddStageTime(ExportStage stage, int64_t ns);
+
+    ExportSnapshot Read() const;
+
+private:
+    std::atomic<bool> m_running{false};
+    std::atomic<int64_t> m_startNs{0};
+    std::atomic<int64_t> m_endNs{0};
+    std::atomic<int64_t> m_cpuStartNs{0};
+    std::atomic<int64_t> m_durationUs{0};
+    std::atomic<int64_t> m_jobPpm{0};
+    std::atomic<int64_t> m_passPpm{0};
+    std::atomic<int64_t> m_passesDone{0};
+    std::atomic<int64_t> m_frames{0};
+    std::atomic<int64_t> m_bytes{0};
+    std::atomic<int64_t> m_stageNs[kExportStageCount] = {};
+};
+
+// Attributes the wall time since the previous lap to a stage. Used on the
+// export thread only; a null stats pointer and tracing off make it a no-op.
+// With tracing on, every lap is also recorded as a trace span.
+class StageClock {
+public:
+    explicit StageClock(ExportStats* stats);
+    // Drops the time since the last lap, e.g. setup before the packet loop.
+    void Restart() { m_last = std::chrono::steady_clock::now(); }
+    void Lap(ExportStage stage);
+
+private:
+    ExportStats* m_stats;
+    std::chrono::steady_clock::time_point m_last;
+};
+
+// Single-line JSON object with every snapshot field, for the export log.
+// Stage times are wall time on the export thread (encoder worker threads
+// are only in cpu_s), so the key says so.
+std::string ExportSnapshotJson(const ExportSnapshot& snap);
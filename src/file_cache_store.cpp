@@ -0,0 +1,185 @@
+#include "file_cache_store.h"
+#include "platform.h"
+#include "debug_log.h"
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static const char* kEntrySuffix = ".entry";
+
+static int64_t WriteTime(const fs::path& file)
+{
+    std::error_code ec;
+    return (int64_t)fs::last_write_time(file, ec).time_since_epoch().count();
+}
+
+fs::path FileCacheStore::Dir() const
+{
+    fs::path dir = LocalDataDir() / L"VideoEditor";
+    dir /= m_dirName;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    return dir;
+}
+
+fs::path FileCacheStore::FilePath(const std::string& key, const std::string& extension) const
+{
+    return Dir() / (key + extension);
+}
+
+bool FileCacheStore::LoadFile(const fs::path& file, FileCacheEntry& entry) const
+{
+    entry = FileCacheEntry();
+    std::ifstream in(file);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        ls >> tag;
+        if (tag == "key") {
+            ls >> entry.key;
+        } else if (tag == "ext") {
+            ls >> entry.extension;
+        } else if (tag == "source") {
+            std::getline(ls >> std::ws, entry.source);
+        } else if (tag == "bytes") {
+            ls >> entry.bytes;
+        } else if (tag == "mtime") {
+            ls >> entry.writeTime;
+        } else if (tag == "used") {
+            ls >> entry.lastUsed;
+        } else if (!tag.empty()) {
+            std::string value;
+            std::getline(ls >> std::ws, value);
+            entry.extra.emplace_back(tag, value);
+        }
+    }
+    return entry.key.size() == 40 && !entry.extension.empty() && entry.bytes > 0;
+}
+
+bool FileCacheStore::Load(const std::string& key, FileCacheEntry& entry) const
+{
+    return LoadFile(Dir() / (key + kEntrySuffix), entry) && entry.key == key;
+}
+
+bool FileCacheStore::Save(const FileCacheEntry& entry) const
+{
+    fs::path file = Dir() / (entry.key + kEntrySuffix);
+    fs::path tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out)
+            return false;
+        out << "key " << entry.key << '\n'
+            << "ext " << entry.extension << '\n'
+            << "source " << entry.source << '\n'
+            << "bytes " << entry.bytes << '\n'
+            << "mtime " << entry.writeTime << '\n'
+            << "used " << entry.lastUsed << '\n';
+        for (const auto& field : entry.extra)
+            out << field.first << ' ' << field.second << '\n';
+        out.flush();
+        if (!out)
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, file, ec);
+    return !ec;
+}
+
+bool FileCacheStore::Find(const std::string& key, FileCacheEntry& entry) const
+{
+    if (key.empty() || !Load(key, entry))
+        return false;
+    fs::path file = FilePath(key, entry.extension);
+    std::error_code ec;
+    if ((int64_t)fs::file_size(file, ec) != entry.bytes || ec || WriteTime(file) != entry.writeTime) {
+        LOG_INFO(m_logName << " entry " << key << " changed on disk; dropping it");
+        Remove(key, entry.extension);
+        return false;
+    }
+    return true;
+}
+
+void FileCacheStore::Touch(FileCacheEntry& entry) const
+{
+    entry.lastUsed = (int64_t)time(nullptr);
+    Save(entry);
+}
+
+bool FileCacheStore::Add(FileCacheEntry& entry) const
+{
+    fs::path file = FilePath(entry.key, entry.extension);
+    std::error_code ec;
+    entry.bytes = (int64_t)fs::file_size(file, ec);
+    if (ec || entry.bytes <= 0) {
+        LOG_WARN(m_logName << " could not add " << file.u8string());
+        fs::remove(file, ec);
+        return false;
+    }
+    entry.writeTime = WriteTime(file);
+    entry.lastUsed = (int64_t)time(nullptr);
+    if (!Save(entry)) {
+        fs::remove(file, ec);
+        return false;
+    }
+    return true;
+}
+
+std::vector<FileCacheEntry> FileCacheStore::Scan() const
+{
+    std::vector<FileCacheEntry> entries;
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(Dir(), ec)) {
+        if (file.path().extension() != kEntrySuffix)
+            continue;
+        FileCacheEntry entry;
+        if (LoadFile(file.path(), entry))
+            entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const FileCacheEntry& a, const FileCacheEntry& b) { return a.lastUsed > b.lastUsed; });
+    return entries;
+}
+
+void FileCacheStore::Remove(const std::string& key, const std::string& extension) const
+{
+    fs::path dir = Dir();
+    std::error_code ec;
+    if (!extension.empty()) {
+        fs::path file = dir / (key + extension);
+        if (!fs::remove(file, ec) && fs::exists(file, ec))
+            return;
+    }
+    fs::remove(dir / (key + kEntrySuffix), ec);
+}
+
+void FileCacheStore::Clear() const
+{
+    std::error_code ec;
+    std::vector<fs::path> files;
+    for (const auto& file : fs::directory_iterator(Dir(), ec))
+        files.push_back(file.path());
+    for (const auto& p : files)
+        fs::remove(p, ec);
+}
+
+void FileCacheStore::Trim(int64_t maxBytes, bool keepNewest) const
+{
+    int64_t total = 0;
+    bool first = true;
+    for (const auto& entry : Scan()) {
+        total += entry.bytes;
+        if (total > maxBytes && !(first && keepNewest)) {
+            LOG_INFO(m_logName << " evicting " << entry.key << " (" << entry.source << ")");
+            Remove(entry.key, entry.extension);
+        }
+        first = false;
+    }
+}
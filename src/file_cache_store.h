@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One file kept by a FileCacheStore. Stored as <key><extension> plus
+// <key>.entry, a few "tag value" lines, in the store's directory.
+struct FileCacheEntry {
+    std::string key;                        // 40 hex digits
+    std::string extension;                  // of the stored file, e.g. ".mp4"
+    std::string source;                     // source file name, for listing
+    int64_t bytes = 0;
+    int64_t writeTime = 0;                  // of the stored file when added
+    int64_t lastUsed = 0;                   // unix seconds
+    // Lines the owning cache adds (tag, rest of the line), kept in order.
+    std::vector<std::pair<std::string, std::string>> extra;
+};
+
+// The on-disk side of the export and proxy caches: files named by content
+// key in VideoEditor/<dirName> under LocalDataDir(), each with an entry
+// file, evicted least recently used first. Not locked; the owning cache
+// serialises calls.
+class FileCacheStore {
+public:
+    // `logName` starts the log lines, e.g. "Export cache".
+    FileCacheStore(const wchar_t* dirName, const char* logName) : m_dirName(dirName), m_logName(logName) {}
+
+    std::filesystem::path Dir() const;
+    std::filesystem::path FilePath(const std::string& key, const std::string& extension) const;
+
+    // The entry for `key` as last saved.
+    bool Load(const std::string& key, FileCacheEntry& entry) const;
+    // Written to a temporary file and renamed over the old entry.
+    bool Save(const FileCacheEntry& entry) const;
+
+    // Load, plus a check that the stored file is the one that was added:
+    // an entry whose file was changed or removed since is dropped.
+    bool Find(const std::string& key, FileCacheEntry& entry) const;
+    // Marks the entry used now and saves it.
+    void Touch(FileCacheEntry& entry) const;
+    // Records a file the owner has just placed at FilePath, taking its size
+    // and write time. On failure the file is removed again.
+    bool Add(FileCacheEntry& entry) const;
+
+    // Most recently used first.
+    std::vector<FileCacheEntry> Scan() const;
+    // The entry goes only with its file: one still open (for playback, say)
+    // cannot be deleted on Windows and stays listed until a later trim.
+    void Remove(const std::string& key, const std::string& extension) const;
+    void Clear() const;
+    // Evicts down to `maxBytes`; `keepNewest` spares the entry used last
+    // even if it alone is over the limit.
+    void Trim(int64_t maxBytes, bool keepNewest) const;
+
+private:
+    bool LoadFile(const std::filesystem::path& file, FileCacheEntry& entry) const;
+
+    const wchar_t* m_dirName;
+    const char* m_logName;
+};
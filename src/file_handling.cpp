@@ -84,3 +84,24 @@ void LoadVideoFile(HWND hwnd, const std::wstring& filename)
         MessageBoxW(hwnd, L"Failed to load the video file. Please check FFmpeg setup.", L"Error", MB_OK | MB_ICONERROR);
     }
 }
+
+void SavePlaybackStatsFile(HWND hwnd)
+{
+    if (!g_videoPlayer)
+        return;
+    OPENFILENAMEW ofn;
+    wchar_t szFile[260] = L"playback-stats.csv";
+
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = sizeof(szFile) / sizeof(wchar_t);
+    ofn.lpstrFilter = L"CSV Files\0*.csv\0All Files\0*.*\0";
+    ofn.nFilterIndex = 1;
+    ofn.lpstrDefExt = L"csv";
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+
+    if (GetSaveFileNameW(&ofn) && !g_videoPlayer->SavePlaybackStats(szFile))
+        MessageBoxW(hwnd, L"Could not write the playback statistics file.", L"Error", MB_OK | MB_ICONERROR);
+}
@@ -5,3 +5,4 @@
 
 void OpenVideoFile(HWND hwnd);
 void LoadVideoFile(HWND hwnd, const std::wstring& filename);
+void SavePlaybackStatsFile(HWND hwnd);
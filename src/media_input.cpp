@@ -0,0 +1,235 @@
+#include "media_input.h"
+#include "debug_log.h"
+#include "read_ahead_io.h"
+#include "trace.h"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// The quick probe; FFmpeg's defaults are 5 MB and 5 s.
+static const int64_t kQuickProbeBytes = 2 * 1024 * 1024;
+static const int64_t kQuickAnalyzeUs = AV_TIME_BASE;
+static const size_t kMaxProbeEntries = 16;
+
+struct FileStamp {
+    uintmax_t size = 0;
+    fs::file_time_type writeTime;
+};
+
+struct ProbedStream {
+    AVCodecParameters* par = nullptr;
+    AVRational avgFrameRate{0, 1};
+    AVRational rFrameRate{0, 1};
+    int64_t startTime = AV_NOPTS_VALUE;
+    int64_t duration = AV_NOPTS_VALUE;
+    int64_t nbFrames = 0;
+};
+
+struct ProbeEntry {
+    std::string path;
+    FileStamp stamp;
+    std::string format;
+    int64_t startTime = AV_NOPTS_VALUE;
+    int64_t duration = AV_NOPTS_VALUE;
+    int64_t bitRate = 0;
+    std::vector<ProbedStream> streams;
+    uint64_t lastUse = 0;
+
+    ~ProbeEntry()
+    {
+        for (ProbedStream& s : streams)
+            avcodec_parameters_free(&s.par);
+    }
+};
+
+static std::mutex s_probeMutex;
+static std::vector<std::unique_ptr<ProbeEntry>> s_probeEntries;
+static uint64_t s_probeUses = 0;
+
+static bool StampFile(const std::string& utf8Path, FileStamp& stamp)
+{
+    std::error_code ec;
+    fs::path path = fs::u8path(utf8Path);
+    stamp.size = fs::file_size(path, ec);
+    if (ec)
+        return false;
+    stamp.writeTime = fs::last_write_time(path, ec);
+    return !ec;
+}
+
+// What avformat_find_stream_info checks before it stops reading, for the
+// streams a decoder exists for.
+static bool StreamsDescribed(const AVFormatContext* ctx)
+{
+    for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+        const AVCodecParameters* par = ctx->streams[i]->codecpar;
+        if (par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO)
+            continue;
+        if (par->codec_id == AV_CODEC_ID_NONE)
+            return false;
+        if (!avcodec_find_decoder(par->codec_id))
+            continue;
+        if (par->format < 0)
+            return false;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO && (par->width <= 0 || par->height <= 0))
+            return false;
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO && (par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0))
+            return false;
+    }
+    return true;
+}
+
+static ProbeEntry* FindLocked(const std::string& utf8Path)
+{
+    for (auto& e : s_probeEntries)
+        if (e->path == utf8Path)
+            return e.get();
+    return nullptr;
+}
+
+// Fills in a freshly opened context from the cache. False unless the file
+// and the streams its header lists still match the entry.
+static bool RestoreProbe(AVFormatContext* ctx, const std::string& utf8Path, const FileStamp& stamp)
+{
+    std::lock_guard<std::mutex> lock(s_probeMutex);
+    ProbeEntry* e = FindLocked(utf8Path);
+    if (!e || e->stamp.size != stamp.size || e->stamp.writeTime != stamp.writeTime ||
+        e->format != ctx->iformat->name || e->streams.size() != ctx->nb_streams)
+        return false;
+    for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+        const AVCodecParameters* header = ctx->streams[i]->codecpar;
+        const AVCodecParameters* probed = e->streams[i].par;
+        if (header->codec_type != probed->codec_type || header->codec_id != probed->codec_id)
+            return false;
+    }
+
+    for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+        AVStream* st = ctx->streams[i];
+        const ProbedStream& s = e->streams[i];
+        if (avcodec_parameters_copy(st->codecpar, s.par) < 0)
+            return false;
+        st->avg_frame_rate = s.avgFrameRate;
+        st->r_frame_rate = s.rFrameRate;
+        st->start_time = s.startTime;
+        st->duration = s.duration;
+        st->nb_frames = s.nbFrames;
+    }
+    ctx->start_time = e->startTime;
+    ctx->duration = e->duration;
+    ctx->bit_rate = e->bitRate;
+    e->lastUse = ++s_probeUses;
+    return true;
+}
+
+static void StoreProbe(const AVFormatContext* ctx, const std::string& utf8Path, const FileStamp& stamp)
+{
+    auto e = std::make_unique<ProbeEntry>();
+    e->path = utf8Path;
+    e->stamp = stamp;
+    e->format = ctx->iformat->name;
+    e->startTime = ctx->start_time;
+    e->duration = ctx->duration;
+    e->bitRate = ctx->bit_rate;
+    for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+        const AVStream* st = ctx->streams[i];
+        ProbedStream s;
+        s.par = avcodec_parameters_alloc();
+        if (!s.par || avcodec_parameters_copy(s.par, st->codecpar) < 0) {
+            avcodec_parameters_free(&s.par);
+            return;
+        }
+        s.avgFrameRate = st->avg_frame_rate;
+        s.rFrameRate = st->r_frame_rate;
+        s.startTime = st->start_time;
+        s.duration = st->duration;
+        s.nbFrames = st->nb_frames;
+        e->streams.push_back(s);
+    }
+
+    std::lock_guard<std::mutex> lock(s_probeMutex);
+    e->lastUse = ++s_probeUses;
+    s_probeEntries.erase(std::remove_if(s_probeEntries.begin(), s_probeEntries.end(),
+                                        [&](const std::unique_ptr<ProbeEntry>& old) { return old->path == utf8Path; }),
+                         s_probeEntries.end());
+    if (s_probeEntries.size() >= kMaxProbeEntries) {
+        auto oldest = std::min_element(s_probeEntries.begin(), s_probeEntries.end(),
+                                       [](const std::unique_ptr<ProbeEntry>& a, const std::unique_ptr<ProbeEntry>& b) {
+                                           return a->lastUse < b->lastUse;
+                                       });
+        s_probeEntries.erase(oldest);
+    }
+    s_probeEntries.push_back(std::move(e));
+}
+
+// avformat_open_input on a read-ahead AVIOContext when one can be made.
+static int OpenInput(AVFormatContext** ctx, const std::string& utf8Path, AVDictionary** opts)
+{
+    AVIOContext* pb = OpenReadAheadIO(utf8Path);
+    if (pb) {
+        *ctx = avformat_alloc_context();
+        if (!*ctx) {
+            CloseReadAheadIO(&pb);
+            return AVERROR(ENOMEM);
+        }
+        (*ctx)->pb = pb;
+        (*ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    int ret = avformat_open_input(ctx, utf8Path.c_str(), nullptr, opts);
+    if (ret < 0)
+        CloseReadAheadIO(&pb);      // FFmpeg freed the context but not our I/O
+    return ret;
+}
+
+int OpenMediaInput(AVFormatContext** ctx, const std::string& utf8Path)
+{
+    TRACE_SCOPE("OpenMediaInput", "io");
+    *ctx = nullptr;
+    FileStamp stamp;
+    bool cacheable = StampFile(utf8Path, stamp);
+
+    AVDictionary* opts = nullptr;
+    av_dict_set_int(&opts, "probesize", kQuickProbeBytes, 0);
+    av_dict_set_int(&opts, "analyzeduration", kQuickAnalyzeUs, 0);
+    int ret = OpenInput(ctx, utf8Path, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    if (cacheable && RestoreProbe(*ctx, utf8Path, stamp)) {
+        LOG_DEBUG("Stream info of " << utf8Path << " taken from the probe cache");
+        return 0;
+    }
+    {
+        TRACE_SCOPE("avformat_find_stream_info", "io");
+        ret = avformat_find_stream_info(*ctx, nullptr);
+    }
+    if (ret >= 0 && !StreamsDescribed(*ctx)) {
+        LOG_INFO("Quick probe of " << utf8Path << " left streams undescribed; probing with the defaults");
+        CloseMediaInput(ctx);
+        ret = OpenInput(ctx, utf8Path, nullptr);
+        if (ret < 0)
+            return ret;
+        TRACE_SCOPE("avformat_find_stream_info", "io");
+        ret = avformat_find_stream_info(*ctx, nullptr);
+    }
+    if (ret < 0) {
+        CloseMediaInput(ctx);
+        return ret;
+    }
+    if (cacheable)
+        StoreProbe(*ctx, utf8Path, stamp);
+    return 0;
+}
+
+void CloseMediaInput(AVFormatContext** ctx)
+{
+    if (!*ctx)
+        return;
+    AVIOContext* pb = ((*ctx)->flags & AVFMT_FLAG_CUSTOM_IO) ? (*ctx)->pb : nullptr;
+    avformat_close_input(ctx);
+    CloseReadAheadIO(&pb);
+}
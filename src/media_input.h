@@ -0,0 +1,23 @@
+#pragma once
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <string>
+
+// avformat_open_input plus avformat_find_stream_info for a source file.
+// The first open of a file probes at most a couple of MB and a second of
+// media, and probes again with FFmpeg's defaults only when a decodable
+// stream is still missing its parameters. The stream parameters found are
+// kept in memory per file (path, size and modification time), so later
+// opens of the same file - a reload, MediaSource's audio demuxer, each
+// pass of an export - restore them without probing. Files whose header
+// does not list every stream (MPEG-TS) are probed every time.
+// The file is read through OpenReadAheadIO when it can be.
+// Returns 0 or a negative AVERROR; on failure *ctx is null.
+int OpenMediaInput(AVFormatContext** ctx, const std::string& utf8Path);
+// avformat_close_input for a context from OpenMediaInput, which also frees
+// its read-ahead I/O.
+void CloseMediaInput(AVFormatContext** ctx);
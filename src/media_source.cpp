@@ -0,0 +1,335 @@
+#include "media_source.h"
+#include "debug_log.h"
+#include "platform.h"
+#include "media_input.h"
+#include <algorithm>
+
+std::vector<int> MediaInfo::UnmutedStreams() const
+{
+    std::vector<int> streams;
+    for (const auto& track : audioTracks) {
+        if (!track.isMuted)
+            streams.push_back(track.streamIndex);
+    }
+    return streams;
+}
+
+bool OpenMergeTrack(AVStream* inStream, int index, MergeTrack& mt)
+{
+    mt.index = index;
+    const AVCodec* dec = avcodec_find_decoder(inStream->codecpar->codec_id);
+    mt.decCtx = avcodec_alloc_context3(dec);
+    if (!dec || !mt.decCtx ||
+        avcodec_parameters_to_context(mt.decCtx, inStream->codecpar) < 0 ||
+        avcodec_open2(mt.decCtx, dec, nullptr) < 0)
+        return false;
+    mt.swrCtx = swr_alloc();
+    av_opt_set_int(mt.swrCtx, "in_sample_rate", mt.decCtx->sample_rate, 0);
+    av_opt_set_int(mt.swrCtx, "out_sample_rate", kMixSampleRate, 0);
+    av_opt_set_sample_fmt(mt.swrCtx, "in_sample_fmt", mt.decCtx->sample_fmt, 0);
+    av_opt_set_sample_fmt(mt.swrCtx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+    av_channel_layout_default(&mt.decCtx->ch_layout,
+                              mt.decCtx->ch_layout.nb_channels ?
+                                  mt.decCtx->ch_layout.nb_channels : 2);
+    AVChannelLayout out_ch{};
+    av_channel_layout_default(&out_ch, 2);
+    av_opt_set_chlayout(mt.swrCtx, "in_chlayout", &mt.decCtx->ch_layout, 0);
+    av_opt_set_chlayout(mt.swrCtx, "out_chlayout", &out_ch, 0);
+    if (swr_init(mt.swrCtx) < 0)
+        return false;
+    mt.frame = av_frame_alloc();
+    return mt.frame != nullptr;
+}
+
+void FreeMergeTrack(MergeTrack& mt)
+{
+    if (mt.swrCtx) swr_free(&mt.swrCtx);
+    if (mt.decCtx) avcodec_free_context(&mt.decCtx);
+    if (mt.frame) av_frame_free(&mt.frame);
+}
+
+void FreeMergeTracks(std::vector<MergeTrack>& tracks)
+{
+    for (auto &mt : tracks)
+        FreeMergeTrack(mt);
+    tracks.clear();
+}
+
+void DecodeMergeTrack(MergeTrack& mt, BlockMixer& mixer, int track, AVPacket* pkt,
+                      AVStream* inStream, int64_t startPts)
+{
+    int64_t trackStart = av_rescale_q(startPts, AV_TIME_BASE_Q, inStream->time_base);
+    avcodec_send_packet(mt.decCtx, pkt);
+    while (avcodec_receive_frame(mt.decCtx, mt.frame) == 0) {
+        int outSamples = swr_get_out_samples(mt.swrCtx, mt.frame->nb_samples);
+        if ((int)mt.scratch.size() < outSamples * 2)
+            mt.scratch.resize(outSamples * 2);
+        // Position of the first converted sample on the mix timeline, net
+        // of what the resampler still holds.
+        int64_t mixPts = BlockMixer::kNoPts;
+        if (mt.frame->best_effort_timestamp != AV_NOPTS_VALUE)
+            mixPts = av_rescale_q(mt.frame->best_effort_timestamp - trackStart,
+                                  inStream->time_base, {1, kMixSampleRate})
+                     - swr_get_delay(mt.swrCtx, kMixSampleRate);
+        uint8_t* outArr[1] = { reinterpret_cast<uint8_t*>(mt.scratch.data()) };
+        int conv = swr_convert(mt.swrCtx, outArr, outSamples,
+                              (const uint8_t**)mt.frame->data,
+                              mt.frame->nb_samples);
+        if (conv > 0)
+            mixer.Push(track, mixPts, mt.scratch.data(), conv);
+    }
+}
+
+struct MediaSource::AudioState {
+    AVFormatContext* fmt = nullptr;
+    AVPacket* packet = nullptr;
+    std::vector<MergeTrack> tracks;
+    std::unique_ptr<BlockMixer> mixer;
+    int64_t startPts = 0;
+    bool eof = false;
+
+    ~AudioState()
+    {
+        FreeMergeTracks(tracks);
+        if (packet)
+            av_packet_free(&packet);
+        CloseMediaInput(&fmt);
+    }
+};
+
+MediaSource::MediaSource() {}
+
+MediaSource::~MediaSource()
+{
+    Close();
+}
+
+bool MediaSource::Open(const std::wstring& filename)
+{
+    Close();
+    m_utf8Name = ToUtf8(filename);
+    if (OpenMediaInput(&m_video, m_utf8Name) < 0) {
+        LOG_ERROR("Could not open " << m_utf8Name);
+        return false;
+    }
+
+    m_info.filename = filename;
+    for (unsigned i = 0; i < m_video->nb_streams; ++i) {
+        AVStream* st = m_video->streams[i];
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && m_info.videoStreamIndex < 0) {
+            m_info.videoStreamIndex = (int)i;
+        } else if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+                   avcodec_find_decoder(st->codecpar->codec_id)) {
+            MediaTrackInfo track;
+            track.streamIndex = (int)i;
+            track.bitRate = st->codecpar->bit_rate;
+            AVDictionaryEntry* title = av_dict_get(st->metadata, "title", nullptr, 0);
+            track.name = title ? title->value : "Audio Track " + std::to_string(m_info.audioTracks.size() + 1);
+            m_info.audioTracks.push_back(track);
+        }
+    }
+    if (m_info.videoStreamIndex < 0 || !OpenVideoDecoder()) {
+        LOG_ERROR("No decodable video stream in " << m_utf8Name);
+        Close();
+        return false;
+    }
+
+    AVStream* vs = m_video->streams[m_info.videoStreamIndex];
+    AVRational rate = av_guess_frame_rate(m_video, vs, nullptr);
+    m_info.frameRate = rate.num > 0 && rate.den > 0 ? av_q2d(rate) : 0.0;
+    m_info.duration = m_video->duration != AV_NOPTS_VALUE ? m_video->duration / (double)AV_TIME_BASE : 0.0;
+    m_info.frameWidth = m_videoDec->width;
+    m_info.frameHeight = m_videoDec->height;
+
+    // This demuxer only feeds the video decoder; audio has its own.
+    for (unsigned i = 0; i < m_video->nb_streams; ++i) {
+        if ((int)i != m_info.videoStreamIndex)
+            m_video->streams[i]->discard = AVDISCARD_ALL;
+    }
+    m_videoPackets.Attach(m_video, m_info.videoStreamIndex);
+    return true;
+}
+
+bool MediaSource::OpenVideoDecoder()
+{
+    AVStream* vs = m_video->streams[m_info.videoStreamIndex];
+    const AVCodec* codec = avcodec_find_decoder(vs->codecpar->codec_id);
+    if (!codec)
+        return false;
+    m_videoDec = avcodec_alloc_context3(codec);
+    if (!m_videoDec || avcodec_parameters_to_context(m_videoDec, vs->codecpar) < 0)
+        return false;
+    m_videoDec->pkt_timebase = vs->time_base;
+    // Headless callers want throughput, so let the decoder use every core.
+    m_videoDec->thread_count = 0;
+    if (avcodec_open2(m_videoDec, codec, nullptr) < 0)
+        return false;
+    m_frame = av_frame_alloc();
+    m_packet = av_packet_alloc();
+    return m_frame && m_packet;
+}
+
+void MediaSource::Close()
+{
+    m_audio.reset();
+    if (m_frame)
+        av_frame_free(&m_frame);
+    if (m_packet)
+        av_packet_free(&m_packet);
+    if (m_videoDec)
+        avcodec_free_context(&m_videoDec);
+    m_videoPackets.Clear();
+    CloseMediaInput(&m_video);
+    m_info = MediaInfo();
+    m_utf8Name.clear();
+    m_videoDrained = false;
+    m_position = 0.0;
+    m_lastVideo = 0.0;
+}
+
+void MediaSource::SetTrackMuted(int track, bool muted)
+{
+    if (track >= 0 && track < (int)m_info.audioTracks.size())
+        m_info.audioTracks[track].isMuted = muted;
+}
+
+bool MediaSource::Seek(double seconds)
+{
+    if (!IsOpen())
+        return false;
+    int64_t ts = (int64_t)(seconds * AV_TIME_BASE);
+    if (m_videoPackets.Seek(-1, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        LOG_WARN("Seek failed in " << m_utf8Name);
+        return false;
+    }
+    avcodec_flush_buffers(m_videoDec);
+    m_videoDrained = false;
+    m_position = seconds;
+    m_lastVideo = seconds;
+    StopAudio();
+    return true;
+}
+
+const AVFrame* MediaSource::DecodeVideo(double* seconds)
+{
+    if (!IsOpen())
+        return nullptr;
+    AVStream* vs = m_video->streams[m_info.videoStreamIndex];
+    double frameTime = m_info.frameRate > 0 ? 1.0 / m_info.frameRate : 0.0;
+    while (true) {
+        int ret = avcodec_receive_frame(m_videoDec, m_frame);
+        if (ret == 0) {
+            double t = m_frame->best_effort_timestamp != AV_NOPTS_VALUE
+                           ? m_frame->best_effort_timestamp * av_q2d(vs->time_base)
+                           : m_lastVideo + frameTime;
+            // Frames between the keyframe and the seek target only prime
+            // the decoder.
+            if (t < m_position - 1e-6)
+                continue;
+            m_lastVideo = t;
+            if (seconds)
+                *seconds = t;
+            return m_frame;
+        }
+        if (ret != AVERROR(EAGAIN) || m_videoDrained)
+            return nullptr;
+        if (m_videoPackets.Read(m_packet) < 0) {
+            avcodec_send_packet(m_videoDec, nullptr);
+            m_videoDrained = true;
+            continue;
+        }
+        if (m_packet->stream_index == m_info.videoStreamIndex)
+            avcodec_send_packet(m_videoDec, m_packet);
+        av_packet_unref(m_packet);
+    }
+}
+
+bool MediaSource::StartAudio()
+{
+    std::vector<int> streams = m_info.UnmutedStreams();
+    if (streams.empty())
+        return false;
+    if (!m_audio)
+        m_audio = std::make_unique<AudioState>();
+    AudioState& a = *m_audio;
+    if (!a.fmt) {
+        if (OpenMediaInput(&a.fmt, m_utf8Name) < 0) {
+            LOG_WARN("Could not open the audio of " << m_utf8Name);
+            return false;
+        }
+        a.packet = av_packet_alloc();
+        if (!a.packet)
+            return false;
+    }
+
+    for (unsigned i = 0; i < a.fmt->nb_streams; ++i) {
+        bool wanted = std::find(streams.begin(), streams.end(), (int)i) != streams.end();
+        a.fmt->streams[i]->discard = wanted ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    a.startPts = (int64_t)(m_position * AV_TIME_BASE);
+    if (av_seek_frame(a.fmt, -1, a.startPts, AVSEEK_FLAG_BACKWARD) < 0 && m_position > 0.0) {
+        LOG_WARN("Audio seek failed in " << m_utf8Name);
+        return false;
+    }
+    for (int idx : streams) {
+        MergeTrack mt;
+        if (OpenMergeTrack(a.fmt->streams[idx], idx, mt)) {
+            a.tracks.push_back(std::move(mt));
+        } else {
+            LOG_WARN("Skipping undecodable audio stream " << idx);
+            FreeMergeTrack(mt);
+        }
+    }
+    if (a.tracks.empty())
+        return false;
+    a.mixer = std::make_unique<BlockMixer>((int)a.tracks.size(), kMixSampleRate, kMixBlockFrames,
+                                           kMixBufferSeconds);
+    a.eof = false;
+    return true;
+}
+
+void MediaSource::StopAudio()
+{
+    if (!m_audio)
+        return;
+    FreeMergeTracks(m_audio->tracks);
+    m_audio->mixer.reset();
+    m_audio->eof = false;
+}
+
+int MediaSource::MixAudio(int16_t* out)
+{
+    if (!IsOpen())
+        return 0;
+    if ((!m_audio || !m_audio->mixer) && !StartAudio())
+        return 0;
+    AudioState& a = *m_audio;
+    BlockMixer& mixer = *a.mixer;
+    while (!mixer.Ready(a.eof)) {
+        if (a.eof)
+            return 0;
+        if (av_read_frame(a.fmt, a.packet) < 0) {
+            // Drain what the decoders still hold, then flush the mixer.
+            for (size_t t = 0; t < a.tracks.size(); ++t)
+                DecodeMergeTrack(a.tracks[t], mixer, (int)t, nullptr,
+                                 a.fmt->streams[a.tracks[t].index], a.startPts);
+            mixer.FinishAll();
+            a.eof = true;
+            continue;
+        }
+        for (size_t t = 0; t < a.tracks.size(); ++t) {
+            if (a.tracks[t].index == a.packet->stream_index) {
+                DecodeMergeTrack(a.tracks[t], mixer, (int)t, a.packet,
+                                 a.fmt->streams[a.packet->stream_index], a.startPts);
+                break;
+            }
+        }
+        av_packet_unref(a.packet);
+    }
+    return mixer.MixS16(out, a.eof);
+}
+
+const MixStats* MediaSource::AudioMixStats() const
+{
+    return m_audio && m_audio->mixer ? &m_audio->mixer->Stats() : nullptr;
+}
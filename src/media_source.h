@@ -0,0 +1,121 @@
+#pragma once
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+#include <libswresample/swresample.h>
+#include <libavutil/opt.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/rational.h>
+#include <libavutil/avutil.h>
+}
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "audio_mixer.h"
+#include "packet_cache.h"
+
+// Merged audio is mixed at this rate; each track may run this far ahead.
+static const int kMixSampleRate = 44100;
+static const double kMixBufferSeconds = 10.0;
+// Frames per block returned by MediaSource::MixAudio.
+static const int kMixBlockFrames = 1024;
+
+struct MediaTrackInfo {
+    int streamIndex = -1;
+    std::string name;
+    int64_t bitRate = 0;        // from the container, 0 if unknown
+    bool isMuted = false;
+};
+
+// What cutting and exporting need to know about a file. VideoPlayer fills
+// one in from its loaded state, MediaSource from its own probe.
+struct MediaInfo {
+    std::wstring filename;
+    int videoStreamIndex = -1;
+    int frameWidth = 0;
+    int frameHeight = 0;
+    double frameRate = 0.0;
+    double duration = 0.0;
+    std::vector<MediaTrackInfo> audioTracks;
+
+    bool IsLoaded() const { return videoStreamIndex >= 0 && !filename.empty(); }
+    // Stream indices of the unmuted audio tracks.
+    std::vector<int> UnmutedStreams() const;
+};
+
+// One source audio track decoded and resampled to stereo S16 at
+// kMixSampleRate for a BlockMixer.
+struct MergeTrack {
+    int index = -1;
+    AVCodecContext* decCtx = nullptr;
+    SwrContext* swrCtx = nullptr;
+    AVFrame* frame = nullptr;
+    std::vector<int16_t> scratch;
+};
+
+bool OpenMergeTrack(AVStream* inStream, int index, MergeTrack& mt);
+void FreeMergeTrack(MergeTrack& mt);
+void FreeMergeTracks(std::vector<MergeTrack>& tracks);
+// Decodes one packet of a merge track and queues the converted samples.
+// `startPts` (AV_TIME_BASE) is mix position 0.
+void DecodeMergeTrack(MergeTrack& mt, BlockMixer& mixer, int track, AVPacket* pkt,
+                      AVStream* inStream, int64_t startPts);
+
+// A file opened for headless use: probe, seek, decode video and mix the
+// unmuted audio tracks, with no window or audio device involved. Video and
+// audio are read through separate demuxers so either can be pulled on its
+// own. Times are in seconds on the file's clock, as in ExportOptions.
+class MediaSource {
+public:
+    MediaSource();
+    ~MediaSource();
+    MediaSource(const MediaSource&) = delete;
+    MediaSource& operator=(const MediaSource&) = delete;
+
+    bool Open(const std::wstring& filename);
+    void Close();
+    bool IsOpen() const { return m_video != nullptr; }
+    const MediaInfo& Info() const { return m_info; }
+
+    // Applies from the next Seek.
+    void SetTrackMuted(int track, bool muted);
+
+    // The next DecodeVideo returns the first frame at or after `seconds`
+    // and MixAudio starts there.
+    bool Seek(double seconds);
+
+    // Next video frame in the decoder's own pixel format, owned by the
+    // source until the next call; nullptr at the end or on error.
+    const AVFrame* DecodeVideo(double* seconds = nullptr);
+
+    // Next kMixBlockFrames frames of the unmuted tracks mixed to
+    // interleaved stereo S16 at kMixSampleRate. Returns the frames
+    // written, fewer at the end and 0 once everything was returned.
+    int MixAudio(int16_t* out);
+    const MixStats* AudioMixStats() const;
+
+private:
+    struct AudioState;
+
+    bool OpenVideoDecoder();
+    bool StartAudio();
+    void StopAudio();
+
+    MediaInfo m_info;
+    std::string m_utf8Name;
+    AVFormatContext* m_video = nullptr;
+    PacketCache m_videoPackets;
+    AVCodecContext* m_videoDec = nullptr;
+    AVFrame* m_frame = nullptr;
+    AVPacket* m_packet = nullptr;
+    bool m_videoDrained = false;
+    double m_position = 0.0;        // last seek target
+    double m_lastVideo = 0.0;       // time of the last returned frame
+    std::unique_ptr<AudioState> m_audio;
+};
@@ -1,4 +1,8 @@
 #include "options_window.h"
+#include "export_cache.h"
+#include "trace.h"
+#include <commdlg.h>
+#include <cstdio>
 
 // Forward declaration from main.cpp for styling
 void ApplyDarkTheme(HWND hwnd);
@@ -6,19 +10,15 @@ void ApplyDarkTheme(HWND hwnd);
 static HWND g_hOptionsWnd = nullptr;
 static HWND g_hUploadWnd = nullptr;
 static HWND g_hCatboxWnd = nullptr;
+static HWND g_hCacheWnd = nullptr;
 
-// Global option variables
+// Global option variables; the engine's own live in engine_settings.cpp
 bool g_useNvenc = false;
-bool g_logToFile = true;
-std::wstring g_b2KeyId;
-std::wstring g_b2AppKey;
-std::wstring g_b2BucketId;
-std::wstring g_b2BucketName;
-std::wstring g_b2CustomUrl;
+bool g_fastFirstPass = false;
+bool g_exportCopies = false;
 bool g_autoUpload = false;
 bool g_useCatbox = false;
 bool g_useB2 = true;
-std::wstring g_catboxUserHash;
 
 // Load settings from Windows registry
 void LoadSettings()
@@ -31,6 +31,38 @@ void LoadSettings()
         size = sizeof(val);
         if (RegQueryValueExW(hKey, L"EnableLogFile", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS)
             g_logToFile = (val != 0);
+        size = sizeof(val);
+        // No UI: set it to 0 for debug records, 2 or 3 to keep only problems.
+        if (RegQueryValueExW(hKey, L"LogLevel", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS && val <= 3)
+            g_logLevel = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"ReadAheadMB", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS && val <= 1024)
+            g_readAheadMB = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"WriteBehindMB", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS && val <= 1024)
+            g_writeBehindMB = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"PacketCacheMB", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS && val <= 4096)
+            g_packetCacheMB = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"ProxyCacheMB", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS)
+            g_proxyCacheMB = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"ProxyHeight", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS &&
+            val >= 144 && val <= 1080)
+            g_proxyHeight = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"FastFirstPass", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS)
+            g_fastFirstPass = (val != 0);
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"ExportCopies", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS)
+            g_exportCopies = (val != 0);
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"ExportCacheMB", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS)
+            g_exportCacheMB = (int)val;
+        size = sizeof(val);
+        if (RegQueryValueExW(hKey, L"EnableTrace", nullptr, nullptr, (LPBYTE)&val, &size) == ERROR_SUCCESS)
+            TraceEnable(val != 0);
 
         wchar_t buf[256];
         DWORD sz = sizeof(buf);
@@ -48,9 +80,18 @@ void LoadSettings()
         sz = sizeof(buf);
         if (RegQueryValueExW(hKey, L"B2CustomUrl", nullptr, nullptr, (LPBYTE)buf, &sz) == ERROR_SUCCESS)
             g_b2CustomUrl = buf;
+        sz = sizeof(DWORD);
+        if (RegQueryValueExW(hKey, L"B2PartSizeMB", nullptr, nullptr, (LPBYTE)&val, &sz) == ERROR_SUCCESS)
+            g_b2PartSizeMB = (int)val;
+        sz = sizeof(DWORD);
+        if (RegQueryValueExW(hKey, L"B2UploadThreads", nullptr, nullptr, (LPBYTE)&val, &sz) == ERROR_SUCCESS)
+            g_b2UploadThreads = (int)val;
         sz = sizeof(DWORD); val = 0;
         if (RegQueryValueExW(hKey, L"AutoUpload", nullptr, nullptr, (LPBYTE)&val, &sz) == ERROR_SUCCESS)
             g_autoUpload = val != 0;
+        sz = sizeof(DWORD);
+        if (RegQueryValueExW(hKey, L"UploadLimitKBps", nullptr, nullptr, (LPBYTE)&val, &sz) == ERROR_SUCCESS)
+            g_uploadLimitKBps = (int)val;
         sz = sizeof(DWORD); val = 0;
         if (RegQueryValueExW(hKey, L"UseCatbox", nullptr, nullptr, (LPBYTE)&val, &sz) == ERROR_SUCCESS)
             g_useCatbox = val != 0;
@@ -73,13 +114,39 @@ void SaveSettings()
         RegSetValueExW(hKey, L"UseNvenc", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
         val = g_logToFile ? 1 : 0;
         RegSetValueExW(hKey, L"EnableLogFile", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_logLevel;
+        RegSetValueExW(hKey, L"LogLevel", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_readAheadMB;
+        RegSetValueExW(hKey, L"ReadAheadMB", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_writeBehindMB;
+        RegSetValueExW(hKey, L"WriteBehindMB", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_packetCacheMB;
+        RegSetValueExW(hKey, L"PacketCacheMB", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_proxyCacheMB;
+        RegSetValueExW(hKey, L"ProxyCacheMB", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_proxyHeight;
+        RegSetValueExW(hKey, L"ProxyHeight", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = g_fastFirstPass ? 1 : 0;
+        RegSetValueExW(hKey, L"FastFirstPass", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = g_exportCopies ? 1 : 0;
+        RegSetValueExW(hKey, L"ExportCopies", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_exportCacheMB;
+        RegSetValueExW(hKey, L"ExportCacheMB", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = TraceEnabled() ? 1 : 0;
+        RegSetValueExW(hKey, L"EnableTrace", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
         RegSetValueExW(hKey, L"B2KeyId", 0, REG_SZ, (const BYTE*)g_b2KeyId.c_str(), (DWORD)((g_b2KeyId.size()+1)*sizeof(wchar_t)));
         RegSetValueExW(hKey, L"B2AppKey", 0, REG_SZ, (const BYTE*)g_b2AppKey.c_str(), (DWORD)((g_b2AppKey.size()+1)*sizeof(wchar_t)));
         RegSetValueExW(hKey, L"B2BucketId", 0, REG_SZ, (const BYTE*)g_b2BucketId.c_str(), (DWORD)((g_b2BucketId.size()+1)*sizeof(wchar_t)));
         RegSetValueExW(hKey, L"B2BucketName", 0, REG_SZ, (const BYTE*)g_b2BucketName.c_str(), (DWORD)((g_b2BucketName.size()+1)*sizeof(wchar_t)));
         RegSetValueExW(hKey, L"B2CustomUrl", 0, REG_SZ, (const BYTE*)g_b2CustomUrl.c_str(), (DWORD)((g_b2CustomUrl.size()+1)*sizeof(wchar_t)));
+        val = (DWORD)g_b2PartSizeMB;
+        RegSetValueExW(hKey, L"B2PartSizeMB", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_b2UploadThreads;
+        RegSetValueExW(hKey, L"B2UploadThreads", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
         val = g_autoUpload ? 1 : 0;
         RegSetValueExW(hKey, L"AutoUpload", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
+        val = (DWORD)g_uploadLimitKBps;
+        RegSetValueExW(hKey, L"UploadLimitKBps", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
         val = g_useCatbox ? 1 : 0;
         RegSetValueExW(hKey, L"UseCatbox", 0, REG_DWORD, (const BYTE*)&val, sizeof(val));
         val = g_useB2 ? 1 : 0;
@@ -98,7 +165,7 @@ void ShowOptionsWindow(HWND parent)
 
     g_hOptionsWnd = CreateWindowEx(0, L"OptionsClass", L"Options",
                                    WS_CAPTION | WS_POPUPWINDOW | WS_VISIBLE,
-                                   CW_USEDEFAULT, CW_USEDEFAULT, 280, 200,
+                                   CW_USEDEFAULT, CW_USEDEFAULT, 280, 315,
                                    parent, nullptr,
                                    (HINSTANCE)GetWindowLongPtr(parent, GWLP_HINSTANCE), nullptr);
     ApplyDarkTheme(g_hOptionsWnd);
@@ -121,31 +188,84 @@ void ShowOptionsWindow(HWND parent)
                              10, 90, 150, 20, g_hOptionsWnd,
                              (HMENU)ID_CHECKBOX_ENABLE_LOG,
                              (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
+    HWND hFastPass = CreateWindow(L"BUTTON", L"Fast first pass (target size)",
+                                  WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+                                  10, 115, 220, 20, g_hOptionsWnd,
+                                  (HMENU)ID_CHECKBOX_FAST_FIRSTPASS,
+                                  (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
+    HWND hCopies = CreateWindow(L"BUTTON", L"Also export 720p + audio copies",
+                                WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+                                10, 140, 240, 20, g_hOptionsWnd,
+                                (HMENU)ID_CHECKBOX_EXPORT_COPIES,
+                                (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
+    HWND hTrace = CreateWindow(L"BUTTON", L"Record performance trace",
+                               WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+                               10, 165, 165, 20, g_hOptionsWnd,
+                               (HMENU)ID_CHECKBOX_TRACE,
+                               (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
+    HWND hSaveTrace = CreateWindow(L"BUTTON", L"Save Trace",
+                                   WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                                   180, 163, 75, 24, g_hOptionsWnd,
+                                   (HMENU)ID_BUTTON_SAVE_TRACE,
+                                   (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
     ApplyDarkTheme(hLib);
     ApplyDarkTheme(hNv);
     ApplyDarkTheme(hLog);
+    ApplyDarkTheme(hFastPass);
+    ApplyDarkTheme(hCopies);
+    ApplyDarkTheme(hTrace);
+    ApplyDarkTheme(hSaveTrace);
     HWND hUpload = CreateWindow(L"BUTTON", L"Upload Settings",
                                WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-                               10, 120, 100, 25, g_hOptionsWnd,
+                               10, 200, 100, 25, g_hOptionsWnd,
                                (HMENU)ID_BUTTON_UPLOAD_CONFIG,
                                (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
+    HWND hCache = CreateWindow(L"BUTTON", L"Export Cache",
+                               WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                               120, 200, 100, 25, g_hOptionsWnd,
+                               (HMENU)ID_BUTTON_EXPORT_CACHE,
+                               (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
     HWND hOk = CreateWindow(L"BUTTON", L"OK",
                             WS_CHILD | WS_VISIBLE | BS_DEFPUSHBUTTON,
-                            120, 120, 60, 25, g_hOptionsWnd,
+                            120, 235, 60, 25, g_hOptionsWnd,
                             (HMENU)IDOK,
                             (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
     HWND hCancel = CreateWindow(L"BUTTON", L"Cancel",
                                 WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-                                190, 120, 60, 25, g_hOptionsWnd,
+                                190, 235, 60, 25, g_hOptionsWnd,
                                 (HMENU)IDCANCEL,
                                 (HINSTANCE)GetWindowLongPtr(g_hOptionsWnd, GWLP_HINSTANCE), nullptr);
     ApplyDarkTheme(hOk);
     ApplyDarkTheme(hCancel);
     ApplyDarkTheme(hUpload);
+    ApplyDarkTheme(hCache);
 
     SendMessage(hLib, BM_SETCHECK, g_useNvenc ? BST_UNCHECKED : BST_CHECKED, 0);
     SendMessage(hNv, BM_SETCHECK, g_useNvenc ? BST_CHECKED : BST_UNCHECKED, 0);
     SendMessage(hLog, BM_SETCHECK, g_logToFile ? BST_CHECKED : BST_UNCHECKED, 0);
+    SendMessage(hFastPass, BM_SETCHECK, g_fastFirstPass ? BST_CHECKED : BST_UNCHECKED, 0);
+    SendMessage(hCopies, BM_SETCHECK, g_exportCopies ? BST_CHECKED : BST_UNCHECKED, 0);
+    SendMessage(hTrace, BM_SETCHECK, TraceEnabled() ? BST_CHECKED : BST_UNCHECKED, 0);
+}
+
+// Saves what has been recorded so far; the recording keeps going.
+static void SaveTraceFile(HWND hwnd)
+{
+    wchar_t path[MAX_PATH] = L"videoeditor-trace.json";
+    OPENFILENAMEW ofn = {};
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = L"Chrome trace (*.json)\0*.json\0All Files\0*.*\0";
+    ofn.lpstrFile = path;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrDefExt = L"json";
+    ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+    if (!GetSaveFileNameW(&ofn))
+        return;
+    if (TraceSave(path))
+        MessageBoxW(hwnd, L"Trace saved. Open it in ui.perfetto.dev or chrome://tracing.", L"Performance Trace", MB_OK);
+    else
+        MessageBoxW(hwnd, L"Could not write the trace file.", L"Performance Trace", MB_OK | MB_ICONERROR);
 }
 
 LRESULT CALLBACK OptionsProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -154,11 +274,19 @@ LRESULT CALLBACK OptionsProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     case WM_COMMAND:
         if (LOWORD(wParam) == ID_BUTTON_UPLOAD_CONFIG) {
             ShowUploadWindow(hwnd);
+        } else if (LOWORD(wParam) == ID_BUTTON_EXPORT_CACHE) {
+            ShowExportCacheWindow(hwnd);
+        } else if (LOWORD(wParam) == ID_CHECKBOX_TRACE) {
+            TraceEnable(SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_TRACE), BM_GETCHECK, 0, 0) == BST_CHECKED);
+        } else if (LOWORD(wParam) == ID_BUTTON_SAVE_TRACE) {
+            SaveTraceFile(hwnd);
         } else if (LOWORD(wParam) == IDOK || LOWORD(wParam) == IDCANCEL) {
             HWND hNv = GetDlgItem(hwnd, ID_RADIO_ENCODER_NVENC);
             HWND hLog = GetDlgItem(hwnd, ID_CHECKBOX_ENABLE_LOG);
             g_useNvenc = SendMessage(hNv, BM_GETCHECK, 0, 0) == BST_CHECKED;
             g_logToFile = SendMessage(hLog, BM_GETCHECK, 0, 0) == BST_CHECKED;
+            g_fastFirstPass = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_FAST_FIRSTPASS), BM_GETCHECK, 0, 0) == BST_CHECKED;
+            g_exportCopies = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_EXPORT_COPIES), BM_GETCHECK, 0, 0) == BST_CHECKED;
             SaveSettings();
             DestroyWindow(hwnd);
         }
@@ -169,6 +297,8 @@ LRESULT CALLBACK OptionsProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             HWND hLog = GetDlgItem(hwnd, ID_CHECKBOX_ENABLE_LOG);
             g_useNvenc = SendMessage(hNv, BM_GETCHECK, 0, 0) == BST_CHECKED;
             g_logToFile = SendMessage(hLog, BM_GETCHECK, 0, 0) == BST_CHECKED;
+            g_fastFirstPass = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_FAST_FIRSTPASS), BM_GETCHECK, 0, 0) == BST_CHECKED;
+            g_exportCopies = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_EXPORT_COPIES), BM_GETCHECK, 0, 0) == BST_CHECKED;
             SaveSettings();
             DestroyWindow(hwnd);
         }
@@ -184,13 +314,24 @@ LRESULT CALLBACK OptionsProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
 static HWND g_hB2Wnd = nullptr;
 
+// Clamps a numeric edit box; an empty box keeps `fallback`.
+static int ReadDlgInt(HWND hwnd, int id, int lo, int hi, int fallback)
+{
+    wchar_t buf[16];
+    GetWindowTextW(GetDlgItem(hwnd, id), buf, 16);
+    if (!buf[0])
+        return fallback;
+    int v = _wtoi(buf);
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
 void ShowB2ConfigWindow(HWND parent)
 {
     if (g_hB2Wnd) { SetForegroundWindow(g_hB2Wnd); return; }
 
     g_hB2Wnd = CreateWindowEx(0, L"B2ConfigClass", L"Upload Settings",
                               WS_CAPTION | WS_POPUPWINDOW | WS_VISIBLE,
-                              CW_USEDEFAULT, CW_USEDEFAULT, 340, 300,
+                              CW_USEDEFAULT, CW_USEDEFAULT, 340, 360,
                               parent, nullptr,
                               (HINSTANCE)GetWindowLongPtr(parent, GWLP_HINSTANCE), nullptr);
     ApplyDarkTheme(g_hB2Wnd);
@@ -240,19 +381,37 @@ void ShowB2ConfigWindow(HWND parent)
                                   (HMENU)ID_EDIT_B2_CUSTOM_URL,
                                   (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
 
+    CreateWindow(L"STATIC", L"Part size (MB):", WS_CHILD | WS_VISIBLE,
+                 10, 160, 100, 20, g_hB2Wnd, nullptr,
+                 (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
+    HWND hPartSize = CreateWindow(L"EDIT", std::to_wstring(g_b2PartSizeMB).c_str(),
+                                  WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                  120, 160, 60, 20, g_hB2Wnd,
+                                  (HMENU)ID_EDIT_B2_PART_SIZE,
+                                  (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
+
+    CreateWindow(L"STATIC", L"Parallel parts:", WS_CHILD | WS_VISIBLE,
+                 10, 190, 100, 20, g_hB2Wnd, nullptr,
+                 (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
+    HWND hThreads = CreateWindow(L"EDIT", std::to_wstring(g_b2UploadThreads).c_str(),
+                                 WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                 120, 190, 60, 20, g_hB2Wnd,
+                                 (HMENU)ID_EDIT_B2_THREADS,
+                                 (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
+
     HWND hEnableB2 = CreateWindow(L"BUTTON", L"Enable Backblaze B2", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
-                                  10, 160, 180, 20, g_hB2Wnd,
+                                  10, 220, 180, 20, g_hB2Wnd,
                                   (HMENU)ID_CHECKBOX_USE_B2,
                                   (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
 
     HWND hOk = CreateWindow(L"BUTTON", L"OK",
                             WS_CHILD | WS_VISIBLE | BS_DEFPUSHBUTTON,
-                            70, 200, 80, 25, g_hB2Wnd,
+                            70, 260, 80, 25, g_hB2Wnd,
                             (HMENU)IDOK,
                             (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
     HWND hCancel = CreateWindow(L"BUTTON", L"Cancel",
                                 WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-                                170, 200, 80, 25, g_hB2Wnd,
+                                170, 260, 80, 25, g_hB2Wnd,
                                 (HMENU)IDCANCEL,
                                 (HINSTANCE)GetWindowLongPtr(g_hB2Wnd, GWLP_HINSTANCE), nullptr);
 
@@ -261,6 +420,8 @@ void ShowB2ConfigWindow(HWND parent)
     ApplyDarkTheme(hBucketId);
     ApplyDarkTheme(hBucketName);
     ApplyDarkTheme(hCustomUrl);
+    ApplyDarkTheme(hPartSize);
+    ApplyDarkTheme(hThreads);
     ApplyDarkTheme(hEnableB2);
     ApplyDarkTheme(hOk);
     ApplyDarkTheme(hCancel);
@@ -283,6 +444,8 @@ LRESULT CALLBACK B2ConfigProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             g_b2BucketName = buf;
             GetWindowTextW(GetDlgItem(hwnd, ID_EDIT_B2_CUSTOM_URL), buf, 256);
             g_b2CustomUrl = buf;
+            g_b2PartSizeMB = ReadDlgInt(hwnd, ID_EDIT_B2_PART_SIZE, 5, 1024, g_b2PartSizeMB);
+            g_b2UploadThreads = ReadDlgInt(hwnd, ID_EDIT_B2_THREADS, 1, 16, g_b2UploadThreads);
             g_useB2 = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_USE_B2), BM_GETCHECK, 0, 0) == BST_CHECKED;
             SaveSettings();
             DestroyWindow(hwnd);
@@ -301,6 +464,8 @@ LRESULT CALLBACK B2ConfigProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             g_b2BucketName = buf;
             GetWindowTextW(GetDlgItem(hwnd, ID_EDIT_B2_CUSTOM_URL), buf, 256);
             g_b2CustomUrl = buf;
+            g_b2PartSizeMB = ReadDlgInt(hwnd, ID_EDIT_B2_PART_SIZE, 5, 1024, g_b2PartSizeMB);
+            g_b2UploadThreads = ReadDlgInt(hwnd, ID_EDIT_B2_THREADS, 1, 16, g_b2UploadThreads);
             g_useB2 = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_USE_B2), BM_GETCHECK, 0, 0) == BST_CHECKED;
             SaveSettings();
             DestroyWindow(hwnd);
@@ -321,7 +486,7 @@ void ShowUploadWindow(HWND parent)
 
     g_hUploadWnd = CreateWindowEx(0, L"UploadConfigClass", L"Upload Settings",
                                   WS_CAPTION | WS_POPUPWINDOW | WS_VISIBLE,
-                                  CW_USEDEFAULT, CW_USEDEFAULT, 300, 150,
+                                  CW_USEDEFAULT, CW_USEDEFAULT, 300, 180,
                                   parent, nullptr,
                                   (HINSTANCE)GetWindowLongPtr(parent, GWLP_HINSTANCE), nullptr);
     ApplyDarkTheme(g_hUploadWnd);
@@ -344,18 +509,28 @@ void ShowUploadWindow(HWND parent)
                              (HMENU)ID_BUTTON_B2_SETTINGS,
                              (HINSTANCE)GetWindowLongPtr(g_hUploadWnd, GWLP_HINSTANCE), nullptr);
 
+    CreateWindow(L"STATIC", L"Upload limit (KB/s):", WS_CHILD | WS_VISIBLE,
+                 10, 75, 130, 20, g_hUploadWnd, nullptr,
+                 (HINSTANCE)GetWindowLongPtr(g_hUploadWnd, GWLP_HINSTANCE), nullptr);
+    HWND hLimit = CreateWindow(L"EDIT", std::to_wstring(g_uploadLimitKBps).c_str(),
+                               WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                               150, 75, 80, 20, g_hUploadWnd,
+                               (HMENU)ID_EDIT_UPLOAD_LIMIT,
+                               (HINSTANCE)GetWindowLongPtr(g_hUploadWnd, GWLP_HINSTANCE), nullptr);
+
     HWND hOk = CreateWindow(L"BUTTON", L"OK",
                             WS_CHILD | WS_VISIBLE | BS_DEFPUSHBUTTON,
-                            40, 80, 80, 25, g_hUploadWnd,
+                            40, 110, 80, 25, g_hUploadWnd,
                             (HMENU)IDOK,
                             (HINSTANCE)GetWindowLongPtr(g_hUploadWnd, GWLP_HINSTANCE), nullptr);
     HWND hCancel = CreateWindow(L"BUTTON", L"Cancel",
                                 WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-                                140, 80, 80, 25, g_hUploadWnd,
+                                140, 110, 80, 25, g_hUploadWnd,
                                 (HMENU)IDCANCEL,
                                 (HINSTANCE)GetWindowLongPtr(g_hUploadWnd, GWLP_HINSTANCE), nullptr);
 
     ApplyDarkTheme(hAuto);
+    ApplyDarkTheme(hLimit);
     ApplyDarkTheme(hCatbox);
     ApplyDarkTheme(hB2);
     ApplyDarkTheme(hOk);
@@ -378,6 +553,7 @@ LRESULT CALLBACK UploadProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         case IDOK:
         case IDCANCEL:
             g_autoUpload = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_AUTO_UPLOAD), BM_GETCHECK, 0, 0) == BST_CHECKED;
+            g_uploadLimitKBps = ReadDlgInt(hwnd, ID_EDIT_UPLOAD_LIMIT, 0, 1024 * 1024, 0);
             SaveSettings();
             DestroyWindow(hwnd);
             break;
@@ -385,6 +561,7 @@ LRESULT CALLBACK UploadProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         break;
     case WM_CLOSE:
         g_autoUpload = SendMessage(GetDlgItem(hwnd, ID_CHECKBOX_AUTO_UPLOAD), BM_GETCHECK, 0, 0) == BST_CHECKED;
+        g_uploadLimitKBps = ReadDlgInt(hwnd, ID_EDIT_UPLOAD_LIMIT, 0, 1024 * 1024, 0);
         SaveSettings();
         DestroyWindow(hwnd);
         break;
@@ -466,3 +643,135 @@ LRESULT CALLBACK CatboxConfigProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPa
     }
     return DefWindowProc(hwnd, msg, wParam, lParam);
 }
+
+// ---------------- Export Cache Window -----------------
+
+static std::vector<std::string> g_cacheKeys;   // listbox row -> entry key
+
+static void FillExportCacheList(HWND hwnd)
+{
+    HWND hList = GetDlgItem(hwnd, ID_LIST_EXPORT_CACHE);
+    SendMessage(hList, LB_RESETCONTENT, 0, 0);
+    g_cacheKeys.clear();
+    int64_t total = 0;
+    for (const auto& entry : ExportCache::Get().List()) {
+        int sz = MultiByteToWideChar(CP_UTF8, 0, entry.source.c_str(), -1, nullptr, 0);
+        std::wstring name(sz > 0 ? sz - 1 : 0, 0);
+        MultiByteToWideChar(CP_UTF8, 0, entry.source.c_str(), -1, name.data(), sz);
+        wchar_t row[400];
+        swprintf_s(row, _countof(row), L"%s  %.1f-%.1f s  %.1f MB%s", name.c_str(),
+                   entry.startTime, entry.endTime, entry.bytes / 1048576.0,
+                   entry.urls.empty() ? L"" : L"  (uploaded)");
+        SendMessage(hList, LB_ADDSTRING, 0, (LPARAM)row);
+        g_cacheKeys.push_back(entry.key);
+        total += entry.bytes;
+    }
+    wchar_t summary[96];
+    swprintf_s(summary, _countof(summary), L"%d entries, %.1f MB",
+               (int)g_cacheKeys.size(), total / 1048576.0);
+    SetWindowTextW(GetDlgItem(hwnd, ID_STATIC_CACHE_TOTAL), summary);
+}
+
+void ShowExportCacheWindow(HWND parent)
+{
+    if (g_hCacheWnd) { SetForegroundWindow(g_hCacheWnd); return; }
+
+    g_hCacheWnd = CreateWindowEx(0, L"ExportCacheClass", L"Export Cache",
+                                 WS_CAPTION | WS_POPUPWINDOW | WS_VISIBLE,
+                                 CW_USEDEFAULT, CW_USEDEFAULT, 440, 330,
+                                 parent, nullptr,
+                                 (HINSTANCE)GetWindowLongPtr(parent, GWLP_HINSTANCE), nullptr);
+    ApplyDarkTheme(g_hCacheWnd);
+
+    HWND hList = CreateWindow(L"LISTBOX", nullptr,
+                              WS_CHILD | WS_VISIBLE | WS_BORDER | WS_VSCROLL | LBS_NOTIFY,
+                              10, 10, 410, 170, g_hCacheWnd,
+                              (HMENU)ID_LIST_EXPORT_CACHE,
+                              (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+    HWND hTotal = CreateWindow(L"STATIC", L"", WS_CHILD | WS_VISIBLE,
+                               10, 185, 250, 20, g_hCacheWnd,
+                               (HMENU)ID_STATIC_CACHE_TOTAL,
+                               (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+
+    CreateWindow(L"STATIC", L"Max size (MB, 0 = off):", WS_CHILD | WS_VISIBLE,
+                 10, 215, 160, 20, g_hCacheWnd, nullptr,
+                 (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+    HWND hLimit = CreateWindow(L"EDIT", std::to_wstring(g_exportCacheMB).c_str(),
+                               WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                               180, 215, 80, 20, g_hCacheWnd,
+                               (HMENU)ID_EDIT_CACHE_LIMIT,
+                               (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+
+    HWND hRemove = CreateWindow(L"BUTTON", L"Remove",
+                                WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                                10, 250, 80, 25, g_hCacheWnd,
+                                (HMENU)ID_BUTTON_CACHE_REMOVE,
+                                (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+    HWND hClear = CreateWindow(L"BUTTON", L"Clear All",
+                               WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                               100, 250, 80, 25, g_hCacheWnd,
+                               (HMENU)ID_BUTTON_CACHE_CLEAR,
+                               (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+    HWND hOk = CreateWindow(L"BUTTON", L"OK",
+                            WS_CHILD | WS_VISIBLE | BS_DEFPUSHBUTTON,
+                            250, 250, 80, 25, g_hCacheWnd,
+                            (HMENU)IDOK,
+                            (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+    HWND hCancel = CreateWindow(L"BUTTON", L"Cancel",
+                                WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                                340, 250, 80, 25, g_hCacheWnd,
+                                (HMENU)IDCANCEL,
+                                (HINSTANCE)GetWindowLongPtr(g_hCacheWnd, GWLP_HINSTANCE), nullptr);
+
+    ApplyDarkTheme(hList);
+    ApplyDarkTheme(hTotal);
+    ApplyDarkTheme(hLimit);
+    ApplyDarkTheme(hRemove);
+    ApplyDarkTheme(hClear);
+    ApplyDarkTheme(hOk);
+    ApplyDarkTheme(hCancel);
+
+    FillExportCacheList(g_hCacheWnd);
+}
+
+LRESULT CALLBACK ExportCacheProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    switch (msg) {
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case ID_BUTTON_CACHE_REMOVE:
+        {
+            int sel = (int)SendMessage(GetDlgItem(hwnd, ID_LIST_EXPORT_CACHE), LB_GETCURSEL, 0, 0);
+            if (sel >= 0 && sel < (int)g_cacheKeys.size()) {
+                ExportCache::Get().Remove(g_cacheKeys[sel]);
+                FillExportCacheList(hwnd);
+            }
+            break;
+        }
+        case ID_BUTTON_CACHE_CLEAR:
+            if (MessageBoxW(hwnd, L"Delete every cached export?", L"Export Cache",
+                            MB_YESNO | MB_ICONQUESTION) == IDYES) {
+                ExportCache::Get().Clear();
+                FillExportCacheList(hwnd);
+            }
+            break;
+        case IDOK:
+            g_exportCacheMB = ReadDlgInt(hwnd, ID_EDIT_CACHE_LIMIT, 0, 1024 * 1024, g_exportCacheMB);
+            SaveSettings();
+            ExportCache::Get().Trim((int64_t)g_exportCacheMB * 1024 * 1024);
+            DestroyWindow(hwnd);
+            break;
+        case IDCANCEL:
+            DestroyWindow(hwnd);
+            break;
+        }
+        break;
+    case WM_CLOSE:
+        DestroyWindow(hwnd);
+        break;
+    case WM_DESTROY:
+        g_hCacheWnd = nullptr;
+        break;
+    }
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
@@ -3,6 +3,7 @@
 
 #include <windows.h>
 #include <string>
+#include "engine_settings.h"
 
 // Option identifiers used in the options window
 #define ID_RADIO_ENCODER_LIBX264 1021
@@ -11,6 +12,11 @@
 #define ID_BUTTON_UPLOAD_CONFIG 1024
 #define ID_BUTTON_CATBOX_CONFIG 1031
 #define ID_BUTTON_B2_SETTINGS   1032
+#define ID_CHECKBOX_FAST_FIRSTPASS 1033
+#define ID_CHECKBOX_EXPORT_COPIES 1034
+#define ID_BUTTON_EXPORT_CACHE  1035
+#define ID_CHECKBOX_TRACE       1036
+#define ID_BUTTON_SAVE_TRACE    1037
 
 // B2 config control identifiers
 #define ID_EDIT_B2_KEY_ID       2001
@@ -22,19 +28,23 @@
 #define ID_EDIT_CATBOX_HASH     2007
 #define ID_CHECKBOX_USE_CATBOX  2008
 #define ID_CHECKBOX_USE_B2      2009
+#define ID_EDIT_B2_PART_SIZE    2010
+#define ID_EDIT_B2_THREADS      2011
+#define ID_EDIT_UPLOAD_LIMIT    2012
 
-extern bool g_useNvenc;
-extern bool g_logToFile;
+// Export cache window control identifiers
+#define ID_LIST_EXPORT_CACHE    2013
+#define ID_BUTTON_CACHE_REMOVE  2014
+#define ID_BUTTON_CACHE_CLEAR   2015
+#define ID_EDIT_CACHE_LIMIT     2016
+#define ID_STATIC_CACHE_TOTAL   2017
 
-extern std::wstring g_b2KeyId;
-extern std::wstring g_b2AppKey;
-extern std::wstring g_b2BucketId;
-extern std::wstring g_b2BucketName;
-extern std::wstring g_b2CustomUrl;
+extern bool g_useNvenc;
+extern bool g_fastFirstPass;
+extern bool g_exportCopies;
 extern bool g_autoUpload;
 extern bool g_useCatbox;
 extern bool g_useB2;
-extern std::wstring g_catboxUserHash;
 
 void ShowUploadWindow(HWND parent);
 LRESULT CALLBACK UploadProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -43,6 +53,9 @@ LRESULT CALLBACK B2ConfigProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 void ShowCatboxConfigWindow(HWND parent);
 LRESULT CALLBACK CatboxConfigProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
+void ShowExportCacheWindow(HWND parent);
+LRESULT CALLBACK ExportCacheProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
 void ShowOptionsWindow(HWND parent);
 LRESULT CALLBACK OptionsProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 void LoadSettings();
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Receives an export's bytes in file order while the file is being written.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Called on the export thread and may block to hold the encoder back.
+    // Returning false detaches the sink; the export itself carries on.
+    virtual bool Write(const uint8_t* data, size_t size) = 0;
+};
@@ -0,0 +1,292 @@
+#include "packet_cache.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "trace.h"
+#include <algorithm>
+
+// Bookkeeping counted per cached packet on top of its payload.
+static const int64_t kPacketOverhead = 128;
+
+static int64_t PacketCost(const AVPacket* pkt)
+{
+    return pkt->size + kPacketOverhead;
+}
+
+static bool SamePacket(const AVPacket* a, const AVPacket* b)
+{
+    return a->stream_index == b->stream_index && a->dts == b->dts && a->pts == b->pts &&
+           a->size == b->size && (a->pos < 0 || b->pos < 0 || a->pos == b->pos);
+}
+
+PacketCache::PacketCache() {}
+
+PacketCache::~PacketCache()
+{
+    Clear();
+}
+
+void PacketCache::Attach(AVFormatContext* fmt, int keyStream)
+{
+    Attach(fmt, keyStream, (int64_t)g_packetCacheMB * 1024 * 1024);
+}
+
+void PacketCache::Attach(AVFormatContext* fmt, int keyStream, int64_t budgetBytes)
+{
+    Clear();
+    m_fmt = fmt;
+    m_keyStream = keyStream;
+    m_budget = budgetBytes;
+    if (m_budget <= 0)
+        return;
+    m_scratch = av_packet_alloc();
+    m_live = NewRun();
+    int64_t fileSize = fmt->pb ? avio_size(fmt->pb) : -1;
+    if (fileSize > 0 && fileSize < m_budget)
+        LOG_DEBUG("Packet cache holds the whole file (" << fileSize / (1024 * 1024) << " MB)");
+}
+
+void PacketCache::Clear()
+{
+    if (m_seekHits + m_seekMisses > 0)
+        LOG_INFO("Packet cache: " << m_seekHits << " of " << m_seekHits + m_seekMisses
+                 << " seeks from memory, " << m_served << " packets served, peak "
+                 << m_peakBytes / (1024 * 1024) << " MB");
+    for (auto& run : m_runs) {
+        for (AVPacket* p : run->packets)
+            av_packet_free(&p);
+    }
+    m_runs.clear();
+    if (m_scratch)
+        av_packet_free(&m_scratch);
+    m_fmt = nullptr;
+    m_keyStream = -1;
+    m_budget = m_bytes = 0;
+    m_live = m_serving = nullptr;
+    m_next = 0;
+    m_uses = 0;
+    m_seekHits = m_seekMisses = m_served = m_peakBytes = 0;
+}
+
+int PacketCache::Read(AVPacket* pkt)
+{
+    if (m_serving) {
+        if (m_next < m_serving->packets.size()) {
+            ++m_served;
+            return av_packet_ref(pkt, m_serving->packets[m_next++]);
+        }
+        if (m_serving->eof)
+            return AVERROR_EOF;
+        // Past the end of the run: the container has to carry on from its
+        // last packet.
+        if (m_serving != m_live && !Resync(m_serving)) {
+            LOG_WARN("Packet cache could not find its place in the file, reading on uncached");
+            m_live = nullptr;
+        }
+        m_serving = nullptr;
+    }
+    int ret = av_read_frame(m_fmt, pkt);
+    if (ret == AVERROR_EOF && m_live)
+        m_live->eof = true;
+    if (ret >= 0 && m_live)
+        Append(pkt);
+    return ret;
+}
+
+int PacketCache::Seek(int streamIndex, int64_t ts, int flags)
+{
+    if (m_budget > 0 && m_keyStream >= 0) {
+        size_t at;
+        if (Run* run = Lookup(streamIndex, ts, flags, at)) {
+            m_serving = run;
+            m_next = at;
+            run->lastUse = ++m_uses;
+            ++m_seekHits;
+            return 0;
+        }
+        ++m_seekMisses;
+    }
+    int ret;
+    {
+        TRACE_SCOPE("av_seek_frame", "playback");
+        ret = av_seek_frame(m_fmt, streamIndex, ts, flags);
+    }
+    m_serving = nullptr;
+    // After a failed seek the container's position is unknown, so nothing
+    // is cached until the next one succeeds.
+    m_live = ret >= 0 && m_budget > 0 ? NewRun() : nullptr;
+    return ret;
+}
+
+bool PacketCache::Covers(int streamIndex, int64_t ts, int flags) const
+{
+    size_t at;
+    return m_budget > 0 && m_keyStream >= 0 && Lookup(streamIndex, ts, flags, at);
+}
+
+void PacketCache::Insert(std::vector<AVPacket*>& packets, bool eof)
+{
+    if (m_budget <= 0 || packets.empty()) {
+        for (AVPacket* p : packets)
+            av_packet_free(&p);
+        packets.clear();
+        return;
+    }
+    Run* run = NewRun();
+    for (AVPacket* p : packets) {
+        run->packets.push_back(p);
+        run->bytes += PacketCost(p);
+        m_bytes += PacketCost(p);
+    }
+    packets.clear();
+    run->eof = eof;
+    run->lastUse = ++m_uses;
+    while (m_bytes > m_budget && EvictOne()) {
+    }
+    m_peakBytes = std::max(m_peakBytes, m_bytes);
+}
+
+// The run a seek to `ts` would start from, and where in it.
+PacketCache::Run* PacketCache::Lookup(int streamIndex, int64_t ts, int flags, size_t& at) const
+{
+    AVRational keyTb = m_fmt->streams[m_keyStream]->time_base;
+    AVRational tb = streamIndex < 0 ? AV_TIME_BASE_Q : m_fmt->streams[streamIndex]->time_base;
+    int64_t keyTs = av_rescale_q(ts, tb, keyTb);
+    for (auto& run : m_runs) {
+        if (Find(*run, keyTs, (flags & AVSEEK_FLAG_ANY) != 0, at))
+            return run.get();
+    }
+    return nullptr;
+}
+
+// Where decoding for `ts` (key stream time base) starts in `run`: its last
+// keyframe at or before `ts`, or its last key stream packet there with
+// `any`. Only if the run also reaches `ts`.
+bool PacketCache::Find(const Run& run, int64_t ts, bool any, size_t& at) const
+{
+    bool found = false;
+    bool reaches = run.eof;
+    for (size_t i = 0; i < run.packets.size(); ++i) {
+        const AVPacket* p = run.packets[i];
+        if (p->stream_index != m_keyStream)
+            continue;
+        int64_t t = p->pts != AV_NOPTS_VALUE ? p->pts : p->dts;
+        if (t == AV_NOPTS_VALUE)
+            continue;
+        if (t >= ts)
+            reaches = true;
+        if (t <= ts && (any || (p->flags & AV_PKT_FLAG_KEY))) {
+            at = i;
+            found = true;
+        }
+        // dts only grows and pts is never below it, so nothing after this
+        // packet is at or before `ts`.
+        if (p->dts != AV_NOPTS_VALUE && p->dts > ts)
+            break;
+    }
+    return found && reaches;
+}
+
+void PacketCache::Append(const AVPacket* pkt)
+{
+    AVPacket* copy = av_packet_clone(pkt);
+    if (!copy)
+        return;
+    m_live->packets.push_back(copy);
+    m_live->bytes += PacketCost(copy);
+    m_live->lastUse = ++m_uses;
+    m_bytes += PacketCost(copy);
+    while (m_bytes > m_budget && EvictOne()) {
+    }
+    m_peakBytes = std::max(m_peakBytes, m_bytes);
+}
+
+// Frees the oldest keyframe group of the least recently used run that has
+// one to spare. False when only packets still to be served are left.
+bool PacketCache::EvictOne()
+{
+    std::vector<Run*> order;
+    for (auto& run : m_runs)
+        order.push_back(run.get());
+    std::sort(order.begin(), order.end(), [](const Run* a, const Run* b) { return a->lastUse < b->lastUse; });
+    for (Run* run : order) {
+        size_t limit = run == m_serving ? m_next : run->packets.size();
+        size_t removed = TrimFront(*run, limit);
+        if (!removed)
+            continue;
+        if (run == m_serving)
+            m_next -= removed;
+        if (run->packets.empty() && run != m_live && run != m_serving) {
+            m_runs.erase(std::find_if(m_runs.begin(), m_runs.end(),
+                                      [run](const std::unique_ptr<Run>& r) { return r.get() == run; }));
+        }
+        return true;
+    }
+    return false;
+}
+
+// Drops packets from the front of `run` up to its next keyframe, so it
+// still starts where decoding can, but none at or past `limit`.
+size_t PacketCache::TrimFront(Run& run, size_t limit)
+{
+    size_t count = 0;
+    while (count < limit) {
+        const AVPacket* p = run.packets[count];
+        if (count > 0 && p->stream_index == m_keyStream && (p->flags & AV_PKT_FLAG_KEY))
+            break;
+        ++count;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        AVPacket* p = run.packets.front();
+        run.packets.pop_front();
+        run.bytes -= PacketCost(p);
+        m_bytes -= PacketCost(p);
+        av_packet_free(&p);
+    }
+    return count;
+}
+
+// Puts the container right after the last packet of `run` by seeking to
+// its last keyframe and reading up to that packet again, so container
+// reads extend the run. False if the packet does not come back.
+bool PacketCache::Resync(Run* run)
+{
+    TRACE_SCOPE("Packet cache resync", "playback");
+    if (run->packets.empty())
+        return false;
+    size_t key = run->packets.size();
+    while (key > 0) {
+        const AVPacket* p = run->packets[--key];
+        if (p->stream_index == m_keyStream && (p->flags & AV_PKT_FLAG_KEY) && p->dts != AV_NOPTS_VALUE)
+            break;
+    }
+    const AVPacket* from = run->packets[key];
+    if (from->stream_index != m_keyStream || from->dts == AV_NOPTS_VALUE ||
+        av_seek_frame(m_fmt, m_keyStream, from->dts, AVSEEK_FLAG_BACKWARD) < 0)
+        return false;
+    const AVPacket* last = run->packets.back();
+    size_t limit = (run->packets.size() - key) * 2 + 64;
+    for (size_t i = 0; i < limit; ++i) {
+        if (av_read_frame(m_fmt, m_scratch) < 0)
+            return false;
+        bool match = SamePacket(m_scratch, last);
+        av_packet_unref(m_scratch);
+        if (match) {
+            m_live = run;
+            return true;
+        }
+    }
+    return false;
+}
+
+PacketCache::Run* PacketCache::NewRun()
+{
+    // An empty run left behind by an earlier seek is reused.
+    for (auto& run : m_runs) {
+        if (run->packets.empty() && run.get() != m_serving && run.get() != m_live) {
+            run->eof = false;
+            return run.get();
+        }
+    }
+    m_runs.push_back(std::make_unique<Run>());
+    return m_runs.back().get();
+}
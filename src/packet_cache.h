@@ -0,0 +1,78 @@
+#pragma once
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Demuxed packets of one AVFormatContext kept in memory, so a seek back
+// into what was already read - a loop, a re-scrub, Stop - restarts decoding
+// from RAM instead of the container and the disk. Packets of every stream
+// the demuxer returns are kept in runs, each one stretch read in order
+// after a container seek. Over g_packetCacheMB the oldest keyframe groups
+// of the least recently used runs go first, so what stays is the window
+// around the playhead; a file smaller than the budget stays whole.
+// Not thread-safe: the demuxer's owner calls it in place of av_read_frame
+// and av_seek_frame. The player's cache is also filled by SeekPrefetcher,
+// so every caller of its Read, Seek, Insert and Covers holds
+// VideoPlayer::decodeMutex.
+class PacketCache {
+public:
+    PacketCache();
+    ~PacketCache();
+    PacketCache(const PacketCache&) = delete;
+    PacketCache& operator=(const PacketCache&) = delete;
+
+    // Starts caching `fmt`, which has not been read from yet. Keyframes of
+    // `keyStream` are where cached decoding may start.
+    void Attach(AVFormatContext* fmt, int keyStream);
+    // The same with a budget of its own instead of g_packetCacheMB.
+    void Attach(AVFormatContext* fmt, int keyStream, int64_t budgetBytes);
+    // Frees the packets and logs how many seeks were served from memory.
+    void Clear();
+
+    // av_read_frame, from memory after a seek into a cached run.
+    int Read(AVPacket* pkt);
+    // av_seek_frame with the same arguments. BACKWARD and ANY are honoured
+    // when a run covers `ts`; otherwise the container seeks.
+    int Seek(int streamIndex, int64_t ts, int flags);
+    // Whether a Seek with these arguments would be served from memory.
+    bool Covers(int streamIndex, int64_t ts, int flags) const;
+    // Adds packets read from the same file by another demuxer - from a
+    // keyframe of the key stream on, in demuxer order - as a run of their
+    // own and takes ownership of them. `eof` if the last is the file's last.
+    void Insert(std::vector<AVPacket*>& packets, bool eof);
+
+private:
+    struct Run {
+        std::deque<AVPacket*> packets;
+        int64_t bytes = 0;
+        bool eof = false;           // the last packet is the file's last
+        uint64_t lastUse = 0;
+    };
+
+    Run* Lookup(int streamIndex, int64_t ts, int flags, size_t& at) const;
+    bool Find(const Run& run, int64_t ts, bool any, size_t& at) const;
+    void Append(const AVPacket* pkt);
+    bool EvictOne();
+    size_t TrimFront(Run& run, size_t limit);
+    bool Resync(Run* run);
+    Run* NewRun();
+
+    AVFormatContext* m_fmt = nullptr;
+    int m_keyStream = -1;
+    int64_t m_budget = 0;
+    int64_t m_bytes = 0;
+    std::vector<std::unique_ptr<Run>> m_runs;
+    Run* m_live = nullptr;          // container reads continue this run
+    Run* m_serving = nullptr;       // reads come from here while set
+    size_t m_next = 0;              // next packet of m_serving
+    uint64_t m_uses = 0;
+    AVPacket* m_scratch = nullptr;
+    int64_t m_seekHits = 0, m_seekMisses = 0, m_served = 0, m_peakBytes = 0;
+};
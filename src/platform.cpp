@@ -0,0 +1,133 @@
+#include "platform.h"
+#include <cstdlib>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+
+std::string ToUtf8(const std::wstring& w)
+{
+    if (w.empty())
+        return std::string();
+    int sz = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+    std::string s(sz, 0);
+    WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), &s[0], sz, nullptr, nullptr);
+    return s;
+}
+
+std::wstring FromUtf8(const std::string& s)
+{
+    if (s.empty())
+        return std::wstring();
+    int sz = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
+    std::wstring w(sz, 0);
+    MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), &w[0], sz);
+    return w;
+}
+
+FILE* OpenFile(const std::wstring& path, const char* mode)
+{
+    return _wfopen(path.c_str(), FromUtf8(mode).c_str());
+}
+
+int SeekFile(FILE* fp, int64_t offset, int origin)
+{
+    return _fseeki64(fp, offset, origin);
+}
+
+fs::path LocalDataDir()
+{
+    wchar_t base[MAX_PATH];
+    DWORD len = GetEnvironmentVariableW(L"LOCALAPPDATA", base, MAX_PATH);
+    std::error_code ec;
+    return (len && len < MAX_PATH) ? fs::path(base) : fs::temp_directory_path(ec);
+}
+
+bool SetEnvVar(const char* name, const char* value)
+{
+    return _putenv_s(name, value) == 0;
+}
+
+#else
+
+// wchar_t is UTF-32 here.
+std::string ToUtf8(const std::wstring& w)
+{
+    std::string s;
+    s.reserve(w.size());
+    for (wchar_t wc : w) {
+        uint32_t c = (uint32_t)wc;
+        if (c < 0x80) {
+            s += (char)c;
+        } else if (c < 0x800) {
+            s += (char)(0xC0 | (c >> 6));
+            s += (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            s += (char)(0xE0 | (c >> 12));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        } else {
+            s += (char)(0xF0 | (c >> 18));
+            s += (char)(0x80 | ((c >> 12) & 0x3F));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return s;
+}
+
+std::wstring FromUtf8(const std::string& s)
+{
+    std::wstring w;
+    w.reserve(s.size());
+    for (size_t i = 0; i < s.size();) {
+        unsigned char c = (unsigned char)s[i];
+        int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+        uint32_t cp = extra == 3 ? (c & 0x07) : extra == 2 ? (c & 0x0F) : extra == 1 ? (c & 0x1F) : c;
+        if (i + extra >= s.size()) {
+            w += (wchar_t)0xFFFD;   // truncated sequence
+            break;
+        }
+        for (int k = 1; k <= extra; ++k)
+            cp = (cp << 6) | ((unsigned char)s[i + k] & 0x3F);
+        w += (wchar_t)cp;
+        i += extra + 1;
+    }
+    return w;
+}
+
+FILE* OpenFile(const std::wstring& path, const char* mode)
+{
+    return fopen(ToUtf8(path).c_str(), mode);
+}
+
+int SeekFile(FILE* fp, int64_t offset, int origin)
+{
+    return fseeko(fp, (off_t)offset, origin);
+}
+
+fs::path LocalDataDir()
+{
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg)
+        return fs::path(xdg);
+    const char* home = getenv("HOME");
+    if (home && *home)
+        return fs::path(home) / ".cache";
+    std::error_code ec;
+    return fs::temp_directory_path(ec);
+}
+
+bool SetEnvVar(const char* name, const char* value)
+{
+    return setenv(name, value, 1) == 0;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+// The few OS services the engine needs, so its sources build without
+// <windows.h>. Paths stay wide strings, as everywhere in the editor.
+
+std::string ToUtf8(const std::wstring& w);
+std::wstring FromUtf8(const std::string& s);
+
+// fopen for a wide path; `mode` as for fopen.
+FILE* OpenFile(const std::wstring& path, const char* mode);
+// fseek with 64-bit offsets.
+int SeekFile(FILE* fp, int64_t offset, int origin);
+
+// Per-user cache root: %LOCALAPPDATA% on Windows, $XDG_CACHE_HOME or
+// ~/.cache elsewhere, the temp directory if neither is set.
+std::filesystem::path LocalDataDir();
+
+bool SetEnvVar(const char* name, const char* value);
@@ -0,0 +1,276 @@
+#include "playback_stats.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstdio>
+
+// Upper bucket edges in ms; the last bucket takes the rest.
+static const double kBucketEdgesMs[kDecodeHistogramBuckets - 1] = { 2, 4, 8, 16, 33, 66, 100 };
+// Ten hours of one-second rows.
+static const size_t kMaxRows = 36000;
+
+const char* DecodeHistogramLabel(int bucket)
+{
+    static const char* labels[kDecodeHistogramBuckets] = {
+        "<2ms", "<4ms", "<8ms", "<16ms", "<33ms", "<66ms", "<100ms", "100ms+"
+    };
+    return bucket >= 0 && bucket < kDecodeHistogramBuckets ? labels[bucket] : "";
+}
+
+static void StoreMax(std::atomic<int64_t>& slot, int64_t value)
+{
+    int64_t cur = slot.load(std::memory_order_relaxed);
+    while (value > cur && !slot.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+    }
+}
+
+int64_t PlaybackStats::NowNs() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count();
+}
+
+void PlaybackStats::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_rowMutex);
+    m_decoded = 0;
+    m_decodeNs = 0;
+    m_decodeMaxNs = 0;
+    for (auto& b : m_histogram)
+        b = 0;
+    m_presented = 0;
+    m_latencyNs = 0;
+    m_latencyMaxNs = 0;
+    m_dropped = 0;
+    m_late = 0;
+    m_underruns = 0;
+    m_positionUs = 0;
+    m_driftUs = 0;
+    m_hasAudioClock = false;
+    m_audioQueueUs = 0;
+    m_deviceFillPermille = 0;
+    m_videoLeadUs = 0;
+    m_framePending = false;
+    m_sessionNs = 0;
+    m_intervalStartNs = -1;
+    m_rowStart = Totals();
+    m_last = PlaybackSnapshot();
+    m_rows.clear();
+}
+
+void PlaybackStats::OnPlay()
+{
+    std::lock_guard<std::mutex> lock(m_rowMutex);
+    m_framePending = false;
+    m_hasAudioClock = false;
+    m_decodeMaxNs = 0;
+    m_latencyMaxNs = 0;
+    m_rowStart = ReadTotals();
+    m_intervalStartNs = NowNs();
+}
+
+void PlaybackStats::OnFrameDecoded(int64_t decodeNs, double pts)
+{
+    m_decoded.fetch_add(1, std::memory_order_relaxed);
+    m_decodeNs.fetch_add(decodeNs, std::memory_order_relaxed);
+    StoreMax(m_decodeMaxNs, decodeNs);
+    double ms = decodeNs / 1e6;
+    int bucket = 0;
+    while (bucket < kDecodeHistogramBuckets - 1 && ms >= kBucketEdgesMs[bucket])
+        ++bucket;
+    m_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    // The previous frame was overwritten before the UI thread painted it.
+    if (m_framePending)
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    m_framePending = true;
+    m_frameReadyNs = NowNs();
+    m_framePts = pts;
+}
+
+void PlaybackStats::OnFramePresented()
+{
+    if (!m_framePending)
+        return;
+    m_framePending = false;
+    int64_t now = NowNs();
+    int64_t latency = now - m_frameReadyNs;
+    m_presented.fetch_add(1, std::memory_order_relaxed);
+    m_latencyNs.fetch_add(latency, std::memory_order_relaxed);
+    StoreMax(m_latencyMaxNs, latency);
+    m_positionUs = (int64_t)(m_framePts * 1e6);
+    if (m_hasAudioClock) {
+        // Extrapolate the audio clock to now; it is refreshed every few ms.
+        double audioPts = m_audioClockUs / 1e6 + (now - m_audioClockAtNs) / 1e9;
+        m_driftUs = (int64_t)((m_framePts - audioPts) * 1e6);
+    }
+}
+
+void PlaybackStats::SetAudioClock(double pts)
+{
+    m_audioClockUs = (int64_t)(pts * 1e6);
+    m_audioClockAtNs = NowNs();
+    m_hasAudioClock = true;
+}
+
+void PlaybackStats::SetAudioBuffers(double queueSeconds, double deviceFill)
+{
+    m_audioQueueUs = (int64_t)(queueSeconds * 1e6);
+    m_deviceFillPermille = (int64_t)(deviceFill * 1000.0);
+}
+
+PlaybackStats::Totals PlaybackStats::ReadTotals() const
+{
+    Totals t;
+    t.decoded = m_decoded;
+    t.decodeNs = m_decodeNs;
+    t.presented = m_presented;
+    t.latencyNs = m_latencyNs;
+    t.dropped = m_dropped;
+    t.late = m_late;
+    t.underruns = m_underruns;
+    for (int i = 0; i < kDecodeHistogramBuckets; ++i)
+        t.histogram[i] = m_histogram[i];
+    return t;
+}
+
+void PlaybackStats::OnPause()
+{
+    int64_t now = NowNs();
+    std::lock_guard<std::mutex> lock(m_rowMutex);
+    if (m_intervalStartNs >= 0 && now > m_intervalStartNs)
+        AddRowLocked(now);
+    m_intervalStartNs = -1;
+}
+
+void PlaybackStats::Tick()
+{
+    int64_t now = NowNs();
+    std::lock_guard<std::mutex> lock(m_rowMutex);
+    if (m_intervalStartNs >= 0 && now - m_intervalStartNs >= 1000000000)
+        AddRowLocked(now);
+}
+
+void PlaybackStats::AddRowLocked(int64_t now)
+{
+    Totals t = ReadTotals();
+    PlaybackSnapshot row;
+    m_sessionNs += now - m_intervalStartNs;
+    row.sessionSeconds = m_sessionNs / 1e9;
+    row.position = m_positionUs / 1e6;
+    row.framesDecoded = t.decoded - m_rowStart.decoded;
+    row.framesPresented = t.presented - m_rowStart.presented;
+    row.framesDropped = t.dropped - m_rowStart.dropped;
+    row.framesLate = t.late - m_rowStart.late;
+    row.audioUnderruns = t.underruns - m_rowStart.underruns;
+    if (row.framesDecoded > 0)
+        row.decodeAvgMs = (t.decodeNs - m_rowStart.decodeNs) / 1e6 / row.framesDecoded;
+    row.decodeMaxMs = m_decodeMaxNs.exchange(0) / 1e6;
+    for (int i = 0; i < kDecodeHistogramBuckets; ++i)
+        row.decodeHistogram[i] = t.histogram[i] - m_rowStart.histogram[i];
+    if (row.framesPresented > 0)
+        row.latencyAvgMs = (t.latencyNs - m_rowStart.latencyNs) / 1e6 / row.framesPresented;
+    row.latencyMaxMs = m_latencyMaxNs.exchange(0) / 1e6;
+    row.hasAudioClock = m_hasAudioClock;
+    row.avDriftMs = m_driftUs / 1e3;
+    row.audioQueueMs = m_audioQueueUs / 1e3;
+    row.audioDeviceFill = m_deviceFillPermille / 1000.0;
+    row.videoLeadMs = m_videoLeadUs / 1e3;
+
+    m_rows.push_back(row);
+    if (m_rows.size() > kMaxRows)
+        m_rows.pop_front();
+    m_last = row;
+    m_rowStart = t;
+    m_intervalStartNs = now;
+}
+
+PlaybackSnapshot PlaybackStats::Current() const
+{
+    PlaybackSnapshot s;
+    Totals t = ReadTotals();
+    {
+        std::lock_guard<std::mutex> lock(m_rowMutex);
+        s = m_last;
+    }
+    s.position = m_positionUs / 1e6;
+    s.framesDecoded = t.decoded;
+    s.framesPresented = t.presented;
+    s.framesDropped = t.dropped;
+    s.framesLate = t.late;
+    s.audioUnderruns = t.underruns;
+    for (int i = 0; i < kDecodeHistogramBuckets; ++i)
+        s.decodeHistogram[i] = t.histogram[i];
+    s.hasAudioClock = m_hasAudioClock;
+    s.avDriftMs = m_driftUs / 1e3;
+    s.audioQueueMs = m_audioQueueUs / 1e3;
+    s.audioDeviceFill = m_deviceFillPermille / 1000.0;
+    s.videoLeadMs = m_videoLeadUs / 1e3;
+    return s;
+}
+
+bool PlaybackStats::SaveCsv(const std::wstring& path) const
+{
+    FILE* fp = OpenFile(path, "wb");
+    if (!fp)
+        return false;
+    fputs("session_s,position_s,frames_decoded,frames_presented,frames_dropped,frames_late,"
+          "decode_avg_ms,decode_max_ms", fp);
+    static const char* bucketColumns[kDecodeHistogramBuckets] = {
+        "decode_0_2ms", "decode_2_4ms", "decode_4_8ms", "decode_8_16ms",
+        "decode_16_33ms", "decode_33_66ms", "decode_66_100ms", "decode_100ms_up"
+    };
+    for (const char* column : bucketColumns)
+        fprintf(fp, ",%s", column);
+    fputs(",present_latency_avg_ms,present_latency_max_ms,av_drift_ms,audio_underruns,"
+          "audio_queue_ms,audio_device_fill_pct,video_lead_ms\n", fp);
+
+    std::lock_guard<std::mutex> lock(m_rowMutex);
+    for (const PlaybackSnapshot& r : m_rows) {
+        fprintf(fp, "%.3f,%.3f,%lld,%lld,%lld,%lld,%.3f,%.3f",
+                r.sessionSeconds, r.position, (long long)r.framesDecoded, (long long)r.framesPresented,
+                (long long)r.framesDropped, (long long)r.framesLate, r.decodeAvgMs, r.decodeMaxMs);
+        for (int i = 0; i < kDecodeHistogramBuckets; ++i)
+            fprintf(fp, ",%lld", (long long)r.decodeHistogram[i]);
+        fprintf(fp, ",%.3f,%.3f,", r.latencyAvgMs, r.latencyMaxMs);
+        // No audio clock, no drift: leave the cell empty rather than 0.
+        if (r.hasAudioClock)
+            fprintf(fp, "%.1f", r.avDriftMs);
+        fprintf(fp, ",%lld,%.1f,%.1f,%.1f\n", (long long)r.audioUnderruns, r.audioQueueMs,
+                r.audioDeviceFill * 100.0, r.videoLeadMs);
+    }
+    bool ok = !ferror(fp);
+    return fclose(fp) == 0 && ok;
+}
+
+std::string FormatPlaybackOverlay(const PlaybackSnapshot& s)
+{
+    char buf[512];
+    std::string out;
+    snprintf(buf, sizeof(buf), "Decode    avg %.1f ms  max %.1f ms\n", s.decodeAvgMs, s.decodeMaxMs);
+    out += buf;
+    int64_t total = 0;
+    for (int64_t n : s.decodeHistogram)
+        total += n;
+    out += "         ";
+    for (int i = 0; i < kDecodeHistogramBuckets; ++i) {
+        snprintf(buf, sizeof(buf), " %s %.0f%%", DecodeHistogramLabel(i),
+                 total ? s.decodeHistogram[i] * 100.0 / total : 0.0);
+        out += buf;
+    }
+    out += "\n";
+    snprintf(buf, sizeof(buf), "Present   avg %.1f ms  max %.1f ms after decode\n",
+             s.latencyAvgMs, s.latencyMaxMs);
+    out += buf;
+    snprintf(buf, sizeof(buf), "Frames    %lld shown  %lld dropped  %lld late\n",
+             (long long)s.framesPresented, (long long)s.framesDropped, (long long)s.framesLate);
+    out += buf;
+    if (s.hasAudioClock)
+        snprintf(buf, sizeof(buf), "Audio     %lld underruns  A/V drift %+.0f ms\n",
+                 (long long)s.audioUnderruns, s.avDriftMs);
+    else
+        snprintf(buf, sizeof(buf), "Audio     %lld underruns  A/V drift n/a\n", (long long)s.audioUnderruns);
+    out += buf;
+    snprintf(buf, sizeof(buf), "Buffers   audio %.0f ms queued  device %.0f%%  video lead %.0f ms",
+             s.audioQueueMs, s.audioDeviceFill * 100.0, s.videoLeadMs);
+    out += buf;
+    return out;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// Decode time buckets in ms: <2, <4, <8, <16, <33, <66, <100, 100+.
+static const int kDecodeHistogramBuckets = 8;
+const char* DecodeHistogramLabel(int bucket);
+
+// A CSV row counts one interval of playback; PlaybackStats::Current() puts
+// session totals in the counters instead. Times are in ms unless named.
+struct PlaybackSnapshot {
+    double sessionSeconds = 0.0;        // playing time since the file was loaded
+    double position = 0.0;              // media time of the last presented frame
+    int64_t framesDecoded = 0;
+    int64_t framesPresented = 0;
+    int64_t framesDropped = 0;          // decoded but replaced before being shown
+    int64_t framesLate = 0;             // ready more than a frame after their due time
+    int64_t audioUnderruns = 0;         // the WASAPI buffer ran dry
+    double decodeAvgMs = 0.0;
+    double decodeMaxMs = 0.0;
+    int64_t decodeHistogram[kDecodeHistogramBuckets] = {};
+    double latencyAvgMs = 0.0;          // frame ready -> on screen
+    double latencyMaxMs = 0.0;
+    bool hasAudioClock = false;
+    double avDriftMs = 0.0;             // video minus audio; positive: video ahead
+    double audioQueueMs = 0.0;          // decoded audio waiting to be mixed
+    double audioDeviceFill = 0.0;       // WASAPI buffer fill, 0..1
+    double videoLeadMs = 0.0;           // decoded video ahead of the clock
+};
+
+// Playback health for the stats overlay and the session CSV. The playback,
+// audio and UI threads each report their part, so the counters are atomics;
+// the playback thread folds them into one row per second while playing.
+class PlaybackStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // A new file: drops every row and counter.
+    void Reset();
+    // Playback (re)starts; a frame decoded before the pause is not pending.
+    void OnPlay();
+    // Playback stops: the part of a second since the last row becomes a row.
+    void OnPause();
+
+    // Playback thread, with the decoder lock held like the frame it decoded.
+    void OnFrameDecoded(int64_t decodeNs, double pts);
+    // UI thread, under the same lock, when the frame reaches the screen.
+    void OnFramePresented();
+    void OnFrameLate() { m_late.fetch_add(1, std::memory_order_relaxed); }
+    void SetVideoLead(double seconds) { m_videoLeadUs = (int64_t)(seconds * 1e6); }
+
+    // Audio thread: the media time now being heard and the buffer levels.
+    void SetAudioClock(double pts);
+    void SetAudioBuffers(double queueSeconds, double deviceFill);
+    void OnAudioUnderrun() { m_underruns.fetch_add(1, std::memory_order_relaxed); }
+
+    // Adds a row once a second has passed since the last one. Playback thread.
+    void Tick();
+
+    // Session totals with the last interval's timings, for the overlay.
+    PlaybackSnapshot Current() const;
+    bool SaveCsv(const std::wstring& path) const;
+
+private:
+    struct Totals {
+        int64_t decoded = 0, decodeNs = 0, presented = 0, latencyNs = 0;
+        int64_t dropped = 0, late = 0, underruns = 0;
+        int64_t histogram[kDecodeHistogramBuckets] = {};
+    };
+    Totals ReadTotals() const;
+    void AddRowLocked(int64_t now);
+    int64_t NowNs() const;
+
+    std::atomic<int64_t> m_decoded{0};
+    std::atomic<int64_t> m_decodeNs{0};
+    std::atomic<int64_t> m_decodeMaxNs{0};      // this interval
+    std::atomic<int64_t> m_histogram[kDecodeHistogramBuckets] = {};
+    std::atomic<int64_t> m_presented{0};
+    std::atomic<int64_t> m_latencyNs{0};
+    std::atomic<int64_t> m_latencyMaxNs{0};     // this interval
+    std::atomic<int64_t> m_dropped{0};
+    std::atomic<int64_t> m_late{0};
+    std::atomic<int64_t> m_underruns{0};
+    std::atomic<int64_t> m_positionUs{0};
+    std::atomic<int64_t> m_driftUs{0};
+    std::atomic<bool> m_hasAudioClock{false};
+    std::atomic<int64_t> m_audioClockUs{0};
+    std::atomic<int64_t> m_audioClockAtNs{0};
+    std::atomic<int64_t> m_audioQueueUs{0};
+    std::atomic<int64_t> m_deviceFillPermille{0};
+    std::atomic<int64_t> m_videoLeadUs{0};
+
+    // Frame handoff; guarded by the player's decode mutex.
+    bool m_framePending = false;
+    int64_t m_frameReadyNs = 0;
+    double m_framePts = 0.0;
+
+    mutable std::mutex m_rowMutex;
+    const Clock::time_point m_epoch = Clock::now();
+    int64_t m_sessionNs = 0;                    // playing time in finished rows
+    int64_t m_intervalStartNs = -1;             // -1: not playing
+    Totals m_rowStart;
+    PlaybackSnapshot m_last;
+    std::deque<PlaybackSnapshot> m_rows;
+};
+
+// Multi-line summary drawn over the video.
+std::string FormatPlaybackOverlay(const PlaybackSnapshot& s);
@@ -2,15 +2,22 @@
 #include <commctrl.h>
 
 std::atomic<bool> g_cancelExport(false);
+ExportStats g_exportStats;
 HWND g_hProgressBar = nullptr;
 HWND g_hProgressWindow = nullptr;
 
+// The export thread only updates g_exportStats; the window samples it at
+// this interval instead of being messaged for every packet.
+static const UINT kStatsTimerId = 1;
+static const UINT kStatsIntervalMs = 250;
+
 // Forward declaration for the dark theme function if needed
 void ApplyDarkTheme(HWND hwnd);
 
 void ShowProgressWindow(HWND parent) {
     if (g_hProgressWindow) {
         SetWindowTextW(g_hProgressWindow, L"Exporting video");
+        SetDlgItemTextW(g_hProgressWindow, 3, L"");
         ShowWindow(g_hProgressWindow, SW_SHOW);
         UpdateWindow(g_hProgressWindow);
         return;
@@ -19,7 +26,7 @@ void ShowProgressWindow(HWND parent) {
     g_hProgressWindow = CreateWindowEx(
         WS_EX_TOPMOST, L"ProgressClass", L"Exporting video",
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU,
-        CW_USEDEFAULT, CW_USEDEFAULT, 300, 150,
+        CW_USEDEFAULT, CW_USEDEFAULT, 300, 185,
         parent, nullptr, GetModuleHandle(nullptr), nullptr);
 
     if (g_hProgressWindow) {
@@ -43,6 +50,30 @@ void CloseProgressWindow() {
     }
 }
 
+static void UpdateExportStats(HWND hwnd) {
+    // One last update after the job ends shows the final numbers.
+    static bool s_wasRunning = false;
+    ExportSnapshot s = g_exportStats.Read();
+    if (!s.running && !s_wasRunning)
+        return;
+    s_wasRunning = s.running;
+    if (g_hProgressBar)
+        SendMessage(g_hProgressBar, PBM_SETPOS, (int)(s.progress * 100.0), 0);
+
+    wchar_t eta[32] = L"--:--";
+    if (s.eta >= 0.0) {
+        int secs = (int)(s.eta + 0.5);
+        swprintf_s(eta, _countof(eta), L"%d:%02d", secs / 60, secs % 60);
+    }
+    wchar_t text[160];
+    if (s.bytes > 0)
+        swprintf_s(text, _countof(text), L"%.1f fps  %.2fx realtime  %.0f kbps\n~%.1f MiB  ETA %s",
+                 s.fps, s.realtime, s.kbps, s.projectedBytes / (1024.0 * 1024.0), eta);
+    else
+        swprintf_s(text, _countof(text), L"%.1f fps  %.2fx realtime\nETA %s", s.fps, s.realtime, eta);
+    SetDlgItemTextW(hwnd, 3, text);
+}
+
 LRESULT CALLBACK ProgressProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
         case WM_CREATE: {
@@ -53,18 +84,31 @@ LRESULT CALLBACK ProgressProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam
                 hwnd, (HMENU)1, GetModuleHandle(nullptr), nullptr);
             SendMessage(g_hProgressBar, PBM_SETRANGE, 0, MAKELPARAM(0, 100));
 
+            CreateWindow(
+                L"STATIC", L"",
+                WS_VISIBLE | WS_CHILD | SS_LEFT,
+                20, 52, 250, 36,
+                hwnd, (HMENU)3, // IDC_EXPORT_STATS
+                (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), nullptr);
+
             HWND hCancelButton = CreateWindow(
                 L"BUTTON", L"Cancel",
                 WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
-                100, 60, 80, 30,
+                100, 95, 80, 30,
                 hwnd, (HMENU)2, // IDC_CANCEL_EXPORT
                 (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), nullptr);
 
             // Apply dark theme if available
             // ApplyDarkTheme(hwnd);
             // ApplyDarkTheme(hCancelButton);
+            SetTimer(hwnd, kStatsTimerId, kStatsIntervalMs, nullptr);
             break;
         }
+        case WM_TIMER:
+            if (wParam == kStatsTimerId)
+                UpdateExportStats(hwnd);
+            break;
+
         case WM_COMMAND:
             if (LOWORD(wParam) == 2) { // Cancel button clicked
                 g_cancelExport = true;
@@ -76,6 +120,7 @@ LRESULT CALLBACK ProgressProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam
             break;
 
         case WM_DESTROY:
+            KillTimer(hwnd, kStatsTimerId);
             g_hProgressBar = nullptr;
             g_hProgressWindow = nullptr;
             break;
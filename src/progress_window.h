@@ -5,8 +5,10 @@
 
 #include <windows.h>
 #include <atomic>
+#include "export_stats.h"
 
 extern std::atomic<bool> g_cancelExport;
+extern ExportStats g_exportStats;
 extern HWND g_hProgressBar;
 extern HWND g_hProgressWindow;
 
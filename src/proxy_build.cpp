@@ -0,0 +1,338 @@
+#include "proxy_build.h"
+#include "engine_settings.h"
+#include "media_input.h"
+#include "write_behind_io.h"
+#include "debug_log.h"
+#include "platform.h"
+#include "trace.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+// Frames from one keyframe to the next: a seek decodes at most this many.
+static const int kProxyGop = 10;
+// A 1080p frame; anything larger gets a proxy whatever its codec.
+static const int64_t kFullHdPixels = 1920 * 1080;
+// How often a held build looks at its flags again.
+static const std::chrono::milliseconds kHoldPoll(100);
+
+bool WantsProxy(const AVCodecParameters* par)
+{
+    if (g_proxyCacheMB <= 0 || par->height <= g_proxyHeight)
+        return false;
+    switch (par->codec_id) {
+    case AV_CODEC_ID_HEVC:
+    case AV_CODEC_ID_AV1:
+    case AV_CODEC_ID_VP9:
+    case AV_CODEC_ID_PRORES:
+        return true;
+    default:
+        return (int64_t)par->width * par->height > kFullHdPixels;
+    }
+}
+
+// libx264 tuned for cheap decoding when it is there, then whatever H.264
+// encoder there is, then MJPEG, whose frames are all keyframes.
+static AVCodecContext* OpenProxyEncoder(const AVStream* in, AVRational sar, AVRational frameRate,
+                                        int width, int height, bool globalHeader)
+{
+    const AVCodec* candidates[] = {
+        avcodec_find_encoder_by_name("libx264"),
+        avcodec_find_encoder(AV_CODEC_ID_H264),
+        avcodec_find_encoder(AV_CODEC_ID_MJPEG),
+    };
+    for (const AVCodec* codec : candidates) {
+        if (!codec)
+            continue;
+        AVCodecContext* enc = avcodec_alloc_context3(codec);
+        if (!enc)
+            return nullptr;
+        enc->width = width;
+        enc->height = height;
+        enc->sample_aspect_ratio = sar;
+        enc->time_base = in->time_base;
+        enc->framerate = frameRate;
+        enc->pix_fmt = codec->id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+        enc->gop_size = kProxyGop;
+        enc->max_b_frames = 0;
+        enc->thread_count = 0;
+        if (globalHeader)
+            enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        AVDictionary* opts = nullptr;
+        if (strcmp(codec->name, "libx264") == 0) {
+            av_dict_set(&opts, "preset", "veryfast", 0);
+            av_dict_set(&opts, "tune", "fastdecode", 0);
+            av_dict_set(&opts, "crf", "23", 0);
+        } else if (codec->id == AV_CODEC_ID_MJPEG) {
+            enc->flags |= AV_CODEC_FLAG_QSCALE;
+            enc->global_quality = FF_QP2LAMBDA * 5;
+        } else {
+            // About 4 Mbit/s at 960x540.
+            enc->bit_rate = (int64_t)width * height * 8;
+        }
+        int ret = avcodec_open2(enc, codec, &opts);
+        av_dict_free(&opts);
+        if (ret >= 0)
+            return enc;
+        LOG_DEBUG("Proxy encoder " << codec->name << " did not open: " << ret);
+        avcodec_free_context(&enc);
+    }
+    return nullptr;
+}
+
+// One proxy being written. Open, Run and Finish in turn; the destructor
+// frees whatever was opened.
+class ProxyTranscoder {
+public:
+    ~ProxyTranscoder()
+    {
+        CloseIO();
+        avformat_free_context(m_out);
+        sws_freeContext(m_sws);
+        av_frame_free(&m_frame);
+        av_frame_free(&m_scaled);
+        av_packet_free(&m_packet);
+        av_packet_free(&m_encoded);
+        avcodec_free_context(&m_dec);
+        avcodec_free_context(&m_enc);
+        CloseMediaInput(&m_in);
+    }
+
+    bool Open(const std::string& sourcePath, const std::string& outputPath, int height)
+    {
+        m_frame = av_frame_alloc();
+        m_scaled = av_frame_alloc();
+        m_packet = av_packet_alloc();
+        m_encoded = av_packet_alloc();
+        if (!m_frame || !m_scaled || !m_packet || !m_encoded || OpenMediaInput(&m_in, sourcePath) < 0)
+            return false;
+        for (unsigned i = 0; i < m_in->nb_streams && m_video < 0; ++i) {
+            if (m_in->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+                m_video = (int)i;
+        }
+        if (m_video < 0)
+            return false;
+
+        AVStream* vs = m_in->streams[m_video];
+        const AVCodec* decoder = avcodec_find_decoder(vs->codecpar->codec_id);
+        m_dec = decoder ? avcodec_alloc_context3(decoder) : nullptr;
+        if (!m_dec || avcodec_parameters_to_context(m_dec, vs->codecpar) < 0)
+            return false;
+        m_dec->thread_count = 0;
+        m_dec->pkt_timebase = vs->time_base;
+        if (avcodec_open2(m_dec, decoder, nullptr) < 0)
+            return false;
+
+        if (avformat_alloc_output_context2(&m_out, nullptr, "matroska", outputPath.c_str()) < 0)
+            return false;
+        int srcH = vs->codecpar->height;
+        int outH = std::min(height, srcH) & ~1;
+        int outW = (int)((int64_t)vs->codecpar->width * outH / srcH) & ~1;
+        m_enc = OpenProxyEncoder(vs, vs->codecpar->sample_aspect_ratio, av_guess_frame_rate(m_in, vs, nullptr),
+                                 outW, outH, (m_out->oformat->flags & AVFMT_GLOBALHEADER) != 0);
+        if (!m_enc) {
+            LOG_WARN("No encoder could be opened for proxies");
+            return false;
+        }
+        m_scaled->format = m_enc->pix_fmt;
+        m_scaled->width = outW;
+        m_scaled->height = outH;
+        if (av_frame_get_buffer(m_scaled, 0) < 0)
+            return false;
+
+        m_streamMap.assign(m_in->nb_streams, -1);
+        for (unsigned i = 0; i < m_in->nb_streams; ++i) {
+            AVStream* in = m_in->streams[i];
+            AVStream* st = nullptr;
+            if ((int)i == m_video) {
+                st = avformat_new_stream(m_out, nullptr);
+                if (!st || avcodec_parameters_from_context(st->codecpar, m_enc) < 0)
+                    return false;
+                st->time_base = m_enc->time_base;
+                st->avg_frame_rate = m_enc->framerate;
+            } else if (in->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+                st = avformat_new_stream(m_out, nullptr);
+                if (!st || avcodec_parameters_copy(st->codecpar, in->codecpar) < 0)
+                    return false;
+                st->codecpar->codec_tag = 0;
+                st->time_base = in->time_base;
+            } else {
+                in->discard = AVDISCARD_ALL;
+                continue;
+            }
+            // Track titles and languages, so the track list reads the same.
+            av_dict_copy(&st->metadata, in->metadata, 0);
+            st->disposition = in->disposition;
+            m_streamMap[i] = st->index;
+        }
+
+        m_out->pb = OpenWriteBehindIO(outputPath, 0);
+        if (m_out->pb)
+            m_out->flags |= AVFMT_FLAG_CUSTOM_IO;
+        else if (avio_open(&m_out->pb, outputPath.c_str(), AVIO_FLAG_WRITE) < 0)
+            return false;
+        m_ioOpen = true;
+        return avformat_write_header(m_out, nullptr) >= 0;
+    }
+
+    bool Run(std::atomic<bool>* cancelFlag, std::atomic<bool>* holdFlag)
+    {
+        while (true) {
+            while (holdFlag && *holdFlag && !(cancelFlag && *cancelFlag))
+                std::this_thread::sleep_for(kHoldPoll);
+            if (cancelFlag && *cancelFlag)
+                return false;
+            int ret = av_read_frame(m_in, m_packet);
+            if (ret == AVERROR_EOF)
+                break;
+            if (ret < 0)
+                return false;
+            int index = m_packet->stream_index;
+            bool ok = true;
+            if (index == m_video)
+                ok = Decode(m_packet);
+            else if (index < (int)m_streamMap.size() && m_streamMap[index] >= 0)
+                ok = Copy(m_packet);
+            av_packet_unref(m_packet);
+            if (!ok)
+                return false;
+        }
+        return Decode(nullptr) && Encode(nullptr);
+    }
+
+    bool Finish()
+    {
+        bool ok = av_write_trailer(m_out) >= 0;
+        return CloseIO() && ok;
+    }
+
+    int Width() const { return m_enc->width; }
+    int Height() const { return m_enc->height; }
+    const char* EncoderName() const { return m_enc->codec->name; }
+    int64_t Frames() const { return m_frames; }
+
+private:
+    // `pkt` null drains the decoder.
+    bool Decode(const AVPacket* pkt)
+    {
+        TRACE_SCOPE("Proxy decode", "proxy");
+        // A damaged packet is skipped, as in playback.
+        if (avcodec_send_packet(m_dec, pkt) < 0 && pkt)
+            return true;
+        int ret;
+        while ((ret = avcodec_receive_frame(m_dec, m_frame)) >= 0) {
+            bool ok = Encode(m_frame);
+            av_frame_unref(m_frame);
+            if (!ok)
+                return false;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    }
+
+    // `frame` null drains the encoder.
+    bool Encode(const AVFrame* frame)
+    {
+        TRACE_SCOPE("Proxy encode", "proxy");
+        if (frame) {
+            int64_t pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+            if (pts == AV_NOPTS_VALUE)
+                pts = m_lastPts == AV_NOPTS_VALUE ? 0 : m_lastPts + 1;
+            // The encoder needs rising timestamps; a repeated one is dropped.
+            if (m_lastPts != AV_NOPTS_VALUE && pts <= m_lastPts)
+                return true;
+            m_lastPts = pts;
+            m_sws = sws_getCachedContext(m_sws, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                         m_enc->width, m_enc->height, m_enc->pix_fmt,
+                                         SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (!m_sws || av_frame_make_writable(m_scaled) < 0)
+                return false;
+            sws_scale(m_sws, (uint8_t const* const*)frame->data, frame->linesize, 0, frame->height,
+                      m_scaled->data, m_scaled->linesize);
+            m_scaled->pts = pts;
+            ++m_frames;
+        }
+        int ret = avcodec_send_frame(m_enc, frame ? m_scaled : nullptr);
+        if (ret < 0)
+            return false;
+        AVStream* st = m_out->streams[m_streamMap[m_video]];
+        while ((ret = avcodec_receive_packet(m_enc, m_encoded)) >= 0) {
+            av_packet_rescale_ts(m_encoded, m_enc->time_base, st->time_base);
+            m_encoded->stream_index = st->index;
+            if (av_interleaved_write_frame(m_out, m_encoded) < 0)
+                return false;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    }
+
+    bool Copy(AVPacket* pkt)
+    {
+        AVStream* in = m_in->streams[pkt->stream_index];
+        AVStream* st = m_out->streams[m_streamMap[pkt->stream_index]];
+        av_packet_rescale_ts(pkt, in->time_base, st->time_base);
+        pkt->stream_index = st->index;
+        pkt->pos = -1;
+        return av_interleaved_write_frame(m_out, pkt) >= 0;
+    }
+
+    // False if a queued write failed.
+    bool CloseIO()
+    {
+        if (!m_ioOpen)
+            return true;
+        m_ioOpen = false;
+        if (m_out->flags & AVFMT_FLAG_CUSTOM_IO)
+            return CloseWriteBehindIO(&m_out->pb);
+        avio_closep(&m_out->pb);
+        return true;
+    }
+
+    AVFormatContext* m_in = nullptr;
+    AVFormatContext* m_out = nullptr;
+    AVCodecContext* m_dec = nullptr;
+    AVCodecContext* m_enc = nullptr;
+    SwsContext* m_sws = nullptr;
+    AVFrame* m_frame = nullptr;
+    AVFrame* m_scaled = nullptr;
+    AVPacket* m_packet = nullptr;
+    AVPacket* m_encoded = nullptr;
+    std::vector<int> m_streamMap;       // source stream -> proxy stream, -1 if dropped
+    int m_video = -1;
+    int64_t m_lastPts = AV_NOPTS_VALUE;
+    int64_t m_frames = 0;
+    bool m_ioOpen = false;
+};
+
+bool BuildProxy(const std::string& sourcePath, const std::string& outputPath, int height,
+                std::atomic<bool>* cancelFlag, std::atomic<bool>* holdFlag)
+{
+    TRACE_SCOPE("Build proxy", "proxy");
+    auto start = std::chrono::steady_clock::now();
+    bool ok;
+    {
+        ProxyTranscoder proxy;
+        ok = proxy.Open(sourcePath, outputPath, height) && proxy.Run(cancelFlag, holdFlag) && proxy.Finish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (ok)
+            LOG_INFO("Proxy of " << sourcePath << ": " << proxy.Width() << "x" << proxy.Height() << " "
+                     << proxy.EncoderName() << ", " << proxy.Frames() << " frames in " << seconds << " s");
+        else if (cancelFlag && *cancelFlag)
+            LOG_INFO("Proxy of " << sourcePath << " cancelled after " << seconds << " s");
+        else
+            LOG_WARN("Proxy of " << sourcePath << " failed");
+    }
+    if (!ok) {
+        std::error_code ec;
+        std::filesystem::remove(std::filesystem::path(FromUtf8(outputPath)), ec);
+    }
+    return ok;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <atomic>
+#include <string>
+
+// Whether a source is worth a proxy: taller than g_proxyHeight and either
+// larger than 1080p or in a codec that is slow to decode in software.
+// Always false with g_proxyCacheMB at 0.
+bool WantsProxy(const AVCodecParameters* par);
+
+// Transcodes the first video stream of `sourcePath` to a Matroska file at
+// `outputPath`: H.264 `height` lines tall with a keyframe every few frames
+// and no B-frames, so it decodes and seeks cheaply. Audio streams are
+// copied in their order and other streams dropped. Timestamps are kept, so
+// a time on the proxy is the same time on the source. Decoding and
+// encoding use every core; while `*holdFlag` is set the work waits between
+// packets. On failure or cancel the output is deleted.
+bool BuildProxy(const std::string& sourcePath, const std::string& outputPath, int height,
+                std::atomic<bool>* cancelFlag, std::atomic<bool>* holdFlag);
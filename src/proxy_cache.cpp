@@ -0,0 +1,72 @@
+#include "proxy_cache.h"
+#include "export_cache.h"
+#include "engine_settings.h"
+#include "platform.h"
+#include "debug_log.h"
+#include "sha1.h"
+
+namespace fs = std::filesystem;
+
+// Bump when BuildProxy changes so older proxies are made again.
+static const int kProxyVersion = 1;
+static const char* kProxySuffix = ".mkv";
+static const char* kWorkSuffix = ".part.mkv";
+
+ProxyCache& ProxyCache::Get()
+{
+    static ProxyCache cache;
+    return cache;
+}
+
+std::string ProxyCache::MakeKey(const std::wstring& sourcePath)
+{
+    Sha1 sha;
+    if (!HashSource(sourcePath, sha))
+        return std::string();
+    std::string s = "|proxy|v" + std::to_string(kProxyVersion) + "|h" + std::to_string(g_proxyHeight);
+    sha.Update(s.data(), s.size());
+    return sha.FinalHex();
+}
+
+bool ProxyCache::Find(const std::string& key, std::wstring& proxyPath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FileCacheEntry entry;
+    if (!m_store.Find(key, entry))
+        return false;
+    m_store.Touch(entry);
+    proxyPath = m_store.FilePath(key, entry.extension).wstring();
+    return true;
+}
+
+std::wstring ProxyCache::WorkPath(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_store.FilePath(key, kWorkSuffix).wstring();
+}
+
+bool ProxyCache::Store(const std::string& key, const std::wstring& sourcePath, std::wstring& proxyPath)
+{
+    if (key.empty())
+        return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fs::path work = m_store.FilePath(key, kWorkSuffix);
+    fs::path proxy = m_store.FilePath(key, kProxySuffix);
+    m_store.Remove(key, kProxySuffix);
+    FileCacheEntry entry;
+    entry.key = key;
+    entry.extension = kProxySuffix;
+    entry.source = fs::path(sourcePath).filename().u8string();
+    std::error_code ec;
+    fs::rename(work, proxy, ec);
+    if (ec) {
+        LOG_WARN("Proxy cache could not store " << proxy.u8string());
+        fs::remove(work, ec);
+        return false;
+    }
+    if (!m_store.Add(entry))
+        return false;
+    m_store.Trim((int64_t)g_proxyCacheMB * 1024 * 1024, true);
+    proxyPath = proxy.wstring();
+    return true;
+}
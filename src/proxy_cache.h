@@ -0,0 +1,33 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include "file_cache_store.h"
+
+// Low-resolution proxies made by BuildProxy, in VideoEditor/ProxyCache
+// under LocalDataDir(). The key covers the source content the way the
+// export cache's does, plus the proxy settings, so a renamed or copied
+// source finds its proxy again. Least recently used proxies are evicted
+// beyond g_proxyCacheMB, never the one stored or found last.
+class ProxyCache {
+public:
+    static ProxyCache& Get();
+
+    // Empty if the source cannot be read.
+    static std::string MakeKey(const std::wstring& sourcePath);
+
+    // The stored proxy for `key`, marked used. False if there is none or it
+    // was changed or removed since it was stored.
+    bool Find(const std::string& key, std::wstring& proxyPath);
+    // Where a proxy for `key` is built before Store takes it in.
+    std::wstring WorkPath(const std::string& key);
+    // Moves a finished proxy from WorkPath into the cache, then evicts down
+    // to the size limit.
+    bool Store(const std::string& key, const std::wstring& sourcePath, std::wstring& proxyPath);
+
+private:
+    ProxyCache() = default;
+
+    FileCacheStore m_store{ L"ProxyCache", "Proxy cache" };
+    std::mutex m_mutex;
+};
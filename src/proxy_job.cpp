@@ -0,0 +1,62 @@
+#include "proxy_job.h"
+#include "proxy_build.h"
+#include "proxy_cache.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "platform.h"
+#include "trace.h"
+
+ProxyJob::ProxyJob(VideoPlayer* player) : m_player(player) {}
+
+ProxyJob::~ProxyJob()
+{
+    Stop();
+}
+
+void ProxyJob::Start(const std::wstring& sourcePath)
+{
+    Stop();
+    m_thread = std::thread(&ProxyJob::Run, this, sourcePath);
+}
+
+void ProxyJob::Stop()
+{
+    m_cancel = true;
+    if (m_thread.joinable())
+        m_thread.join();
+    m_cancel = false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ready.clear();
+}
+
+std::wstring ProxyJob::ReadyPath()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ready;
+}
+
+void ProxyJob::Run(std::wstring sourcePath)
+{
+    TraceSetThreadName("Proxy");
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    ProxyCache& cache = ProxyCache::Get();
+    std::string key = ProxyCache::MakeKey(sourcePath);
+    if (key.empty())
+        return;
+    std::wstring proxy;
+    if (!cache.Find(key, proxy)) {
+        if (m_cancel)
+            return;
+        LOG_INFO("Building a " << g_proxyHeight << "p proxy of " << ToUtf8(sourcePath));
+        if (!BuildProxy(ToUtf8(sourcePath), ToUtf8(cache.WorkPath(key)), g_proxyHeight, &m_cancel, &m_hold) ||
+            !cache.Store(key, sourcePath, proxy))
+            return;
+    }
+    if (m_cancel)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready = proxy;
+    }
+    PostMessage(m_player->videoWindow, (WM_APP + 2), 0, 0); // WM_APP_PROXY_READY
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "video_player.h"
+
+class VideoPlayer;
+
+// Finds the proxy of the loaded source in the ProxyCache, or builds it on a
+// below normal priority thread, then posts WM_APP + 2 (WM_APP_PROXY_READY)
+// to the player's video window. The build waits while the player plays,
+// so it never takes cores from playback; unloading cancels it.
+class ProxyJob {
+public:
+    ProxyJob(VideoPlayer* player);
+    ~ProxyJob();
+
+    void Start(const std::wstring& sourcePath);
+    // Cancels, ends the thread and forgets the ready proxy. A cancelled
+    // build deletes what it wrote.
+    void Stop();
+    void SetHold(bool hold) { m_hold = hold; }
+    // The proxy to switch to; empty until the message is posted.
+    std::wstring ReadyPath();
+
+private:
+    void Run(std::wstring sourcePath);
+
+    VideoPlayer* m_player;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::wstring m_ready;
+    std::atomic<bool> m_cancel{false};
+    std::atomic<bool> m_hold{false};
+};
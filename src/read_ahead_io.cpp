@@ -0,0 +1,597 @@
+#include "read_ahead_io.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "platform.h"
+#include "trace.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <climits>
+#include <cstdlib>
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+#endif
+#endif
+
+static const int64_t kBlockBytes = 1024 * 1024;
+static const int kAvioBufferBytes = 256 * 1024;
+// Mapped files: how far ahead of the reader the OS is asked to page in.
+static const int64_t kPrefetchBytes = 8 * 1024 * 1024;
+
+// The few file calls the readers need.
+#ifdef _WIN32
+
+struct NativeFile {
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const uint8_t* view = nullptr;
+    int64_t size = 0;
+};
+
+static bool OpenNative(const std::string& utf8Path, NativeFile& f)
+{
+    f.handle = CreateFileW(FromUtf8(utf8Path).c_str(), GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f.handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f.handle, &size)) {
+        CloseHandle(f.handle);
+        f.handle = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    f.size = size.QuadPart;
+    return true;
+}
+
+static int64_t ReadNative(NativeFile& f, int64_t offset, uint8_t* buf, int64_t size)
+{
+    int64_t done = 0;
+    while (done < size) {
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)((offset + done) & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD)((offset + done) >> 32);
+        DWORD got = 0;
+        if (!ReadFile(f.handle, buf + done, (DWORD)(size - done), &got, &ov))
+            return GetLastError() == ERROR_HANDLE_EOF ? done : -1;
+        if (got == 0)
+            break;
+        done += got;
+    }
+    return done;
+}
+
+static bool MapNative(NativeFile& f)
+{
+    f.mapping = CreateFileMappingW(f.handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!f.mapping)
+        return false;
+    f.view = (const uint8_t*)MapViewOfFile(f.mapping, FILE_MAP_READ, 0, 0, 0);
+    return f.view != nullptr;
+}
+
+static void PrefetchNative(const uint8_t* addr, int64_t size)
+{
+    WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)addr, (SIZE_T)size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+static void CloseNative(NativeFile& f)
+{
+    if (f.view)
+        UnmapViewOfFile(f.view);
+    if (f.mapping)
+        CloseHandle(f.mapping);
+    if (f.handle != INVALID_HANDLE_VALUE)
+        CloseHandle(f.handle);
+    f = NativeFile();
+}
+
+// USB, FireWire and card-reader disks. A USB hard drive reports itself as
+// a fixed drive, but a cold page fault on it stalls the reader as long as a
+// network read does.
+static bool IsRemovableBus(const wchar_t* root)
+{
+    wchar_t volume[MAX_PATH];
+    if (!GetVolumeNameForVolumeMountPointW(root, volume, MAX_PATH))
+        return false;
+    size_t len = wcslen(volume);
+    if (len > 0 && volume[len - 1] == L'\\')
+        volume[len - 1] = 0;        // the volume device, not its root folder
+    HANDLE device = CreateFileW(volume, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (device == INVALID_HANDLE_VALUE)
+        return false;
+    STORAGE_PROPERTY_QUERY query = {};
+    query.PropertyId = StorageDeviceProperty;
+    query.QueryType = PropertyStandardQuery;
+    STORAGE_DEVICE_DESCRIPTOR desc = {};
+    DWORD got = 0;
+    BOOL ok = DeviceIoControl(device, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                              &desc, sizeof(desc), &got, nullptr);
+    CloseHandle(device);
+    if (!ok || got < FIELD_OFFSET(STORAGE_DEVICE_DESCRIPTOR, RawPropertiesLength))
+        return false;
+    if (desc.RemovableMedia)
+        return true;
+    switch (desc.BusType) {
+    case BusTypeUsb:
+    case BusType1394:
+    case BusTypeSd:
+    case BusTypeMmc:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Network shares, removable or optical drives and disks on a removable
+// bus; an internal disk is mapped.
+static bool IsSlowStorage(const std::string& utf8Path)
+{
+    wchar_t root[MAX_PATH];
+    if (!GetVolumePathNameW(FromUtf8(utf8Path).c_str(), root, MAX_PATH))
+        return true;
+    UINT type = GetDriveTypeW(root);
+    if (type == DRIVE_REMOTE || type == DRIVE_REMOVABLE || type == DRIVE_CDROM)
+        return true;
+    return type == DRIVE_FIXED && IsRemovableBus(root);
+}
+
+#else
+
+struct NativeFile {
+    int fd = -1;
+    const uint8_t* view = nullptr;
+    int64_t size = 0;
+};
+
+static bool OpenNative(const std::string& utf8Path, NativeFile& f)
+{
+    f.fd = open(utf8Path.c_str(), O_RDONLY);
+    if (f.fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(f.fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(f.fd);
+        f.fd = -1;
+        return false;
+    }
+    f.size = (int64_t)st.st_size;
+    return true;
+}
+
+static int64_t ReadNative(NativeFile& f, int64_t offset, uint8_t* buf, int64_t size)
+{
+    int64_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(f.fd, buf + done, (size_t)(size - done), (off_t)(offset + done));
+        if (got < 0)
+            return -1;
+        if (got == 0)
+            break;
+        done += got;
+    }
+    return done;
+}
+
+static bool MapNative(NativeFile& f)
+{
+    void* view = mmap(nullptr, (size_t)f.size, PROT_READ, MAP_SHARED, f.fd, 0);
+    if (view == MAP_FAILED)
+        return false;
+    posix_madvise(view, (size_t)f.size, POSIX_MADV_SEQUENTIAL);
+    f.view = (const uint8_t*)view;
+    return true;
+}
+
+static void PrefetchNative(const uint8_t* addr, int64_t size)
+{
+    static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(page - 1);
+    posix_madvise((void*)start, (size_t)((uintptr_t)addr + size - start), POSIX_MADV_WILLNEED);
+}
+
+static void CloseNative(NativeFile& f)
+{
+    if (f.view)
+        munmap((void*)f.view, (size_t)f.size);
+    if (f.fd >= 0)
+        close(f.fd);
+    f = NativeFile();
+}
+
+#ifdef __linux__
+// Block devices behind a USB, FireWire or SD/MMC host; sysfs names the bus
+// in the device's path. Such disks mount like any other (ext4, exFAT,
+// NTFS), but a cold page fault on them stalls the reader.
+static bool IsRemovableBus(const std::string& utf8Path)
+{
+    struct stat st;
+    if (stat(utf8Path.c_str(), &st) != 0)
+        return false;
+    char link[64];
+    snprintf(link, sizeof(link), "/sys/dev/block/%u:%u", major(st.st_dev), minor(st.st_dev));
+    char device[PATH_MAX];
+    if (!realpath(link, device))
+        return false;
+    return strstr(device, "/usb") || strstr(device, "/firewire") || strstr(device, "/mmc_host/");
+}
+#endif
+
+static bool IsSlowStorage(const std::string& utf8Path)
+{
+#ifdef __linux__
+    struct statfs fs;
+    if (statfs(utf8Path.c_str(), &fs) != 0)
+        return true;
+    switch ((unsigned long)fs.f_type) {
+    case 0x6969:        // NFS
+    case 0x517B:        // SMB
+    case 0xFF534D42:    // CIFS
+    case 0xFE534D42:    // SMB2
+    case 0x65735546:    // FUSE (sshfs and the like)
+        return true;
+    default:
+        return IsRemovableBus(utf8Path);
+    }
+#else
+    (void)utf8Path;
+    return false;
+#endif
+}
+
+#endif
+
+// One open source file behind an AVIOContext. Read and SeekTo are called
+// by whichever thread drives the demuxer, one at a time.
+class MediaFile {
+public:
+    MediaFile(const std::string& utf8Path, NativeFile file) : m_name(utf8Path), m_file(file) {}
+    virtual ~MediaFile() { CloseNative(m_file); }
+
+    virtual int Read(uint8_t* buf, int size) = 0;
+    virtual void SeekTo(int64_t pos) { m_pos = pos; ++m_seeks; }
+    virtual void LogStats() const = 0;
+    int64_t Position() const { return m_pos; }
+    int64_t Size() const { return m_file.size; }
+
+protected:
+    std::string m_name;
+    NativeFile m_file;
+    int64_t m_pos = 0;
+    int64_t m_seeks = 0;
+};
+
+// Local files: reads are copies out of the mapping.
+class MappedFile : public MediaFile {
+public:
+    using MediaFile::MediaFile;
+
+    int Read(uint8_t* buf, int size) override
+    {
+        if (m_pos >= m_file.size)
+            return AVERROR_EOF;
+        int n = (int)std::min<int64_t>(size, m_file.size - m_pos);
+        if (m_pos + n > m_prefetched - kPrefetchBytes / 2) {
+            int64_t from = std::max(m_pos, m_prefetched);
+            int64_t to = std::min(m_pos + kPrefetchBytes, m_file.size);
+            if (to > from)
+                PrefetchNative(m_file.view + from, to - from);
+            m_prefetched = to;
+        }
+        memcpy(buf, m_file.view + m_pos, n);
+        m_pos += n;
+        m_bytes += n;
+        return n;
+    }
+
+    void SeekTo(int64_t pos) override
+    {
+        MediaFile::SeekTo(pos);
+        m_prefetched = pos;
+    }
+
+    void LogStats() const override
+    {
+        LOG_INFO("Mapped read of " << m_name << ": " << m_bytes / (1024 * 1024) << " MB, "
+                 << m_seeks << " seeks");
+    }
+
+private:
+    int64_t m_prefetched = 0;       // paged-in hint given up to here
+    int64_t m_bytes = 0;
+};
+
+// Slow storage: an I/O thread fills a block cache ahead of the reader.
+class ReadAheadFile : public MediaFile {
+public:
+    ReadAheadFile(const std::string& utf8Path, NativeFile file, int cacheMB)
+        : MediaFile(utf8Path, file)
+    {
+        m_maxBlocks = std::max(4, cacheMB * 1024 * 1024 / (int)kBlockBytes);
+        m_aheadBlocks = m_maxBlocks / 2;
+        m_blockCount = (m_file.size + kBlockBytes - 1) / kBlockBytes;
+        m_thread = std::thread(&ReadAheadFile::Run, this);
+    }
+
+    ~ReadAheadFile() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+
+    int Read(uint8_t* buf, int size) override
+    {
+        if (m_pos >= m_file.size)
+            return AVERROR_EOF;
+        int64_t index = m_pos / kBlockBytes;
+        int64_t offset = m_pos % kBlockBytes;
+        Block* block;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            block = Request(index, lock);
+            Schedule(index);
+        }
+        m_wake.notify_one();
+        // A ready block is only written again after the reader evicts it.
+        if (block->failed)
+            return AVERROR(EIO);
+        if (block->size <= offset)
+            return AVERROR_EOF;
+        int n = (int)std::min<int64_t>(size, block->size - offset);
+        memcpy(buf, block->data.data() + offset, n);
+        m_pos += n;
+        return n;
+    }
+
+    void SeekTo(int64_t pos) override
+    {
+        MediaFile::SeekTo(pos);
+        int64_t first = pos / kBlockBytes;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Queued blocks outside the new window are stale: drop them so the
+        // I/O thread goes straight to the new position.
+        for (auto it = m_queue.begin(); it != m_queue.end();) {
+            if (*it < first || *it > first + m_aheadBlocks) {
+                m_blocks.erase(*it);
+                it = m_queue.erase(it);
+                ++m_cancelled;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void LogStats() const override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int64_t reads = m_hits + m_misses;
+        LOG_INFO("Read-ahead of " << m_name << ": " << (reads ? m_hits * 100 / reads : 0) << "% of "
+                 << reads << " block reads from the cache, " << m_fetched / (1024 * 1024) << " MB fetched, "
+                 << m_seeks << " seeks, " << m_cancelled << " queued blocks cancelled");
+    }
+
+private:
+    enum class State { Queued, Loading, Ready };
+    struct Block {
+        State state = State::Queued;
+        std::vector<uint8_t> data;
+        int64_t size = 0;
+        bool failed = false;
+        uint64_t lastUse = 0;
+    };
+
+    // The block at `index`, fetched first if it is not cached yet.
+    Block* Request(int64_t index, std::unique_lock<std::mutex>& lock)
+    {
+        auto it = m_blocks.find(index);
+        if (it == m_blocks.end()) {
+            if (!EvictFor(index))
+                DropFurthestQueued();
+            it = m_blocks.emplace(index, std::make_unique<Block>()).first;
+            m_queue.push_front(index);
+        } else if (it->second->state == State::Queued) {
+            m_queue.erase(std::find(m_queue.begin(), m_queue.end(), index));
+            m_queue.push_front(index);
+        }
+        Block* block = it->second.get();
+        block->lastUse = ++m_uses;
+        if (block->state == State::Ready) {
+            ++m_hits;
+            return block;
+        }
+        ++m_misses;
+        TRACE_SCOPE("Read-ahead wait", "io");
+        m_wake.notify_one();
+        m_ready.wait(lock, [&] { return block->state == State::Ready; });
+        return block;
+    }
+
+    // Queues the blocks up to m_aheadBlocks past `index`.
+    void Schedule(int64_t index)
+    {
+        int64_t last = std::min(index + m_aheadBlocks, m_blockCount - 1);
+        for (int64_t i = index + 1; i <= last; ++i) {
+            if (m_blocks.count(i))
+                continue;
+            if (!EvictFor(index))
+                break;
+            m_blocks.emplace(i, std::make_unique<Block>());
+            m_queue.push_back(i);
+        }
+    }
+
+    // Makes room for one block, dropping the least recently used ready
+    // block outside the window ahead of `index`. False if there is none.
+    bool EvictFor(int64_t index)
+    {
+        if ((int)m_blocks.size() < m_maxBlocks)
+            return true;
+        auto victim = m_blocks.end();
+        for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+            bool inWindow = it->first >= index && it->first <= index + m_aheadBlocks;
+            if (it->second->state == State::Ready && !inWindow &&
+                (victim == m_blocks.end() || it->second->lastUse < victim->second->lastUse))
+                victim = it;
+        }
+        if (victim == m_blocks.end())
+            return false;
+        m_spare.push_back(std::move(victim->second->data));
+        m_blocks.erase(victim);
+        return true;
+    }
+
+    // The reader needs a block and nothing ready can go: give up the queued
+    // block furthest ahead instead, so the cache never grows past
+    // m_maxBlocks. With at most half the cache in the window and one block
+    // loading, some block outside the window is always queued or ready.
+    void DropFurthestQueued()
+    {
+        if (m_queue.empty())
+            return;
+        m_blocks.erase(m_queue.back());
+        m_queue.pop_back();
+        ++m_cancelled;
+    }
+
+    void Run()
+    {
+        TraceSetThreadName("Read-ahead");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                break;
+            int64_t index = m_queue.front();
+            m_queue.pop_front();
+            Block* block = m_blocks[index].get();
+            block->state = State::Loading;
+            if (!m_spare.empty()) {
+                block->data = std::move(m_spare.back());
+                m_spare.pop_back();
+            }
+            block->data.resize(kBlockBytes);
+            lock.unlock();
+
+            int64_t offset = index * kBlockBytes;
+            int64_t got;
+            {
+                TRACE_SCOPE("Read-ahead block", "io");
+                got = ReadNative(m_file, offset, block->data.data(), std::min(kBlockBytes, m_file.size - offset));
+            }
+
+            lock.lock();
+            block->failed = got < 0;
+            block->size = std::max<int64_t>(got, 0);
+            block->state = State::Ready;
+            m_fetched += block->size;
+            m_ready.notify_all();
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;         // I/O thread: work queued
+    std::condition_variable m_ready;        // reader: a block finished
+    std::map<int64_t, std::unique_ptr<Block>> m_blocks;
+    std::deque<int64_t> m_queue;            // blocks to fetch, next first
+    std::vector<std::vector<uint8_t>> m_spare;
+    int m_maxBlocks = 0;
+    int m_aheadBlocks = 0;
+    int64_t m_blockCount = 0;
+    uint64_t m_uses = 0;
+    bool m_stop = false;
+    int64_t m_hits = 0, m_misses = 0, m_fetched = 0, m_cancelled = 0;
+    std::thread m_thread;                   // last, so it starts after the rest
+};
+
+static int ReadPacket(void* opaque, uint8_t* buf, int size)
+{
+    return static_cast<MediaFile*>(opaque)->Read(buf, size);
+}
+
+static int64_t SeekPacket(void* opaque, int64_t offset, int whence)
+{
+    MediaFile* file = static_cast<MediaFile*>(opaque);
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE)
+        return file->Size();
+    int64_t target;
+    if (whence == SEEK_SET)
+        target = offset;
+    else if (whence == SEEK_CUR)
+        target = file->Position() + offset;
+    else if (whence == SEEK_END)
+        target = file->Size() + offset;
+    else
+        return AVERROR(EINVAL);
+    if (target < 0)
+        return AVERROR(EINVAL);
+    file->SeekTo(target);
+    return target;
+}
+
+AVIOContext* OpenReadAheadIO(const std::string& utf8Path)
+{
+    if (g_readAheadMB <= 0)
+        return nullptr;
+    NativeFile native;
+    if (!OpenNative(utf8Path, native))
+        return nullptr;
+    if (native.size <= 0) {
+        CloseNative(native);
+        return nullptr;
+    }
+
+    std::unique_ptr<MediaFile> file;
+    if (!IsSlowStorage(utf8Path) && MapNative(native))
+        file = std::make_unique<MappedFile>(utf8Path, native);
+    else
+        file = std::make_unique<ReadAheadFile>(utf8Path, native, g_readAheadMB);
+
+    uint8_t* buffer = (uint8_t*)av_malloc(kAvioBufferBytes);
+    if (!buffer)
+        return nullptr;
+    AVIOContext* pb = avio_alloc_context(buffer, kAvioBufferBytes, 0, file.get(), ReadPacket, nullptr, SeekPacket);
+    if (!pb) {
+        av_free(buffer);
+        return nullptr;
+    }
+    file.release();
+    return pb;
+}
+
+void CloseReadAheadIO(AVIOContext** pb)
+{
+    if (!*pb)
+        return;
+    MediaFile* file = static_cast<MediaFile*>((*pb)->opaque);
+    file->LogStats();
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+    delete file;
+}
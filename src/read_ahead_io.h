@@ -0,0 +1,21 @@
+#pragma once
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <string>
+
+// Source file reads for the demuxers that keep disk and network latency off
+// the decode thread. Local files are memory-mapped, and the OS is asked to
+// page in the next few MB ahead of the reader. Files on network shares,
+// removable drives and USB or card-reader disks are read in 1 MB blocks by
+// an I/O thread into a cache of at most g_readAheadMB, half of it ahead of
+// the reader; a seek drops the queued blocks that are no longer ahead of
+// the new position.
+// nullptr if the file cannot be opened or g_readAheadMB is 0; the caller
+// then lets FFmpeg read the file itself.
+AVIOContext* OpenReadAheadIO(const std::string& utf8Path);
+// Logs how many block reads the cache served and frees the context.
+void CloseReadAheadIO(AVIOContext** pb);
@@ -0,0 +1,283 @@
+#include "scrub_decoder.h"
+#include "video_player.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "media_input.h"
+#include "platform.h"
+#include "trace.h"
+#include <utility>
+
+// How long the pointer has to rest before a hovered frame is decoded.
+static const std::chrono::milliseconds kHoverDwell(120);
+// A target at most this far past the decoder's last frame is reached by
+// decoding on; one further away seeks to its keyframe.
+static const double kDecodeOnSeconds = 1.0;
+
+static int64_t FrameTime(const AVFrame* f)
+{
+    return f->best_effort_timestamp != AV_NOPTS_VALUE ? f->best_effort_timestamp : f->pts;
+}
+
+ScrubDecoder::ScrubDecoder(VideoPlayer* player) : m_player(player) {}
+
+ScrubDecoder::~ScrubDecoder()
+{
+    Stop();
+}
+
+void ScrubDecoder::Show(double seconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_target = seconds;
+        m_show = true;
+        m_pending = true;
+        ++m_generation;
+        if (!m_thread.joinable())
+            m_thread = std::thread(&ScrubDecoder::Run, this);
+    }
+    m_wake.notify_one();
+}
+
+void ScrubDecoder::Warm(double seconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_target = seconds;
+        m_show = false;
+        m_pending = true;
+        ++m_generation;
+        if (!m_thread.joinable())
+            m_thread = std::thread(&ScrubDecoder::Run, this);
+    }
+    m_wake.notify_one();
+}
+
+void ScrubDecoder::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = false;
+        ++m_generation;
+    }
+    m_wake.notify_one();
+}
+
+void ScrubDecoder::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = false;
+        ++m_generation;
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+    m_stop = false;
+    m_failed = false;
+}
+
+bool ScrubDecoder::Cancelled(uint64_t generation) const
+{
+    return m_generation != generation || m_player->isPlaying;
+}
+
+void ScrubDecoder::Run()
+{
+    TraceSetThreadName("Scrub decoder");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stop || m_pending; });
+        if (m_stop)
+            break;
+        // A drag is drawn at once; a hover only counts once the pointer rests.
+        uint64_t generation = m_generation;
+        if (!m_show && m_wake.wait_for(lock, kHoverDwell, [&] { return m_stop || m_generation != generation; }))
+            continue;
+        m_pending = false;
+        double target = m_target;
+        bool show = m_show;
+        lock.unlock();
+        Work(target, show, generation);
+        lock.lock();
+    }
+    lock.unlock();
+    Close();
+}
+
+void ScrubDecoder::Work(double seconds, bool show, uint64_t generation)
+{
+    VideoPlayer* p = m_player;
+    int stream;
+    int64_t ts;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(p->decodeMutex);
+        if (!p->isLoaded || Cancelled(generation))
+            return;
+        stream = p->videoStreamIndex;
+        AVStream* vs = p->formatContext->streams[stream];
+        ts = (int64_t)((seconds + p->startTimeOffset) / av_q2d(vs->time_base));
+        path = ToUtf8(p->playbackFilename);
+    }
+
+    if (!m_fmt && !Open(path, stream)) {
+        LOG_WARN("Scrub decoder could not open the file, scrubbing through the playback decoder");
+        Close();
+        m_failed = true;
+        return;
+    }
+    if (!DecodeTo(ts, generation) || !show)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(p->decodeMutex);
+        // Checked under the lock, so nothing is drawn after a seek or Play
+        // that cancelled this.
+        if (!p->isLoaded || Cancelled(generation) || !p->frameRGB)
+            return;
+        TRACE_SCOPE("Scrub sws_scale", "playback");
+        const AVFrame* f = m_haveLast ? m_last : m_ahead;
+        m_sws = sws_getCachedContext(m_sws, f->width, f->height, (AVPixelFormat)f->format,
+                                     p->frameWidth, p->frameHeight, AV_PIX_FMT_BGRA,
+                                     SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+        if (!m_sws)
+            return;
+        sws_scale(m_sws, (uint8_t const* const*)f->data, f->linesize, 0, f->height,
+                  p->frameRGB->data, p->frameRGB->linesize);
+        ++m_shown;
+    }
+    InvalidateRect(p->videoWindow, nullptr, FALSE);
+}
+
+bool ScrubDecoder::Open(const std::string& path, int stream)
+{
+    TRACE_SCOPE("Scrub decoder open", "playback");
+    if (OpenMediaInput(&m_fmt, path) < 0)
+        return false;
+    if (stream < 0 || stream >= (int)m_fmt->nb_streams ||
+        m_fmt->streams[stream]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+        return false;
+    for (unsigned i = 0; i < m_fmt->nb_streams; ++i) {
+        if ((int)i != stream)
+            m_fmt->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVCodecParameters* cp = m_fmt->streams[stream]->codecpar;
+    const AVCodec* codec = avcodec_find_decoder(cp->codec_id);
+    if (!codec)
+        return false;
+    m_codec = avcodec_alloc_context3(codec);
+    if (!m_codec || avcodec_parameters_to_context(m_codec, cp) < 0)
+        return false;
+    // Skips what the playback decoder skips, so both show the same frames.
+    m_codec->skip_frame = AVDISCARD_NONREF;
+    if (avcodec_open2(m_codec, codec, nullptr) < 0)
+        return false;
+
+    m_packet = av_packet_alloc();
+    m_last = av_frame_alloc();
+    m_ahead = av_frame_alloc();
+    if (!m_packet || !m_last || !m_ahead)
+        return false;
+    // Only video is read here, so a quarter of the budget goes a long way.
+    m_packets.Attach(m_fmt, stream, (int64_t)g_packetCacheMB * 1024 * 1024 / 4);
+    m_stream = stream;
+    m_haveLast = m_haveAhead = m_eof = false;
+    return true;
+}
+
+void ScrubDecoder::Close()
+{
+    if (m_shown + m_seeks > 0)
+        LOG_DEBUG("Scrub decoder: " << m_shown << " frames shown, " << m_seeks << " seeks, "
+                  << m_continued << " targets decoded on to");
+    m_shown = m_seeks = m_continued = 0;
+    if (m_sws)
+        sws_freeContext(m_sws), m_sws = nullptr;
+    if (m_last)
+        av_frame_free(&m_last);
+    if (m_ahead)
+        av_frame_free(&m_ahead);
+    if (m_packet)
+        av_packet_free(&m_packet);
+    if (m_codec)
+        avcodec_free_context(&m_codec);
+    m_packets.Clear();
+    CloseMediaInput(&m_fmt);
+    m_stream = -1;
+    m_haveLast = m_haveAhead = m_eof = false;
+}
+
+// avcodec_receive_frame, feeding the decoder video packets as it asks.
+int ScrubDecoder::ReceiveFrame(AVFrame* out)
+{
+    while (true) {
+        int ret = avcodec_receive_frame(m_codec, out);
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+        ret = m_packets.Read(m_packet);
+        if (ret == AVERROR_EOF) {
+            // Drains the frames still in the decoder; the next seek flushes.
+            avcodec_send_packet(m_codec, nullptr);
+            continue;
+        }
+        if (ret < 0)
+            return ret;
+        if (m_packet->stream_index == m_stream)
+            avcodec_send_packet(m_codec, m_packet);
+        av_packet_unref(m_packet);
+    }
+}
+
+// Decodes up to the frame shown at `ts` (stream time base): the last one
+// at or before it, or the first one when `ts` comes before any. Leaves it
+// in m_last, or in m_ahead for the first. False if cancelled or failed.
+bool ScrubDecoder::DecodeTo(int64_t ts, uint64_t generation)
+{
+    TRACE_SCOPE("Scrub decode", "playback");
+    AVStream* vs = m_fmt->streams[m_stream];
+    int64_t window = (int64_t)(kDecodeOnSeconds / av_q2d(vs->time_base));
+    bool onward = false;
+    if (m_haveLast && FrameTime(m_last) != AV_NOPTS_VALUE) {
+        int64_t at = FrameTime(m_haveAhead ? m_ahead : m_last);
+        onward = FrameTime(m_last) <= ts && ts - at <= window;
+    }
+    if (!onward) {
+        ++m_seeks;
+        m_haveLast = m_haveAhead = m_eof = false;
+        if (m_packets.Seek(m_stream, ts, AVSEEK_FLAG_BACKWARD) < 0)
+            return false;
+        avcodec_flush_buffers(m_codec);
+    } else if (!m_haveAhead || FrameTime(m_ahead) <= ts) {
+        ++m_continued;
+    }
+
+    while (true) {
+        if (m_haveAhead) {
+            if (FrameTime(m_ahead) > ts)
+                return true;
+            std::swap(m_last, m_ahead);
+            m_haveLast = true;
+            m_haveAhead = false;
+            // A frame without a timestamp is taken for the one asked for.
+            if (FrameTime(m_last) == AV_NOPTS_VALUE)
+                return true;
+        }
+        if (m_eof)
+            return m_haveLast;
+        if (Cancelled(generation))
+            return false;
+        int ret = ReceiveFrame(m_ahead);
+        if (ret == AVERROR_EOF) {
+            m_eof = true;
+        } else if (ret < 0) {
+            // Where the decoder stands is unknown; the next target seeks.
+            m_haveLast = m_haveAhead = false;
+            return false;
+        } else {
+            m_haveAhead = true;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "video_player.h"
+
+class VideoPlayer;
+
+// A second, software-only decoder for timeline scrubbing, with a demuxer
+// of its own that reads only the video stream, so dragging the playhead
+// does not flush the playback decoder or move its demuxer. It works on a
+// thread of its own and only the latest target counts: a frame is found by
+// decoding on from where the decoder already is when the target lies a
+// little ahead, and by seeking to the keyframe before it otherwise, then
+// drawn into the player's frame. A hovered spot is decoded ahead without
+// being drawn, so a click there shows at once.
+class ScrubDecoder {
+public:
+    ScrubDecoder(VideoPlayer* player);
+    ~ScrubDecoder();
+
+    // `seconds` as for VideoPlayer::SeekToTime.
+    void Show(double seconds);
+    // Decodes the frame at `seconds` once the pointer rests, without
+    // drawing it.
+    void Warm(double seconds);
+    // Drops the pending target; a frame being decoded is not drawn.
+    void Cancel();
+    // Cancels, ends the thread and closes the demuxer and decoder.
+    void Stop();
+    // The file could not be opened or decoded here; scrubbing has to go
+    // through the playback decoder.
+    bool Failed() const { return m_failed; }
+
+private:
+    void Run();
+    void Work(double seconds, bool show, uint64_t generation);
+    bool Open(const std::string& path, int stream);
+    void Close();
+    int ReceiveFrame(AVFrame* out);
+    bool DecodeTo(int64_t ts, uint64_t generation);
+    bool Cancelled(uint64_t generation) const;
+
+    VideoPlayer* m_player;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    double m_target = 0.0;
+    bool m_pending = false;
+    bool m_show = false;                    // draw the frame once decoded
+    bool m_stop = false;
+    std::atomic<uint64_t> m_generation{0};  // bumped by every request and cancel
+    std::atomic<bool> m_failed{false};
+
+    // Scrub thread only.
+    AVFormatContext* m_fmt = nullptr;
+    PacketCache m_packets;
+    AVCodecContext* m_codec = nullptr;
+    SwsContext* m_sws = nullptr;
+    AVPacket* m_packet = nullptr;
+    int m_stream = -1;
+    AVFrame* m_last = nullptr;              // latest frame at or before the target
+    AVFrame* m_ahead = nullptr;             // first frame past it, if decoded
+    bool m_haveLast = false, m_haveAhead = false;
+    bool m_eof = false;
+    int64_t m_shown = 0, m_seeks = 0, m_continued = 0;
+};
@@ -0,0 +1,158 @@
+#include "seek_prefetch.h"
+#include "video_player.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "media_input.h"
+#include "platform.h"
+#include "trace.h"
+#include <algorithm>
+
+// How long the pointer has to rest before its spot is read.
+static const std::chrono::milliseconds kHoverDwell(120);
+// Largest keyframe group read ahead; never more than a quarter of the cache.
+static const int64_t kMaxPrefetchBytes = 32 * 1024 * 1024;
+// The flags SeekToTime seeks with.
+static const int kSeekFlags = AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY;
+
+SeekPrefetcher::SeekPrefetcher(VideoPlayer* player) : m_player(player) {}
+
+SeekPrefetcher::~SeekPrefetcher()
+{
+    Stop();
+}
+
+void SeekPrefetcher::Request(double seconds)
+{
+    if (g_packetCacheMB <= 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_target = seconds;
+        m_pending = true;
+        ++m_generation;
+        if (!m_thread.joinable())
+            m_thread = std::thread(&SeekPrefetcher::Run, this);
+    }
+    m_wake.notify_one();
+}
+
+void SeekPrefetcher::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = false;
+        ++m_generation;
+    }
+    m_wake.notify_one();
+}
+
+void SeekPrefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = false;
+        ++m_generation;
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+    m_stop = false;
+}
+
+bool SeekPrefetcher::Cancelled(uint64_t generation) const
+{
+    return m_generation != generation || m_player->isPlaying;
+}
+
+void SeekPrefetcher::Run()
+{
+    TraceSetThreadName("Seek prefetch");
+    // Background mode lowers the I/O priority too, so these reads queue
+    // behind the playback thread's.
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stop || m_pending; });
+        if (m_stop)
+            break;
+        // A pointer moving across the timeline keeps replacing the target.
+        uint64_t generation = m_generation;
+        if (m_wake.wait_for(lock, kHoverDwell, [&] { return m_stop || m_generation != generation; }))
+            continue;
+        m_pending = false;
+        double target = m_target;
+        lock.unlock();
+        Prefetch(target, generation);
+        lock.lock();
+    }
+    lock.unlock();
+    if (m_packet)
+        av_packet_free(&m_packet);
+    CloseMediaInput(&m_fmt);
+}
+
+void SeekPrefetcher::Prefetch(double seconds, uint64_t generation)
+{
+    VideoPlayer* p = m_player;
+    int stream;
+    int64_t ts;
+    std::string path;
+    {
+        // Busy means a decode or a seek is running; the hover can wait.
+        std::unique_lock<std::mutex> lock(p->decodeMutex, std::try_to_lock);
+        if (!lock.owns_lock() || !p->isLoaded || Cancelled(generation))
+            return;
+        stream = p->videoStreamIndex;
+        AVStream* vs = p->formatContext->streams[stream];
+        ts = (int64_t)((seconds + p->startTimeOffset) / av_q2d(vs->time_base));
+        if (p->packetCache.Covers(stream, ts, kSeekFlags))
+            return;
+        path = ToUtf8(p->playbackFilename);
+    }
+
+    TRACE_SCOPE("Seek prefetch", "playback");
+    if (!m_fmt) {
+        if (OpenMediaInput(&m_fmt, path) < 0)
+            return;
+        m_packet = av_packet_alloc();
+    }
+    if (!m_packet || av_seek_frame(m_fmt, stream, ts, AVSEEK_FLAG_BACKWARD) < 0)
+        return;
+
+    int64_t budget = std::min<int64_t>(kMaxPrefetchBytes, (int64_t)g_packetCacheMB * 1024 * 1024 / 4);
+    std::vector<AVPacket*> packets;
+    int64_t bytes = 0;
+    bool eof = false;
+    bool complete = false;
+    while (!Cancelled(generation) && bytes <= budget) {
+        int ret = av_read_frame(m_fmt, m_packet);
+        if (ret < 0) {
+            eof = complete = ret == AVERROR_EOF;
+            break;
+        }
+        // Nothing after a video packet decoded later than the target is
+        // needed to show it.
+        bool past = m_packet->stream_index == stream && m_packet->dts != AV_NOPTS_VALUE && m_packet->dts > ts;
+        AVPacket* copy = av_packet_clone(m_packet);
+        av_packet_unref(m_packet);
+        if (!copy)
+            break;
+        packets.push_back(copy);
+        bytes += copy->size;
+        if (past) {
+            complete = true;
+            break;
+        }
+    }
+
+    if (complete) {
+        std::lock_guard<std::mutex> lock(p->decodeMutex);
+        if (p->isLoaded && !Cancelled(generation)) {
+            LOG_DEBUG("Prefetched " << packets.size() << " packets (" << bytes / 1024 << " KB) at " << seconds << "s");
+            p->packetCache.Insert(packets, eof);
+        }
+    }
+    for (AVPacket* pkt : packets)
+        av_packet_free(&pkt);
+}
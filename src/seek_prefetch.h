@@ -0,0 +1,39 @@
+#pragma once
+
+#include "video_player.h"
+
+class VideoPlayer;
+
+// Reads the keyframe group under the timeline pointer on a low priority
+// thread with a demuxer of its own, and adds it to the player's
+// PacketCache so a click there starts decoding from memory. Only the
+// latest hover counts and only once the pointer rests; a new hover, a
+// seek, Play and unloading cancel the read in flight. Nothing is read
+// while the player plays, and a group larger than the budget is dropped.
+class SeekPrefetcher {
+public:
+    SeekPrefetcher(VideoPlayer* player);
+    ~SeekPrefetcher();
+
+    // `seconds` as for VideoPlayer::SeekToTime.
+    void Request(double seconds);
+    void Cancel();
+    // Cancels, ends the thread and closes the demuxer.
+    void Stop();
+
+private:
+    void Run();
+    void Prefetch(double seconds, uint64_t generation);
+    bool Cancelled(uint64_t generation) const;
+
+    VideoPlayer* m_player;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    double m_target = 0.0;
+    bool m_pending = false;
+    bool m_stop = false;
+    std::atomic<uint64_t> m_generation{0};  // bumped by every request and cancel
+    AVFormatContext* m_fmt = nullptr;       // prefetch thread only
+    AVPacket* m_packet = nullptr;
+};
@@ -0,0 +1,102 @@
+#include "sha1.h"
+#include <algorithm>
+#include <cstring>
+
+static inline uint32_t Rol(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+void Sha1::Reset()
+{
+    m_h[0] = 0x67452301u;
+    m_h[1] = 0xEFCDAB89u;
+    m_h[2] = 0x98BADCFEu;
+    m_h[3] = 0x10325476u;
+    m_h[4] = 0xC3D2E1F0u;
+    m_length = 0;
+    m_bufLen = 0;
+}
+
+void Sha1::Block(const uint8_t* p)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 |
+               (uint32_t)p[i * 4 + 2] << 8 | (uint32_t)p[i * 4 + 3];
+    for (int i = 16; i < 80; ++i)
+        w[i] = Rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = m_h[0], b = m_h[1], c = m_h[2], d = m_h[3], e = m_h[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999u;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1u;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDCu;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6u;
+        }
+        uint32_t t = Rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = Rol(b, 30);
+        b = a;
+        a = t;
+    }
+    m_h[0] += a;
+    m_h[1] += b;
+    m_h[2] += c;
+    m_h[3] += d;
+    m_h[4] += e;
+}
+
+void Sha1::Update(const void* data, size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_length += size;
+    if (m_bufLen) {
+        size_t take = std::min(size, sizeof(m_buf) - m_bufLen);
+        memcpy(m_buf + m_bufLen, p, take);
+        m_bufLen += take;
+        p += take;
+        size -= take;
+        if (m_bufLen < sizeof(m_buf))
+            return;
+        Block(m_buf);
+        m_bufLen = 0;
+    }
+    for (; size >= 64; p += 64, size -= 64)
+        Block(p);
+    memcpy(m_buf, p, size);
+    m_bufLen = size;
+}
+
+std::string Sha1::FinalHex()
+{
+    uint64_t bits = m_length * 8;
+    uint8_t pad = 0x80;
+    Update(&pad, 1);
+    uint8_t zero = 0;
+    while (m_bufLen != 56)
+        Update(&zero, 1);
+    uint8_t len[8];
+    for (int i = 0; i < 8; ++i)
+        len[i] = (uint8_t)(bits >> (56 - i * 8));
+    Update(len, 8);
+
+    static const char* kHex = "0123456789abcdef";
+    std::string out(40, '0');
+    for (int i = 0; i < 20; ++i) {
+        uint8_t byte = (uint8_t)(m_h[i / 4] >> (24 - (i % 4) * 8));
+        out[i * 2] = kHex[byte >> 4];
+        out[i * 2 + 1] = kHex[byte & 15];
+    }
+    return out;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Incremental SHA-1 for upload integrity headers.
+class Sha1 {
+public:
+    Sha1() { Reset(); }
+
+    void Reset();
+    void Update(const void* data, size_t size);
+    // Lowercase hex digest; the object must be Reset before reuse.
+    std::string FinalHex();
+
+private:
+    void Block(const uint8_t* p);
+
+    uint32_t m_h[5];
+    uint64_t m_length = 0;      // bytes hashed so far
+    uint8_t m_buf[64];
+    size_t m_bufLen = 0;
+};
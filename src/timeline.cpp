@@ -16,6 +16,9 @@ extern bool g_wasPlayingBeforeDrag;
 enum class DragMode { None, Cursor, StartMarker, EndMarker };
 extern DragMode g_timelineDragMode;
 
+// Whether WM_MOUSELEAVE was requested for the current hover.
+static bool s_trackingLeave = false;
+
 LRESULT CALLBACK TimelineProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     switch (msg)
@@ -48,7 +51,7 @@ LRESULT CALLBACK TimelineProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
                 g_wasPlayingBeforeDrag = g_videoPlayer->IsPlaying();
                 if (g_wasPlayingBeforeDrag)
                     g_videoPlayer->Pause();
-                g_videoPlayer->SeekToTime(seekTime);
+                g_videoPlayer->ScrubTo(seekTime);
             }
 
             g_isTimelineDragging = true;
@@ -70,7 +73,7 @@ LRESULT CALLBACK TimelineProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
             if (g_timelineDragMode == DragMode::Cursor)
             {
-                g_videoPlayer->SeekToTime(seekTime);
+                g_videoPlayer->ScrubTo(seekTime);
             }
             else if (g_timelineDragMode == DragMode::StartMarker)
             {
@@ -93,7 +96,27 @@ LRESULT CALLBACK TimelineProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             UpdateControls();
             return 0;
         }
+        if (g_videoPlayer && g_videoPlayer->IsLoaded() && !g_videoPlayer->IsPlaying())
+        {
+            // Where the pointer rests is likely the next click.
+            RECT rc; GetClientRect(hwnd, &rc);
+            int x = GET_X_LPARAM(lParam);
+            if (x < 0) x = 0; if (x > rc.right) x = rc.right;
+            double ratio = rc.right > 0 ? (x / (double)rc.right) : 0.0;
+            g_videoPlayer->PrefetchAt(ratio * g_videoPlayer->GetDuration());
+            if (!s_trackingLeave)
+            {
+                TRACKMOUSEEVENT tme = { sizeof(tme), TME_LEAVE, hwnd, 0 };
+                s_trackingLeave = TrackMouseEvent(&tme) != FALSE;
+            }
+            return 0;
+        }
         break;
+    case WM_MOUSELEAVE:
+        s_trackingLeave = false;
+        if (g_videoPlayer)
+            g_videoPlayer->CancelPrefetch();
+        return 0;
     case WM_LBUTTONUP:
         if (g_isTimelineDragging && g_videoPlayer && g_videoPlayer->IsLoaded())
         {
@@ -108,7 +131,7 @@ LRESULT CALLBACK TimelineProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
             if (g_timelineDragMode == DragMode::Cursor)
             {
-                g_videoPlayer->SeekToTime(seekTime);
+                g_videoPlayer->EndScrub(seekTime);
                 if (g_wasPlayingBeforeDrag)
                     g_videoPlayer->Play();
             }
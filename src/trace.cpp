@@ -0,0 +1,175 @@
+#include "trace.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> g_traceEnabled{ false };
+
+// 64K events of 32 bytes: 2 MB per thread that records, allocated on its
+// first event.
+static const size_t kTraceEventsPerThread = 64 * 1024;
+// Buffers of finished threads (export jobs, uploads) kept for saving.
+static const size_t kMaxExitedBuffers = 32;
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    int64_t startNs;
+    int64_t endNs;
+};
+
+struct TraceBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;     // ring
+    uint64_t count = 0;                 // events ever recorded
+    uint32_t tid = 0;
+    std::string threadName;
+    std::atomic<bool> exited{ false };
+};
+
+static std::mutex s_registryMutex;
+static std::vector<std::shared_ptr<TraceBuffer>> s_buffers;
+static uint32_t s_nextTid = 1;
+static const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+
+// Marks the buffer when its thread ends; the events stay until pruned.
+struct ThreadTrace {
+    std::shared_ptr<TraceBuffer> buffer;
+    ~ThreadTrace()
+    {
+        if (buffer)
+            buffer->exited = true;
+    }
+};
+static thread_local ThreadTrace t_trace;
+
+static void PruneExitedLocked()
+{
+    size_t exited = std::count_if(s_buffers.begin(), s_buffers.end(),
+                                  [](const std::shared_ptr<TraceBuffer>& b) { return b->exited.load(); });
+    for (auto it = s_buffers.begin(); exited > kMaxExitedBuffers && it != s_buffers.end();) {
+        if ((*it)->exited) {
+            it = s_buffers.erase(it);
+            --exited;
+        } else {
+            ++it;
+        }
+    }
+}
+
+static TraceBuffer& ThreadBuffer()
+{
+    if (!t_trace.buffer) {
+        auto buffer = std::make_shared<TraceBuffer>();
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        buffer->tid = s_nextTid++;
+        PruneExitedLocked();
+        s_buffers.push_back(buffer);
+        t_trace.buffer = buffer;
+    }
+    return *t_trace.buffer;
+}
+
+void TraceEnable(bool enabled)
+{
+    g_traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t TraceTimeNs(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t - s_epoch).count();
+}
+
+int64_t TraceNowNs()
+{
+    return TraceTimeNs(std::chrono::steady_clock::now());
+}
+
+void TraceRecord(const char* name, const char* category, int64_t startNs, int64_t endNs)
+{
+    TraceBuffer& b = ThreadBuffer();
+    std::lock_guard<std::mutex> lock(b.mutex);
+    if (b.events.empty())
+        b.events.resize(kTraceEventsPerThread);
+    b.events[b.count % kTraceEventsPerThread] = { name, category, startNs, endNs };
+    ++b.count;
+}
+
+void TraceSetThreadName(const char* name)
+{
+    TraceBuffer& b = ThreadBuffer();
+    std::lock_guard<std::mutex> lock(b.mutex);
+    b.threadName = name;
+}
+
+static void WriteJsonString(FILE* fp, const std::string& s)
+{
+    fputc('"', fp);
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)c >= 0x20)
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+bool TraceSave(const std::wstring& path)
+{
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        buffers = s_buffers;
+    }
+    FILE* fp = OpenFile(path, "wb");
+    if (!fp)
+        return false;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"VideoEditor\"}}",
+          fp);
+    std::vector<TraceEvent> events;
+    for (const auto& b : buffers) {
+        std::string threadName;
+        uint32_t tid;
+        {
+            std::lock_guard<std::mutex> lock(b->mutex);
+            size_t n = (size_t)std::min<uint64_t>(b->count, b->events.size());
+            events.clear();
+            // Oldest first.
+            for (uint64_t i = b->count - n; i < b->count; ++i)
+                events.push_back(b->events[i % kTraceEventsPerThread]);
+            threadName = b->threadName.empty() ? "Thread " + std::to_string(b->tid) : b->threadName;
+            tid = b->tid;
+        }
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", tid);
+        WriteJsonString(fp, threadName);
+        fputs("}}", fp);
+        for (const TraceEvent& e : events) {
+            fputs(",\n{\"name\":", fp);
+            WriteJsonString(fp, e.name);
+            fputs(",\"cat\":", fp);
+            WriteJsonString(fp, e.category);
+            fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    tid, e.startNs / 1000.0, (e.endNs - e.startNs) / 1000.0);
+        }
+    }
+    fputs("\n]}\n", fp);
+    bool ok = !ferror(fp);
+    return fclose(fp) == 0 && ok;
+}
+
+void TraceClear()
+{
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    for (const auto& b : s_buffers) {
+        std::lock_guard<std::mutex> bufferLock(b->mutex);
+        b->count = 0;
+    }
+    s_buffers.erase(std::remove_if(s_buffers.begin(), s_buffers.end(),
+                                   [](const std::shared_ptr<TraceBuffer>& b) { return b->exited.load(); }),
+                    s_buffers.end());
+}
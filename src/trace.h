@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scoped timing events on the playback, audio and export hot paths, saved
+// as a Chrome trace (chrome://tracing or ui.perfetto.dev). Each thread
+// records into its own ring of the last kTraceEventsPerThread events, so
+// tracing can stay on and be saved after a stutter has happened. Off, a
+// scope costs one relaxed load; on, two clock reads and an uncontended lock.
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool TraceEnabled() { return g_traceEnabled.load(std::memory_order_relaxed); }
+// Turning tracing off keeps what was recorded, so it can still be saved.
+void TraceEnable(bool enabled);
+
+int64_t TraceNowNs();
+int64_t TraceTimeNs(std::chrono::steady_clock::time_point t);
+// `name` and `category` are kept as pointers: pass string literals.
+void TraceRecord(const char* name, const char* category, int64_t startNs, int64_t endNs);
+// Label for the calling thread in saved traces.
+void TraceSetThreadName(const char* name);
+
+// Writes every thread's events as Chrome trace JSON.
+bool TraceSave(const std::wstring& path);
+void TraceClear();
+
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category)
+        : m_name(name), m_category(category), m_startNs(TraceEnabled() ? TraceNowNs() : -1) {}
+    ~TraceScope()
+    {
+        if (m_startNs >= 0)
+            TraceRecord(m_name, m_category, m_startNs, TraceNowNs());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    const char* m_category;
+    int64_t m_startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, category)
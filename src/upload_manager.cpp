@@ -0,0 +1,264 @@
+#include "upload_manager.h"
+#include "b2_upload.h"
+#include "catbox_upload.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+
+// Uploads running at once; the rest wait in the queue.
+static const int kMaxActiveUploads = 2;
+// Whole-upload attempts; waits of 2 s, 4 s... come between them.
+static const int kJobAttempts = 3;
+
+UploadManager& UploadManager::Get()
+{
+    static UploadManager manager;
+    return manager;
+}
+
+void UploadManager::LockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+{
+    static_cast<UploadManager*>(userptr)->m_shareLocks[data].lock();
+}
+
+void UploadManager::UnlockShare(CURL*, curl_lock_data data, void* userptr)
+{
+    static_cast<UploadManager*>(userptr)->m_shareLocks[data].unlock();
+}
+
+void UploadManager::Start()
+{
+    if (m_multi)
+        return;
+    m_multi = curl_multi_init();
+    m_share = curl_share_init();
+    if (!m_multi || !m_share) {
+        LOG_WARN("Upload manager could not start; uploads run directly");
+        if (m_multi) curl_multi_cleanup(m_multi);
+        if (m_share) curl_share_cleanup(m_share);
+        m_multi = nullptr;
+        m_share = nullptr;
+        return;
+    }
+    // The multi handle already pools connections; the share adds DNS and
+    // TLS session reuse for handles that are recreated between requests.
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, LockShare);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, UnlockShare);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, 16L);
+
+    m_stopping = false;
+    m_transferThread = std::thread(&UploadManager::TransferLoop, this);
+    for (int i = 0; i < kMaxActiveUploads; ++i)
+        m_jobThreads.emplace_back(&UploadManager::JobLoop, this);
+}
+
+void UploadManager::Stop()
+{
+    if (!m_multi)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobReady.notify_all();
+    curl_multi_wakeup(m_multi);
+    m_transferThread.join();
+    for (auto& t : m_jobThreads)
+        t.join();
+    m_jobThreads.clear();
+
+    // Anything still queued never ran.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& job : m_jobs)
+        job->done = true;
+    m_jobs.clear();
+    m_jobDone.notify_all();
+    curl_multi_cleanup(m_multi);
+    curl_share_cleanup(m_share);
+    m_multi = nullptr;
+    m_share = nullptr;
+}
+
+CURLcode UploadManager::Perform(CURL* easy)
+{
+    if (!m_multi)
+        return curl_easy_perform(easy);
+
+    Transfer t;
+    t.easy = easy;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping)
+            return CURLE_ABORTED_BY_CALLBACK;
+        curl_easy_setopt(easy, CURLOPT_SHARE, m_share);
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, &t);
+        m_incoming.push_back(&t);
+    }
+    curl_multi_wakeup(m_multi);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_transferDone.wait(lock, [&t] { return t.done; });
+    return t.result;
+}
+
+void UploadManager::FinishTransfer(Transfer* t, CURLcode result)
+{
+    curl_multi_remove_handle(m_multi, t->easy);
+    curl_easy_setopt(t->easy, CURLOPT_SHARE, nullptr);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running.erase(std::remove(m_running.begin(), m_running.end(), t), m_running.end());
+    t->result = result;
+    t->done = true;
+}
+
+// Splits g_uploadLimitKBps evenly between the transfers in flight. Runs on
+// the transfer thread between curl_multi_perform calls whenever one joins
+// or leaves, so the shares always add up to the limit and a finished
+// transfer's share goes back to the others.
+void UploadManager::RebalanceLocked()
+{
+    curl_off_t share = 0;
+    if (g_uploadLimitKBps > 0 && !m_running.empty())
+        share = (curl_off_t)g_uploadLimitKBps * 1024 / (curl_off_t)m_running.size();
+    for (Transfer* t : m_running)
+        curl_easy_setopt(t->easy, CURLOPT_MAX_SEND_SPEED_LARGE, share);
+}
+
+void UploadManager::TransferLoop()
+{
+    TraceSetThreadName("Upload transfers");
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+                break;
+            if (!m_incoming.empty()) {
+                for (Transfer* t : m_incoming) {
+                    curl_multi_add_handle(m_multi, t->easy);
+                    m_running.push_back(t);
+                }
+                m_incoming.clear();
+                RebalanceLocked();
+            }
+        }
+
+        int active = 0;
+        curl_multi_perform(m_multi, &active);
+        bool finished = false;
+        int left = 0;
+        while (CURLMsg* msg = curl_multi_info_read(m_multi, &left)) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            Transfer* t = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&t);
+            FinishTransfer(t, msg->data.result);
+            finished = true;
+        }
+        if (finished) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                RebalanceLocked();
+            }
+            m_transferDone.notify_all();
+        }
+        curl_multi_poll(m_multi, nullptr, 0, 100, nullptr);
+    }
+
+    // Shutting down: whatever is still in flight is abandoned.
+    std::vector<Transfer*> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending = m_running;
+        for (Transfer* t : m_incoming) {
+            t->result = CURLE_ABORTED_BY_CALLBACK;
+            t->done = true;
+        }
+        m_incoming.clear();
+    }
+    for (Transfer* t : pending)
+        FinishTransfer(t, CURLE_ABORTED_BY_CALLBACK);
+    m_transferDone.notify_all();
+}
+
+std::shared_ptr<UploadJob> UploadManager::Enqueue(UploadProvider provider, const std::wstring& filePath)
+{
+    auto job = std::make_shared<UploadJob>();
+    job->provider = provider;
+    job->filePath = filePath;
+    if (!m_multi) {
+        // Not started: run inline so callers see the same behaviour.
+        RunJob(*job);
+        return job;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+    m_jobReady.notify_one();
+    return job;
+}
+
+bool UploadManager::Wait(const std::shared_ptr<UploadJob>& job, std::string& outUrl,
+                         const std::function<void(int)>& progress)
+{
+    if (progress)
+        progress(0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_jobDone.wait_for(lock, std::chrono::milliseconds(200), [&job] { return job->done; })) {
+        if (progress) {
+            lock.unlock();
+            progress(job->percent.load());
+            lock.lock();
+        }
+    }
+    outUrl = job->url;
+    return job->ok;
+}
+
+void UploadManager::RunJob(UploadJob& job)
+{
+    std::string url;
+    bool ok = false;
+    for (int attempt = 0; attempt < kJobAttempts && !ok && !m_stopping; ++attempt) {
+        if (attempt > 0) {
+            LOG_WARN("Upload failed, retrying");
+            auto until = std::chrono::steady_clock::now() + std::chrono::seconds(2 << (attempt - 1));
+            while (!m_stopping && std::chrono::steady_clock::now() < until)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        job.attempts = attempt + 1;
+        job.percent = 0;
+        url.clear();
+        if (job.provider == UploadProvider::Catbox)
+            ok = UploadToCatbox(job.filePath, url, &job.percent);
+        else
+            ok = UploadToB2(job.filePath, url, &job.percent);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    job.ok = ok;
+    job.url = url;
+    job.done = true;
+}
+
+void UploadManager::JobLoop()
+{
+    TraceSetThreadName("Upload job");
+    while (true) {
+        std::shared_ptr<UploadJob> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobReady.wait(lock, [this] { return !m_jobs.empty() || m_stopping; });
+            if (m_stopping)
+                return;
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+        RunJob(*job);
+        m_jobDone.notify_all();
+    }
+}
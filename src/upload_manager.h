@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <curl/curl.h>
+
+enum class UploadProvider { Catbox, B2 };
+
+// One queued file upload. The manager fills in the result; `percent` can be
+// polled at any time.
+struct UploadJob {
+    UploadProvider provider = UploadProvider::B2;
+    std::wstring filePath;
+    std::atomic<int> percent{ 0 };
+    std::atomic<int> attempts{ 0 };
+    bool done = false;
+    bool ok = false;
+    std::string url;
+};
+
+// Every request the uploaders make runs on one curl multi handle on a
+// background thread, so connections, DNS lookups and TLS sessions are
+// reused across requests and across uploads. g_uploadLimitKBps is shared
+// out between the transfers in flight. Whole uploads are queued and run
+// kMaxActiveUploads at a time, each retried with backoff.
+class UploadManager {
+public:
+    static UploadManager& Get();
+
+    void Start();
+    void Stop();
+
+    std::shared_ptr<UploadJob> Enqueue(UploadProvider provider, const std::wstring& filePath);
+    // Blocks until the job has finished, passing its progress to `progress`
+    // every 200 ms.
+    bool Wait(const std::shared_ptr<UploadJob>& job, std::string& outUrl,
+              const std::function<void(int)>& progress);
+
+    // Runs a prepared easy handle on the transfer thread and waits for it.
+    // Before Start (or after Stop) the handle is performed directly.
+    CURLcode Perform(CURL* easy);
+
+private:
+    struct Transfer {
+        CURL* easy = nullptr;
+        CURLcode result = CURLE_OK;
+        bool done = false;
+    };
+
+    UploadManager() = default;
+    void TransferLoop();
+    void JobLoop();
+    void RunJob(UploadJob& job);
+    void FinishTransfer(Transfer* t, CURLcode result);
+    void RebalanceLocked();
+    static void LockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr);
+    static void UnlockShare(CURL*, curl_lock_data data, void* userptr);
+
+    CURLM* m_multi = nullptr;
+    CURLSH* m_share = nullptr;
+    std::mutex m_shareLocks[CURL_LOCK_DATA_LAST];
+    std::thread m_transferThread;
+    std::vector<std::thread> m_jobThreads;
+    std::atomic<bool> m_stopping{ false };
+
+    std::mutex m_mutex;
+    std::condition_variable m_transferDone;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_jobDone;
+    std::vector<Transfer*> m_incoming;      // waiting to join the multi handle
+    std::vector<Transfer*> m_running;
+    std::deque<std::shared_ptr<UploadJob>> m_jobs;
+};
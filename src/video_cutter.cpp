@@ -1,55 +1,1116 @@
 #include "video_cutter.h"
-#include "video_player.h"
-#include "options_window.h"
+#include "export_cache.h"
+#include "sha1.h"
+#include "platform.h"
 #include "debug_log.h"
+#include "audio_mixer.h"
+#include "export_segments.h"
+#include "output_sink.h"
+#include "media_input.h"
+#include "write_behind_io.h"
+#include "trace.h"
 #include <iostream>
 #include <sstream>
-#include <commctrl.h>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <mutex>
+#include <set>
 
-VideoCutter::VideoCutter(VideoPlayer* player) : m_player(player) {}
+namespace fs = std::filesystem;
+
+// Fraction of a target size kept free for container overhead (headers, index).
+static const double kContainerReserve = 0.015;
+static const int kMinVideoKbps = 100;
+// Number of cached first-pass stats sets kept in the temp directory.
+static const size_t kMaxCachedStats = 8;
+// Re-encodes at least twice this long are written as resumable segments.
+static const double kSegmentSeconds = 60.0;
+// Segments of unfinished exports are kept this many days, and for at most
+// this many exports besides the running one.
+static const int kPartsMaxAgeDays = 7;
+static const size_t kMaxCachedParts = 4;
+
+static void RemoveFirstPassStats(const std::string& statsPath)
+{
+    std::error_code ec;
+    fs::path p = fs::u8path(statsPath);
+    fs::remove(p, ec);
+    fs::remove(fs::u8path(statsPath + ".mbtree"), ec);
+}
+
+// Keep only the most recently used stats sets so the temp folder stays small.
+static void PruneFirstPassStats(const fs::path& dir)
+{
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> logs;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().extension() == L".log")
+            logs.emplace_back(entry.last_write_time(ec), entry.path());
+    }
+    if (logs.size() <= kMaxCachedStats)
+        return;
+    std::sort(logs.begin(), logs.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (size_t i = kMaxCachedStats; i < logs.size(); ++i)
+        RemoveFirstPassStats(logs[i].second.u8string());
+}
+
+// Segment folders that running exports in this process write to. Exports
+// run side by side (videoeditor-cli -j), and pruning must not take a folder
+// from under one of them.
+static std::mutex s_partsMutex;
+static std::set<fs::path> s_partsInUse;
+
+// Holds a segment folder for the lifetime of one export.
+class ExportPartsClaim {
+public:
+    explicit ExportPartsClaim(const fs::path& dir) : m_dir(dir)
+    {
+        std::lock_guard<std::mutex> lock(s_partsMutex);
+        m_claimed = s_partsInUse.insert(dir).second;
+    }
+    ~ExportPartsClaim()
+    {
+        if (!m_claimed)
+            return;
+        std::lock_guard<std::mutex> lock(s_partsMutex);
+        s_partsInUse.erase(m_dir);
+    }
+    // False if another export of the same key already writes there.
+    bool Claimed() const { return m_claimed; }
+
+private:
+    fs::path m_dir;
+    bool m_claimed = false;
+};
+
+// Drops the segment folders of exports that were abandoned or last ran
+// long ago, so unfinished jobs cannot fill the disk. Folders in use are
+// left alone, as are ones whose manifest cannot be dated.
+static void PruneExportParts(const fs::path& root)
+{
+    std::lock_guard<std::mutex> lock(s_partsMutex);
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> dirs;
+    for (const auto& entry : fs::directory_iterator(root, ec)) {
+        if (!entry.is_directory(ec) || s_partsInUse.count(entry.path()))
+            continue;
+        std::error_code timeEc;
+        auto written = fs::last_write_time(entry.path() / L"manifest.txt", timeEc);
+        if (!timeEc)
+            dirs.emplace_back(written, entry.path());
+    }
+    std::sort(dirs.begin(), dirs.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+    auto oldest = fs::file_time_type::clock::now() - std::chrono::hours(24 * kPartsMaxAgeDays);
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        if (i < kMaxCachedParts && dirs[i].first > oldest)
+            continue;
+        LOG_INFO("Removing unfinished export segments " << dirs[i].second.u8string());
+        fs::remove_all(dirs[i].second, ec);
+    }
+}
+
+// Creates and opens the H.264 encoder used for re-encoding. For target size
+// exports libx264 runs a real two-pass encode through its stats file while
+// NVENC uses its internal lookahead/multipass rate control. A zero width or
+// height keeps the source size.
+static AVCodecContext* OpenH264Encoder(const AVCodec* vEnc, AVStream* inStream, int videoKbps,
+                                       bool useNvenc, bool globalHeader, bool targetSize,
+                                       bool fastFirstPass, int passFlags,
+                                       const std::string& statsPath,
+                                       int width = 0, int height = 0)
+{
+    AVCodecContext* vEncCtx = avcodec_alloc_context3(vEnc);
+    if (!vEncCtx)
+        return nullptr;
+    vEncCtx->codec_id = AV_CODEC_ID_H264;
+    vEncCtx->width = width > 0 ? width : inStream->codecpar->width;
+    vEncCtx->height = height > 0 ? height : inStream->codecpar->height;
+    vEncCtx->time_base = inStream->time_base;
+    vEncCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+    vEncCtx->max_b_frames = 2;
+    vEncCtx->gop_size = 12;
+    if (videoKbps > 0)
+        vEncCtx->bit_rate = (int64_t)videoKbps * 1000;
+    if (globalHeader)
+        vEncCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    AVDictionary* encOpts = nullptr;
+    av_dict_set(&encOpts, "preset", "fast", 0);
+    if (targetSize && useNvenc) {
+        av_dict_set(&encOpts, "rc", "vbr", 0);
+        av_dict_set(&encOpts, "multipass", fastFirstPass ? "qres" : "fullres", 0);
+        av_dict_set(&encOpts, "rc-lookahead", "32", 0);
+        vEncCtx->rc_max_rate = vEncCtx->bit_rate * 2;
+        vEncCtx->rc_buffer_size = (int)std::min<int64_t>(vEncCtx->bit_rate * 2, INT_MAX);
+    } else if (passFlags) {
+        vEncCtx->flags |= passFlags;
+        av_dict_set(&encOpts, "stats", statsPath.c_str(), 0);
+    }
+    int ret = avcodec_open2(vEncCtx, vEnc, &encOpts);
+    av_dict_free(&encOpts);
+    if (ret < 0) {
+        avcodec_free_context(&vEncCtx);
+        return nullptr;
+    }
+    return vEncCtx;
+}
+
+// The block mixer and the AAC encoder it feeds.
+struct MergedAudio {
+    AVCodecContext* enc = nullptr;
+    SwrContext* swr = nullptr;      // only for encoders not taking stereo FLTP
+    AVFrame* frame = nullptr;       // reused for every encoded block
+    std::vector<int16_t> s16;
+    std::unique_ptr<BlockMixer> mixer;
+    int64_t pts = 0;
+};
+
+// Keyframe-aligned segment files of a resumable export. The layout context
+// supplies the format and streams but is never opened itself; packets come
+// in its stream time bases. Segments end at the first video keyframe past
+// segmentUs, so each one decodes on its own and the join is a plain remux.
+struct SegmentOutput {
+    AVFormatContext* layout = nullptr;
+    int videoStream = -1;
+    fs::path dir;
+    std::string extension;
+    SegmentManifest* manifest = nullptr;
+    AVFormatContext* ctx = nullptr;     // segment being written
+    int index = 0;
+    int64_t startUs = 0;
+    std::vector<AVPacket*> pending;     // audio already past the boundary
+    int64_t doneBytes = 0;
+};
+
+// A muxer stream that receives encoded or copied packets. With `segments`
+// set the packets go to the open segment of that output instead.
+struct PacketTarget {
+    AVFormatContext* ctx;
+    int stream;
+    SegmentOutput* segments = nullptr;
+};
+
+static bool OpenMergedAudio(MergedAudio& ma, int trackCount, double duration, bool globalHeader)
+{
+    const AVCodec* aEnc = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!aEnc) {
+        DebugLog("AAC encoder not found", true);
+        return false;
+    }
+    ma.enc = avcodec_alloc_context3(aEnc);
+    if (!ma.enc) {
+        DebugLog("Failed to allocate AAC encoder context", true);
+        return false;
+    }
+    ma.enc->sample_rate = kMixSampleRate;
+    av_channel_layout_default(&ma.enc->ch_layout, 2);
+    ma.enc->sample_fmt = aEnc->sample_fmts ? aEnc->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    ma.enc->time_base = {1, ma.enc->sample_rate};
+    ma.enc->bit_rate = 128000; // match ffmpeg default
+    if (globalHeader)
+        ma.enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(ma.enc, aEnc, nullptr) < 0) {
+        DebugLog("Failed to open AAC encoder", true);
+        return false;
+    }
+    LOG_DEBUG("AAC encoder initialized");
+    int frameSamples = ma.enc->frame_size > 0 ? ma.enc->frame_size : 1024;
+    if (ma.enc->ch_layout.nb_channels <= 0) {
+        DebugLog("Invalid channel count in AAC encoder context", true);
+        return false;
+    }
+    // The native AAC encoder takes stereo float planar, which the mixer
+    // writes directly; other formats go through a resampler.
+    if (ma.enc->sample_fmt != AV_SAMPLE_FMT_FLTP || ma.enc->ch_layout.nb_channels != 2) {
+        ma.s16.resize(frameSamples * 2);
+        ma.swr = swr_alloc();
+        AVChannelLayout stereo;
+        av_channel_layout_default(&stereo, 2);
+        av_opt_set_int   (ma.swr, "in_sample_rate", kMixSampleRate, 0);
+        av_opt_set_sample_fmt(ma.swr, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+        av_opt_set_chlayout  (ma.swr, "in_chlayout", &stereo, 0);
+        av_opt_set_int   (ma.swr, "out_sample_rate", ma.enc->sample_rate, 0);
+        av_opt_set_sample_fmt(ma.swr, "out_sample_fmt", ma.enc->sample_fmt, 0);
+        av_opt_set_chlayout  (ma.swr, "out_chlayout", &ma.enc->ch_layout, 0);
+        if (swr_init(ma.swr) < 0) {
+            DebugLog("Failed to init mix resampler", true);
+            return false;
+        }
+    }
+    ma.frame = av_frame_alloc();
+    if (!ma.frame) {
+        DebugLog("Failed to allocate audio frame", true);
+        return false;
+    }
+    ma.frame->nb_samples = frameSamples;
+    av_channel_layout_copy(&ma.frame->ch_layout, &ma.enc->ch_layout);
+    ma.frame->format = ma.enc->sample_fmt;
+    ma.frame->sample_rate = ma.enc->sample_rate;
+    if (av_frame_get_buffer(ma.frame, 0) < 0) {
+        DebugLog("Failed to allocate audio frame buffer", true);
+        return false;
+    }
+    ma.mixer.reset(new BlockMixer(trackCount, kMixSampleRate, frameSamples,
+                                  kMixBufferSeconds, (int64_t)(duration * kMixSampleRate)));
+    return true;
+}
+
+static void FreeMergedAudio(MergedAudio& ma)
+{
+    if (ma.enc) avcodec_free_context(&ma.enc);
+    if (ma.swr) swr_free(&ma.swr);
+    if (ma.frame) av_frame_free(&ma.frame);
+    ma.mixer.reset();
+}
+
+// Output size at the streams' bitrates over `seconds`, for preallocating
+// the file. When a stream's bitrate is unknown `fallbackBitRate` stands in
+// for the whole file; 0 when nothing is known.
+static int64_t EstimateOutputBytes(const AVFormatContext* ctx, int64_t fallbackBitRate, double seconds)
+{
+    int64_t bitRate = 0;
+    for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+        int64_t br = ctx->streams[i]->codecpar->bit_rate;
+        if (br <= 0) {
+            bitRate = fallbackBitRate;
+            break;
+        }
+        bitRate += br;
+    }
+    if (bitRate <= 0 || seconds <= 0)
+        return 0;
+    return (int64_t)(bitRate / 8.0 * seconds * (1.0 + kContainerReserve));
+}
+
+// avio_open for an output file, through the write-behind I/O when it can be.
+static bool OpenOutputIO(AVFormatContext* ctx, const std::string& path, int64_t expectedBytes)
+{
+    if (ctx->oformat->flags & AVFMT_NOFILE)
+        return true;
+    ctx->pb = OpenWriteBehindIO(path, expectedBytes);
+    if (ctx->pb) {
+        ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        return true;
+    }
+    return avio_open(&ctx->pb, path.c_str(), AVIO_FLAG_WRITE) >= 0;
+}
+
+// Closes a file from OpenOutputIO. False if a queued write failed.
+static bool CloseOutputIO(AVFormatContext* ctx)
+{
+    if (ctx->oformat->flags & AVFMT_NOFILE)
+        return true;
+    if (ctx->flags & AVFMT_FLAG_CUSTOM_IO)
+        return CloseWriteBehindIO(&ctx->pb);
+    avio_closep(&ctx->pb);
+    return true;
+}
+
+static bool OpenSegment(SegmentOutput& so)
+{
+    std::string path = (so.dir / SegmentFileName(so.index, so.extension)).u8string();
+    if (avformat_alloc_output_context2(&so.ctx, so.layout->oformat, nullptr, path.c_str()) < 0) {
+        DebugLog("Failed to allocate output context for " + path, true);
+        return false;
+    }
+    bool ok = true;
+    for (unsigned i = 0; ok && i < so.layout->nb_streams; ++i) {
+        AVStream* in = so.layout->streams[i];
+        AVStream* st = avformat_new_stream(so.ctx, nullptr);
+        if (!st || avcodec_parameters_copy(st->codecpar, in->codecpar) < 0) {
+            DebugLog("Failed to copy codec parameters", true);
+            ok = false;
+            break;
+        }
+        st->time_base = in->time_base;
+    }
+    if (ok && !OpenOutputIO(so.ctx, path, EstimateOutputBytes(so.layout, 0, so.manifest->segmentUs / 1e6))) {
+        DebugLog("Could not open segment file " + path, true);
+        ok = false;
+    }
+    if (ok && avformat_write_header(so.ctx, nullptr) < 0) {
+        DebugLog("Failed to write header for " + path, true);
+        ok = false;
+    }
+    if (!ok) {
+        CloseOutputIO(so.ctx);
+        avformat_free_context(so.ctx);
+        so.ctx = nullptr;
+    }
+    return ok;
+}
+
+// Finalizes the open segment. Only a complete one is added to the manifest;
+// an aborted one stays on disk until the next run overwrites it.
+static bool CloseSegment(SegmentOutput& so, bool complete, int64_t endUs)
+{
+    if (!so.ctx)
+        return !complete;
+    bool ok = av_write_trailer(so.ctx) >= 0;
+    ok = CloseOutputIO(so.ctx) && ok;
+    avformat_free_context(so.ctx);
+    so.ctx = nullptr;
+    if (!complete || !ok)
+        return false;
+
+    ExportSegment seg;
+    seg.index = so.index;
+    seg.file = SegmentFileName(so.index, so.extension);
+    seg.startUs = so.startUs;
+    seg.endUs = endUs;
+    so.manifest->segments.push_back(seg);
+    if (!so.manifest->Save(so.dir)) {
+        DebugLog("Failed to save export manifest", true);
+        return false;
+    }
+    std::error_code ec;
+    so.doneBytes += (int64_t)fs::file_size(so.dir / fs::u8path(seg.file), ec);
+    return true;
+}
+
+static int64_t PacketUs(const SegmentOutput& so, const AVPacket* pkt)
+{
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts == AV_NOPTS_VALUE)
+        return AV_NOPTS_VALUE;
+    return av_rescale_q(ts, so.layout->streams[pkt->stream_index]->time_base, AV_TIME_BASE_Q);
+}
+
+static void MuxSegmentPacket(SegmentOutput& so, AVPacket* pkt)
+{
+    av_packet_rescale_ts(pkt, so.layout->streams[pkt->stream_index]->time_base,
+                         so.ctx->streams[pkt->stream_index]->time_base);
+    av_interleaved_write_frame(so.ctx, pkt);
+}
+
+// Writes queued audio that starts before `limitUs` to the open segment.
+static void FlushPendingSegmentPackets(SegmentOutput& so, int64_t limitUs)
+{
+    size_t kept = 0;
+    for (AVPacket* p : so.pending) {
+        if (PacketUs(so, p) < limitUs) {
+            MuxSegmentPacket(so, p);
+            av_packet_free(&p);
+        } else {
+            so.pending[kept++] = p;
+        }
+    }
+    so.pending.resize(kept);
+}
+
+// Routes a packet to the open segment, starting the next one at a video
+// keyframe past the boundary. Takes the packet's reference like
+// av_interleaved_write_frame.
+static bool WriteSegmentPacket(SegmentOutput& so, AVPacket* pkt)
+{
+    if (!so.ctx)
+        return false;
+    int64_t us = PacketUs(so, pkt);
+    int64_t boundary = so.startUs + so.manifest->segmentUs;
+    if (us != AV_NOPTS_VALUE && us >= boundary) {
+        if (pkt->stream_index != so.videoStream) {
+            // The encoder delays video, so audio reaches the boundary first.
+            AVPacket* held = av_packet_alloc();
+            if (!held)
+                return false;
+            av_packet_move_ref(held, pkt);
+            so.pending.push_back(held);
+            return true;
+        }
+        if (pkt->flags & AV_PKT_FLAG_KEY) {
+            FlushPendingSegmentPackets(so, us);
+            if (!CloseSegment(so, true, us))
+                return false;
+            so.index++;
+            so.startUs = us;
+            if (!OpenSegment(so))
+                return false;
+            FlushPendingSegmentPackets(so, us + so.manifest->segmentUs);
+        }
+    }
+    MuxSegmentPacket(so, pkt);
+    return true;
+}
+
+// Closes the last segment. Without `complete` it is left out of the
+// manifest and queued audio is dropped.
+static bool FinishSegments(SegmentOutput& so, bool complete, int64_t endUs)
+{
+    if (complete && so.ctx)
+        FlushPendingSegmentPackets(so, INT64_MAX);
+    for (AVPacket* p : so.pending)
+        av_packet_free(&p);
+    so.pending.clear();
+    return CloseSegment(so, complete, endUs);
+}
+
+// Output file whose bytes also go to an OutputSink as they are written. The
+// AVIO context has no seek callback, so the muxer must write in order.
+struct StreamedOutput {
+    FILE* fp = nullptr;
+    OutputSink* sink = nullptr;
+    bool failed = false;
+};
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int WriteStreamed(void* opaque, const uint8_t* buf, int size)
+#else
+static int WriteStreamed(void* opaque, uint8_t* buf, int size)
+#endif
+{
+    StreamedOutput* so = static_cast<StreamedOutput*>(opaque);
+    if (fwrite(buf, 1, size, so->fp) != (size_t)size) {
+        so->failed = true;
+        return AVERROR(EIO);
+    }
+    if (so->sink && !so->sink->Write(buf, size)) {
+        LOG_WARN("Output sink detached, export continues to disk only");
+        so->sink = nullptr;
+    }
+    return size;
+}
+
+// Only the MP4 family can be written without going back to patch the index.
+static bool CanStreamOutput(const AVFormatContext* ctx)
+{
+    const char* name = ctx->oformat->name;
+    return strcmp(name, "mp4") == 0 || strcmp(name, "mov") == 0 || strcmp(name, "ipod") == 0;
+}
+
+static bool OpenStreamedOutput(AVFormatContext* ctx, const std::wstring& path, StreamedOutput& so)
+{
+    const int bufSize = 64 * 1024;
+    so.fp = OpenFile(path, "wb");
+    if (!so.fp)
+        return false;
+    unsigned char* buf = (unsigned char*)av_malloc(bufSize);
+    ctx->pb = buf ? avio_alloc_context(buf, bufSize, 1, &so, nullptr, WriteStreamed, nullptr) : nullptr;
+    if (!ctx->pb) {
+        av_free(buf);
+        fclose(so.fp);
+        so.fp = nullptr;
+        return false;
+    }
+    ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return true;
+}
+
+// Closes either kind of output file. False if a queued or streamed write
+// failed.
+static bool CloseOutputFile(AVFormatContext* ctx, StreamedOutput& so)
+{
+    if (!so.fp)
+        return CloseOutputIO(ctx);
+    if (ctx->pb) {
+        avio_flush(ctx->pb);
+        av_freep(&ctx->pb->buffer);
+        avio_context_free(&ctx->pb);
+    }
+    bool ok = fclose(so.fp) == 0 && !so.failed;
+    so.fp = nullptr;
+    return ok;
+}
+
+// Writes a packet in `srcTb` to every target. All but the last target get a
+// new reference to the same data; the last one takes `pkt` itself.
+static void WritePacket(AVPacket* pkt, AVRational srcTb, const std::vector<PacketTarget>& targets,
+                        AVPacket* ref)
+{
+    for (size_t i = 0; i < targets.size(); ++i) {
+        AVPacket* out = pkt;
+        if (i + 1 < targets.size()) {
+            if (av_packet_ref(ref, pkt) < 0)
+                continue;
+            out = ref;
+        }
+        av_packet_rescale_ts(out, srcTb, targets[i].ctx->streams[targets[i].stream]->time_base);
+        out->stream_index = targets[i].stream;
+        out->pos = -1;
+        if (targets[i].segments)
+            WriteSegmentPacket(*targets[i].segments, out);
+        else
+            av_interleaved_write_frame(targets[i].ctx, out);
+        av_packet_unref(out);
+    }
+    av_packet_unref(pkt);
+}
+
+// Sends a frame (nullptr flushes) and writes everything the encoder returns.
+// Encoder time is booked to `stage`, writing to Mux.
+static void EncodeToTargets(AVCodecContext* enc, AVFrame* frame,
+                            const std::vector<PacketTarget>& targets, AVPacket* outPkt, AVPacket* ref,
+                            StageClock& clock, ExportStage stage)
+{
+    avcodec_send_frame(enc, frame);
+    while (avcodec_receive_packet(enc, outPkt) == 0) {
+        clock.Lap(stage);
+        WritePacket(outPkt, enc->time_base, targets, ref);
+        clock.Lap(ExportStage::Mux);
+    }
+    clock.Lap(stage);
+}
+
+// Mixes the next block of merged audio into the reused encoder frame and
+// encodes it. Returns the frames encoded, 0 when no block is ready yet and
+// -1 on error.
+static int EncodeMixedBlock(MergedAudio& ma, bool flush, const std::vector<PacketTarget>& targets,
+                            AVPacket* outPkt, AVPacket* ref, StageClock& clock)
+{
+    BlockMixer& mixer = *ma.mixer;
+    if (!mixer.Ready(flush))
+        return 0;
+    // The encoder may still reference the previous buffer; this only
+    // allocates if it does.
+    ma.frame->nb_samples = mixer.BlockFrames();
+    if (av_frame_make_writable(ma.frame) < 0) {
+        DebugLog("Failed to allocate audio frame buffer", true);
+        return -1;
+    }
+    int n;
+    if (ma.swr) {
+        n = mixer.MixS16(ma.s16.data(), flush);
+        const uint8_t* inBuf[1] = { (const uint8_t*)ma.s16.data() };
+        if (swr_convert(ma.swr, ma.frame->data, n, inBuf, n) < 0) {
+            DebugLog("Failed to convert mixed samples", true);
+            return -1;
+        }
+    } else {
+        n = mixer.MixPlanar((float*)ma.frame->data[0], (float*)ma.frame->data[1], flush);
+    }
+    ma.frame->nb_samples = n;
+    ma.frame->pts = ma.pts;
+    ma.pts += n;
+    EncodeToTargets(ma.enc, ma.frame, targets, outPkt, ref, clock, ExportStage::Audio);
+    return n;
+}
+
+static void LogMixStats(const BlockMixer& mixer)
+{
+    const MixStats& ms = mixer.Stats();
+    LOG_INFO("Audio mix blocks=" << ms.blocks << " forced=" << ms.forcedBlocks
+             << " padded=" << ms.paddedFrames << " dropped=" << ms.droppedFrames);
+}
+
+// Remuxes the finished segments into the final file. Segment files may or
+// may not keep absolute timestamps, so each one is shifted until its first
+// video frame sits at its manifest start. Audio that overlaps at a resume
+// point is dropped.
+static bool JoinSegments(const SegmentManifest& manifest, const fs::path& dir,
+                         const std::string& output)
+{
+    AVFormatContext* outCtx = nullptr;
+    AVPacket* pkt = av_packet_alloc();
+    std::vector<int64_t> lastDts;
+    bool headerWritten = false;
+    bool success = pkt != nullptr;
+
+    if (success && avformat_alloc_output_context2(&outCtx, nullptr, nullptr, output.c_str()) < 0) {
+        DebugLog("Failed to allocate output context", true);
+        success = false;
+    }
+    // The joined file is about as large as its segments together.
+    int64_t expectedBytes = 0;
+    for (const ExportSegment& seg : manifest.segments) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(dir / fs::u8path(seg.file), ec);
+        if (!ec)
+            expectedBytes += (int64_t)size;
+    }
+    for (size_t i = 0; success && i < manifest.segments.size(); ++i) {
+        const ExportSegment& seg = manifest.segments[i];
+        std::string path = (dir / fs::u8path(seg.file)).u8string();
+        AVFormatContext* in = nullptr;
+        if (avformat_open_input(&in, path.c_str(), nullptr, nullptr) < 0 ||
+            avformat_find_stream_info(in, nullptr) < 0) {
+            DebugLog("Failed to open segment " + path, true);
+            avformat_close_input(&in);
+            success = false;
+            break;
+        }
+        if (!headerWritten) {
+            for (unsigned s = 0; success && s < in->nb_streams; ++s) {
+                AVStream* st = avformat_new_stream(outCtx, nullptr);
+                if (!st || avcodec_parameters_copy(st->codecpar, in->streams[s]->codecpar) < 0) {
+                    DebugLog("Failed to copy codec parameters", true);
+                    success = false;
+                    break;
+                }
+                st->codecpar->codec_tag = 0;
+                st->time_base = in->streams[s]->time_base;
+            }
+            if (success && !OpenOutputIO(outCtx, output, expectedBytes)) {
+                DebugLog("Could not open output file", true);
+                success = false;
+            }
+            if (success && avformat_write_header(outCtx, nullptr) < 0) {
+                DebugLog("Failed to write header", true);
+                success = false;
+            }
+            headerWritten = success;
+            lastDts.assign(outCtx->nb_streams, INT64_MIN);
+        }
+        if (success && in->nb_streams != outCtx->nb_streams) {
+            DebugLog("Segment " + path + " does not match the other segments", true);
+            success = false;
+        }
+
+        int64_t shiftUs = 0;
+        int v = av_find_best_stream(in, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (v >= 0 && in->streams[v]->start_time != AV_NOPTS_VALUE)
+            shiftUs = seg.startUs - av_rescale_q(in->streams[v]->start_time,
+                                                 in->streams[v]->time_base, AV_TIME_BASE_Q);
+        while (success && av_read_frame(in, pkt) >= 0) {
+            AVStream* ist = in->streams[pkt->stream_index];
+            AVStream* ost = outCtx->streams[pkt->stream_index];
+            int64_t shift = av_rescale_q(shiftUs, AV_TIME_BASE_Q, ist->time_base);
+            if (pkt->pts != AV_NOPTS_VALUE) pkt->pts += shift;
+            if (pkt->dts != AV_NOPTS_VALUE) pkt->dts += shift;
+            av_packet_rescale_ts(pkt, ist->time_base, ost->time_base);
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                if (pkt->dts <= lastDts[pkt->stream_index]) {
+                    av_packet_unref(pkt);
+                    continue;
+                }
+                lastDts[pkt->stream_index] = pkt->dts;
+            }
+            pkt->pos = -1;
+            av_interleaved_write_frame(outCtx, pkt);
+        }
+        avformat_close_input(&in);
+    }
+
+    if (headerWritten && av_write_trailer(outCtx) < 0)
+        success = false;
+    if (outCtx) {
+        if (!CloseOutputIO(outCtx))
+            success = false;
+        avformat_free_context(outCtx);
+    }
+    av_packet_free(&pkt);
+    if (success)
+        LOG_INFO("Segments joined into " << output);
+    else
+        LOG_ERROR("Joining segments failed");
+    return success;
+}
+
+// Video bitrate that fills the target size after the audio share.
+static int TargetVideoKbps(const ExportOptions& options, int audioKbps)
+{
+    double duration = options.endTime - options.startTime;
+    int64_t targetBytes = (int64_t)options.targetSizeMB * 1024 * 1024;
+    double totalKbps = targetBytes * 8.0 * (1.0 - kContainerReserve) / 1000.0 / duration;
+    int videoKbps = (int)(totalKbps - audioKbps);
+    if (videoKbps < kMinVideoKbps)
+        videoKbps = std::max(kMinVideoKbps, (int)(totalKbps / 2));
+    return videoKbps;
+}
+
+VideoCutter::VideoCutter(const MediaInfo& source) : m_source(source) {}
 
 VideoCutter::~VideoCutter() {}
 
-bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
-                           double endTime, bool mergeAudio, bool convertH264,
-                           bool useNvenc, int maxBitrate, HWND progressBar,
-                           std::atomic<bool>* cancelFlag)
+int VideoCutter::EstimateAudioKbps(bool mergeAudio) const
+{
+    if (mergeAudio)
+        return 128; // single AAC track
+    int audioKbps = 0;
+    for (const auto& track : m_source.audioTracks) {
+        if (track.isMuted) continue;
+        int64_t br = track.bitRate > 0 ? track.bitRate : 128000;
+        audioKbps += (int)(br / 1000);
+    }
+    return audioKbps;
+}
+
+std::wstring VideoCutter::FirstPassStatsPath(const ExportOptions& options) const
+{
+    // The stats only depend on the decoded frames and the encoder structure,
+    // not on the bitrate, so a retry at another size can reuse them. The
+    // source is identified by content, as in the export and proxy caches.
+    Sha1 sha;
+    if (!HashSource(m_source.filename, sha))
+        return std::wstring();
+    std::ostringstream key;
+    key << "|2pass|" << std::fixed << std::setprecision(3) << options.startTime << '|' << options.endTime
+        << '|' << m_source.frameWidth << 'x' << m_source.frameHeight
+        << "|libx264|fast|g12|b2|" << options.fastFirstPass;
+    std::string s = key.str();
+    sha.Update(s.data(), s.size());
+
+    std::error_code ec;
+    fs::path dir = fs::temp_directory_path(ec) / L"VideoEditor";
+    dir /= L"2pass";
+    fs::create_directories(dir, ec);
+    return (dir / fs::u8path(sha.FinalHex() + ".log")).wstring();
+}
+
+std::string VideoCutter::ResumeKey(const ExportOptions& options, const std::string& extension) const
+{
+    // Everything that changes the encoded segments; any difference means the
+    // parts of an older run cannot be reused. The output name is not part of
+    // it, so a retry under another name resumes too.
+    Sha1 sha;
+    if (!HashSource(m_source.filename, sha))
+        return std::string();
+    std::ostringstream key;
+    key << "|resume|" << std::fixed << std::setprecision(3) << options.startTime << '|' << options.endTime
+        << '|' << options.mergeAudio << '|' << options.useNvenc << '|' << options.maxBitrate
+        << "|fast|g12|b2|seg" << kSegmentSeconds << '|' << extension << "|tracks";
+    for (int idx : m_source.UnmutedStreams())
+        key << ',' << idx;
+    std::string s = key.str();
+    sha.Update(s.data(), s.size());
+    return sha.FinalHex();
+}
+
+bool VideoCutter::ResumableTranscode(const std::wstring& outputFilename, const ExportOptions& options,
+                                     ExportStats* stats, std::atomic<bool>* cancelFlag)
+{
+    fs::path output(outputFilename);
+    std::string key = ResumeKey(options, output.extension().u8string());
+    if (key.empty()) {
+        DebugLog("Failed to read input file", true);
+        return false;
+    }
+    std::error_code ec;
+    fs::path root = LocalDataDir() / L"VideoEditor";
+    root /= L"ExportParts";
+    fs::path dir = root / fs::u8path(key);
+    ExportPartsClaim claim(dir);
+    if (!claim.Claimed()) {
+        LOG_INFO("Segments of this export are in use by another job; encoding in one piece");
+        return Transcode(outputFilename, options, options.maxBitrate, RatePass::Single,
+                         std::string(), 0.0, 1.0, stats, cancelFlag);
+    }
+    PruneExportParts(root);
+
+    SegmentManifest manifest;
+    int64_t segmentUs = (int64_t)(kSegmentSeconds * AV_TIME_BASE);
+    if (!manifest.Load(dir) || manifest.key != key || manifest.segmentUs != segmentUs) {
+        fs::remove_all(dir, ec);
+        manifest = SegmentManifest();
+        manifest.key = key;
+        manifest.segmentUs = segmentUs;
+    }
+    fs::create_directories(dir, ec);
+    if (!manifest.Save(dir)) {
+        DebugLog("Failed to create export checkpoint in " + dir.u8string(), true);
+        return false;
+    }
+    RemoveStaleSegments(dir, manifest);
+
+    SegmentOutput so;
+    so.dir = dir;
+    so.extension = output.extension().u8string();
+    so.manifest = &manifest;
+    so.index = manifest.NextIndex();
+    so.startUs = manifest.ResumeUs();
+    for (const auto& seg : manifest.segments)
+        so.doneBytes += (int64_t)fs::file_size(dir / fs::u8path(seg.file), ec);
+    if (!manifest.segments.empty())
+        LOG_INFO("Resuming export after " << manifest.segments.size() << " finished segments at "
+                 << so.startUs / (double)AV_TIME_BASE << "s");
+
+    int64_t durationUs = (int64_t)(options.endTime * AV_TIME_BASE) - (int64_t)(options.startTime * AV_TIME_BASE);
+    bool ok = so.startUs >= durationUs ||
+              Transcode(outputFilename, options, options.maxBitrate, RatePass::Single,
+                        std::string(), 0.0, 1.0, stats, cancelFlag, &so);
+    if (!ok) {
+        LOG_WARN("Export stopped; " << manifest.segments.size() << " finished segments kept in "
+                 << dir.u8string() << " for the next run");
+        return false;
+    }
+    if (!JoinSegments(manifest, dir, ToUtf8(outputFilename)))
+        return false;
+    fs::remove_all(dir, ec);
+    return true;
+}
+
+bool VideoCutter::CutVideo(const std::wstring& outputFilename, const ExportOptions& options,
+                           ExportStats* stats, std::atomic<bool>* cancelFlag)
 {
-    if (!m_player->isLoaded) {
+    TRACE_SCOPE("CutVideo", "export");
+    m_targetReport = TargetSizeReport();
+    if (!m_source.IsLoaded()) {
         DebugLog("CutVideo called but no video loaded", true);
         return false;
     }
 
-    {
-        std::ostringstream oss;
-        oss << "CutVideo start start=" << startTime << " end=" << endTime
-            << " mergeAudio=" << mergeAudio
-            << " convertH264=" << convertH264
-            << " useNvenc=" << useNvenc
-            << " maxBitrate=" << maxBitrate;
-        DebugLog(oss.str());
+    if (!options.convertH264 || options.targetSizeMB <= 0) {
+        // Long re-encodes are checkpointed so an interrupted job can resume.
+        // Target size exports are not: the second pass needs every frame.
+        // Neither are streamed ones, whose bytes leave as they are written.
+        if (options.convertH264 && !options.sink &&
+            options.endTime - options.startTime >= 2 * kSegmentSeconds)
+            return ResumableTranscode(outputFilename, options, stats, cancelFlag);
+        return Transcode(outputFilename, options, options.maxBitrate, RatePass::Single,
+                         std::string(), 0.0, 1.0, stats, cancelFlag);
+    }
+
+    double duration = options.endTime - options.startTime;
+    if (duration <= 0.0) {
+        DebugLog("Target size export needs a positive duration", true);
+        return false;
     }
 
-    int bufSize = WideCharToMultiByte(CP_UTF8, 0, outputFilename.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    std::string utf8Output(bufSize, 0);
-    WideCharToMultiByte(CP_UTF8, 0, outputFilename.c_str(), -1, &utf8Output[0], bufSize, nullptr, nullptr);
-    utf8Output.resize(bufSize - 1);
+    int64_t targetBytes = (int64_t)options.targetSizeMB * 1024 * 1024;
+    int audioKbps = EstimateAudioKbps(options.mergeAudio);
+    int videoKbps = TargetVideoKbps(options, audioKbps);
 
-    bufSize = WideCharToMultiByte(CP_UTF8, 0, m_player->loadedFilename.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    std::string utf8Input(bufSize, 0);
-    WideCharToMultiByte(CP_UTF8, 0, m_player->loadedFilename.c_str(), -1, &utf8Input[0], bufSize, nullptr, nullptr);
-    utf8Input.resize(bufSize - 1);
+    // Real two-pass needs libx264 (stats file). NVENC gets lookahead/multipass
+    // instead and any other H.264 encoder falls back to a single ABR pass.
+    const AVCodec* x264 = avcodec_find_encoder(AV_CODEC_ID_H264);
+    bool twoPass = !options.useNvenc && x264 && strcmp(x264->name, "libx264") == 0;
 
-    std::vector<int> activeTracks;
-    for (const auto& track : m_player->audioTracks) {
-        if (!track->isMuted)
-            activeTracks.push_back(track->streamIndex);
+    std::string statsPath;
+    bool reused = false;
+    double passBase = 0.0;
+    if (twoPass) {
+        std::wstring wStats = FirstPassStatsPath(options);
+        if (wStats.empty()) {
+            DebugLog("Failed to read input file", true);
+            return false;
+        }
+        statsPath = ToUtf8(wStats);
+        std::error_code ec;
+        reused = fs::exists(wStats, ec) && fs::exists(wStats + L".mbtree", ec);
+        if (!reused) {
+            const AVOutputFormat* ofmt = av_guess_format(nullptr, ToUtf8(outputFilename).c_str(), nullptr);
+            bool globalHeader = ofmt && (ofmt->flags & AVFMT_GLOBALHEADER);
+            if (!RunFirstPass(options, videoKbps, globalHeader, statsPath, 0.5, stats, cancelFlag)) {
+                RemoveFirstPassStats(statsPath);
+                return false;
+            }
+            PruneFirstPassStats(fs::path(wStats).parent_path());
+            passBase = 0.5;
+        } else {
+            LOG_INFO("Reusing cached first-pass stats: " << statsPath);
+        }
     }
-    {
+
+    LOG_INFO("Target size " << options.targetSizeMB << " MiB over " << duration
+             << "s: video=" << videoKbps << "kbps audio=" << audioKbps << "kbps"
+             << (twoPass ? " two-pass" : options.useNvenc ? " nvenc-lookahead" : " single-pass"));
+
+    // The second pass is re-run once with a corrected bitrate if the result
+    // misses the target noticeably; with cached stats that skips pass one.
+    RatePass pass = twoPass ? RatePass::Second : RatePass::Single;
+    bool ok = false;
+    int64_t actualBytes = 0;
+    for (int attempt = 1; attempt <= 2; ++attempt) {
+        ok = Transcode(outputFilename, options, videoKbps, pass, statsPath,
+                       passBase, 1.0 - passBase, stats, cancelFlag);
+        m_targetReport.attempts = attempt;
+        if (!ok) {
+            // Kept after a cancel or a write error, so the retry skips pass
+            // one; only stats x264 refuses are made again.
+            if (reused && m_statsRejected) {
+                LOG_WARN("Cached first-pass stats were rejected; removing " << statsPath);
+                RemoveFirstPassStats(statsPath);
+            }
+            break;
+        }
+        std::error_code ec;
+        actualBytes = (int64_t)fs::file_size(fs::path(outputFilename), ec);
+        double error = (actualBytes - targetBytes) * 100.0 / targetBytes;
+        LOG_INFO("Target size attempt " << attempt << ": " << actualBytes << " of "
+                 << targetBytes << " bytes (" << std::showpos << std::fixed
+                 << std::setprecision(2) << error << "%)");
+        if (attempt == 2 || (actualBytes <= targetBytes && error > -3.0))
+            break;
+        if (cancelFlag && *cancelFlag)
+            break;
+
+        // Scale only the video share; the audio size is fixed by its bitrate.
+        double audioBytes = audioKbps * 1000.0 / 8.0 * duration;
+        double wantVideo = targetBytes * (1.0 - kContainerReserve) - audioBytes;
+        double gotVideo = actualBytes - audioBytes;
+        if (wantVideo <= 0.0 || gotVideo <= 0.0)
+            break;
+        videoKbps = std::max(kMinVideoKbps, (int)(videoKbps * wantVideo / gotVideo));
+        passBase = 0.0;
+    }
+
+    if (ok) {
+        m_targetReport.valid = true;
+        m_targetReport.targetBytes = targetBytes;
+        m_targetReport.actualBytes = actualBytes;
+        m_targetReport.videoKbps = videoKbps;
+        m_targetReport.reusedFirstPass = reused;
+    }
+    return ok;
+}
+
+bool VideoCutter::RunFirstPass(const ExportOptions& options, int videoKbps, bool globalHeader,
+                               const std::string& statsPath, double progressSpan,
+                               ExportStats* stats, std::atomic<bool>* cancelFlag)
+{
+    TRACE_SCOPE("RunFirstPass", "export");
+    LOG_INFO("First pass start stats=" << statsPath);
+    std::string utf8Input = ToUtf8(m_source.filename);
+    AVFormatContext* inputCtx = nullptr;
+    if (OpenMediaInput(&inputCtx, utf8Input) < 0) {
+        DebugLog("First pass: failed to open input file", true);
+        return false;
+    }
+
+    int videoIndex = m_source.videoStreamIndex;
+    AVStream* inStream = inputCtx->streams[videoIndex];
+    const AVCodec* dec = avcodec_find_decoder(inStream->codecpar->codec_id);
+    const AVCodec* enc = avcodec_find_encoder(AV_CODEC_ID_H264);
+    AVCodecContext* decCtx = dec ? avcodec_alloc_context3(dec) : nullptr;
+    AVCodecContext* encCtx = nullptr;
+    SwsContext* swsCtx = nullptr;
+    AVFrame* decFrame = av_frame_alloc();
+    AVFrame* encFrame = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    AVPacket* outPkt = av_packet_alloc();
+    bool success = decCtx && decFrame && encFrame && pkt && outPkt;
+
+    if (success && avcodec_parameters_to_context(decCtx, inStream->codecpar) < 0)
+        success = false;
+    if (success) {
+        // Skipping the deblocking filter makes the analysis pass decode
+        // noticeably faster; the stats barely change.
+        if (options.fastFirstPass)
+            decCtx->skip_loop_filter = AVDISCARD_ALL;
+        if (avcodec_open2(decCtx, dec, nullptr) < 0)
+            success = false;
+    }
+    if (success) {
+        encCtx = OpenH264Encoder(enc, inStream, videoKbps, false, globalHeader, true,
+                                 options.fastFirstPass, AV_CODEC_FLAG_PASS1, statsPath);
+        if (!encCtx)
+            success = false;
+    }
+    if (success) {
+        encFrame->format = encCtx->pix_fmt;
+        encFrame->width = encCtx->width;
+        encFrame->height = encCtx->height;
+        if (av_frame_get_buffer(encFrame, 32) < 0)
+            success = false;
+    }
+    if (!success)
+        DebugLog("First pass: failed to set up decoder/encoder", true);
+
+    // Mirror the packet selection of the second pass exactly: x264 refuses a
+    // second pass that has more frames than the first one.
+    int64_t startPts = (int64_t)(options.startTime * AV_TIME_BASE);
+    int64_t endPts = (int64_t)(options.endTime * AV_TIME_BASE);
+    if (success && av_seek_frame(inputCtx, -1, startPts, AVSEEK_FLAG_BACKWARD) < 0)
+        DebugLog("First pass: seek failed", true);
+
+    StageClock clock(stats);
+    while (success && av_read_frame(inputCtx, pkt) >= 0) {
+        clock.Lap(ExportStage::Demux);
+        if (cancelFlag && *cancelFlag) { success = false; av_packet_unref(pkt); break; }
+        AVStream* st = inputCtx->streams[pkt->stream_index];
+        int64_t pktPtsUs = av_rescale_q(pkt->pts, st->time_base, AV_TIME_BASE_Q);
+        if (pktPtsUs < startPts && pkt->stream_index != videoIndex) { av_packet_unref(pkt); continue; }
+        if (pktPtsUs > endPts) { av_packet_unref(pkt); break; }
+        if (pkt->stream_index == videoIndex) {
+            avcodec_send_packet(decCtx, pkt);
+            while (avcodec_receive_frame(decCtx, decFrame) == 0) {
+                clock.Lap(ExportStage::Decode);
+                if (decFrame->pts != AV_NOPTS_VALUE &&
+                    av_rescale_q(decFrame->pts, st->time_base, AV_TIME_BASE_Q) < startPts) {
+                    av_frame_unref(decFrame);
+                    continue;
+                }
+                if (!swsCtx) {
+                    swsCtx = sws_getContext(decCtx->width, decCtx->height,
+                                            (AVPixelFormat)decFrame->format,
+                                            encCtx->width, encCtx->height,
+                                            encCtx->pix_fmt, SWS_BILINEAR,
+                                            nullptr, nullptr, nullptr);
+                    if (!swsCtx) {
+                        DebugLog("First pass: failed to create scaling context", true);
+                        success = false;
+                        break;
+                    }
+                }
+                sws_scale(swsCtx, decFrame->data, decFrame->linesize, 0, decCtx->height,
+                          encFrame->data, encFrame->linesize);
+                clock.Lap(ExportStage::Scale);
+                encFrame->pts = av_rescale_q(decFrame->pts - av_rescale_q(startPts, AV_TIME_BASE_Q, st->time_base),
+                                             st->time_base, encCtx->time_base);
+                avcodec_send_frame(encCtx, encFrame);
+                while (avcodec_receive_packet(encCtx, outPkt) == 0)
+                    av_packet_unref(outPkt);
+                clock.Lap(ExportStage::Encode);
+                if (stats)
+                    stats->AddFrames(1);
+                av_frame_unref(decFrame);
+            }
+            clock.Lap(ExportStage::Decode);
+        }
+        av_packet_unref(pkt);
+
+        if (stats) {
+            double progress = (pktPtsUs - startPts) / double(endPts - startPts);
+            stats->SetProgress(progress * progressSpan, progress);
+        }
+    }
+
+    if (success) {
+        avcodec_send_frame(encCtx, nullptr);
+        while (avcodec_receive_packet(encCtx, outPkt) == 0)
+            av_packet_unref(outPkt);
+        clock.Lap(ExportStage::Encode);
+        if (stats)
+            stats->EndPass();
+    }
+
+    // Closing the encoder is what finalizes the stats file.
+    if (encCtx) avcodec_free_context(&encCtx);
+    if (decCtx) avcodec_free_context(&decCtx);
+    if (swsCtx) sws_freeContext(swsCtx);
+    av_frame_free(&decFrame);
+    av_frame_free(&encFrame);
+    av_packet_free(&pkt);
+    av_packet_free(&outPkt);
+    CloseMediaInput(&inputCtx);
+
+    LOG_INFO("First pass " << (success ? "finished" : "aborted"));
+    return success;
+}
+
+bool VideoCutter::Transcode(const std::wstring& outputFilename, const ExportOptions& options,
+                            int videoKbps, RatePass pass, const std::string& statsPath,
+                            double progressBase, double progressSpan,
+                            ExportStats* stats, std::atomic<bool>* cancelFlag,
+                            SegmentOutput* segments)
+{
+    TRACE_SCOPE("Transcode", "export");
+    m_statsRejected = false;
+    const double startTime = options.startTime;
+    const double endTime = options.endTime;
+    const bool mergeAudio = options.mergeAudio;
+    const bool convertH264 = options.convertH264;
+    const bool useNvenc = options.useNvenc;
+
+    LOG_INFO("CutVideo start start=" << startTime << " end=" << endTime
+             << " mergeAudio=" << mergeAudio
+             << " convertH264=" << convertH264
+             << " useNvenc=" << useNvenc
+             << " videoKbps=" << videoKbps
+             << " pass=" << (pass == RatePass::Second ? 2 : 1)
+             << " resumeUs=" << (segments ? segments->startUs : 0));
+
+    std::string utf8Output = ToUtf8(outputFilename);
+    std::string utf8Input = ToUtf8(m_source.filename);
+
+    std::vector<int> activeTracks = m_source.UnmutedStreams();
+    if (LogEnabled(LogLevel::Info)) {
         std::ostringstream oss;
         oss << "Active tracks:";
         for (int idx : activeTracks) oss << ' ' << idx;
-        DebugLog(oss.str());
+        LogMessage(LogLevel::Info, oss.str());
     }
 
     // When re-encoding or merging audio we need to set up decoder/encoder
@@ -62,52 +1123,42 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
     AVFrame*        encFrame = nullptr;
     AVFrame*        decFrame = nullptr;
 
-    struct MergeTrack {
-        int index;
-        AVCodecContext* decCtx;
-        SwrContext* swrCtx;
-        AVFrame* frame;
-        std::deque<int16_t> buffer;
-    };
     std::vector<MergeTrack> mergeTracks;
-    AVCodecContext* aEncCtx = nullptr;
-    int encFrameSamples = 0;
-    std::vector<int16_t> mixBuffer;
-    SwrContext* mixSwr = nullptr;
+    MergedAudio merged;
+    std::vector<PacketTarget> mergedTargets;
+    int mixed = 0;
     bool headerWritten = false;
+    StreamedOutput streamed;
+    AVDictionary* muxOpts = nullptr;
+    StageClock clock(stats);
 
     bool needReencode = convertH264 || mergeAudio;
+    // Timestamps stay relative to the cut start; a resumed run only begins
+    // reading at the first frame of its segment. Set before the first goto.
+    int64_t startPts = (int64_t)(startTime * AV_TIME_BASE);
+    int64_t endPts = (int64_t)(endTime * AV_TIME_BASE);
+    int64_t beginPts = startPts + (segments ? segments->startUs : 0);
 
     AVFormatContext* inputCtx = nullptr;
-    if (avformat_open_input(&inputCtx, utf8Input.c_str(), nullptr, nullptr) < 0) {
+    if (OpenMediaInput(&inputCtx, utf8Input) < 0) {
         DebugLog("Failed to open input file", true);
         return false;
     }
-    DebugLog("Input opened");
-    if (avformat_find_stream_info(inputCtx, nullptr) < 0) {
-        DebugLog("Failed to read stream info", true);
-        avformat_close_input(&inputCtx);
-        return false;
-    }
-    {
-        std::ostringstream oss;
-        oss << "Input streams=" << inputCtx->nb_streams;
-        DebugLog(oss.str());
-    }
+    LOG_INFO("Input streams=" << inputCtx->nb_streams);
 
     AVFormatContext* outputCtx = nullptr;
     if (avformat_alloc_output_context2(&outputCtx, nullptr, nullptr, utf8Output.c_str()) < 0) {
         DebugLog("Failed to allocate output context", true);
-        avformat_close_input(&inputCtx);
+        CloseMediaInput(&inputCtx);
         return false;
     }
-    DebugLog("Output context allocated");
+    LOG_DEBUG("Output context allocated");
 
     std::vector<int> streamMapping(inputCtx->nb_streams, -1);
     int mergedAudioIndex = -1;
     for (unsigned i = 0; i < inputCtx->nb_streams; ++i) {
         AVStream* inStream = inputCtx->streams[i];
-        bool useStream = (inStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && i == (unsigned)m_player->videoStreamIndex);
+        bool useStream = (inStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && i == (unsigned)m_source.videoStreamIndex);
         if (!useStream && inStream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
             useStream = std::find(activeTracks.begin(), activeTracks.end(), (int)i) != activeTracks.end();
         }
@@ -115,40 +1166,30 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
             continue;
 
         AVStream* outStream = nullptr;
-        if (needReencode && inStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && i == (unsigned)m_player->videoStreamIndex && convertH264) {
+        if (needReencode && inStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && i == (unsigned)m_source.videoStreamIndex && convertH264) {
             const AVCodec* vEnc = useNvenc ?
                 avcodec_find_encoder_by_name("h264_nvenc") :
                 avcodec_find_encoder(AV_CODEC_ID_H264);
             if (!vEnc) {
                 DebugLog("H.264 encoder not found", true);
                 avformat_free_context(outputCtx);
-                avformat_close_input(&inputCtx);
+                CloseMediaInput(&inputCtx);
                 return false;
             }
             outStream = avformat_new_stream(outputCtx, vEnc);
-            vEncCtx = avcodec_alloc_context3(vEnc);
-            vEncCtx->codec_id = AV_CODEC_ID_H264;
-            vEncCtx->width = inStream->codecpar->width;
-            vEncCtx->height = inStream->codecpar->height;
-            vEncCtx->time_base = inStream->time_base;
-            vEncCtx->pix_fmt = AV_PIX_FMT_YUV420P;
-            vEncCtx->max_b_frames = 2;
-            vEncCtx->gop_size = 12;
-            if (maxBitrate > 0)
-                vEncCtx->bit_rate = maxBitrate * 1000;
-            if (outputCtx->oformat->flags & AVFMT_GLOBALHEADER)
-                vEncCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-            AVDictionary* encOpts = nullptr;
-            av_dict_set(&encOpts, "preset", "fast", 0);
-            if (avcodec_open2(vEncCtx, vEnc, &encOpts) < 0) {
+            vEncCtx = OpenH264Encoder(vEnc, inStream, videoKbps, useNvenc,
+                                      outputCtx->oformat->flags & AVFMT_GLOBALHEADER,
+                                      options.targetSizeMB > 0, options.fastFirstPass,
+                                      pass == RatePass::Second ? AV_CODEC_FLAG_PASS2 : 0,
+                                      statsPath);
+            if (!vEncCtx) {
+                // With PASS2 set, x264 fails to open on stats it cannot use.
+                m_statsRejected = pass == RatePass::Second;
                 DebugLog("Failed to open H.264 encoder", true);
-                avcodec_free_context(&vEncCtx);
                 avformat_free_context(outputCtx);
-                avformat_close_input(&inputCtx);
-                av_dict_free(&encOpts);
+                CloseMediaInput(&inputCtx);
                 return false;
             }
-            av_dict_free(&encOpts);
             if (avcodec_parameters_from_context(outStream->codecpar, vEncCtx) < 0) {
                 DebugLog("Failed to copy encoder parameters", true);
                 success = false;
@@ -162,7 +1203,7 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
                 avcodec_free_context(&vEncCtx);
                 if (vDecCtx) avcodec_free_context(&vDecCtx);
                 avformat_free_context(outputCtx);
-                avformat_close_input(&inputCtx);
+                CloseMediaInput(&inputCtx);
                 return false;
             }
             if (avcodec_open2(vDecCtx, avcodec_find_decoder(inStream->codecpar->codec_id), nullptr) < 0) {
@@ -170,10 +1211,10 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
                 avcodec_free_context(&vEncCtx);
                 avcodec_free_context(&vDecCtx);
                 avformat_free_context(outputCtx);
-                avformat_close_input(&inputCtx);
+                CloseMediaInput(&inputCtx);
                 return false;
             }
-            DebugLog("Video decoder/encoder initialized");
+            LOG_DEBUG("Video decoder/encoder initialized");
             swsCtx = nullptr; // initialized after first decoded frame
             encFrame = av_frame_alloc();
             decFrame = av_frame_alloc();
@@ -192,34 +1233,20 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
             }
         } else if (needReencode && inStream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && mergeAudio) {
             // We'll create a single output audio stream later
-            MergeTrack mt{};
-            mt.index = i;
-            const AVCodec* dec = avcodec_find_decoder(inStream->codecpar->codec_id);
-            mt.decCtx = avcodec_alloc_context3(dec);
-            avcodec_parameters_to_context(mt.decCtx, inStream->codecpar);
-            avcodec_open2(mt.decCtx, dec, nullptr);
-            mt.swrCtx = swr_alloc();
-            av_opt_set_int(mt.swrCtx, "in_sample_rate", mt.decCtx->sample_rate, 0);
-            av_opt_set_int(mt.swrCtx, "out_sample_rate", 44100, 0);
-            av_opt_set_sample_fmt(mt.swrCtx, "in_sample_fmt", mt.decCtx->sample_fmt, 0);
-            av_opt_set_sample_fmt(mt.swrCtx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-            av_channel_layout_default(&mt.decCtx->ch_layout,
-                                      mt.decCtx->ch_layout.nb_channels ?
-                                          mt.decCtx->ch_layout.nb_channels : 2);
-            AVChannelLayout out_ch{};
-            av_channel_layout_default(&out_ch, 2);
-            av_opt_set_chlayout(mt.swrCtx, "in_chlayout", &mt.decCtx->ch_layout, 0);
-            av_opt_set_chlayout(mt.swrCtx, "out_chlayout", &out_ch, 0);
-            swr_init(mt.swrCtx);
-            mt.frame = av_frame_alloc();
-            mergeTracks.push_back(mt);
+            MergeTrack mt;
+            if (OpenMergeTrack(inStream, i, mt)) {
+                mergeTracks.push_back(std::move(mt));
+            } else {
+                FreeMergeTrack(mt);
+                LOG_WARN("Skipping audio track that could not be decoded: " << i);
+            }
             continue; // output stream created later
         } else {
             outStream = avformat_new_stream(outputCtx, nullptr);
             if (avcodec_parameters_copy(outStream->codecpar, inStream->codecpar) < 0) {
                 DebugLog("Failed to copy codec parameters", true);
                 avformat_free_context(outputCtx);
-                avformat_close_input(&inputCtx);
+                CloseMediaInput(&inputCtx);
                 return false;
             }
             outStream->codecpar->codec_tag = 0;
@@ -229,106 +1256,98 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
     }
 
     if (mergeAudio && !mergeTracks.empty()) {
-        const AVCodec* aEnc = avcodec_find_encoder(AV_CODEC_ID_AAC);
-        if (!aEnc) {
-            DebugLog("AAC encoder not found", true);
-            avformat_free_context(outputCtx);
-            avformat_close_input(&inputCtx);
-            return false;
-        }
-        AVStream* aOut = avformat_new_stream(outputCtx, aEnc);
-        aEncCtx = avcodec_alloc_context3(aEnc);
-        if (!aEncCtx) {
-            DebugLog("Failed to allocate AAC encoder context", true);
-            avformat_free_context(outputCtx);
-            avformat_close_input(&inputCtx);
-            return false;
-        }
-        aEncCtx->sample_rate = 44100;
-        av_channel_layout_default(&aEncCtx->ch_layout, 2);
-        aEncCtx->sample_fmt = aEnc->sample_fmts ? aEnc->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
-        aEncCtx->time_base = {1, aEncCtx->sample_rate};
-        aEncCtx->bit_rate = 128000; // match ffmpeg default
-        if (avcodec_open2(aEncCtx, aEnc, nullptr) < 0) {
-            DebugLog("Failed to open AAC encoder", true);
-            avcodec_free_context(&aEncCtx);
-            avformat_free_context(outputCtx);
-            avformat_close_input(&inputCtx);
-            return false;
-        }
-        DebugLog("AAC encoder initialized");
-        if (avcodec_parameters_from_context(aOut->codecpar, aEncCtx) < 0) {
-            DebugLog("Failed to copy AAC encoder parameters", true);
+        double resumeSeconds = segments ? segments->startUs / (double)AV_TIME_BASE : 0.0;
+        if (!OpenMergedAudio(merged, (int)mergeTracks.size(), endTime - startTime - resumeSeconds, false)) {
             success = false;
             goto cleanup;
         }
-        aOut->time_base = aEncCtx->time_base;
-        encFrameSamples = aEncCtx->frame_size > 0 ? aEncCtx->frame_size : 1024;
-        if (aEncCtx->ch_layout.nb_channels <= 0) {
-            DebugLog("Invalid channel count in AAC encoder context", true);
-            success = false;
-            goto cleanup;
-        }
-        mixBuffer.resize(encFrameSamples * aEncCtx->ch_layout.nb_channels);
-        mixSwr = swr_alloc();
-        AVChannelLayout stereo;
-        av_channel_layout_default(&stereo, 2);
-        av_opt_set_int   (mixSwr, "in_sample_rate", 44100, 0);
-        av_opt_set_sample_fmt(mixSwr, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-        av_opt_set_chlayout  (mixSwr, "in_chlayout", &stereo, 0);
-        av_opt_set_int   (mixSwr, "out_sample_rate", aEncCtx->sample_rate, 0);
-        av_opt_set_sample_fmt(mixSwr, "out_sample_fmt", aEncCtx->sample_fmt, 0);
-        av_opt_set_chlayout  (mixSwr, "out_chlayout", &aEncCtx->ch_layout, 0);
-        if (swr_init(mixSwr) < 0) {
-            DebugLog("Failed to init mix resampler", true);
+        if (segments)
+            merged.pts = av_rescale_q(segments->startUs, AV_TIME_BASE_Q, merged.enc->time_base);
+        AVStream* aOut = avformat_new_stream(outputCtx, merged.enc->codec);
+        if (!aOut || avcodec_parameters_from_context(aOut->codecpar, merged.enc) < 0) {
+            DebugLog("Failed to copy AAC encoder parameters", true);
             success = false;
             goto cleanup;
         }
+        aOut->time_base = merged.enc->time_base;
         mergedAudioIndex = aOut->index;
+        mergedTargets.push_back({ outputCtx, mergedAudioIndex, segments });
     }
 
-    if (!(outputCtx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&outputCtx->pb, utf8Output.c_str(), AVIO_FLAG_WRITE) < 0) {
+    if (segments) {
+        // The output context only describes the streams; the data goes to
+        // segment files that are joined once all of them are done.
+        segments->layout = outputCtx;
+        segments->videoStream = streamMapping[m_source.videoStreamIndex];
+        if (!OpenSegment(*segments)) {
+            success = false;
+            goto cleanup;
+        }
+    } else if (!(outputCtx->oformat->flags & AVFMT_NOFILE)) {
+        // A sink gets a fragmented MP4: every byte is final once written, so
+        // it can be uploaded while the rest is still encoding. Target size
+        // exports may be redone and are never streamed.
+        bool opened;
+        if (options.sink && options.targetSizeMB <= 0 && CanStreamOutput(outputCtx)) {
+            streamed.sink = options.sink;
+            opened = OpenStreamedOutput(outputCtx, outputFilename, streamed);
+            av_dict_set(&muxOpts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+            av_dict_set(&muxOpts, "min_frag_duration", "2000000", 0);
+        } else {
+            opened = OpenOutputIO(outputCtx, utf8Output,
+                                  EstimateOutputBytes(outputCtx, inputCtx->bit_rate, endTime - startTime));
+        }
+        if (!opened) {
             DebugLog("Could not open output file", true);
+            av_dict_free(&muxOpts);
             avformat_free_context(outputCtx);
-            avformat_close_input(&inputCtx);
+            CloseMediaInput(&inputCtx);
             return false;
         }
     }
 
-    if (avformat_write_header(outputCtx, nullptr) < 0) {
+    if (!segments && avformat_write_header(outputCtx, &muxOpts) < 0) {
         DebugLog("Failed to write header", true);
-        if (!(outputCtx->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&outputCtx->pb);
+        av_dict_free(&muxOpts);
+        CloseOutputFile(outputCtx, streamed);
         avformat_free_context(outputCtx);
-        avformat_close_input(&inputCtx);
+        CloseMediaInput(&inputCtx);
         return false;
     }
-    DebugLog("Header written");
-    headerWritten = true;
-    DebugLog("Beginning packet processing");
+    av_dict_free(&muxOpts);
+    LOG_DEBUG("Header written");
+    headerWritten = !segments;
+    LOG_DEBUG("Beginning packet processing");
 
-    int64_t startPts = (int64_t)(startTime * AV_TIME_BASE);
-    int64_t endPts = (int64_t)(endTime * AV_TIME_BASE);
-    if (av_seek_frame(inputCtx, -1, startPts, AVSEEK_FLAG_BACKWARD) < 0) {
+    if (av_seek_frame(inputCtx, -1, beginPts, AVSEEK_FLAG_BACKWARD) < 0) {
         DebugLog("Seek failed", true);
     }
 
     AVPacket pkt, outPkt;
     av_init_packet(&pkt);
     av_init_packet(&outPkt); // ensure fields are zeroed before use
-    int64_t audioPts = 0;
+    clock.Restart();
     while (av_read_frame(inputCtx, &pkt) >= 0) {
+        clock.Lap(ExportStage::Demux);
         if (cancelFlag && *cancelFlag) { success = false; goto cleanup; }
         bool handled = false;
         AVStream* inStream = inputCtx->streams[pkt.stream_index];
         int64_t pktPtsUs = av_rescale_q(pkt.pts, inStream->time_base, AV_TIME_BASE_Q);
-        if (pktPtsUs < startPts) { av_packet_unref(&pkt); continue; }
+        bool decodeVideo = convertH264 && pkt.stream_index == m_source.videoStreamIndex;
+        // Re-encoded video is decoded from the keyframe the seek landed on
+        // so the first kept frame is complete.
+        if (pktPtsUs < beginPts && !decodeVideo) { av_packet_unref(&pkt); continue; }
         if (pktPtsUs > endPts) { av_packet_unref(&pkt); break; }
 
-        if (convertH264 && pkt.stream_index == m_player->videoStreamIndex) {
+        if (decodeVideo) {
             avcodec_send_packet(vDecCtx, &pkt);
             while (avcodec_receive_frame(vDecCtx, decFrame) == 0) {
+                clock.Lap(ExportStage::Decode);
+                if (decFrame->pts != AV_NOPTS_VALUE &&
+                    av_rescale_q(decFrame->pts, inStream->time_base, AV_TIME_BASE_Q) < beginPts) {
+                    av_frame_unref(decFrame);
+                    continue;
+                }
                 if (!swsCtx) {
                     swsCtx = sws_getContext(vDecCtx->width, vDecCtx->height,
                                             (AVPixelFormat)decFrame->format,
@@ -343,31 +1362,34 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
                     }
                 }
                 sws_scale(swsCtx, decFrame->data, decFrame->linesize, 0, vDecCtx->height, encFrame->data, encFrame->linesize);
+                clock.Lap(ExportStage::Scale);
                 encFrame->pts = av_rescale_q(decFrame->pts - av_rescale_q(startPts, AV_TIME_BASE_Q, inStream->time_base), inStream->time_base, vEncCtx->time_base);
                 avcodec_send_frame(vEncCtx, encFrame);
                 while (avcodec_receive_packet(vEncCtx, &outPkt) == 0) {
+                    clock.Lap(ExportStage::Encode);
                     av_packet_rescale_ts(&outPkt, vEncCtx->time_base, outputCtx->streams[streamMapping[pkt.stream_index]]->time_base);
                     outPkt.stream_index = streamMapping[pkt.stream_index];
-                    av_interleaved_write_frame(outputCtx, &outPkt);
+                    if (segments)
+                        WriteSegmentPacket(*segments, &outPkt);
+                    else
+                        av_interleaved_write_frame(outputCtx, &outPkt);
                     av_packet_unref(&outPkt);
+                    clock.Lap(ExportStage::Mux);
                 }
+                clock.Lap(ExportStage::Encode);
+                if (stats)
+                    stats->AddFrames(1);
                 av_frame_unref(decFrame);
             }
+            clock.Lap(ExportStage::Decode);
             handled = true;
         } else if (mergeAudio) {
-            for (auto &mt : mergeTracks) {
-                if (mt.index == pkt.stream_index) {
-                    avcodec_send_packet(mt.decCtx, &pkt);
-                    while (avcodec_receive_frame(mt.decCtx, mt.frame) == 0) {
-                        int outSamples = swr_get_out_samples(mt.swrCtx, mt.frame->nb_samples);
-                        std::vector<int16_t> tmp(outSamples * 2);
-                        uint8_t* outArr[1] = { reinterpret_cast<uint8_t*>(tmp.data()) };
-                        int conv = swr_convert(mt.swrCtx, outArr, outSamples,
-                                              (const uint8_t**)mt.frame->data,
-                                              mt.frame->nb_samples);
-                        mt.buffer.insert(mt.buffer.end(), tmp.begin(),
-                                          tmp.begin() + conv * 2);
-                    }
+            for (size_t t = 0; t < mergeTracks.size(); ++t) {
+                if (mergeTracks[t].index == pkt.stream_index) {
+                    if (merged.mixer)
+                        DecodeMergeTrack(mergeTracks[t], *merged.mixer, (int)t, &pkt,
+                                         inStream, beginPts);
+                    clock.Lap(ExportStage::Audio);
                     handled = true;
                     break;
                 }
@@ -386,154 +1408,535 @@ bool VideoCutter::CutVideo(const std::wstring& outputFilename, double startTime,
                 pkt.duration = av_rescale_q(pkt.duration, inStream->time_base, outStream->time_base);
             pkt.pos = -1;
             pkt.stream_index = outStream->index;
-            av_interleaved_write_frame(outputCtx, &pkt);
+            if (segments)
+                WriteSegmentPacket(*segments, &pkt);
+            else
+                av_interleaved_write_frame(outputCtx, &pkt);
+            clock.Lap(ExportStage::Mux);
+            if (stats && inStream->index == m_source.videoStreamIndex)
+                stats->AddFrames(1);
         }
 
         av_packet_unref(&pkt);
 
-        // check if we can encode audio frame
-        if (mergeAudio && !mergeTracks.empty()) {
-            bool ready = true;
-            for (auto &mt : mergeTracks)
-                if ((int)mt.buffer.size() < encFrameSamples * 2) { ready = false; break; }
-            if (ready) {
-                for (int i = 0; i < encFrameSamples * 2; ++i) {
-                    int sum = 0;
-                    for (auto &mt : mergeTracks) {
-                        sum += mt.buffer.front();
-                        mt.buffer.pop_front();
-                    }
-                    int v = sum / (int)mergeTracks.size();
-                    if (v > 32767) v = 32767;
-                    if (v < -32768) v = -32768;
-                    mixBuffer[i] = (int16_t)v;
-                }
-                AVFrame* af = av_frame_alloc();
-                af->nb_samples = encFrameSamples;
-                av_channel_layout_copy(&af->ch_layout, &aEncCtx->ch_layout);
-                af->format = aEncCtx->sample_fmt;
-                af->sample_rate = aEncCtx->sample_rate;
-                if (av_frame_get_buffer(af, 0) < 0) {
-                    DebugLog("Failed to allocate audio frame buffer", true);
-                    av_frame_free(&af);
-                    success = false;
-                    goto cleanup;
-                }
-                const uint8_t* inBuf[1] = { (const uint8_t*)mixBuffer.data() };
-                if (swr_convert(mixSwr, af->data, encFrameSamples, inBuf, encFrameSamples) < 0) {
-                    DebugLog("Failed to convert mixed samples", true);
-                    av_frame_free(&af);
-                    success = false;
-                    goto cleanup;
-                }
-                af->pts = audioPts;
-                audioPts += encFrameSamples;
-                avcodec_send_frame(aEncCtx, af);
-                while (avcodec_receive_packet(aEncCtx, &outPkt) == 0) {
-                    av_packet_rescale_ts(&outPkt, aEncCtx->time_base, outputCtx->streams[mergedAudioIndex]->time_base);
-                    outPkt.stream_index = mergedAudioIndex;
-                    av_interleaved_write_frame(outputCtx, &outPkt);
-                    av_packet_unref(&outPkt);
-                }
-                av_frame_free(&af);
-            }
+        // encode every mixed block that is ready
+        if (merged.mixer) {
+            while ((mixed = EncodeMixedBlock(merged, false, mergedTargets, &outPkt, nullptr, clock)) > 0) {}
+            if (mixed < 0) { success = false; goto cleanup; }
         }
 
-        double progress = (pktPtsUs - startPts) / double(endPts - startPts);
-        if (progressBar && IsWindow(progressBar))
-            SendMessage(progressBar, PBM_SETPOS, (int)(progress * 100.0), 0);
+        if (segments && !segments->ctx) { success = false; goto cleanup; }
+
+        if (stats) {
+            double progress = (pktPtsUs - startPts) / double(endPts - startPts);
+            stats->SetProgress(progressBase + progress * progressSpan, progress);
+            if (segments)
+                stats->SetOutputBytes(segments->doneBytes +
+                                      (segments->ctx->pb ? avio_tell(segments->ctx->pb) : 0));
+            else if (outputCtx->pb)
+                stats->SetOutputBytes(avio_tell(outputCtx->pb));
+        }
     }
 
     // Flush encoders
-    DebugLog("Flushing encoders");
+    LOG_DEBUG("Flushing encoders");
     if (convertH264 && vEncCtx) {
         avcodec_send_frame(vEncCtx, nullptr);
         while (avcodec_receive_packet(vEncCtx, &outPkt) == 0) {
-            av_packet_rescale_ts(&outPkt, vEncCtx->time_base, outputCtx->streams[streamMapping[m_player->videoStreamIndex]]->time_base);
-            outPkt.stream_index = streamMapping[m_player->videoStreamIndex];
-            av_interleaved_write_frame(outputCtx, &outPkt);
+            clock.Lap(ExportStage::Encode);
+            av_packet_rescale_ts(&outPkt, vEncCtx->time_base, outputCtx->streams[streamMapping[m_source.videoStreamIndex]]->time_base);
+            outPkt.stream_index = streamMapping[m_source.videoStreamIndex];
+            if (segments)
+                WriteSegmentPacket(*segments, &outPkt);
+            else
+                av_interleaved_write_frame(outputCtx, &outPkt);
             av_packet_unref(&outPkt);
+            clock.Lap(ExportStage::Mux);
         }
+        clock.Lap(ExportStage::Encode);
     }
-    if (mergeAudio && aEncCtx) {
-        // flush remaining samples
+    if (merged.mixer) {
+        // flush remaining samples; tracks that ended early contribute silence
+        merged.mixer->FinishAll();
         while (true) {
             if (cancelFlag && *cancelFlag) { success = false; goto cleanup; }
-            bool ready = true;
-            for (auto &mt : mergeTracks)
-                if ((int)mt.buffer.size() < encFrameSamples * 2) { ready = false; break; }
-            if (!ready) break;
-            for (int i = 0; i < encFrameSamples * 2; ++i) {
-                int sum = 0;
-                for (auto &mt : mergeTracks) { sum += mt.buffer.front(); mt.buffer.pop_front(); }
-                int v = sum / (int)mergeTracks.size();
-                if (v > 32767) v = 32767;
-                if (v < -32768) v = -32768;
-                mixBuffer[i] = (int16_t)v;
+            mixed = EncodeMixedBlock(merged, true, mergedTargets, &outPkt, nullptr, clock);
+            if (mixed < 0) { success = false; goto cleanup; }
+            if (mixed == 0) break;
+        }
+        LogMixStats(*merged.mixer);
+        EncodeToTargets(merged.enc, nullptr, mergedTargets, &outPkt, nullptr, clock, ExportStage::Audio);
+    }
+
+cleanup:
+    LOG_DEBUG("Entering cleanup");
+    if (headerWritten) {
+        av_write_trailer(outputCtx);
+        clock.Lap(ExportStage::Mux);
+        if (stats && outputCtx->pb)
+            stats->SetOutputBytes(avio_tell(outputCtx->pb));
+    }
+    if (segments) {
+        if (!FinishSegments(*segments, success, endPts - startPts))
+            success = false;
+        clock.Lap(ExportStage::Mux);
+        if (stats)
+            stats->SetOutputBytes(segments->doneBytes);
+    }
+    if (!CloseOutputFile(outputCtx, streamed))
+        success = false;
+    if (vEncCtx) avcodec_free_context(&vEncCtx);
+    if (vDecCtx) avcodec_free_context(&vDecCtx);
+    if (swsCtx) sws_freeContext(swsCtx);
+    if (encFrame) av_frame_free(&encFrame);
+    if (decFrame) av_frame_free(&decFrame);
+    FreeMergedAudio(merged);
+    FreeMergeTracks(mergeTracks);
+    avformat_free_context(outputCtx);
+    CloseMediaInput(&inputCtx);
+
+    if (stats && success)
+        stats->EndPass();
+
+    LOG_INFO("CutVideo finished");
+
+    return success;
+}
+
+// Per-output state of a fan-out export.
+struct BranchOutput {
+    AVFormatContext* ctx = nullptr;
+    std::string path;
+    bool headerWritten = false;
+};
+
+// Decoded frames converted to one output size, shared by every encoder of
+// that size.
+struct BranchScaler {
+    int width = 0;
+    int height = 0;
+    SwsContext* sws = nullptr;
+    AVFrame* frame = nullptr;
+    bool passthrough = false;   // encoders reference the decoded frame itself
+};
+
+struct BranchEncoder {
+    int scaler = -1;
+    int kbps = 0;
+    bool globalHeader = false;
+    AVCodecContext* ctx = nullptr;
+    std::vector<PacketTarget> targets;
+};
+
+static bool ScaleBranchFrame(BranchScaler& sc, const AVFrame* src)
+{
+    sc.passthrough = src->width == sc.width && src->height == sc.height &&
+                     src->format == AV_PIX_FMT_YUV420P;
+    if (sc.passthrough)
+        return true;
+    sc.sws = sws_getCachedContext(sc.sws, src->width, src->height, (AVPixelFormat)src->format,
+                                  sc.width, sc.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
+                                  nullptr, nullptr, nullptr);
+    if (!sc.sws) {
+        DebugLog("Failed to create scaling context", true);
+        return false;
+    }
+    // Encoders normally copy the picture during send; a new buffer is only
+    // allocated if one still holds the previous frame.
+    if (!sc.frame->buf[0]) {
+        sc.frame->format = AV_PIX_FMT_YUV420P;
+        sc.frame->width = sc.width;
+        sc.frame->height = sc.height;
+        if (av_frame_get_buffer(sc.frame, 32) < 0) {
+            DebugLog("Failed to allocate buffer for encoder frame", true);
+            return false;
+        }
+    } else if (av_frame_make_writable(sc.frame) < 0) {
+        DebugLog("Failed to allocate buffer for encoder frame", true);
+        return false;
+    }
+    sws_scale(sc.sws, src->data, src->linesize, 0, src->height, sc.frame->data, sc.frame->linesize);
+    return true;
+}
+
+// Moves packet timestamps so the cut starts at zero (input time base).
+static void ShiftPacket(AVPacket* pkt, int64_t offset)
+{
+    if (pkt->pts != AV_NOPTS_VALUE) pkt->pts -= offset;
+    if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= offset;
+}
+
+bool VideoCutter::ExportBranches(const std::vector<ExportBranch>& branches, const ExportOptions& options,
+                                 ExportStats* stats, std::atomic<bool>* cancelFlag)
+{
+    TRACE_SCOPE("ExportBranches", "export");
+    m_targetReport = TargetSizeReport();
+    if (!m_source.IsLoaded()) {
+        DebugLog("ExportBranches called but no video loaded", true);
+        return false;
+    }
+    if (branches.empty())
+        return false;
+
+    const double startTime = options.startTime;
+    const double endTime = options.endTime;
+    const int videoIndex = m_source.videoStreamIndex;
+    std::vector<int> activeTracks = m_source.UnmutedStreams();
+    int defaultKbps = options.maxBitrate;
+    if (options.targetSizeMB > 0 && endTime > startTime)
+        defaultKbps = TargetVideoKbps(options, EstimateAudioKbps(options.mergeAudio));
+    LOG_INFO("Fan-out export start=" << startTime << " end=" << endTime
+             << " branches=" << branches.size() << " useNvenc=" << options.useNvenc
+             << " defaultKbps=" << defaultKbps);
+
+    bool success = true;
+    bool needMerge = false;
+    bool mergeGlobalHeader = false;
+    std::string utf8Input = ToUtf8(m_source.filename);
+    AVFormatContext* inputCtx = nullptr;
+    AVStream* vIn = nullptr;
+    AVCodecContext* vDecCtx = nullptr;
+    AVFrame* decFrame = nullptr;
+    const AVCodec* vEnc = nullptr;
+    std::vector<BranchOutput> outs(branches.size());
+    std::vector<BranchScaler> scalers;
+    std::vector<BranchEncoder> encoders;
+    std::vector<PacketTarget> videoCopyTargets;
+    std::vector<std::vector<PacketTarget>> audioCopyTargets;
+    std::vector<MergeTrack> mergeTracks;
+    MergedAudio merged;
+    std::vector<PacketTarget> mergedTargets;
+    int openOutputs = 0;
+    int mixed = 0;
+    int64_t startPts = (int64_t)(startTime * AV_TIME_BASE);
+    int64_t endPts = (int64_t)(endTime * AV_TIME_BASE);
+    StageClock clock(stats);
+    AVPacket pkt, outPkt, refPkt;
+    av_init_packet(&pkt);
+    av_init_packet(&outPkt);
+    av_init_packet(&refPkt);
+
+    if (OpenMediaInput(&inputCtx, utf8Input) < 0) {
+        DebugLog("Failed to open input file", true);
+        return false;
+    }
+    if (videoIndex >= 0 && videoIndex < (int)inputCtx->nb_streams)
+        vIn = inputCtx->streams[videoIndex];
+    audioCopyTargets.resize(inputCtx->nb_streams);
+
+    for (size_t b = 0; b < branches.size(); ++b) {
+        outs[b].path = ToUtf8(branches[b].outputFilename);
+        if (avformat_alloc_output_context2(&outs[b].ctx, nullptr, nullptr, outs[b].path.c_str()) < 0) {
+            DebugLog("Failed to allocate output context for " + outs[b].path, true);
+            success = false;
+            goto cleanup;
+        }
+        if (branches[b].audio == ExportBranch::Audio::Merge) {
+            needMerge = true;
+            mergeGlobalHeader |= (outs[b].ctx->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+        }
+    }
+
+    // Shared decode state: one video decoder and one audio mix for all
+    // branches that need them.
+    for (const auto& br : branches) {
+        if (br.video != ExportBranch::Video::H264 || !vIn || vDecCtx)
+            continue;
+        const AVCodec* dec = avcodec_find_decoder(vIn->codecpar->codec_id);
+        vDecCtx = avcodec_alloc_context3(dec);
+        if (!dec || !vDecCtx ||
+            avcodec_parameters_to_context(vDecCtx, vIn->codecpar) < 0 ||
+            avcodec_open2(vDecCtx, dec, nullptr) < 0) {
+            DebugLog("Failed to open video decoder", true);
+            success = false;
+            goto cleanup;
+        }
+        decFrame = av_frame_alloc();
+        vEnc = options.useNvenc ? avcodec_find_encoder_by_name("h264_nvenc")
+                                : avcodec_find_encoder(AV_CODEC_ID_H264);
+        if (!decFrame || !vEnc) {
+            DebugLog(vEnc ? "Failed to allocate frames" : "H.264 encoder not found", true);
+            success = false;
+            goto cleanup;
+        }
+    }
+    if (needMerge) {
+        for (int idx : activeTracks) {
+            MergeTrack mt;
+            if (OpenMergeTrack(inputCtx->streams[idx], idx, mt)) {
+                mergeTracks.push_back(std::move(mt));
+            } else {
+                FreeMergeTrack(mt);
+                LOG_WARN("Skipping audio track that could not be decoded: " << idx);
             }
-            AVFrame* af = av_frame_alloc();
-            af->nb_samples = encFrameSamples;
-            av_channel_layout_copy(&af->ch_layout, &aEncCtx->ch_layout);
-            af->format = aEncCtx->sample_fmt;
-            af->sample_rate = aEncCtx->sample_rate;
-            if (av_frame_get_buffer(af, 0) < 0) {
-                DebugLog("Failed to allocate audio frame buffer", true);
-                av_frame_free(&af);
+        }
+        if (!mergeTracks.empty() &&
+            !OpenMergedAudio(merged, (int)mergeTracks.size(), endTime - startTime, mergeGlobalHeader)) {
+            success = false;
+            goto cleanup;
+        }
+    }
+
+    for (size_t b = 0; b < branches.size(); ++b) {
+        const ExportBranch& br = branches[b];
+        AVFormatContext* ctx = outs[b].ctx;
+        bool globalHeader = (ctx->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+
+        if (br.video == ExportBranch::Video::Copy && vIn) {
+            AVStream* st = avformat_new_stream(ctx, nullptr);
+            if (!st || avcodec_parameters_copy(st->codecpar, vIn->codecpar) < 0) {
+                DebugLog("Failed to copy codec parameters", true);
                 success = false;
                 goto cleanup;
             }
-            const uint8_t* inBuf[1] = { (const uint8_t*)mixBuffer.data() };
-            if (swr_convert(mixSwr, af->data, encFrameSamples, inBuf, encFrameSamples) < 0) {
-                DebugLog("Failed to convert mixed samples", true);
-                av_frame_free(&af);
+            st->codecpar->codec_tag = 0;
+            st->time_base = vIn->time_base;
+            videoCopyTargets.push_back({ ctx, st->index });
+        } else if (br.video == ExportBranch::Video::H264 && vDecCtx) {
+            int srcW = vIn->codecpar->width;
+            int srcH = vIn->codecpar->height;
+            int height = (br.height > 0 && br.height < srcH) ? br.height & ~1 : srcH;
+            int width = height == srcH ? srcW : (int)((int64_t)srcW * height / srcH) & ~1;
+            int kbps = br.videoKbps > 0 ? br.videoKbps : defaultKbps;
+
+            int scaler = -1;
+            for (size_t i = 0; i < scalers.size(); ++i)
+                if (scalers[i].width == width && scalers[i].height == height)
+                    scaler = (int)i;
+            if (scaler < 0) {
+                BranchScaler sc;
+                sc.width = width;
+                sc.height = height;
+                sc.frame = av_frame_alloc();
+                scalers.push_back(sc);
+                scaler = (int)scalers.size() - 1;
+                if (!sc.frame) {
+                    DebugLog("Failed to allocate frames", true);
+                    success = false;
+                    goto cleanup;
+                }
+            }
+            int encoder = -1;
+            for (size_t i = 0; i < encoders.size(); ++i)
+                if (encoders[i].scaler == scaler && encoders[i].kbps == kbps &&
+                    encoders[i].globalHeader == globalHeader)
+                    encoder = (int)i;
+            if (encoder < 0) {
+                BranchEncoder enc;
+                enc.scaler = scaler;
+                enc.kbps = kbps;
+                enc.globalHeader = globalHeader;
+                enc.ctx = OpenH264Encoder(vEnc, vIn, kbps, options.useNvenc, globalHeader,
+                                          false, false, 0, std::string(), width, height);
+                encoders.push_back(enc);
+                encoder = (int)encoders.size() - 1;
+                if (!enc.ctx) {
+                    DebugLog("Failed to open H.264 encoder", true);
+                    success = false;
+                    goto cleanup;
+                }
+                LOG_INFO("Branch encoder " << encoder << ": " << width << "x" << height
+                         << " " << kbps << "kbps");
+            }
+            AVStream* st = avformat_new_stream(ctx, nullptr);
+            if (!st || avcodec_parameters_from_context(st->codecpar, encoders[encoder].ctx) < 0) {
+                DebugLog("Failed to copy encoder parameters", true);
                 success = false;
                 goto cleanup;
             }
-            af->pts = audioPts;
-            audioPts += encFrameSamples;
-            avcodec_send_frame(aEncCtx, af);
-            while (avcodec_receive_packet(aEncCtx, &outPkt) == 0) {
-                av_packet_rescale_ts(&outPkt, aEncCtx->time_base, outputCtx->streams[mergedAudioIndex]->time_base);
-                outPkt.stream_index = mergedAudioIndex;
-                av_interleaved_write_frame(outputCtx, &outPkt);
-                av_packet_unref(&outPkt);
+            st->time_base = encoders[encoder].ctx->time_base;
+            encoders[encoder].targets.push_back({ ctx, st->index });
+        }
+
+        if (br.audio == ExportBranch::Audio::Copy) {
+            for (int idx : activeTracks) {
+                AVStream* in = inputCtx->streams[idx];
+                AVStream* st = avformat_new_stream(ctx, nullptr);
+                if (!st || avcodec_parameters_copy(st->codecpar, in->codecpar) < 0) {
+                    DebugLog("Failed to copy codec parameters", true);
+                    success = false;
+                    goto cleanup;
+                }
+                st->codecpar->codec_tag = 0;
+                st->time_base = in->time_base;
+                audioCopyTargets[idx].push_back({ ctx, st->index });
             }
-            av_frame_free(&af);
+        } else if (br.audio == ExportBranch::Audio::Merge && merged.enc) {
+            AVStream* st = avformat_new_stream(ctx, nullptr);
+            if (!st || avcodec_parameters_from_context(st->codecpar, merged.enc) < 0) {
+                DebugLog("Failed to copy AAC encoder parameters", true);
+                success = false;
+                goto cleanup;
+            }
+            st->time_base = merged.enc->time_base;
+            mergedTargets.push_back({ ctx, st->index });
         }
-        avcodec_send_frame(aEncCtx, nullptr);
-        while (avcodec_receive_packet(aEncCtx, &outPkt) == 0) {
-            av_packet_rescale_ts(&outPkt, aEncCtx->time_base, outputCtx->streams[mergedAudioIndex]->time_base);
-            outPkt.stream_index = mergedAudioIndex;
-            av_interleaved_write_frame(outputCtx, &outPkt);
-            av_packet_unref(&outPkt);
+    }
+
+    for (auto& out : outs) {
+        if (out.ctx->nb_streams == 0) {
+            LOG_WARN("Skipping " << out.path << ": nothing to write");
+            continue;
+        }
+        if (!OpenOutputIO(out.ctx, out.path,
+                          EstimateOutputBytes(out.ctx, inputCtx->bit_rate, endTime - startTime))) {
+            DebugLog("Could not open output file " + out.path, true);
+            success = false;
+            goto cleanup;
+        }
+        if (avformat_write_header(out.ctx, nullptr) < 0) {
+            DebugLog("Failed to write header for " + out.path, true);
+            success = false;
+            goto cleanup;
+        }
+        out.headerWritten = true;
+        ++openOutputs;
+    }
+    if (openOutputs == 0) {
+        DebugLog("Fan-out export has no streams to write", true);
+        success = false;
+        goto cleanup;
+    }
+
+    if (av_seek_frame(inputCtx, -1, startPts, AVSEEK_FLAG_BACKWARD) < 0) {
+        DebugLog("Seek failed", true);
+    }
+
+    clock.Restart();
+    while (av_read_frame(inputCtx, &pkt) >= 0) {
+        clock.Lap(ExportStage::Demux);
+        if (cancelFlag && *cancelFlag) { av_packet_unref(&pkt); success = false; goto cleanup; }
+        AVStream* inStream = inputCtx->streams[pkt.stream_index];
+        int64_t pktPtsUs = av_rescale_q(pkt.pts, inStream->time_base, AV_TIME_BASE_Q);
+        bool beforeStart = pktPtsUs < startPts;
+        if (beforeStart && !(pkt.stream_index == videoIndex && vDecCtx)) { av_packet_unref(&pkt); continue; }
+        if (pktPtsUs > endPts) { av_packet_unref(&pkt); break; }
+        int64_t offset = av_rescale_q(startPts, AV_TIME_BASE_Q, inStream->time_base);
+
+        if (pkt.stream_index == videoIndex) {
+            if (vDecCtx) {
+                // Decoding starts at the keyframe before the cut; frames
+                // ahead of it are dropped once decoded.
+                avcodec_send_packet(vDecCtx, &pkt);
+                while (avcodec_receive_frame(vDecCtx, decFrame) == 0) {
+                    clock.Lap(ExportStage::Decode);
+                    int64_t pts = decFrame->pts - offset;
+                    if (decFrame->pts != AV_NOPTS_VALUE && pts < 0) {
+                        av_frame_unref(decFrame);
+                        continue;
+                    }
+                    for (auto& sc : scalers) {
+                        if (!ScaleBranchFrame(sc, decFrame)) {
+                            av_frame_unref(decFrame);
+                            av_packet_unref(&pkt);
+                            success = false;
+                            goto cleanup;
+                        }
+                    }
+                    clock.Lap(ExportStage::Scale);
+                    // Source frame types must not force the encoders' GOP.
+                    decFrame->pict_type = AV_PICTURE_TYPE_NONE;
+                    for (auto& enc : encoders) {
+                        BranchScaler& sc = scalers[enc.scaler];
+                        AVFrame* f = sc.passthrough ? decFrame : sc.frame;
+                        f->pts = pts;
+                        EncodeToTargets(enc.ctx, f, enc.targets, &outPkt, &refPkt, clock, ExportStage::Encode);
+                    }
+                    if (stats)
+                        stats->AddFrames(1);
+                    av_frame_unref(decFrame);
+                }
+                clock.Lap(ExportStage::Decode);
+            } else if (stats) {
+                stats->AddFrames(1);
+            }
+            if (!videoCopyTargets.empty() && !beforeStart) {
+                ShiftPacket(&pkt, offset);
+                WritePacket(&pkt, inStream->time_base, videoCopyTargets, &refPkt);
+                clock.Lap(ExportStage::Mux);
+            }
+        } else {
+            for (size_t t = 0; t < mergeTracks.size(); ++t) {
+                if (mergeTracks[t].index == pkt.stream_index && merged.mixer) {
+                    DecodeMergeTrack(mergeTracks[t], *merged.mixer, (int)t, &pkt,
+                                     inStream, startPts);
+                    clock.Lap(ExportStage::Audio);
+                    break;
+                }
+            }
+            if (pkt.stream_index < (int)audioCopyTargets.size() &&
+                !audioCopyTargets[pkt.stream_index].empty()) {
+                ShiftPacket(&pkt, offset);
+                WritePacket(&pkt, inStream->time_base, audioCopyTargets[pkt.stream_index], &refPkt);
+                clock.Lap(ExportStage::Mux);
+            }
+        }
+        av_packet_unref(&pkt);
+
+        if (merged.mixer) {
+            while ((mixed = EncodeMixedBlock(merged, false, mergedTargets, &outPkt, &refPkt, clock)) > 0) {}
+            if (mixed < 0) { success = false; goto cleanup; }
+        }
+
+        if (stats) {
+            double progress = (pktPtsUs - startPts) / double(endPts - startPts);
+            stats->SetProgress(progress, progress);
+            int64_t bytes = 0;
+            for (const auto& out : outs)
+                if (out.headerWritten && out.ctx->pb)
+                    bytes += avio_tell(out.ctx->pb);
+            stats->SetOutputBytes(bytes);
         }
     }
 
+    LOG_DEBUG("Flushing encoders");
+    for (auto& enc : encoders)
+        EncodeToTargets(enc.ctx, nullptr, enc.targets, &outPkt, &refPkt, clock, ExportStage::Encode);
+    if (merged.mixer) {
+        merged.mixer->FinishAll();
+        while (true) {
+            if (cancelFlag && *cancelFlag) { success = false; goto cleanup; }
+            mixed = EncodeMixedBlock(merged, true, mergedTargets, &outPkt, &refPkt, clock);
+            if (mixed < 0) { success = false; goto cleanup; }
+            if (mixed == 0) break;
+        }
+        LogMixStats(*merged.mixer);
+        EncodeToTargets(merged.enc, nullptr, mergedTargets, &outPkt, &refPkt, clock, ExportStage::Audio);
+    }
+
 cleanup:
-    DebugLog("Entering cleanup");
-    if (headerWritten)
-        av_write_trailer(outputCtx);
-    if (!(outputCtx->oformat->flags & AVFMT_NOFILE))
-        avio_closep(&outputCtx->pb);
-    if (vEncCtx) avcodec_free_context(&vEncCtx);
+    LOG_DEBUG("Entering fan-out cleanup");
+    int64_t totalBytes = 0;
+    for (auto& out : outs) {
+        if (!out.ctx)
+            continue;
+        if (out.headerWritten) {
+            av_write_trailer(out.ctx);
+            if (out.ctx->pb)
+                totalBytes += avio_tell(out.ctx->pb);
+        }
+        if (!CloseOutputIO(out.ctx))
+            success = false;
+        avformat_free_context(out.ctx);
+    }
+    for (auto& enc : encoders)
+        if (enc.ctx) avcodec_free_context(&enc.ctx);
+    for (auto& sc : scalers) {
+        if (sc.sws) sws_freeContext(sc.sws);
+        if (sc.frame) av_frame_free(&sc.frame);
+    }
     if (vDecCtx) avcodec_free_context(&vDecCtx);
-    if (swsCtx) sws_freeContext(swsCtx);
-    if (encFrame) av_frame_free(&encFrame);
     if (decFrame) av_frame_free(&decFrame);
-    if (aEncCtx) avcodec_free_context(&aEncCtx);
-    if (mixSwr) swr_free(&mixSwr);
-    for (auto &mt : mergeTracks) {
-        if (mt.swrCtx) swr_free(&mt.swrCtx);
-        if (mt.decCtx) avcodec_free_context(&mt.decCtx);
-        if (mt.frame) av_frame_free(&mt.frame);
-    }
-    avformat_free_context(outputCtx);
-    avformat_close_input(&inputCtx);
-
-    if (progressBar && IsWindow(progressBar))
-        SendMessage(progressBar, PBM_SETPOS, 100, 0);
+    FreeMergedAudio(merged);
+    FreeMergeTracks(mergeTracks);
+    CloseMediaInput(&inputCtx);
 
-    DebugLog("CutVideo finished");
+    clock.Lap(ExportStage::Mux);
+    if (stats && success) {
+        stats->SetOutputBytes(totalBytes);
+        stats->EndPass();
+    }
 
+    LOG_INFO("Fan-out export " << (success ? "finished" : "failed"));
     return success;
 }
@@ -1,18 +1,51 @@
 #pragma once
 
-#include "video_player.h"
+#include "media_source.h"
+#include "export_options.h"
+#include "export_stats.h"
+#include <atomic>
+#include <vector>
 
-class VideoPlayer;
+struct SegmentOutput;
 
+// Cuts and exports ranges of a file described by a MediaInfo; the unmuted
+// audio tracks are copied or merged. Opens its own demuxer, so a player can
+// keep using the same file.
 class VideoCutter {
 public:
-    VideoCutter(VideoPlayer* player);
+    explicit VideoCutter(const MediaInfo& source);
     ~VideoCutter();
 
-    bool CutVideo(const std::wstring& outputFilename, double startTime, double endTime,
-                  bool mergeAudio, bool convertH264, bool useNvenc,
-                  int maxBitrate, HWND progressBar, std::atomic<bool>* cancelFlag);
+    bool CutVideo(const std::wstring& outputFilename, const ExportOptions& options,
+                  ExportStats* stats, std::atomic<bool>* cancelFlag);
+
+    // Decodes the range once and writes every branch from it.
+    bool ExportBranches(const std::vector<ExportBranch>& branches, const ExportOptions& options,
+                        ExportStats* stats, std::atomic<bool>* cancelFlag);
+
+    const TargetSizeReport& GetTargetSizeReport() const { return m_targetReport; }
 
 private:
-    VideoPlayer* m_player;
+    enum class RatePass { Single, First, Second };
+
+    bool Transcode(const std::wstring& outputFilename, const ExportOptions& options,
+                   int videoKbps, RatePass pass, const std::string& statsPath,
+                   double progressBase, double progressSpan,
+                   ExportStats* stats, std::atomic<bool>* cancelFlag,
+                   SegmentOutput* segments = nullptr);
+    // Re-encodes into checkpointed segments under LocalDataDir(), continuing
+    // after the last finished one if an earlier run was interrupted.
+    bool ResumableTranscode(const std::wstring& outputFilename, const ExportOptions& options,
+                            ExportStats* stats, std::atomic<bool>* cancelFlag);
+    bool RunFirstPass(const ExportOptions& options, int videoKbps, bool globalHeader,
+                      const std::string& statsPath, double progressSpan,
+                      ExportStats* stats, std::atomic<bool>* cancelFlag);
+    int EstimateAudioKbps(bool mergeAudio) const;
+    std::wstring FirstPassStatsPath(const ExportOptions& options) const;
+    // Names the segment folder; empty if the source cannot be read.
+    std::string ResumeKey(const ExportOptions& options, const std::string& extension) const;
+
+    MediaInfo m_source;
+    TargetSizeReport m_targetReport;
+    bool m_statsRejected = false;   // the last Transcode could not open x264 on its stats
 };
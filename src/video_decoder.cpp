@@ -2,6 +2,7 @@
 #include "video_player.h"
 #include "audio_player.h"
 #include "video_renderer.h"
+#include "trace.h"
 
 VideoDecoder::VideoDecoder(VideoPlayer* player) : m_player(player) {}
 
@@ -124,12 +125,18 @@ void VideoDecoder::Cleanup() {
 bool VideoDecoder::DecodeNextFrame(bool updateDisplay) {
     if (!m_player->isLoaded)
         return false;
+    TRACE_SCOPE("DecodeNextFrame", "playback");
 
     std::unique_lock<std::mutex> lock(m_player->decodeMutex);
+    auto decodeStart = std::chrono::steady_clock::now();
 
     while (true)
     {
-        int ret = av_read_frame(m_player->formatContext, m_player->packet);
+        int ret;
+        {
+            TRACE_SCOPE("Read packet", "playback");
+            ret = m_player->packetCache.Read(m_player->packet);
+        }
         if (ret < 0)
         {
             m_player->Stop();
@@ -138,14 +145,20 @@ bool VideoDecoder::DecodeNextFrame(bool updateDisplay) {
 
         if (m_player->packet->stream_index == m_player->videoStreamIndex)
         {
-            ret = avcodec_send_packet(m_player->codecContext, m_player->packet);
+            {
+                TRACE_SCOPE("avcodec_send_packet", "playback");
+                ret = avcodec_send_packet(m_player->codecContext, m_player->packet);
+            }
             av_packet_unref(m_player->packet);
             if (ret < 0)
                 continue;
 
             while (true)
             {
-                ret = avcodec_receive_frame(m_player->codecContext, m_player->hwFrame);
+                {
+                    TRACE_SCOPE("avcodec_receive_frame", "playback");
+                    ret = avcodec_receive_frame(m_player->codecContext, m_player->hwFrame);
+                }
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
                     break;
                 if (ret < 0)
@@ -154,6 +167,7 @@ bool VideoDecoder::DecodeNextFrame(bool updateDisplay) {
                 AVFrame* swFrame = m_player->hwFrame;
                 if (m_player->useHwAccel && m_player->hwFrame->format == m_player->hwPixelFormat)
                 {
+                    TRACE_SCOPE("av_hwframe_transfer_data", "playback");
                     if (av_hwframe_transfer_data(m_player->frame, m_player->hwFrame, 0) < 0)
                         return false;
                     swFrame = m_player->frame;
@@ -171,11 +185,19 @@ bool VideoDecoder::DecodeNextFrame(bool updateDisplay) {
                 if (m_player->currentPts < 0.0)
                     m_player->currentPts = 0.0;
                 m_player->currentFrame++;
-                sws_scale(
-                    m_player->swsContext,
-                    (uint8_t const *const *)swFrame->data, swFrame->linesize,
-                    0, m_player->frameHeight,
-                    m_player->frameRGB->data, m_player->frameRGB->linesize);
+                {
+                    TRACE_SCOPE("sws_scale", "playback");
+                    sws_scale(
+                        m_player->swsContext,
+                        (uint8_t const *const *)swFrame->data, swFrame->linesize,
+                        0, m_player->frameHeight,
+                        m_player->frameRGB->data, m_player->frameRGB->linesize);
+                }
+                if (m_player->isPlaying)
+                    m_player->playbackStats.OnFrameDecoded(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - decodeStart).count(),
+                        m_player->currentPts);
 
                 av_frame_unref(m_player->hwFrame);
                 if (swFrame != m_player->hwFrame)
@@ -3,7 +3,14 @@
 #include "audio_player.h"
 #include "video_renderer.h"
 #include "video_cutter.h"
+#include "seek_prefetch.h"
+#include "scrub_decoder.h"
+#include "proxy_job.h"
+#include "proxy_build.h"
 #include "options_window.h"
+#include "media_input.h"
+#include "platform.h"
+#include "debug_log.h"
 #include <iostream>
 #include <windows.h>
 #include <d2d1.h>
@@ -26,16 +33,20 @@ VideoPlayer::VideoPlayer(HWND parent)
       audioInitialized(false), audioThreadRunning(false),
       playbackThreadRunning(false),
       audioSampleRate(44100), audioChannels(2), audioSampleFormat(AV_SAMPLE_FMT_S16),
-      originalVideoWndProc(nullptr)
+      showStatsOverlay(false), isScrubbing(false), scrubTime(0.0), originalVideoWndProc(nullptr)
 {
     m_decoder = std::make_unique<VideoDecoder>(this);
     m_audioPlayer = std::make_unique<AudioPlayer>(this);
     m_renderer = std::make_unique<VideoRenderer>(this);
-    m_cutter = std::make_unique<VideoCutter>(this);
+    m_cutter = std::make_unique<VideoCutter>(MediaInfo());
+    m_prefetcher = std::make_unique<SeekPrefetcher>(this);
+    m_scrubber = std::make_unique<ScrubDecoder>(this);
+    m_proxyJob = std::make_unique<ProxyJob>(this);
 
-    m_renderer->Initialize();
+    // The render target is made with the first frame and the audio device
+    // opens in the background, so neither delays the first paint.
     CreateVideoWindow();
-    m_audioPlayer->Initialize();
+    m_audioPlayer->StartDeviceInit();
 }
 
 VideoPlayer::~VideoPlayer()
@@ -72,27 +83,31 @@ void VideoPlayer::CreateVideoWindow()
         SetWindowLongPtr(videoWindow, GWLP_USERDATA, (LONG_PTR)this);
         originalVideoWndProc = (WNDPROC)SetWindowLongPtr(videoWindow, GWLP_WNDPROC, (LONG_PTR)VideoWindowProc);
         SetWindowTheme(videoWindow, L"DarkMode_Explorer", nullptr);
-        m_renderer->CreateRenderTarget();
     }
 }
 
 bool VideoPlayer::LoadVideo(const std::wstring &filename)
 {
     UnloadVideo();
-    loadedFilename = filename;
+    if (!OpenPlayback(filename, filename))
+        return false;
+    if (WantsProxy(formatContext->streams[videoStreamIndex]->codecpar))
+        m_proxyJob->Start(filename);
+    return true;
+}
+
+bool VideoPlayer::OpenPlayback(const std::wstring &source, const std::wstring &path)
+{
+    loadedFilename = source;
+    playbackFilename = path;
+    playbackStats.Reset();
 
-    int bufSize = WideCharToMultiByte(CP_UTF8, 0, filename.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    int bufSize = WideCharToMultiByte(CP_UTF8, 0, path.c_str(), -1, nullptr, 0, nullptr, nullptr);
     std::string utf8Filename(bufSize, 0);
-    WideCharToMultiByte(CP_UTF8, 0, filename.c_str(), -1, &utf8Filename[0], bufSize, nullptr, nullptr);
+    WideCharToMultiByte(CP_UTF8, 0, path.c_str(), -1, &utf8Filename[0], bufSize, nullptr, nullptr);
 
-    formatContext = avformat_alloc_context();
-    if (avformat_open_input(&formatContext, utf8Filename.c_str(), nullptr, nullptr) < 0)
+    if (OpenMediaInput(&formatContext, utf8Filename.c_str()) < 0)
         return false;
-    if (avformat_find_stream_info(formatContext, nullptr) < 0)
-    {
-        avformat_close_input(&formatContext);
-        return false;
-    }
 
     videoStreamIndex = -1;
     for (unsigned i = 0; i < formatContext->nb_streams; i++)
@@ -105,13 +120,14 @@ bool VideoPlayer::LoadVideo(const std::wstring &filename)
     }
     if (videoStreamIndex < 0)
     {
-        avformat_close_input(&formatContext);
+        CloseMediaInput(&formatContext);
         return false;
     }
+    packetCache.Attach(formatContext, videoStreamIndex);
 
     if (!m_decoder->Initialize())
     {
-        UnloadVideo();
+        ClosePlayback();
         return false;
     }
 
@@ -131,7 +147,8 @@ bool VideoPlayer::LoadVideo(const std::wstring &filename)
     if (minStart != std::numeric_limits<double>::max())
         startTimeOffset = minStart;
 
-    // Initialize audio tracks
+    // Tracks resample to the device rate, so the device has to be open.
+    m_audioPlayer->WaitForDevice();
     if (!m_audioPlayer->InitializeTracks())
     {
         std::cout << "Warning: Failed to initialize audio tracks" << std::endl;
@@ -166,17 +183,32 @@ bool VideoPlayer::LoadVideo(const std::wstring &filename)
     else
         duration = 0.0;
     currentPts = 0.0;
+
+    // Show the first frame right away instead of a black area until Play.
+    m_renderer->Render();
     return true;
 }
 
 void VideoPlayer::UnloadVideo()
 {
+    m_proxyJob->Stop();
+    ClosePlayback();
+}
+
+void VideoPlayer::ClosePlayback()
+{
+    // The prefetch thread inserts into packetCache; end it before Stop and
+    // Clear touch the cache.
+    m_prefetcher->Stop();
     Stop();
+    m_scrubber->Stop();
+    isScrubbing = false;
     m_audioPlayer->CleanupTracks();
     m_decoder->Cleanup();
+    packetCache.Clear();
     if (formatContext)
     {
-        avformat_close_input(&formatContext);
+        CloseMediaInput(&formatContext);
         formatContext = nullptr;
     }
     isLoaded = false;
@@ -192,9 +224,14 @@ bool VideoPlayer::Play()
     if (!isLoaded || isPlaying)
         return false;
     isPlaying = true;
+    m_proxyJob->SetHold(true);
+    m_prefetcher->Cancel();
+    m_scrubber->Cancel();
+    isScrubbing = false;
 
     masterStartPts = currentPts;
     masterStartTime = std::chrono::high_resolution_clock::now();
+    playbackStats.OnPlay();
 
     m_audioPlayer->StartThread();
     playbackThreadRunning = true;
@@ -204,6 +241,7 @@ bool VideoPlayer::Play()
 
 void VideoPlayer::Pause()
 {
+    m_proxyJob->SetHold(false);
     if (isPlaying)
     {
         isPlaying = false;
@@ -227,11 +265,16 @@ void VideoPlayer::Pause()
 void VideoPlayer::Stop()
 {
     Pause();
+    m_prefetcher->Cancel();
+    m_scrubber->Cancel();
     currentFrame = 0;
     currentPts = 0.0;
     if (isLoaded)
     {
-        av_seek_frame(formatContext, videoStreamIndex, 0, AVSEEK_FLAG_FRAME);
+        std::lock_guard<std::mutex> decodeLock(decodeMutex);
+        AVStream *vs = formatContext->streams[videoStreamIndex];
+        packetCache.Seek(videoStreamIndex, vs->start_time != AV_NOPTS_VALUE ? vs->start_time : 0,
+                         AVSEEK_FLAG_BACKWARD);
         avcodec_flush_buffers(codecContext);
         
         // Flush audio codec buffers
@@ -261,6 +304,9 @@ void VideoPlayer::SeekToTime(double seconds)
 {
     if (!isLoaded)
         return;
+    m_prefetcher->Cancel();
+    m_scrubber->Cancel();
+    isScrubbing = false;
 
     {
         std::lock_guard<std::mutex> lock(decodeMutex);
@@ -271,8 +317,7 @@ void VideoPlayer::SeekToTime(double seconds)
         // Seek directly to the requested timestamp. AVSEEK_FLAG_ANY allows seeking
         // to non-keyframes so the timeline jumps exactly where the user clicked
         // without having to decode many frames.
-        av_seek_frame(formatContext, videoStreamIndex, ts,
-                        AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY);
+        packetCache.Seek(videoStreamIndex, ts, AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY);
         avcodec_flush_buffers(codecContext);
         for (auto &track : audioTracks)
         {
@@ -299,6 +344,53 @@ void VideoPlayer::SeekToTime(double seconds)
     }
 }
 
+void VideoPlayer::ScrubTo(double seconds)
+{
+    if (!isLoaded || isPlaying)
+        return;
+    if (m_scrubber->Failed())
+    {
+        SeekToTime(seconds);
+        return;
+    }
+    m_prefetcher->Cancel();
+    isScrubbing = true;
+    scrubTime = seconds;
+    m_scrubber->Show(seconds);
+}
+
+void VideoPlayer::EndScrub(double seconds)
+{
+    if (!isLoaded)
+        return;
+    bool scrubbed = isScrubbing;
+    isScrubbing = false;
+    // Released on the frame the playback decoder last showed, it carries
+    // on from there and the scrub decoder draws that frame again.
+    double frameTime = frameRate > 0 ? 1.0 / frameRate : 0.0;
+    if (scrubbed && !isPlaying && !m_scrubber->Failed() &&
+        seconds >= currentPts && seconds < currentPts + frameTime)
+    {
+        m_scrubber->Show(seconds);
+        return;
+    }
+    SeekToTime(seconds);
+}
+
+void VideoPlayer::PrefetchAt(double seconds)
+{
+    if (isLoaded && !isPlaying)
+    {
+        m_prefetcher->Request(seconds);
+        m_scrubber->Warm(seconds);
+    }
+}
+
+void VideoPlayer::CancelPrefetch()
+{
+    m_prefetcher->Cancel();
+}
+
 double VideoPlayer::GetDuration() const
 {
     return isLoaded ? duration : 0.0;
@@ -306,7 +398,7 @@ double VideoPlayer::GetDuration() const
 
 double VideoPlayer::GetCurrentTime() const
 {
-    return currentPts;
+    return isScrubbing ? scrubTime : currentPts;
 }
 
 void VideoPlayer::SetPosition(int x, int y, int width, int height)
@@ -374,6 +466,13 @@ void VideoPlayer::SetMasterVolume(float volume)
     m_audioPlayer->SetMasterVolume(volume);
 }
 
+void VideoPlayer::SetStatsOverlayVisible(bool visible)
+{
+    showStatsOverlay = visible;
+    if (videoWindow)
+        InvalidateRect(videoWindow, nullptr, FALSE);
+}
+
 void VideoPlayer::PlaybackThreadFunction()
 {
     auto startTime = masterStartTime;
@@ -386,18 +485,134 @@ void VideoPlayer::PlaybackThreadFunction()
         double target = currentPts - startPts;
         double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
         double delay = target - elapsed;
+        playbackStats.SetVideoLead(delay);
+        if (frameRate > 0 && delay < -1.0 / frameRate)
+            playbackStats.OnFrameLate();
+        playbackStats.Tick();
         if (delay > 0)
             std::this_thread::sleep_for(std::chrono::duration<double>(delay));
     }
+    playbackStats.OnPause();
     isPlaying = false;
+    m_proxyJob->SetHold(false);
+}
+
+// Reopens playback on the proxy where the source was, keeping the track
+// mute and volume settings, and carries on playing if it was.
+void VideoPlayer::OnProxyReady()
+{
+    std::wstring proxy = m_proxyJob->ReadyPath();
+    if (!isLoaded || proxy.empty() || proxy == playbackFilename)
+        return;
+    std::wstring source = loadedFilename;
+    double at = currentPts;
+    bool wasPlaying = isPlaying;
+    std::vector<std::pair<bool, float>> trackStates;
+    for (const auto& track : audioTracks)
+        trackStates.emplace_back(track->isMuted, track->volume);
+
+    ClosePlayback();
+    if (!OpenPlayback(source, proxy))
+    {
+        LOG_WARN("Could not open the proxy " << ToUtf8(proxy) << ", staying on the source");
+        ClosePlayback();
+        if (!OpenPlayback(source, source))
+            return;
+    }
+    else
+    {
+        LOG_INFO("Playing " << ToUtf8(source) << " through its proxy");
+    }
+    if (trackStates.size() == audioTracks.size())
+    {
+        for (size_t i = 0; i < audioTracks.size(); ++i)
+        {
+            audioTracks[i]->isMuted = trackStates[i].first;
+            audioTracks[i]->volume = trackStates[i].second;
+        }
+    }
+    SeekToTime(at);
+    if (wasPlaying)
+        Play();
 }
 
-bool VideoPlayer::CutVideo(const std::wstring &outputFilename, double startTime,
-                           double endTime, bool mergeAudio, bool convertH264,
-                           bool useNvenc, int maxBitrate, HWND progressBar,
-                           std::atomic<bool>* cancelFlag)
+bool VideoPlayer::CutVideo(const std::wstring &outputFilename, const ExportOptions &options,
+                           ExportStats* stats, std::atomic<bool>* cancelFlag)
+{
+    m_cutter = std::make_unique<VideoCutter>(DescribeMedia());
+    return m_cutter->CutVideo(outputFilename, options, stats, cancelFlag);
+}
+
+bool VideoPlayer::ExportBranches(const std::vector<ExportBranch> &branches, const ExportOptions &options,
+                                 ExportStats* stats, std::atomic<bool>* cancelFlag)
+{
+    m_cutter = std::make_unique<VideoCutter>(DescribeMedia());
+    return m_cutter->ExportBranches(branches, options, stats, cancelFlag);
+}
+
+const TargetSizeReport &VideoPlayer::GetTargetSizeReport() const
 {
-    return m_cutter->CutVideo(outputFilename, startTime, endTime, mergeAudio, convertH264, useNvenc, maxBitrate, progressBar, cancelFlag);
+    return m_cutter->GetTargetSizeReport();
+}
+
+MediaInfo VideoPlayer::DescribeMedia() const
+{
+    MediaInfo info;
+    if (!isLoaded)
+        return info;
+    info.filename = loadedFilename;
+    info.videoStreamIndex = videoStreamIndex;
+    info.frameWidth = frameWidth;
+    info.frameHeight = frameHeight;
+    info.frameRate = frameRate;
+    info.duration = duration;
+    for (const auto& track : audioTracks)
+    {
+        MediaTrackInfo t;
+        t.streamIndex = track->streamIndex;
+        t.name = track->name;
+        t.bitRate = formatContext->streams[track->streamIndex]->codecpar->bit_rate;
+        t.isMuted = track->isMuted;
+        info.audioTracks.push_back(t);
+    }
+    if (!IsUsingProxy())
+        return info;
+
+    // The cutter reads the source, not the proxy: the video stream, frame
+    // size and bit rates come from it, and audio tracks match in order.
+    AVFormatContext *src = nullptr;
+    if (OpenMediaInput(&src, ToUtf8(loadedFilename)) < 0)
+        return MediaInfo();
+    std::vector<int> sourceAudio;
+    info.videoStreamIndex = -1;
+    for (unsigned i = 0; i < src->nb_streams; ++i)
+    {
+        AVCodecParameters *cp = src->streams[i]->codecpar;
+        if (cp->codec_type == AVMEDIA_TYPE_VIDEO && info.videoStreamIndex < 0)
+        {
+            info.videoStreamIndex = i;
+            info.frameWidth = cp->width;
+            info.frameHeight = cp->height;
+        }
+        else if (cp->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            sourceAudio.push_back(i);
+        }
+    }
+    for (auto& t : info.audioTracks)
+    {
+        size_t rank = 0;
+        for (int i = 0; i < t.streamIndex; ++i)
+        {
+            if (formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+                ++rank;
+        }
+        t.streamIndex = rank < sourceAudio.size() ? sourceAudio[rank] : -1;
+        if (t.streamIndex >= 0)
+            t.bitRate = src->streams[t.streamIndex]->codecpar->bit_rate;
+    }
+    CloseMediaInput(&src);
+    return info;
 }
 
 LRESULT CALLBACK VideoPlayer::VideoWindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -414,6 +629,11 @@ LRESULT CALLBACK VideoPlayer::VideoWindowProc(HWND hwnd, UINT msg, WPARAM wParam
         {
             return 1;
         }
+        else if (msg == (WM_APP + 2)) // WM_APP_PROXY_READY
+        {
+            player->OnProxyReady();
+            return 0;
+        }
         return CallWindowProc(player->originalVideoWndProc, hwnd, msg, wParam, lParam);
     }
     return DefWindowProc(hwnd, msg, wParam, lParam);
@@ -37,10 +37,19 @@ extern "C"
 #include <audioclient.h>
 #include <audiopolicy.h>
 
+#include "export_options.h"
+#include "export_stats.h"
+#include "media_source.h"
+#include "packet_cache.h"
+#include "playback_stats.h"
+
 class VideoDecoder;
 class AudioPlayer;
 class VideoRenderer;
 class VideoCutter;
+class SeekPrefetcher;
+class ScrubDecoder;
+class ProxyJob;
 
 // Audio track structure
 struct AudioTrack {
@@ -64,10 +73,13 @@ class VideoPlayer
     friend class VideoDecoder;
     friend class AudioPlayer;
     friend class VideoRenderer;
-    friend class VideoCutter;
+    friend class SeekPrefetcher;
+    friend class ScrubDecoder;
+    friend class ProxyJob;
 
 public:
     AVFormatContext *formatContext;
+    PacketCache packetCache; // reads and seeks of formatContext go through it
     AVCodecContext *codecContext;
     AVFrame *frame;
     AVFrame *frameRGB;
@@ -132,11 +144,26 @@ public:
 
     // Currently loaded file path
     std::wstring loadedFilename;
+    // What playback decodes: loadedFilename, or its proxy once one is
+    // ready. Exports always read loadedFilename.
+    std::wstring playbackFilename;
+
+    // Playback health since the file was loaded, and whether it is drawn
+    // over the video
+    PlaybackStats playbackStats;
+    std::atomic<bool> showStatsOverlay;
 
     std::unique_ptr<VideoDecoder> m_decoder;
     std::unique_ptr<AudioPlayer> m_audioPlayer;
     std::unique_ptr<VideoRenderer> m_renderer;
     std::unique_ptr<VideoCutter> m_cutter;
+    std::unique_ptr<SeekPrefetcher> m_prefetcher;
+    std::unique_ptr<ScrubDecoder> m_scrubber;
+    std::unique_ptr<ProxyJob> m_proxyJob;
+
+    // While a timeline drag shows frames from m_scrubber, where it is.
+    bool isScrubbing;
+    double scrubTime;
 
 private:
 
@@ -151,9 +178,21 @@ public:
     void Stop();
     bool IsPlaying() const { return isPlaying; }
     bool IsLoaded() const { return isLoaded; }
+    // Whether a low-resolution proxy stands in for the source; set when
+    // the proxy job finishes, with the position and track states kept.
+    bool IsUsingProxy() const { return isLoaded && playbackFilename != loadedFilename; }
 
     void SeekToFrame(int64_t frameNumber);
     void SeekToTime(double seconds);
+    // Timeline drags show frames from a second decoder, so the playback
+    // decoder keeps its place and buffers until the release, and seeks
+    // then only if the drag ended somewhere else. Ignored while playing.
+    void ScrubTo(double seconds);
+    void EndScrub(double seconds);
+    // Reads ahead the spot under the timeline pointer, which is likely to
+    // be clicked next, and decodes its frame. Ignored while playing.
+    void PrefetchAt(double seconds);
+    void CancelPrefetch();
 
     double GetDuration() const;
     double GetCurrentTime() const;
@@ -171,9 +210,18 @@ public:
     float GetAudioTrackVolume(int trackIndex) const;
     void SetAudioTrackVolume(int trackIndex, float volume);
     void SetMasterVolume(float volume);
-    bool CutVideo(const std::wstring& outputFilename, double startTime, double endTime,
-                  bool mergeAudio, bool convertH264, bool useNvenc,
-                  int maxBitrate, HWND progressBar, std::atomic<bool>* cancelFlag);
+
+    bool IsStatsOverlayVisible() const { return showStatsOverlay; }
+    void SetStatsOverlayVisible(bool visible);
+    bool SavePlaybackStats(const std::wstring& path) const { return playbackStats.SaveCsv(path); }
+
+    bool CutVideo(const std::wstring& outputFilename, const ExportOptions& options,
+                  ExportStats* stats, std::atomic<bool>* cancelFlag);
+    bool ExportBranches(const std::vector<ExportBranch>& branches, const ExportOptions& options,
+                        ExportStats* stats, std::atomic<bool>* cancelFlag);
+    const TargetSizeReport& GetTargetSizeReport() const;
+    // What the cutter needs of the loaded file, with the current mute state.
+    MediaInfo DescribeMedia() const;
 
     // Timer callback
     static void CALLBACK TimerProc(HWND hwnd, UINT msg, UINT_PTR timerId, DWORD time);
@@ -181,6 +229,10 @@ public:
 
 private:
     void CreateVideoWindow();
+    // Opens `path` for playback as the file loaded from `source`.
+    bool OpenPlayback(const std::wstring& source, const std::wstring& path);
+    void ClosePlayback();
+    void OnProxyReady();
     void PlaybackThreadFunction();
     static LRESULT CALLBACK VideoWindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 };
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "video_renderer.h"
 #include "video_player.h"
 #include "video_decoder.h"
+#include "platform.h"
+#include "trace.h"
+#include <algorithm>
 
 VideoRenderer::VideoRenderer(VideoPlayer* player) : m_player(player) {}
 
@@ -9,10 +12,39 @@ VideoRenderer::~VideoRenderer() {
 }
 
 bool VideoRenderer::Initialize() {
+    TRACE_SCOPE("D2D init", "startup");
     return SUCCEEDED(D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, &m_player->d2dFactory));
 }
 
+bool VideoRenderer::EnsureRenderTarget() {
+    if (m_player->d2dRenderTarget)
+        return true;
+    if (!m_player->d2dFactory && !Initialize())
+        return false;
+    return CreateRenderTarget();
+}
+
 void VideoRenderer::Cleanup() {
+    if (m_statsTextBrush)
+    {
+        m_statsTextBrush->Release();
+        m_statsTextBrush = nullptr;
+    }
+    if (m_statsPanelBrush)
+    {
+        m_statsPanelBrush->Release();
+        m_statsPanelBrush = nullptr;
+    }
+    if (m_statsFormat)
+    {
+        m_statsFormat->Release();
+        m_statsFormat = nullptr;
+    }
+    if (m_dwriteFactory)
+    {
+        m_dwriteFactory->Release();
+        m_dwriteFactory = nullptr;
+    }
     if (m_player->d2dBitmap)
     {
         m_player->d2dBitmap->Release();
@@ -31,26 +63,30 @@ void VideoRenderer::Cleanup() {
 }
 
 void VideoRenderer::UpdateDisplay() {
-    if (!m_player->d2dRenderTarget || !m_player->frameRGB->data[0])
+    if (!m_player->frameRGB->data[0] || !EnsureRenderTarget())
         return;
+    TRACE_SCOPE("UpdateDisplay", "playback");
 
     std::lock_guard<std::mutex> lock(m_player->decodeMutex);
 
-    if (!m_player->d2dBitmap)
     {
-        D2D1_BITMAP_PROPERTIES props = D2D1::BitmapProperties(
-            D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE));
-        m_player->d2dRenderTarget->CreateBitmap(
-            D2D1::SizeU(m_player->frameWidth, m_player->frameHeight),
-            m_player->frameRGB->data[0],
-            m_player->frameRGB->linesize[0],
-            props,
-            &m_player->d2dBitmap);
-    }
-    else
-    {
-        D2D1_RECT_U rect = {0, 0, (UINT32)m_player->frameWidth, (UINT32)m_player->frameHeight};
-        m_player->d2dBitmap->CopyFromMemory(&rect, m_player->frameRGB->data[0], m_player->frameRGB->linesize[0]);
+        TRACE_SCOPE("D2D bitmap upload", "playback");
+        if (!m_player->d2dBitmap)
+        {
+            D2D1_BITMAP_PROPERTIES props = D2D1::BitmapProperties(
+                D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE));
+            m_player->d2dRenderTarget->CreateBitmap(
+                D2D1::SizeU(m_player->frameWidth, m_player->frameHeight),
+                m_player->frameRGB->data[0],
+                m_player->frameRGB->linesize[0],
+                props,
+                &m_player->d2dBitmap);
+        }
+        else
+        {
+            D2D1_RECT_U rect = {0, 0, (UINT32)m_player->frameWidth, (UINT32)m_player->frameHeight};
+            m_player->d2dBitmap->CopyFromMemory(&rect, m_player->frameRGB->data[0], m_player->frameRGB->linesize[0]);
+        }
     }
 
     m_player->d2dRenderTarget->BeginDraw();
@@ -80,7 +116,41 @@ void VideoRenderer::UpdateDisplay() {
         D2D1::RectF(offsetX, offsetY, offsetX + drawWidth, offsetY + drawHeight),
         1.0f,
         D2D1_BITMAP_INTERPOLATION_MODE_LINEAR);
-    m_player->d2dRenderTarget->EndDraw();
+    if (m_player->showStatsOverlay)
+        DrawStatsOverlay();
+    {
+        TRACE_SCOPE("EndDraw", "playback");
+        m_player->d2dRenderTarget->EndDraw();
+    }
+    m_player->playbackStats.OnFramePresented();
+}
+
+void VideoRenderer::DrawStatsOverlay() {
+    ID2D1HwndRenderTarget* target = m_player->d2dRenderTarget;
+    // The overlay is optional; playback works without DirectWrite.
+    if (!m_dwriteFactory &&
+        SUCCEEDED(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory),
+                                      reinterpret_cast<IUnknown**>(&m_dwriteFactory))))
+    {
+        m_dwriteFactory->CreateTextFormat(L"Consolas", nullptr, DWRITE_FONT_WEIGHT_NORMAL,
+                                          DWRITE_FONT_STYLE_NORMAL, DWRITE_FONT_STRETCH_NORMAL,
+                                          12.0f, L"", &m_statsFormat);
+    }
+    if (!m_statsTextBrush)
+        target->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::White), &m_statsTextBrush);
+    if (!m_statsPanelBrush)
+        target->CreateSolidColorBrush(D2D1::ColorF(0.0f, 0.0f, 0.0f, 0.65f), &m_statsPanelBrush);
+    if (!m_statsFormat || !m_statsTextBrush || !m_statsPanelBrush)
+        return;
+
+    std::wstring text = FromUtf8(FormatPlaybackOverlay(m_player->playbackStats.Current()));
+    D2D1_SIZE_F size = target->GetSize();
+    // Six lines of 12 DIP Consolas.
+    D2D1_RECT_F panel = D2D1::RectF(8.0f, 8.0f, (std::min)(size.width - 8.0f, 620.0f), 8.0f + 6 * 15.0f + 12.0f);
+    target->FillRectangle(panel, m_statsPanelBrush);
+    target->DrawText(text.c_str(), (UINT32)text.size(), m_statsFormat,
+                     D2D1::RectF(panel.left + 6.0f, panel.top + 6.0f, panel.right - 6.0f, panel.bottom - 6.0f),
+                     m_statsTextBrush);
 }
 
 void VideoRenderer::SetPosition(int x, int y, int width, int height) {
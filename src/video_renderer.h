@@ -1,6 +1,8 @@
 #pragma once
 
 #include "video_player.h"
+#include <dwrite.h>
+#pragma comment(lib, "dwrite.lib")
 
 class VideoPlayer;
 
@@ -9,7 +11,11 @@ public:
     VideoRenderer(VideoPlayer* player);
     ~VideoRenderer();
 
+    // Creates the D2D factory. Nothing calls it at startup: the first frame
+    // shown goes through EnsureRenderTarget, which makes the factory and the
+    // render target then. UI thread only, the factory is single-threaded.
     bool Initialize();
+    bool EnsureRenderTarget();
     void Cleanup();
     void UpdateDisplay();
     void SetPosition(int x, int y, int width, int height);
@@ -20,4 +26,14 @@ public:
     bool CreateRenderTarget();
 
     VideoPlayer* m_player;
+
+private:
+    void DrawStatsOverlay();
+
+    // Created with the first overlay.
+    IDWriteFactory* m_dwriteFactory = nullptr;
+    IDWriteTextFormat* m_statsFormat = nullptr;
+    // Belong to the render target; created with the first overlay.
+    ID2D1SolidColorBrush* m_statsTextBrush = nullptr;
+    ID2D1SolidColorBrush* m_statsPanelBrush = nullptr;
 };
@@ -36,6 +36,7 @@ extern double g_cutEndTime;
 extern bool g_lastOperationWasExport;
 extern bool g_uploadSuccess;
 extern std::wstring g_uploadedUrl;
+extern std::wstring g_exportSummary;
 extern bool g_autoUpload;
 extern HBRUSH g_hbrBackground;
 extern HFONT g_hFont;
@@ -269,29 +270,27 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             EnableWindow(hwnd, TRUE);
             bool success = wParam != 0;
             std::wstring provider = g_useCatbox ? L"catbox.moe" : L"Backblaze B2";
+            std::wstring done = g_lastOperationWasExport ? L"Video successfully exported." : L"Video successfully cut and saved.";
+            if (!g_exportSummary.empty())
+                done += L"\n" + g_exportSummary;
             if (success && g_autoUpload && g_uploadSuccess) {
-                std::wstring m = g_lastOperationWasExport ? L"Video successfully exported." : L"Video successfully cut and saved.";
+                std::wstring m = done;
                 m += L"\nUploaded to " + provider + L":";
                 ShowUrlCopyDialog(hwnd, m, g_uploadedUrl);
             } else {
+                std::wstring m;
                 const wchar_t* msg;
                 const wchar_t* title;
                 UINT flags;
                 if (success) {
-                    if (g_autoUpload) {
-                        if (g_useCatbox || g_useB2) {
-                            std::wstring m = g_lastOperationWasExport ? L"Video successfully exported." : L"Video successfully cut and saved.";
-                            if (g_uploadSuccess)
-                                m += L"\nUploaded to " + provider + L":\n" + g_uploadedUrl;
-                            else
-                                m += L"\nFailed to upload to " + provider + L".";
-                            msg = m.c_str();
-                        } else {
-                            msg = g_lastOperationWasExport ? L"Video successfully exported." : L"Video successfully cut and saved.";
-                        }
-                    } else {
-                        msg = g_lastOperationWasExport ? L"Video successfully exported." : L"Video successfully cut and saved.";
+                    m = done;
+                    if (g_autoUpload && (g_useCatbox || g_useB2)) {
+                        if (g_uploadSuccess)
+                            m += L"\nUploaded to " + provider + L":\n" + g_uploadedUrl;
+                        else
+                            m += L"\nFailed to upload to " + provider + L".";
                     }
+                    msg = m.c_str();
                     title = L"Success";
                     flags = MB_OK | MB_ICONINFORMATION;
                 } else if (g_cancelExport) {
@@ -0,0 +1,357 @@
+#include "write_behind_io.h"
+#include "engine_settings.h"
+#include "debug_log.h"
+#include "platform.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const int64_t kBlockBytes = 4 * 1024 * 1024;
+static const int kAvioBufferBytes = 256 * 1024;
+
+// The few file calls the writer needs.
+#ifdef _WIN32
+
+struct NativeOutput {
+    HANDLE handle = INVALID_HANDLE_VALUE;
+};
+
+static bool CreateNative(const std::string& utf8Path, NativeOutput& f)
+{
+    f.handle = CreateFileW(FromUtf8(utf8Path).c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return f.handle != INVALID_HANDLE_VALUE;
+}
+
+// Reserves the space without moving the end of file; NTFS releases what is
+// left unused when the handle is closed.
+static void PreallocateNative(NativeOutput& f, int64_t size)
+{
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+    if (!SetFileInformationByHandle(f.handle, FileAllocationInfo, &info, sizeof(info)))
+        LOG_DEBUG("Preallocating " << size << " bytes failed: " << GetLastError());
+}
+
+static bool WriteNative(NativeOutput& f, int64_t offset, const uint8_t* buf, int64_t size)
+{
+    int64_t done = 0;
+    while (done < size) {
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)((offset + done) & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD)((offset + done) >> 32);
+        DWORD put = 0;
+        if (!WriteFile(f.handle, buf + done, (DWORD)(size - done), &put, &ov) || put == 0)
+            return false;
+        done += put;
+    }
+    return true;
+}
+
+static bool CloseNative(NativeOutput& f, int64_t size)
+{
+    (void)size;
+    bool ok = CloseHandle(f.handle) != 0;
+    f = NativeOutput();
+    return ok;
+}
+
+#else
+
+struct NativeOutput {
+    int fd = -1;
+};
+
+static bool CreateNative(const std::string& utf8Path, NativeOutput& f)
+{
+    f.fd = open(utf8Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return f.fd >= 0;
+}
+
+static void PreallocateNative(NativeOutput& f, int64_t size)
+{
+#ifdef __linux__
+    if (fallocate(f.fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0)
+        LOG_DEBUG("Preallocating " << size << " bytes failed: " << errno);
+#else
+    (void)f;
+    (void)size;
+#endif
+}
+
+static bool WriteNative(NativeOutput& f, int64_t offset, const uint8_t* buf, int64_t size)
+{
+    int64_t done = 0;
+    while (done < size) {
+        ssize_t put = pwrite(f.fd, buf + done, (size_t)(size - done), (off_t)(offset + done));
+        if (put <= 0)
+            return false;
+        done += put;
+    }
+    return true;
+}
+
+// The truncate frees the preallocated blocks past the end of the data.
+static bool CloseNative(NativeOutput& f, int64_t size)
+{
+    bool ok = ftruncate(f.fd, (off_t)size) == 0;
+    ok = close(f.fd) == 0 && ok;
+    f = NativeOutput();
+    return ok;
+}
+
+#endif
+
+// Start of the block after the one holding `offset`.
+static int64_t BlockEnd(int64_t offset)
+{
+    return (offset / kBlockBytes + 1) * kBlockBytes;
+}
+
+// One export file behind an AVIOContext. Write and SeekTo are called by the
+// muxing thread; Run writes the filled blocks in the order they were queued.
+class WriteBehindFile {
+public:
+    WriteBehindFile(const std::string& utf8Path, NativeOutput file, int queueMB)
+        : m_name(utf8Path), m_file(file)
+    {
+        m_maxQueued = std::max<size_t>(2, (size_t)((int64_t)queueMB * 1024 * 1024 / kBlockBytes));
+        m_thread = std::thread(&WriteBehindFile::Run, this);
+    }
+
+    ~WriteBehindFile()
+    {
+        if (m_thread.joinable())
+            Close();
+    }
+
+    int Write(const uint8_t* buf, int size)
+    {
+        if (m_failed)
+            return AVERROR(EIO);
+        int done = 0;
+        while (done < size) {
+            // A block holds one contiguous run: a write that does not extend
+            // or overwrite it, or that reaches the next block offset, starts
+            // a new one.
+            if (!m_current || m_pos < m_current->offset || m_pos > m_current->offset + m_current->size ||
+                m_pos == BlockEnd(m_current->offset)) {
+                Submit();
+                StartBlock(m_pos);
+            }
+            int64_t at = m_pos - m_current->offset;
+            int n = (int)std::min<int64_t>(size - done, BlockEnd(m_current->offset) - m_pos);
+            memcpy(m_current->data.data() + at, buf + done, n);
+            m_current->size = std::max(m_current->size, at + n);
+            m_pos += n;
+            done += n;
+        }
+        m_end = std::max(m_end, m_pos);
+        return size;
+    }
+
+    void SeekTo(int64_t pos)
+    {
+        m_pos = pos;
+        ++m_seeks;
+    }
+
+    // Writes what is left and closes the file. False if a write failed.
+    bool Close()
+    {
+        Submit();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+        bool ok = CloseNative(m_file, m_end) && !m_failed;
+        LOG_INFO("Write-behind of " << m_name << ": " << m_written / (1024 * 1024) << " MB in "
+                 << m_blocks << " blocks, " << m_seeks << " seeks, waited " << m_waitMs
+                 << " ms for the disk" << (ok ? "" : ", writing failed"));
+        return ok;
+    }
+
+    int64_t Position() const { return m_pos; }
+    int64_t Size() const { return m_end; }
+
+private:
+    struct Block {
+        std::vector<uint8_t> data;
+        int64_t offset = 0;
+        int64_t size = 0;
+    };
+
+    // Queues the current block, waiting while the queue is full.
+    void Submit()
+    {
+        if (!m_current)
+            return;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_current->size == 0) {
+            m_spare.push_back(std::move(m_current));
+            return;
+        }
+        if (m_queue.size() >= m_maxQueued) {
+            TRACE_SCOPE("Write-behind wait", "io");
+            auto start = std::chrono::steady_clock::now();
+            m_room.wait(lock, [this] { return m_queue.size() < m_maxQueued; });
+            m_waitMs += std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+        }
+        m_queue.push_back(std::move(m_current));
+        lock.unlock();
+        m_wake.notify_one();
+    }
+
+    void StartBlock(int64_t offset)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_spare.empty()) {
+                m_current = std::move(m_spare.back());
+                m_spare.pop_back();
+            }
+        }
+        if (!m_current) {
+            m_current = std::make_unique<Block>();
+            m_current->data.resize(kBlockBytes);
+        }
+        m_current->offset = offset;
+        m_current->size = 0;
+    }
+
+    void Run()
+    {
+        TraceSetThreadName("Write-behind");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                break;
+            std::unique_ptr<Block> block = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_room.notify_one();
+            lock.unlock();
+
+            bool ok = false;
+            if (!m_failed) {
+                TRACE_SCOPE("Write-behind block", "io");
+                ok = WriteNative(m_file, block->offset, block->data.data(), block->size);
+            }
+
+            lock.lock();
+            if (!ok)
+                m_failed = true;
+            m_written += block->size;
+            ++m_blocks;
+            m_spare.push_back(std::move(block));
+        }
+    }
+
+    std::string m_name;
+    NativeOutput m_file;
+    std::unique_ptr<Block> m_current;       // muxing thread only
+    int64_t m_pos = 0;
+    int64_t m_end = 0;                      // end of the furthest write
+    int64_t m_seeks = 0;
+    int64_t m_waitMs = 0;
+    std::atomic<bool> m_failed{false};
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;         // I/O thread: block queued
+    std::condition_variable m_room;         // muxing thread: queue has room
+    std::deque<std::unique_ptr<Block>> m_queue;
+    std::vector<std::unique_ptr<Block>> m_spare;
+    size_t m_maxQueued = 0;
+    bool m_stop = false;
+    int64_t m_written = 0, m_blocks = 0;
+    std::thread m_thread;                   // last, so it starts after the rest
+};
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int WritePacket(void* opaque, const uint8_t* buf, int size)
+#else
+static int WritePacket(void* opaque, uint8_t* buf, int size)
+#endif
+{
+    return static_cast<WriteBehindFile*>(opaque)->Write(buf, size);
+}
+
+static int64_t SeekPacket(void* opaque, int64_t offset, int whence)
+{
+    WriteBehindFile* file = static_cast<WriteBehindFile*>(opaque);
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE)
+        return file->Size();
+    int64_t target;
+    if (whence == SEEK_SET)
+        target = offset;
+    else if (whence == SEEK_CUR)
+        target = file->Position() + offset;
+    else if (whence == SEEK_END)
+        target = file->Size() + offset;
+    else
+        return AVERROR(EINVAL);
+    if (target < 0)
+        return AVERROR(EINVAL);
+    file->SeekTo(target);
+    return target;
+}
+
+AVIOContext* OpenWriteBehindIO(const std::string& utf8Path, int64_t expectedBytes)
+{
+    if (g_writeBehindMB <= 0)
+        return nullptr;
+    NativeOutput native;
+    if (!CreateNative(utf8Path, native))
+        return nullptr;
+    if (expectedBytes > kBlockBytes)
+        PreallocateNative(native, expectedBytes);
+
+    auto file = std::make_unique<WriteBehindFile>(utf8Path, native, g_writeBehindMB);
+    uint8_t* buffer = (uint8_t*)av_malloc(kAvioBufferBytes);
+    if (!buffer)
+        return nullptr;
+    AVIOContext* pb = avio_alloc_context(buffer, kAvioBufferBytes, 1, file.get(), nullptr, WritePacket, SeekPacket);
+    if (!pb) {
+        av_free(buffer);
+        return nullptr;
+    }
+    file.release();
+    return pb;
+}
+
+bool CloseWriteBehindIO(AVIOContext** pb)
+{
+    if (!*pb)
+        return true;
+    WriteBehindFile* file = static_cast<WriteBehindFile*>((*pb)->opaque);
+    avio_flush(*pb);
+    bool ok = (*pb)->error == 0;
+    ok = file->Close() && ok;
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+    delete file;
+    return ok;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <string>
+
+// Output file writes for the muxers that keep the disk off the export
+// thread. Muxed bytes are gathered into 4 MB blocks that start on 4 MB file
+// offsets, and an I/O thread writes each one while the next fills; once
+// g_writeBehindMB is queued the muxer waits for the disk. A seek back (the
+// MP4 mdat size, Matroska cues) closes the current block and starts a new
+// one at the target, so a patch is written after the data it overwrites.
+// The file is preallocated for `expectedBytes` (0 = unknown) and trimmed
+// to the bytes written when it is closed.
+// nullptr if the file cannot be created or g_writeBehindMB is 0; the caller
+// then opens it with avio_open.
+AVIOContext* OpenWriteBehindIO(const std::string& utf8Path, int64_t expectedBytes);
+// Writes the queued blocks, logs the totals and frees the context. False
+// if any write failed.
+bool CloseWriteBehindIO(AVIOContext** pb);
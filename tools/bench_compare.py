@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compares two bench_media result files, e.g. from two commits.
+
+    bench_media --out before.json --label "$(git rev-parse --short HEAD~1)"
+    bench_media --out after.json  --label "$(git rev-parse --short HEAD)"
+    tools/bench_compare.py before.json after.json [--threshold 10]
+
+Prints every metric per clip with its change. A change worse than
+--threshold percent is marked REGRESSION and makes the exit status 1.
+Timings move a few percent between runs, so compare runs on the same
+machine and repeat before reading much into small changes.
+"""
+
+import argparse
+import json
+import sys
+
+# (key, label, higher_is_better)
+METRICS = [
+    ("decode_fps", "decode fps", True),
+    ("seek_p50_ms", "seek p50 ms", False),
+    ("seek_p99_ms", "seek p99 ms", False),
+    ("mix_realtime", "mix x realtime", True),
+    ("copy_realtime", "copy x realtime", True),
+    ("encode_fps", "encode fps", True),
+]
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        data = json.load(f)
+    if data.get("bench") != "media":
+        sys.exit(f"{path}: not a bench_media result file")
+    return data, {c["name"]: c for c in data.get("clips", []) if c.get("ok")}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent change that counts as a regression (default 10)")
+    args = parser.parse_args()
+
+    before_run, before = load(args.before)
+    after_run, after = load(args.after)
+    if before_run.get("config") != after_run.get("config"):
+        print("warning: the runs used different clip settings", file=sys.stderr)
+    print(f"{before_run.get('label') or args.before} -> {after_run.get('label') or args.after}")
+
+    regressions = 0
+    for name in sorted(set(before) & set(after)):
+        print(f"\n{name}")
+        for key, label, higher_better in METRICS:
+            old, new = before[name].get(key, 0), after[name].get(key, 0)
+            if not old:
+                continue
+            change = (new - old) * 100.0 / old
+            worse = -change if higher_better else change
+            mark = ""
+            if worse > args.threshold:
+                mark = "  REGRESSION"
+                regressions += 1
+            elif -worse > args.threshold:
+                mark = "  improved"
+            print(f"  {label:16} {old:10.2f} {new:10.2f} {change:+7.1f}%{mark}")
+    for name in sorted(set(before) ^ set(after)):
+        print(f"\n{name}: only in {'before' if name in before else 'after'}")
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
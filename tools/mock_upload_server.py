@@ -0,0 +1,356 @@
+#!/usr/bin/env python3
+"""Local stand-in for the parts of Backblaze B2 and catbox.moe the uploader uses.
+
+Point the editor (or bench_upload) at it with
+
+    VIDEOEDITOR_B2_API_URL=http://127.0.0.1:8765
+    VIDEOEDITOR_CATBOX_URL=http://127.0.0.1:8765/user/api.php
+
+Uploaded data is hashed and counted but not kept, so multi-gigabyte files
+cost no disk space. SHA-1s are checked exactly like B2 does, including
+"hex_digits_at_end" and the partSha1Array of large files.
+
+Fault injection:
+    --latency-ms N      delay before every response
+    --throttle-kbps N   cap the receive rate of each connection
+    --fail-rate P       fail this fraction of uploads with --fail-status
+    --fail-every N      fail every Nth upload
+    --auth-ttl N        reject account tokens (401) after N API calls
+
+GET /stats returns counters as JSON; POST /stats/reset clears them.
+"""
+
+import argparse
+import hashlib
+import http.server
+import json
+import random
+import threading
+import time
+import uuid
+
+CHUNK = 256 * 1024
+SHA1_HEX = 40
+
+
+class Stats:
+    KEYS = ("connections", "requests", "uploads", "upload_bytes", "injected_failures",
+            "authorize_calls", "upload_url_calls", "expired_tokens", "files_finished",
+            "sha1_mismatches")
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.values = dict.fromkeys(self.KEYS, 0)
+
+    def reset(self):
+        with self.lock:
+            self.values = dict.fromkeys(self.KEYS, 0)
+
+    def add(self, key, n=1):
+        with self.lock:
+            self.values[key] += n
+
+    def snapshot(self):
+        with self.lock:
+            return dict(self.values)
+
+
+class State:
+    def __init__(self, args):
+        self.args = args
+        self.stats = Stats()
+        self.rng = random.Random(args.seed)
+        self.lock = threading.Lock()
+        self.upload_count = 0
+        self.tokens = {}            # account token -> API calls made with it
+        self.large = {}             # fileId -> {name, parts: {number: (sha1, size)}}
+
+    def should_fail(self):
+        with self.lock:
+            self.upload_count += 1
+            if self.args.fail_every and self.upload_count % self.args.fail_every == 0:
+                return True
+            return self.rng.random() < self.args.fail_rate
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "MockUpload/1.0"
+
+    def log_message(self, fmt, *a):
+        if self.server.state.args.verbose:
+            super().log_message(fmt, *a)
+
+    def setup(self):
+        super().setup()
+        self.server.state.stats.add("connections")
+
+    @property
+    def state(self):
+        return self.server.state
+
+    def base(self):
+        return "http://%s:%d" % self.server.server_address[:2]
+
+    # ---- request/response helpers ----
+
+    def reply(self, code, body, content_type="application/json"):
+        if self.state.args.latency_ms:
+            time.sleep(self.state.args.latency_ms / 1000.0)
+        data = body if isinstance(body, bytes) else json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def error(self, code, status):
+        self.reply(code, {"status": code, "code": status, "message": status})
+
+    def read_chunks(self):
+        """Yields the request body in chunks, throttled if requested."""
+        remaining = int(self.headers.get("Content-Length", "0"))
+        kbps = self.state.args.throttle_kbps
+        start = time.monotonic()
+        got = 0
+        while remaining > 0:
+            chunk = self.rfile.read(min(CHUNK, remaining))
+            if not chunk:
+                break
+            remaining -= len(chunk)
+            got += len(chunk)
+            if kbps:
+                ahead = got / (kbps * 1024.0) - (time.monotonic() - start)
+                if ahead > 0:
+                    time.sleep(ahead)
+            yield chunk
+
+    def read_json(self):
+        return json.loads(b"".join(self.read_chunks()) or b"{}")
+
+    def drain(self):
+        for _ in self.read_chunks():
+            pass
+
+    def check_token(self):
+        """Validates an account token; False after a 401 was sent."""
+        token = self.headers.get("Authorization", "")
+        ttl = self.state.args.auth_ttl
+        with self.state.lock:
+            if token not in self.state.tokens:
+                ok = False
+            else:
+                self.state.tokens[token] += 1
+                ok = not ttl or self.state.tokens[token] <= ttl
+        if not ok:
+            self.state.stats.add("expired_tokens")
+            self.drain()
+            self.error(401, "expired_auth_token")
+        return ok
+
+    def upload_failed(self):
+        """Injects a failure for an upload request, draining its body."""
+        if not self.state.should_fail():
+            return False
+        self.state.stats.add("injected_failures")
+        self.drain()
+        self.error(self.state.args.fail_status, "service_unavailable")
+        return True
+
+    def hash_body(self, trailer):
+        """Hashes the body; with `trailer` the last 40 bytes are the hex SHA-1."""
+        sha = hashlib.sha1()
+        size = 0
+        tail = b""
+        for chunk in self.read_chunks():
+            size += len(chunk)
+            if trailer:
+                buf = tail + chunk
+                sha.update(buf[:-SHA1_HEX])
+                tail = buf[-SHA1_HEX:]
+            else:
+                sha.update(chunk)
+        self.state.stats.add("upload_bytes", size)
+        return sha.hexdigest(), tail.decode("ascii", "replace"), size
+
+    # ---- routes ----
+
+    def do_GET(self):
+        self.state.stats.add("requests")
+        if self.path == "/stats":
+            return self.reply(200, self.state.stats.snapshot())
+        if self.path.endswith("/b2_authorize_account"):
+            if not self.headers.get("Authorization", "").startswith("Basic "):
+                return self.error(401, "bad_auth_token")
+            token = "acct_" + uuid.uuid4().hex
+            with self.state.lock:
+                self.state.tokens[token] = 0
+            self.state.stats.add("authorize_calls")
+            return self.reply(200, {
+                "accountId": "mock",
+                "authorizationToken": token,
+                "apiUrl": self.base(),
+                "downloadUrl": self.base(),
+                "recommendedPartSize": 100 * 1024 * 1024,
+                "absoluteMinimumPartSize": 5 * 1024 * 1024,
+            })
+        self.error(404, "not_found")
+
+    def do_POST(self):
+        self.state.stats.add("requests")
+        path = self.path
+        if path == "/stats/reset":
+            self.drain()
+            self.state.stats.reset()
+            return self.reply(200, {})
+        if path == "/user/api.php":
+            return self.catbox_upload()
+        if path.startswith("/upload/"):
+            return self.b2_upload_file(path[len("/upload/"):])
+        if path.startswith("/part/"):
+            return self.b2_upload_part(path[len("/part/"):])
+        call = path.rsplit("/", 1)[-1]
+        handler = {
+            "b2_get_upload_url": self.b2_get_upload_url,
+            "b2_start_large_file": self.b2_start_large_file,
+            "b2_get_upload_part_url": self.b2_get_upload_part_url,
+            "b2_finish_large_file": self.b2_finish_large_file,
+            "b2_cancel_large_file": self.b2_cancel_large_file,
+        }.get(call)
+        if not handler:
+            self.drain()
+            return self.error(404, "not_found")
+        if not self.check_token():
+            return
+        handler()
+
+    def b2_get_upload_url(self):
+        body = self.read_json()
+        self.state.stats.add("upload_url_calls")
+        self.reply(200, {
+            "bucketId": body.get("bucketId", ""),
+            "uploadUrl": self.base() + "/upload/" + uuid.uuid4().hex,
+            "authorizationToken": "upload_" + uuid.uuid4().hex,
+        })
+
+    def b2_upload_file(self, _):
+        if self.upload_failed():
+            return
+        expected = self.headers.get("X-Bz-Content-Sha1", "")
+        trailer = expected == "hex_digits_at_end"
+        digest, tail, size = self.hash_body(trailer)
+        if trailer:
+            expected = tail
+            size -= SHA1_HEX
+        if expected != "do_not_verify" and expected != digest:
+            self.state.stats.add("sha1_mismatches")
+            return self.error(400, "bad_request")
+        self.state.stats.add("uploads")
+        self.state.stats.add("files_finished")
+        self.reply(200, {
+            "fileId": uuid.uuid4().hex,
+            "fileName": self.headers.get("X-Bz-File-Name", ""),
+            "contentLength": size,
+            "contentSha1": digest,
+        })
+
+    def b2_start_large_file(self):
+        body = self.read_json()
+        file_id = "large_" + uuid.uuid4().hex
+        with self.state.lock:
+            self.state.large[file_id] = {"name": body.get("fileName", ""), "parts": {}}
+        self.reply(200, {"fileId": file_id, "fileName": body.get("fileName", "")})
+
+    def b2_get_upload_part_url(self):
+        body = self.read_json()
+        self.state.stats.add("upload_url_calls")
+        self.reply(200, {
+            "fileId": body.get("fileId", ""),
+            "uploadUrl": self.base() + "/part/" + body.get("fileId", ""),
+            "authorizationToken": "part_" + uuid.uuid4().hex,
+        })
+
+    def b2_upload_part(self, file_id):
+        if self.upload_failed():
+            return
+        with self.state.lock:
+            known = file_id in self.state.large
+        if not known:
+            self.drain()
+            return self.error(400, "bad_request")
+        number = int(self.headers.get("X-Bz-Part-Number", "0"))
+        expected = self.headers.get("X-Bz-Content-Sha1", "")
+        digest, _, size = self.hash_body(False)
+        if expected != digest:
+            self.state.stats.add("sha1_mismatches")
+            return self.error(400, "bad_request")
+        with self.state.lock:
+            self.state.large[file_id]["parts"][number] = (digest, size)
+        self.state.stats.add("uploads")
+        self.reply(200, {"fileId": file_id, "partNumber": number,
+                         "contentLength": size, "contentSha1": digest})
+
+    def b2_finish_large_file(self):
+        body = self.read_json()
+        with self.state.lock:
+            lf = self.state.large.pop(body.get("fileId", ""), None)
+        if not lf:
+            return self.error(400, "bad_request")
+        parts = lf["parts"]
+        numbers = sorted(parts)
+        hashes = [parts[n][0] for n in numbers]
+        small = [n for n in numbers[:-1] if parts[n][1] < 5 * 1024 * 1024]
+        if numbers != list(range(1, len(numbers) + 1)) or len(numbers) < 2 or small:
+            return self.error(400, "bad_request")
+        if hashes != body.get("partSha1Array"):
+            self.state.stats.add("sha1_mismatches")
+            return self.error(400, "bad_request")
+        self.state.stats.add("files_finished")
+        self.reply(200, {"fileId": body["fileId"], "fileName": lf["name"],
+                         "contentLength": sum(p[1] for p in parts.values())})
+
+    def b2_cancel_large_file(self):
+        body = self.read_json()
+        with self.state.lock:
+            self.state.large.pop(body.get("fileId", ""), None)
+        self.reply(200, {"fileId": body.get("fileId", "")})
+
+    def catbox_upload(self):
+        if self.upload_failed():
+            return
+        # The multipart body is hashed only to consume it; catbox does not
+        # verify uploads.
+        _, _, size = self.hash_body(False)
+        self.state.stats.add("uploads")
+        self.state.stats.add("files_finished")
+        name = uuid.uuid4().hex[:6] + ".mp4"
+        self.reply(200, ("%s/%s" % (self.base(), name)).encode(), "text/plain")
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    p.add_argument("--host", default="127.0.0.1")
+    p.add_argument("--port", type=int, default=8765)
+    p.add_argument("--latency-ms", type=int, default=0)
+    p.add_argument("--throttle-kbps", type=int, default=0)
+    p.add_argument("--fail-rate", type=float, default=0.0)
+    p.add_argument("--fail-every", type=int, default=0)
+    p.add_argument("--fail-status", type=int, default=503)
+    p.add_argument("--auth-ttl", type=int, default=0)
+    p.add_argument("--seed", type=int, default=1)
+    p.add_argument("--verbose", action="store_true")
+    args = p.parse_args()
+
+    server = http.server.ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    server.state = State(args)
+    print("mock upload server on http://%s:%d" % (args.host, args.port), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print(json.dumps(server.state.stats.snapshot()), flush=True)
+
+
+if __name__ == "__main__":
+    main()